@@ -0,0 +1,265 @@
+/* Benchmark runner for `make bench`.
+ *
+ * Runs each workload (every .jung file in bench/ unless files are given)
+ * several times and reports the medians of wall time, throughput and peak
+ * RSS. A workload prints "ops N" (units of work it did) and "secs X" (time
+ * of its measured section, from now()); throughput is N / X, or N / wall
+ * time without a secs line. Results are written as JSON and compared
+ * with a baseline file from an earlier run.
+ *
+ *   bench [-n runs] [-j jung] [-a jung-arg].. [-b baseline] [-o out]
+ *         [-c commit] [file.jung..] */
+
+/* wait4() is a BSD interface */
+#define _DEFAULT_SOURCE
+#define _DARWIN_C_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_RUNS 101
+#define MAX_ARGS 16
+
+typedef struct {
+    char name[64];
+    int ok;
+    double ops;
+    double wall_ms;       /* medians over the runs */
+    double secs;          /* < 0 without a secs line */
+    long rss_kb;
+    double ops_per_sec;
+} Result;
+
+typedef struct {
+    char name[64];
+    double wall_ms;
+    double ops_per_sec;
+} Baseline;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double median(double *v, int n) {
+    qsort(v, (size_t)n, sizeof(double), cmp_double);
+    return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+/* One run of jung on path: 0 and the measurements, or -1 if it failed */
+static int run_once(const char *jung, char **args, int nargs, const char *path,
+                    double *wall_ms, double *ops, double *secs, long *rss_kb) {
+    int fds[2];
+    if (pipe(fds) != 0) return -1;
+
+    char *argv[MAX_ARGS + 3];
+    int argc = 0;
+    argv[argc++] = (char *)jung;
+    for (int i = 0; i < nargs; i++) argv[argc++] = args[i];
+    argv[argc++] = (char *)path;
+    argv[argc] = NULL;
+
+    double start = now_ms();
+    pid_t pid = fork();
+    if (pid < 0) return -1;
+    if (pid == 0) {
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        execv(jung, argv);
+        fprintf(stderr, "bench: cannot run %s: %s\n", jung, strerror(errno));
+        _exit(127);
+    }
+    close(fds[1]);
+
+    /* Keep the last lines of output; the workload reports at the end */
+    char buf[8192];
+    size_t len = 0;
+    ssize_t n;
+    for (;;) {
+        n = read(fds[0], buf + len, sizeof(buf) - 1 - len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        len += (size_t)n;
+        if (len == sizeof(buf) - 1) {
+            memmove(buf, buf + len / 2, len - len / 2);
+            len -= len / 2;
+        }
+    }
+    buf[len] = '\0';
+    close(fds[0]);
+
+    int status;
+    struct rusage ru;
+    while (wait4(pid, &status, 0, &ru) < 0) {
+        if (errno != EINTR) return -1;
+    }
+    *wall_ms = now_ms() - start;
+#ifdef __APPLE__
+    *rss_kb = ru.ru_maxrss / 1024;    /* bytes there, kilobytes on Linux */
+#else
+    *rss_kb = ru.ru_maxrss;
+#endif
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) return -1;
+
+    *ops = -1;
+    *secs = -1;
+    for (char *line = strtok(buf, "\n"); line; line = strtok(NULL, "\n")) {
+        if (strncmp(line, "ops ", 4) == 0) *ops = atof(line + 4);
+        else if (strncmp(line, "secs ", 5) == 0) *secs = atof(line + 5);
+    }
+    return *ops < 0 ? -1 : 0;
+}
+
+static void bench_name(const char *path, char *out, size_t size) {
+    const char *base = strrchr(path, '/');
+    base = base ? base + 1 : path;
+    snprintf(out, size, "%s", base);
+    char *dot = strrchr(out, '.');
+    if (dot) *dot = '\0';
+}
+
+static int load_baseline(const char *path, Baseline *out, int max) {
+    FILE *f = fopen(path, "r");
+    if (!f) return 0;
+    char line[512];
+    int n = 0;
+    while (n < max && fgets(line, sizeof(line), f)) {
+        Baseline b;
+        if (sscanf(line, " \"%63[^\"]\": {\"wall_ms\": %lf, \"secs\": %*f, \"ops\": %*f, "
+                         "\"ops_per_sec\": %lf", b.name, &b.wall_ms, &b.ops_per_sec) == 3)
+            out[n++] = b;
+    }
+    fclose(f);
+    return n;
+}
+
+static int write_results(const char *path, const char *commit, int runs, char **args,
+                         int nargs, Result *res, int count) {
+    FILE *f = fopen(path, "w");
+    if (!f) return -1;
+    fprintf(f, "{\n  \"commit\": \"%s\",\n  \"runs\": %d,\n  \"jung_args\": \"", commit, runs);
+    for (int i = 0; i < nargs; i++) fprintf(f, "%s%s", i ? " " : "", args[i]);
+    fprintf(f, "\",\n  \"benchmarks\": {\n");
+    int first = 1;
+    for (int i = 0; i < count; i++) {
+        if (!res[i].ok) continue;
+        fprintf(f, "%s    \"%s\": {\"wall_ms\": %.3f, \"secs\": %.6f, \"ops\": %.0f, "
+                   "\"ops_per_sec\": %.1f, \"peak_rss_kb\": %ld}",
+                first ? "" : ",\n", res[i].name, res[i].wall_ms, res[i].secs,
+                res[i].ops, res[i].ops_per_sec, res[i].rss_kb);
+        first = 0;
+    }
+    fprintf(f, "\n  }\n}\n");
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: bench [-n runs] [-j jung] [-a jung-arg].. [-b baseline] "
+                    "[-o out] [-c commit] [file.jung..]\n");
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    int runs = 5;
+    const char *jung = "./jung";
+    const char *baseline_path = "bench/baseline.json";
+    const char *out_path = "bench/last.json";
+    const char *commit = "";
+    char *args[MAX_ARGS];
+    int nargs = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:j:a:b:o:c:")) != -1) {
+        switch (opt) {
+            case 'n': runs = atoi(optarg); break;
+            case 'j': jung = optarg; break;
+            case 'a': if (nargs < MAX_ARGS) args[nargs++] = optarg; break;
+            case 'b': baseline_path = optarg; break;
+            case 'o': out_path = optarg; break;
+            case 'c': commit = optarg; break;
+            default: usage();
+        }
+    }
+    if (runs < 1 || runs > MAX_RUNS) usage();
+
+    glob_t g;
+    memset(&g, 0, sizeof(g));
+    char **files = argv + optind;
+    int nfiles = argc - optind;
+    if (nfiles == 0) {
+        if (glob("bench/*.jung", 0, NULL, &g) != 0) {
+            fprintf(stderr, "bench: no bench/*.jung workloads (run from the repository root)\n");
+            return 2;
+        }
+        files = g.gl_pathv;
+        nfiles = (int)g.gl_pathc;
+    }
+
+    Baseline base[128];
+    int nbase = load_baseline(baseline_path, base, 128);
+    Result *res = calloc((size_t)nfiles, sizeof(Result));
+    int failed = 0;
+
+    printf("%d runs each, medians%s%s\n\n", runs, nbase ? "; baseline " : "",
+           nbase ? baseline_path : "");
+    printf("%-12s %10s %14s %10s %10s\n", "benchmark", "wall ms", "ops/sec", "peak RSS", "vs base");
+    for (int i = 0; i < nfiles; i++) {
+        Result *r = &res[i];
+        bench_name(files[i], r->name, sizeof(r->name));
+        double walls[MAX_RUNS], secs[MAX_RUNS], rss[MAX_RUNS];
+        r->ok = 1;
+        for (int k = 0; k < runs && r->ok; k++) {
+            long kb = 0;
+            if (run_once(jung, args, nargs, files[i], &walls[k], &r->ops, &secs[k], &kb) != 0)
+                r->ok = 0;
+            rss[k] = (double)kb;
+        }
+        if (!r->ok) {
+            printf("%-12s %10s\n", r->name, "FAILED");
+            failed = 1;
+            continue;
+        }
+        r->wall_ms = median(walls, runs);
+        r->secs = median(secs, runs);
+        r->rss_kb = (long)median(rss, runs);
+        r->ops_per_sec = r->ops / (r->secs > 0 ? r->secs : r->wall_ms / 1e3);
+
+        char delta[32] = "";
+        for (int b = 0; b < nbase; b++) {
+            if (strcmp(base[b].name, r->name) == 0 && base[b].wall_ms > 0) {
+                snprintf(delta, sizeof(delta), "%+.1f%%",
+                         (r->wall_ms - base[b].wall_ms) / base[b].wall_ms * 100);
+                break;
+            }
+        }
+        printf("%-12s %10.1f %14.0f %7.1f MB %10s\n", r->name, r->wall_ms, r->ops_per_sec,
+               (double)r->rss_kb / 1024, delta);
+        fflush(stdout);
+    }
+
+    if (write_results(out_path, commit, runs, args, nargs, res, nfiles) != 0) {
+        fprintf(stderr, "bench: cannot write %s: %s\n", out_path, strerror(errno));
+        failed = 1;
+    } else {
+        printf("\nwrote %s\n", out_path);
+    }
+    free(res);
+    globfree(&g);
+    return failed;
+}
@@ -0,0 +1,72 @@
+#include "arena.h"
+#include "memstats.h"
+#include <stdlib.h>
+
+typedef struct Block {
+    struct Block *prev;
+    size_t size;                    /* bytes, with this header */
+    double data[];                  /* aligned for doubles and pointers */
+} Block;
+
+struct Arena {
+    Block *blocks;                  /* newest first */
+    char *next;                     /* unused rest of the newest block */
+    char *end;
+    size_t block_size;              /* size of the next block */
+    Value *kept;
+    int kept_count;
+    int kept_cap;
+};
+
+#define ALIGN(n) (((n) + sizeof(double) - 1) & ~(sizeof(double) - 1))
+
+Arena *arena_new(void) {
+    Arena *a = calloc(1, sizeof(Arena));
+    MEM_ALLOC(MEM_AST, sizeof(Arena));
+    a->block_size = ARENA_BLOCK;
+    return a;
+}
+
+static void grow(Arena *a, size_t need) {
+    size_t size = a->block_size;
+    if (size < sizeof(Block) + need) size = sizeof(Block) + need;
+    else if (a->block_size < ARENA_BLOCK_MAX) a->block_size *= 2;
+    Block *b = calloc(1, size);
+    MEM_ALLOC(MEM_AST, size);
+    b->prev = a->blocks;
+    b->size = size;
+    a->blocks = b;
+    a->next = (char *)b->data;
+    a->end = (char *)b + size;
+}
+
+void *arena_alloc(Arena *a, size_t size) {
+    size = ALIGN(size ? size : 1);
+    if ((size_t)(a->end - a->next) < size) grow(a, size);
+    void *p = a->next;
+    a->next += size;
+    return p;
+}
+
+void arena_keep(Arena *a, Value v) {
+    if (a->kept_count == a->kept_cap) {
+        a->kept_cap = a->kept_cap ? a->kept_cap * 2 : 16;
+        a->kept = realloc(a->kept, sizeof(Value) * (size_t)a->kept_cap);
+    }
+    a->kept[a->kept_count++] = v;
+}
+
+void arena_free(Arena *a) {
+    if (!a) return;
+    for (int i = 0; i < a->kept_count; i++) val_free(&a->kept[i]);
+    free(a->kept);
+    Block *b = a->blocks;
+    while (b) {
+        Block *prev = b->prev;
+        MEM_FREE(MEM_AST, b->size);
+        free(b);
+        b = prev;
+    }
+    MEM_FREE(MEM_AST, sizeof(Arena));
+    free(a);
+}
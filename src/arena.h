@@ -0,0 +1,35 @@
+#ifndef JUNG_ARENA_H
+#define JUNG_ARENA_H
+
+#include "value.h"
+#include <stddef.h>
+
+/* Bump allocation for syntax trees.
+ *
+ * Every node of a program, its child lists and its literal texts are
+ * carved out of the program's arena, so parsing does no per-node malloc
+ * and freeing the tree is one arena_free instead of a walk. Nothing in an
+ * arena is freed on its own: a subtree the optimizer drops stays until
+ * the whole arena goes. Values the tree holds a reference on (the strings
+ * of NODE_CONST) are handed to arena_keep and released along with it.
+ *
+ * Memory comes in blocks that start at ARENA_BLOCK bytes and double up to
+ * ARENA_BLOCK_MAX, so a REPL line costs one small block and a large
+ * program a handful of big ones. An arena is not thread-safe. */
+
+#define ARENA_BLOCK     4096
+#define ARENA_BLOCK_MAX (256 * 1024)
+
+typedef struct Arena Arena;
+
+Arena *arena_new(void);
+
+/* size bytes, zeroed and aligned for any node field */
+void  *arena_alloc(Arena *a, size_t size);
+
+/* Release v (a reference the caller owned) when the arena is freed */
+void   arena_keep(Arena *a, Value v);
+
+void   arena_free(Arena *a);
+
+#endif
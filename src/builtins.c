@@ -1,5 +1,11 @@
 #include "builtins.h"
 #include "interpreter.h"
+#include "kernels.h"
+#include "gc.h"
+#include "json.h"
+#include "memstats.h"
+#include "sort.h"
+#include "stream.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -20,63 +26,69 @@ static Value bi_str(Value *args, int argc) {
 /* len(x) - length of string or array */
 static Value bi_len(Value *args, int argc) {
     if (argc < 1) return val_number(0);
-    if (args[0].type == VAL_STRING) return val_number(args[0].as.string.len);
-    if (args[0].type == VAL_ARRAY) return val_number(args[0].as.array.count);
+    if (IS_STRING(args[0])) return val_number(AS_STRING(args[0])->len);
+    if (IS_ARRAY(args[0])) return val_number(AS_ARRAY(args[0])->count);
+    if (IS_RANGE(args[0])) return val_number(AS_RANGE(args[0])->count);
+    if (IS_F64ARRAY(args[0])) return val_number(AS_F64(args[0])->count);
     return val_number(0);
 }
 
 /* push(arr, item) */
 static Value bi_push(Value *args, int argc) {
-    if (argc < 2 || args[0].type != VAL_ARRAY) return val_null();
+    if (argc >= 2 && IS_F64ARRAY(args[0]) && IS_NUMBER(args[1])) {
+        val_f64_push(&args[0], AS_NUMBER(args[1]));
+        return val_null();
+    }
+    if (argc < 2 || !IS_ARRAY(args[0])) return val_null();
     val_array_push(&args[0], val_copy(args[1]));
     return val_null();
 }
 
 /* pop(arr) */
 static Value bi_pop(Value *args, int argc) {
-    if (argc < 1 || args[0].type != VAL_ARRAY) return val_null();
+    if (argc >= 1 && IS_F64ARRAY(args[0])) {
+        val_f64_detach(&args[0]);
+        F64Array *a = AS_F64(args[0]);
+        return a->count > 0 ? val_number(a->data[--a->count]) : val_null();
+    }
+    if (argc < 1 || !IS_ARRAY(args[0])) return val_null();
     return val_array_pop(&args[0]);
 }
 
-/* range(n) or range(start, end) */
+/* range(n), range(start, end) or range(start, end, step), built lazily */
 static Value bi_range(Value *args, int argc) {
-    if (argc < 1) return val_array(8);
-    int start = 0, end = 0;
+    int start = 0, end = 0, step = 1;
     if (argc == 1) {
-        end = (int)args[0].as.number;
-    } else {
-        start = (int)args[0].as.number;
-        end = (int)args[1].as.number;
-    }
-    Value arr = val_array(end - start > 0 ? end - start : 8);
-    for (int i = start; i < end; i++) {
-        val_array_push(&arr, val_number(i));
+        end = (int)AS_NUMBER(args[0]);
+    } else if (argc >= 2) {
+        start = (int)AS_NUMBER(args[0]);
+        end = (int)AS_NUMBER(args[1]);
+        if (argc >= 3) step = (int)AS_NUMBER(args[2]);
     }
-    return arr;
+    return val_range(start, end, step);
 }
-
 /* int(x) - convert to integer */
 static Value bi_int(Value *args, int argc) {
     if (argc < 1) return val_number(0);
-    if (args[0].type == VAL_NUMBER) return val_number(floor(args[0].as.number));
-    if (args[0].type == VAL_STRING) {
+    if (IS_NUMBER(args[0])) return val_number(floor(AS_NUMBER(args[0])));
+    if (IS_STRING(args[0])) {
         char *end;
-        double val = strtod(args[0].as.string.str, &end);
-        if (end == args[0].as.string.str) return val_number(0);
+        double val = strtod(AS_STRING(args[0])->chars, &end);
+        if (end == AS_STRING(args[0])->chars) return val_number(0);
         return val_number(val);
     }
-    if (args[0].type == VAL_BOOL) return val_number(args[0].as.boolean);
+    if (IS_BOOL(args[0])) return val_number(AS_BOOL(args[0]));
     return val_number(0);
 }
 
 /* float(x) - convert to float */
 static Value bi_float(Value *args, int argc) {
     if (argc < 1) return val_number(0);
-    if (args[0].type == VAL_NUMBER) return val_number(args[0].as.number);
-    if (args[0].type == VAL_STRING) {
+    if (IS_NUMBER(args[0])) return val_number(AS_NUMBER(args[0]));
+    if (IS_STRING(args[0])) {
         char *end;
-        double val = strtod(args[0].as.string.str, &end);
-        if (end == args[0].as.string.str) return val_number(0);
+        double val = strtod(AS_STRING(args[0])->chars, &end);
+        if (end == AS_STRING(args[0])->chars) return val_number(0);
         return val_number(val);
     }
     return val_number(0);
@@ -84,8 +96,8 @@ static Value bi_float(Value *args, int argc) {
 
 /* input(prompt) - read line from stdin */
 static Value bi_input(Value *args, int argc) {
-    if (argc > 0 && args[0].type == VAL_STRING) {
-        printf("%s", args[0].as.string.str);
+    if (argc > 0 && IS_STRING(args[0])) {
+        printf("%s", AS_STRING(args[0])->chars);
         fflush(stdout);
     }
     char buf[4096];
@@ -97,16 +109,16 @@ static Value bi_input(Value *args, int argc) {
 
 /* split(str, delim) */
 static Value bi_split(Value *args, int argc) {
-    if (argc < 2 || args[0].type != VAL_STRING || args[1].type != VAL_STRING)
+    if (argc < 2 || !IS_STRING(args[0]) || !IS_STRING(args[1]))
         return val_array(8);
-    const char *s = args[0].as.string.str;
-    const char *d = args[1].as.string.str;
+    const char *s = AS_STRING(args[0])->chars;
+    const char *d = AS_STRING(args[1])->chars;
     int dlen = (int)strlen(d);
     Value arr = val_array(8);
 
     if (dlen == 0) {
         /* split every character */
-        for (int i = 0; i < args[0].as.string.len; i++) {
+        for (int i = 0; i < AS_STRING(args[0])->len; i++) {
             val_array_push(&arr, val_string(s + i, 1));
         }
         return arr;
@@ -127,21 +139,21 @@ static Value bi_split(Value *args, int argc) {
 
 /* join(arr, sep) */
 static Value bi_join(Value *args, int argc) {
-    if (argc < 2 || args[0].type != VAL_ARRAY || args[1].type != VAL_STRING)
+    if (argc < 2 || !IS_ARRAY(args[0]) || !IS_STRING(args[1]))
         return val_string("", 0);
-    const char *sep = args[1].as.string.str;
+    const char *sep = AS_STRING(args[1])->chars;
     int seplen = (int)strlen(sep);
     int cap = 256, len = 0;
     char *buf = malloc((size_t)cap);
     buf[0] = '\0';
 
-    for (int i = 0; i < args[0].as.array.count; i++) {
+    for (int i = 0; i < AS_ARRAY(args[0])->count; i++) {
         if (i > 0) {
             while (len + seplen + 1 >= cap) { cap *= 2; buf = realloc(buf, (size_t)cap); }
             memcpy(buf + len, sep, (size_t)seplen);
             len += seplen;
         }
-        char *s = val_to_string(args[0].as.array.items[i]);
+        char *s = val_to_string(AS_ARRAY(args[0])->items[i]);
         int slen = (int)strlen(s);
         while (len + slen + 1 >= cap) { cap *= 2; buf = realloc(buf, (size_t)cap); }
         memcpy(buf + len, s, (size_t)slen);
@@ -154,56 +166,70 @@ static Value bi_join(Value *args, int argc) {
 
 /* keys(obj) */
 static Value bi_keys(Value *args, int argc) {
-    if (argc < 1 || args[0].type != VAL_OBJECT) return val_array(8);
-    return table_keys(args[0].as.object);
+    if (argc < 1 || !IS_OBJECT(args[0])) return val_array(8);
+    return table_keys(AS_OBJECT(args[0]));
 }
 
 /* values(obj) */
 static Value bi_values(Value *args, int argc) {
-    if (argc < 1 || args[0].type != VAL_OBJECT) return val_array(8);
-    return table_values(args[0].as.object);
+    if (argc < 1 || !IS_OBJECT(args[0])) return val_array(8);
+    return table_values(AS_OBJECT(args[0]));
 }
 
 /* has(obj, key) */
 static Value bi_has(Value *args, int argc) {
-    if (argc < 2 || args[0].type != VAL_OBJECT || args[1].type != VAL_STRING)
+    if (argc < 2 || !IS_OBJECT(args[0]) || !IS_STRING(args[1]))
         return val_bool(0);
-    return val_bool(table_has(args[0].as.object, args[1].as.string.str));
+    return val_bool(table_has(AS_OBJECT(args[0]), AS_STRING(args[1])->chars));
 }
 
 /* delete(obj, key) */
 static Value bi_delete(Value *args, int argc) {
-    if (argc < 2 || args[0].type != VAL_OBJECT || args[1].type != VAL_STRING)
+    if (argc < 2 || !IS_OBJECT(args[0]) || !IS_STRING(args[1]))
         return val_null();
-    table_delete(args[0].as.object, args[1].as.string.str);
+    table_delete(AS_OBJECT(args[0]), AS_STRING(args[1])->chars);
     return val_null();
 }
 
 /* slice(str_or_arr, start, end) */
 static Value bi_slice(Value *args, int argc) {
     if (argc < 2) return val_null();
-    if (args[0].type == VAL_STRING) {
-        int len = args[0].as.string.len;
-        int start = (int)args[1].as.number;
-        int end = (argc >= 3) ? (int)args[2].as.number : len;
+    if (IS_STRING(args[0])) {
+        int len = AS_STRING(args[0])->len;
+        int start = (int)AS_NUMBER(args[1]);
+        int end = (argc >= 3) ? (int)AS_NUMBER(args[2]) : len;
         if (start < 0) start += len;
         if (end < 0) end += len;
         if (start < 0) start = 0;
         if (end > len) end = len;
         if (start >= end) return val_string("", 0);
-        return val_string(args[0].as.string.str + start, end - start);
+        return val_string(AS_STRING(args[0])->chars + start, end - start);
     }
-    if (args[0].type == VAL_ARRAY) {
-        int len = args[0].as.array.count;
-        int start = (int)args[1].as.number;
-        int end = (argc >= 3) ? (int)args[2].as.number : len;
+    if (IS_ARRAY(args[0])) {
+        int len = AS_ARRAY(args[0])->count;
+        int start = (int)AS_NUMBER(args[1]);
+        int end = (argc >= 3) ? (int)AS_NUMBER(args[2]) : len;
         if (start < 0) start += len;
         if (end < 0) end += len;
         if (start < 0) start = 0;
         if (end > len) end = len;
         Value arr = val_array(end - start > 0 ? end - start : 8);
         for (int i = start; i < end; i++) {
-            val_array_push(&arr, val_copy(args[0].as.array.items[i]));
+            val_array_push(&arr, val_copy(AS_ARRAY(args[0])->items[i]));
+        }
+        return arr;
+    }
+    if (IS_F64ARRAY(args[0])) {
+        int len = AS_F64(args[0])->count;
+        int start = (int)AS_NUMBER(args[1]);
+        int end = (argc >= 3) ? (int)AS_NUMBER(args[2]) : len;
+        if (start < 0) start += len;
+        if (end < 0) end += len;
+        if (start < 0) start = 0;
+        if (end > len) end = len;
+        Value arr = val_f64array(end > start ? end - start : 0);
+        if (end > start) {
+            memcpy(AS_F64(arr)->data, AS_F64(args[0])->data + start, sizeof(double) * (size_t)(end - start));
         }
         return arr;
     }
@@ -232,43 +258,170 @@ static Value bi_reduce(Value *args, int argc) {
 /* ---- Math builtins ---- */
 
 static Value bi_abs(Value *args, int argc) {
-    if (argc < 1 || args[0].type != VAL_NUMBER) return val_number(0);
-    return val_number(fabs(args[0].as.number));
+    if (argc < 1 || !IS_NUMBER(args[0])) return val_number(0);
+    return val_number(fabs(AS_NUMBER(args[0])));
 }
 
 static Value bi_floor(Value *args, int argc) {
-    if (argc < 1 || args[0].type != VAL_NUMBER) return val_number(0);
-    return val_number(floor(args[0].as.number));
+    if (argc < 1 || !IS_NUMBER(args[0])) return val_number(0);
+    return val_number(floor(AS_NUMBER(args[0])));
 }
 
 static Value bi_ceil(Value *args, int argc) {
-    if (argc < 1 || args[0].type != VAL_NUMBER) return val_number(0);
-    return val_number(ceil(args[0].as.number));
+    if (argc < 1 || !IS_NUMBER(args[0])) return val_number(0);
+    return val_number(ceil(AS_NUMBER(args[0])));
 }
 
 static Value bi_round(Value *args, int argc) {
-    if (argc < 1 || args[0].type != VAL_NUMBER) return val_number(0);
-    return val_number(round(args[0].as.number));
+    if (argc < 1 || !IS_NUMBER(args[0])) return val_number(0);
+    return val_number(round(AS_NUMBER(args[0])));
+}
+
+/* ---- Float64Array ---- */
+
+/* Copy src's numbers into a new Float64Array. Returns 0, leaving out
+ * untouched, if src is not an array, range or Float64Array of numbers. */
+static int to_f64(Value src, Value *out) {
+    if (IS_F64ARRAY(src)) {
+        *out = val_copy(src);
+        return 1;
+    }
+    if (IS_RANGE(src)) {
+        RangeObj *r = AS_RANGE(src);
+        *out = val_f64array(r->count);
+        for (int i = 0; i < r->count; i++) AS_F64(*out)->data[i] = r->start + (double)i * r->step;
+        return 1;
+    }
+    if (!IS_ARRAY(src)) return 0;
+    ArrObj *a = AS_ARRAY(src);
+    for (int i = 0; i < a->count; i++) {
+        if (!IS_NUMBER(a->items[i])) return 0;
+    }
+    *out = val_f64array(a->count);
+    for (int i = 0; i < a->count; i++) AS_F64(*out)->data[i] = AS_NUMBER(a->items[i]);
+    return 1;
+}
+
+/* Float64Array(n) - n zeros; Float64Array(arr) - same as f64(arr) */
+static Value bi_Float64Array(Value *args, int argc) {
+    if (argc < 1) return val_f64array(0);
+    if (IS_NUMBER(args[0])) {
+        int n = (int)AS_NUMBER(args[0]);
+        return val_f64array(n > 0 ? n : 0);
+    }
+    Value out;
+    return to_f64(args[0], &out) ? out : val_null();
+}
+
+/* f64(arr) - Float64Array copy of a numeric array or range, else null */
+static Value bi_f64(Value *args, int argc) {
+    Value out;
+    return argc >= 1 && to_f64(args[0], &out) ? out : val_null();
 }
 
+/* sum(arr) - total of the numbers in an array, range or Float64Array */
+static Value bi_sum(Value *args, int argc) {
+    if (argc < 1) return val_number(0);
+    if (IS_F64ARRAY(args[0])) {
+        return val_number(kernel_sum(AS_F64(args[0])->data, AS_F64(args[0])->count));
+    }
+    if (IS_RANGE(args[0])) {
+        RangeObj *r = AS_RANGE(args[0]);
+        double n = r->count;
+        return val_number(n * r->start + (double)r->step * n * (n - 1) / 2);
+    }
+    double total = 0;
+    if (IS_ARRAY(args[0])) {
+        ArrObj *a = AS_ARRAY(args[0]);
+        for (int i = 0; i < a->count; i++) {
+            if (IS_NUMBER(a->items[i])) total += AS_NUMBER(a->items[i]);
+        }
+    }
+    return val_number(total);
+}
+
+/* dot(a, b) - inner product of two equal-length numeric arrays */
+static Value bi_dot(Value *args, int argc) {
+    Value a, b;
+    if (argc < 2 || !to_f64(args[0], &a)) return val_null();
+    if (!to_f64(args[1], &b)) {
+        val_free(&a);
+        return val_null();
+    }
+    Value result = val_null();
+    if (AS_F64(a)->count == AS_F64(b)->count) {
+        result = val_number(kernel_dot(AS_F64(a)->data, AS_F64(b)->data, AS_F64(a)->count));
+    }
+    val_free(&a);
+    val_free(&b);
+    return result;
+}
+
+/* vecScale(arr, k) - new Float64Array of arr[i] * k */
+static Value bi_scale(Value *args, int argc) {
+    Value a;
+    if (argc < 2 || !IS_NUMBER(args[1]) || !to_f64(args[0], &a)) return val_null();
+    Value out = val_f64array(AS_F64(a)->count);
+    kernel_scale(AS_F64(out)->data, AS_F64(a)->data, AS_NUMBER(args[1]), AS_F64(a)->count);
+    val_free(&a);
+    return out;
+}
+
+/* vecAdd(a, b) - new Float64Array of a[i] + b[i], or a[i] + b for a number */
+static Value bi_add(Value *args, int argc) {
+    Value a, b;
+    if (argc < 2 || !to_f64(args[0], &a)) return val_null();
+    int n = AS_F64(a)->count;
+    Value out = val_null();
+    if (IS_NUMBER(args[1])) {
+        out = val_f64array(n);
+        kernel_add_scalar(AS_F64(out)->data, AS_F64(a)->data, AS_NUMBER(args[1]), n);
+    } else if (to_f64(args[1], &b)) {
+        if (AS_F64(b)->count == n) {
+            out = val_f64array(n);
+            kernel_add(AS_F64(out)->data, AS_F64(a)->data, AS_F64(b)->data, n);
+        }
+        val_free(&b);
+    }
+    val_free(&a);
+    return out;
+}
+
+/* Smallest (want_max 0) or largest number of a numeric array; null if empty */
+static Value extreme(Value src, int want_max) {
+    Value a;
+    if (!to_f64(src, &a)) return val_null();
+    Value result = val_null();
+    if (AS_F64(a)->count > 0) {
+        result = val_number(want_max ? kernel_max(AS_F64(a)->data, AS_F64(a)->count)
+                                     : kernel_min(AS_F64(a)->data, AS_F64(a)->count));
+    }
+    val_free(&a);
+    return result;
+}
+
+/* min(a, b) or min(arr) */
 static Value bi_min(Value *args, int argc) {
-    if (argc < 2 || args[0].type != VAL_NUMBER || args[1].type != VAL_NUMBER) return val_number(0);
-    return val_number(args[0].as.number < args[1].as.number ? args[0].as.number : args[1].as.number);
+    if (argc == 1) return extreme(args[0], 0);
+    if (argc < 2 || !IS_NUMBER(args[0]) || !IS_NUMBER(args[1])) return val_number(0);
+    return val_number(AS_NUMBER(args[0]) < AS_NUMBER(args[1]) ? AS_NUMBER(args[0]) : AS_NUMBER(args[1]));
 }
 
+/* max(a, b) or max(arr) */
 static Value bi_max(Value *args, int argc) {
-    if (argc < 2 || args[0].type != VAL_NUMBER || args[1].type != VAL_NUMBER) return val_number(0);
-    return val_number(args[0].as.number > args[1].as.number ? args[0].as.number : args[1].as.number);
+    if (argc == 1) return extreme(args[0], 1);
+    if (argc < 2 || !IS_NUMBER(args[0]) || !IS_NUMBER(args[1])) return val_number(0);
+    return val_number(AS_NUMBER(args[0]) > AS_NUMBER(args[1]) ? AS_NUMBER(args[0]) : AS_NUMBER(args[1]));
 }
 
 static Value bi_pow(Value *args, int argc) {
-    if (argc < 2 || args[0].type != VAL_NUMBER || args[1].type != VAL_NUMBER) return val_number(0);
-    return val_number(pow(args[0].as.number, args[1].as.number));
+    if (argc < 2 || !IS_NUMBER(args[0]) || !IS_NUMBER(args[1])) return val_number(0);
+    return val_number(pow(AS_NUMBER(args[0]), AS_NUMBER(args[1])));
 }
 
 static Value bi_sqrt(Value *args, int argc) {
-    if (argc < 1 || args[0].type != VAL_NUMBER) return val_number(0);
-    return val_number(sqrt(args[0].as.number));
+    if (argc < 1 || !IS_NUMBER(args[0])) return val_number(0);
+    return val_number(sqrt(AS_NUMBER(args[0])));
 }
 
 /* type(x) - returns type name */
@@ -278,54 +431,72 @@ static Value bi_type(Value *args, int argc) {
     return val_string(tn, (int)strlen(tn));
 }
 
-/* ---- String methods (called as __method_NAME(self, ...)) ---- */
+/* ---- String methods (recv.NAME(...) with args[0] the receiver) ---- */
+
+/* The string receiver to rewrite: args[0] itself when the call holds its
+ * only reference (a temporary, such as the previous result in a chain like
+ * s.trim().lower()), taken over so no copy is made; else a fresh copy */
+static Value own_receiver(Value *args) {
+    StrObj *s = AS_STRING(args[0]);
+    if (s->refcount == 1) {
+        Value self = args[0];
+        args[0] = val_null();
+        return self;
+    }
+    return val_string(s->chars, s->len);
+}
 
 static Value bi_method_upper(Value *args, int argc) {
-    if (argc < 1 || args[0].type != VAL_STRING) return val_string("", 0);
-    int len = args[0].as.string.len;
-    char *s = malloc((size_t)len + 1);
-    for (int i = 0; i < len; i++) s[i] = (char)toupper((unsigned char)args[0].as.string.str[i]);
-    s[len] = '\0';
-    return val_string_take(s, len);
+    if (argc < 1 || !IS_STRING(args[0])) return val_string("", 0);
+    Value r = own_receiver(args);
+    StrObj *s = AS_STRING(r);
+    for (int i = 0; i < s->len; i++) s->chars[i] = (char)toupper((unsigned char)s->chars[i]);
+    return r;
 }
 
 static Value bi_method_lower(Value *args, int argc) {
-    if (argc < 1 || args[0].type != VAL_STRING) return val_string("", 0);
-    int len = args[0].as.string.len;
-    char *s = malloc((size_t)len + 1);
-    for (int i = 0; i < len; i++) s[i] = (char)tolower((unsigned char)args[0].as.string.str[i]);
-    s[len] = '\0';
-    return val_string_take(s, len);
+    if (argc < 1 || !IS_STRING(args[0])) return val_string("", 0);
+    Value r = own_receiver(args);
+    StrObj *s = AS_STRING(r);
+    for (int i = 0; i < s->len; i++) s->chars[i] = (char)tolower((unsigned char)s->chars[i]);
+    return r;
 }
 
 static Value bi_method_trim(Value *args, int argc) {
-    if (argc < 1 || args[0].type != VAL_STRING) return val_string("", 0);
-    const char *s = args[0].as.string.str;
-    int len = args[0].as.string.len;
+    if (argc < 1 || !IS_STRING(args[0])) return val_string("", 0);
+    const char *s = AS_STRING(args[0])->chars;
+    int len = AS_STRING(args[0])->len;
     int start = 0, end = len;
     while (start < end && isspace((unsigned char)s[start])) start++;
     while (end > start && isspace((unsigned char)s[end - 1])) end--;
-    return val_string(s + start, end - start);
+    if (start == 0 && end == len) return val_copy(args[0]);
+    if (AS_STRING(args[0])->refcount > 1) return val_string(s + start, end - start);
+    Value r = own_receiver(args);
+    StrObj *o = AS_STRING(r);
+    memmove(o->chars, o->chars + start, (size_t)(end - start));
+    o->len = end - start;
+    o->chars[o->len] = '\0';
+    return r;
 }
 
 static Value bi_method_contains(Value *args, int argc) {
-    if (argc < 2 || args[0].type != VAL_STRING || args[1].type != VAL_STRING)
+    if (argc < 2 || !IS_STRING(args[0]) || !IS_STRING(args[1]))
         return val_bool(0);
-    return val_bool(strstr(args[0].as.string.str, args[1].as.string.str) != NULL);
+    return val_bool(strstr(AS_STRING(args[0])->chars, AS_STRING(args[1])->chars) != NULL);
 }
 
 static Value bi_method_replace(Value *args, int argc) {
-    if (argc < 3 || args[0].type != VAL_STRING ||
-        args[1].type != VAL_STRING || args[2].type != VAL_STRING)
+    if (argc < 3 || !IS_STRING(args[0]) ||
+        !IS_STRING(args[1]) || !IS_STRING(args[2]))
         return (argc >= 1) ? val_copy(args[0]) : val_string("", 0);
 
-    const char *src = args[0].as.string.str;
-    const char *old = args[1].as.string.str;
-    const char *rep = args[2].as.string.str;
+    const char *src = AS_STRING(args[0])->chars;
+    const char *old = AS_STRING(args[1])->chars;
+    const char *rep = AS_STRING(args[2])->chars;
     int oldlen = (int)strlen(old);
     int replen = (int)strlen(rep);
 
-    if (oldlen == 0) return val_copy(args[0]);
+    if (oldlen == 0 || !strstr(src, old)) return val_copy(args[0]);
 
     int cap = 256, len = 0;
     char *buf = malloc((size_t)cap);
@@ -355,16 +526,16 @@ static Value bi_method_indexOf(Value *args, int argc) {
     if (argc < 2) return val_number(-1);
 
     /* String indexOf */
-    if (args[0].type == VAL_STRING && args[1].type == VAL_STRING) {
-        const char *found = strstr(args[0].as.string.str, args[1].as.string.str);
+    if (IS_STRING(args[0]) && IS_STRING(args[1])) {
+        const char *found = strstr(AS_STRING(args[0])->chars, AS_STRING(args[1])->chars);
         if (!found) return val_number(-1);
-        return val_number((double)(found - args[0].as.string.str));
+        return val_number((double)(found - AS_STRING(args[0])->chars));
     }
 
     /* Array indexOf */
-    if (args[0].type == VAL_ARRAY) {
-        for (int i = 0; i < args[0].as.array.count; i++) {
-            if (val_equal(args[0].as.array.items[i], args[1])) {
+    if (IS_ARRAY(args[0])) {
+        for (int i = 0; i < AS_ARRAY(args[0])->count; i++) {
+            if (val_equal(AS_ARRAY(args[0])->items[i], args[1])) {
                 return val_number(i);
             }
         }
@@ -377,21 +548,21 @@ static Value bi_method_indexOf(Value *args, int argc) {
 /* ---- Array methods ---- */
 
 static Value bi_method_includes(Value *args, int argc) {
-    if (argc < 2 || args[0].type != VAL_ARRAY) return val_bool(0);
-    for (int i = 0; i < args[0].as.array.count; i++) {
-        if (val_equal(args[0].as.array.items[i], args[1])) return val_bool(1);
+    if (argc < 2 || !IS_ARRAY(args[0])) return val_bool(0);
+    for (int i = 0; i < AS_ARRAY(args[0])->count; i++) {
+        if (val_equal(AS_ARRAY(args[0])->items[i], args[1])) return val_bool(1);
     }
     return val_bool(0);
 }
 
 static Value bi_method_flat(Value *args, int argc) {
-    if (argc < 1 || args[0].type != VAL_ARRAY) return val_array(8);
-    Value result = val_array(args[0].as.array.count * 2);
-    for (int i = 0; i < args[0].as.array.count; i++) {
-        Value item = args[0].as.array.items[i];
-        if (item.type == VAL_ARRAY) {
-            for (int j = 0; j < item.as.array.count; j++) {
-                val_array_push(&result, val_copy(item.as.array.items[j]));
+    if (argc < 1 || !IS_ARRAY(args[0])) return val_array(8);
+    Value result = val_array(AS_ARRAY(args[0])->count * 2);
+    for (int i = 0; i < AS_ARRAY(args[0])->count; i++) {
+        Value item = AS_ARRAY(args[0])->items[i];
+        if (IS_ARRAY(item)) {
+            for (int j = 0; j < AS_ARRAY(item)->count; j++) {
+                val_array_push(&result, val_copy(AS_ARRAY(item)->items[j]));
             }
         } else {
             val_array_push(&result, val_copy(item));
@@ -401,60 +572,58 @@ static Value bi_method_flat(Value *args, int argc) {
 }
 
 static Value bi_method_concat(Value *args, int argc) {
-    if (argc < 2 || args[0].type != VAL_ARRAY || args[1].type != VAL_ARRAY)
-        return (argc >= 1 && args[0].type == VAL_ARRAY) ? val_copy(args[0]) : val_array(8);
-    Value result = val_array(args[0].as.array.count + args[1].as.array.count);
-    for (int i = 0; i < args[0].as.array.count; i++) {
-        val_array_push(&result, val_copy(args[0].as.array.items[i]));
+    if (argc < 2 || !IS_ARRAY(args[0]) || !IS_ARRAY(args[1]))
+        return (argc >= 1 && IS_ARRAY(args[0])) ? val_copy(args[0]) : val_array(8);
+    Value result = val_array(AS_ARRAY(args[0])->count + AS_ARRAY(args[1])->count);
+    for (int i = 0; i < AS_ARRAY(args[0])->count; i++) {
+        val_array_push(&result, val_copy(AS_ARRAY(args[0])->items[i]));
     }
-    for (int i = 0; i < args[1].as.array.count; i++) {
-        val_array_push(&result, val_copy(args[1].as.array.items[i]));
+    for (int i = 0; i < AS_ARRAY(args[1])->count; i++) {
+        val_array_push(&result, val_copy(AS_ARRAY(args[1])->items[i]));
     }
     return result;
 }
 
 /* Array .push() / .pop() / .length() as methods */
 static Value bi_method_push(Value *args, int argc) {
-    if (argc < 2 || args[0].type != VAL_ARRAY) return val_null();
-    val_array_push(&args[0], val_copy(args[1]));
-    return val_null();
+    return bi_push(args, argc);
 }
 
 static Value bi_method_pop(Value *args, int argc) {
-    if (argc < 1 || args[0].type != VAL_ARRAY) return val_null();
-    return val_array_pop(&args[0]);
+    return bi_pop(args, argc);
 }
 
 static Value bi_method_length(Value *args, int argc) {
     if (argc < 1) return val_number(0);
-    if (args[0].type == VAL_STRING) return val_number(args[0].as.string.len);
-    if (args[0].type == VAL_ARRAY) return val_number(args[0].as.array.count);
+    if (IS_STRING(args[0])) return val_number(AS_STRING(args[0])->len);
+    if (IS_ARRAY(args[0])) return val_number(AS_ARRAY(args[0])->count);
+    if (IS_F64ARRAY(args[0])) return val_number(AS_F64(args[0])->count);
     return val_number(0);
 }
 
 /* ---- Object methods ---- */
 
 static Value bi_method_keys(Value *args, int argc) {
-    if (argc < 1 || args[0].type != VAL_OBJECT) return val_array(8);
-    return table_keys(args[0].as.object);
+    if (argc < 1 || !IS_OBJECT(args[0])) return val_array(8);
+    return table_keys(AS_OBJECT(args[0]));
 }
 
 static Value bi_method_values(Value *args, int argc) {
-    if (argc < 1 || args[0].type != VAL_OBJECT) return val_array(8);
-    return table_values(args[0].as.object);
+    if (argc < 1 || !IS_OBJECT(args[0])) return val_array(8);
+    return table_values(AS_OBJECT(args[0]));
 }
 
 static Value bi_method_has(Value *args, int argc) {
-    if (argc < 2 || args[0].type != VAL_OBJECT || args[1].type != VAL_STRING)
+    if (argc < 2 || !IS_OBJECT(args[0]) || !IS_STRING(args[1]))
         return val_bool(0);
-    return val_bool(table_has(args[0].as.object, args[1].as.string.str));
+    return val_bool(table_has(AS_OBJECT(args[0]), AS_STRING(args[1])->chars));
 }
 
 /* ---- File I/O builtins ---- */
 
 static Value bi_readFile(Value *args, int argc) {
-    if (argc < 1 || args[0].type != VAL_STRING) return val_null();
-    FILE *f = fopen(args[0].as.string.str, "r");
+    if (argc < 1 || !IS_STRING(args[0])) return val_null();
+    FILE *f = fopen(AS_STRING(args[0])->chars, "r");
     if (!f) return val_null();
     fseek(f, 0, SEEK_END);
     long size = ftell(f);
@@ -467,25 +636,79 @@ static Value bi_readFile(Value *args, int argc) {
 }
 
 static Value bi_writeFile(Value *args, int argc) {
-    if (argc < 2 || args[0].type != VAL_STRING || args[1].type != VAL_STRING)
+    if (argc < 2 || !IS_STRING(args[0]) || !IS_STRING(args[1]))
         return val_bool(0);
-    FILE *f = fopen(args[0].as.string.str, "w");
+    FILE *f = fopen(AS_STRING(args[0])->chars, "w");
     if (!f) return val_bool(0);
-    fwrite(args[1].as.string.str, 1, (size_t)args[1].as.string.len, f);
+    fwrite(AS_STRING(args[1])->chars, 1, (size_t)AS_STRING(args[1])->len, f);
     fclose(f);
     return val_bool(1);
 }
 
 static Value bi_appendFile(Value *args, int argc) {
-    if (argc < 2 || args[0].type != VAL_STRING || args[1].type != VAL_STRING)
+    if (argc < 2 || !IS_STRING(args[0]) || !IS_STRING(args[1]))
         return val_bool(0);
-    FILE *f = fopen(args[0].as.string.str, "a");
+    FILE *f = fopen(AS_STRING(args[0])->chars, "a");
     if (!f) return val_bool(0);
-    fwrite(args[1].as.string.str, 1, (size_t)args[1].as.string.len, f);
+    fwrite(AS_STRING(args[1])->chars, 1, (size_t)AS_STRING(args[1])->len, f);
     fclose(f);
     return val_bool(1);
 }
 
+/* ---- File handles (stream.h) ---- */
+
+/* open(path, mode = "r") -- handle, or null if the file cannot be opened */
+static Value bi_open(Value *args, int argc) {
+    if (argc < 1 || !IS_STRING(args[0])) return val_null();
+    const char *mode = "r";
+    if (argc > 1 && IS_STRING(args[1])) mode = AS_STRING(args[1])->chars;
+    return stream_open(AS_STRING(args[0])->chars, mode);
+}
+
+/* readLines(path) -- a read handle, for iterating in for-in */
+static Value bi_readLines(Value *args, int argc) {
+    if (argc < 1 || !IS_STRING(args[0])) return val_null();
+    return stream_open(AS_STRING(args[0])->chars, "r");
+}
+
+/* jsonLines(path) -- a read handle yielding one parsed value per line */
+static Value bi_jsonLines(Value *args, int argc) {
+    if (argc < 1 || !IS_STRING(args[0])) return val_null();
+    Value f = stream_open(AS_STRING(args[0])->chars, "r");
+    if (IS_FILE(f)) stream_json_lines(AS_FILE(f));
+    return f;
+}
+
+static Value bi_method_readLine(Value *args, int argc) {
+    Value line;
+    if (argc < 1 || !IS_FILE(args[0]) || !stream_next(AS_FILE(args[0]), &line))
+        return val_null();
+    return line;
+}
+
+/* f.write(x) -- x as str() would print it; false on error */
+static Value bi_method_write(Value *args, int argc) {
+    if (argc < 2 || !IS_FILE(args[0])) return val_bool(0);
+    if (IS_STRING(args[1])) {
+        return val_bool(stream_write(AS_FILE(args[0]), AS_STRING(args[1])->chars,
+                                     (size_t)AS_STRING(args[1])->len));
+    }
+    char *s = val_to_string(args[1]);
+    int ok = stream_write(AS_FILE(args[0]), s, strlen(s));
+    free(s);
+    return val_bool(ok);
+}
+
+static Value bi_method_flush(Value *args, int argc) {
+    if (argc < 1 || !IS_FILE(args[0])) return val_bool(0);
+    return val_bool(stream_flush(AS_FILE(args[0])));
+}
+
+static Value bi_method_close(Value *args, int argc) {
+    if (argc < 1 || !IS_FILE(args[0])) return val_bool(0);
+    return val_bool(stream_close(AS_FILE(args[0])));
+}
+
 /* ---- HTTP stubs ---- */
 
 static Value bi_httpGet(Value *args, int argc) {
@@ -502,19 +725,18 @@ static Value bi_httpPost(Value *args, int argc) {
 
 /* ---- JSON builtins ---- */
 
+/* jsonParse(text) -- the value, or null if text is not valid JSON */
 static Value bi_jsonParse(Value *args, int argc) {
-    if (argc < 1 || args[0].type != VAL_STRING) return val_null();
-    /* Simple JSON parse -- reuse the value_from_json approach */
-    /* For now, return the string as-is. A full JSON parser would go here. */
-    (void)args;
-    return val_null();
+    Value v;
+    if (argc < 1 || !IS_STRING(args[0]) ||
+        !json_parse(AS_STRING(args[0])->chars, (size_t)AS_STRING(args[0])->len, NULL, &v))
+        return val_null();
+    return v;
 }
 
 static Value bi_jsonStringify(Value *args, int argc) {
     if (argc < 1) return val_string("null", 4);
-    char *s = val_to_string(args[0]);
-    int len = (int)strlen(s);
-    return val_string_take(s, len);
+    return json_stringify(args[0]);
 }
 
 /* ---- time ---- */
@@ -529,13 +751,37 @@ static Value bi_clock(Value *args, int argc) {
     return val_number((double)clock() / CLOCKS_PER_SEC);
 }
 
+/* now() -- seconds on a monotonic clock, nanosecond resolution; only
+ * differences between calls mean anything */
+static Value bi_now(Value *args, int argc) {
+    (void)args; (void)argc;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return val_number((double)ts.tv_sec + (double)ts.tv_nsec / 1e9);
+}
+
+/* ---- memory ---- */
+
+/* gc() -- collect unreachable cycles now; the number of arrays and
+ * objects freed */
+static Value bi_gc(Value *args, int argc) {
+    (void)args; (void)argc;
+    return val_number(gc_collect());
+}
+
+/* memStats() -- allocation counters so far (jung --mem-stats), null when
+ * counting is off */
+static Value bi_memStats(Value *args, int argc) {
+    (void)args; (void)argc;
+    return mem_stats_value();
+}
+
 /* ---- exit ---- */
 
+/* exit(code) -- handled specially in interpreter, which unwinds to the host */
 static Value bi_exit(Value *args, int argc) {
-    int code = 0;
-    if (argc > 0 && args[0].type == VAL_NUMBER) code = (int)args[0].as.number;
-    exit(code);
-    return val_null(); /* unreachable */
+    (void)args; (void)argc;
+    return val_null();
 }
 
 /* ---- toString (alias for str) ---- */
@@ -546,57 +792,101 @@ static Value bi_toString(Value *args, int argc) {
 /* ---- number ---- */
 static Value bi_number(Value *args, int argc) {
     if (argc < 1) return val_number(0);
-    if (args[0].type == VAL_NUMBER) return args[0];
-    if (args[0].type == VAL_STRING) {
+    if (IS_NUMBER(args[0])) return args[0];
+    if (IS_STRING(args[0])) {
         char *end;
-        double val = strtod(args[0].as.string.str, &end);
-        if (end == args[0].as.string.str) return val_number(0);
+        double val = strtod(AS_STRING(args[0])->chars, &end);
+        if (end == AS_STRING(args[0])->chars) return val_number(0);
         return val_number(val);
     }
-    if (args[0].type == VAL_BOOL) return val_number(args[0].as.boolean);
+    if (IS_BOOL(args[0])) return val_number(AS_BOOL(args[0]));
     return val_number(0);
 }
 
 /* ---- Sort/Reverse ---- */
 
-static int value_compare(const void *a, const void *b) {
-    const Value *va = (const Value *)a;
-    const Value *vb = (const Value *)b;
-    if (va->type == VAL_NUMBER && vb->type == VAL_NUMBER) {
-        if (va->as.number < vb->as.number) return -1;
-        if (va->as.number > vb->as.number) return 1;
-        return 0;
+/* sort(arr) - sorted copy in the natural order of sort.h. Float64Arrays
+ * and all-number arrays go through the radix kernel directly. sort(arr,
+ * fn) with a key function or comparator is run by the interpreter. */
+static Value bi_sort(Value *args, int argc) {
+    if (argc >= 1 && IS_F64ARRAY(args[0])) {
+        Value result = val_copy(args[0]);
+        val_f64_detach(&result);
+        kernel_sort(AS_F64(result)->data, AS_F64(result)->count);
+        return result;
     }
-    if (va->type == VAL_STRING && vb->type == VAL_STRING) {
-        return strcmp(va->as.string.str, vb->as.string.str);
+    if (argc < 1 || !IS_ARRAY(args[0])) return val_array(8);
+    Value nums;
+    if (AS_ARRAY(args[0])->count > 1 && to_f64(args[0], &nums)) {
+        kernel_sort(AS_F64(nums)->data, AS_F64(nums)->count);
+        Value result = val_f64_to_array(AS_F64(nums));
+        val_free(&nums);
+        return result;
     }
-    return 0;
+    Value result = val_copy(args[0]);
+    val_array_detach(&result);
+    sort_values(AS_ARRAY(result)->items, AS_ARRAY(result)->count);
+    return result;
 }
 
-static Value bi_sort(Value *args, int argc) {
-    if (argc < 1 || args[0].type != VAL_ARRAY) return val_array(8);
-    Value result = val_copy(args[0]);
-    if (result.as.array.count > 1) {
-        qsort(result.as.array.items, (size_t)result.as.array.count, sizeof(Value), value_compare);
+/* arr.sortInPlace() - sorts the caller's array without a copy */
+static Value bi_method_sortInPlace(Value *args, int argc) {
+    if (argc < 1) return val_null();
+    if (IS_F64ARRAY(args[0])) {
+        kernel_sort(AS_F64(args[0])->data, AS_F64(args[0])->count);
+    } else if (IS_ARRAY(args[0])) {
+        sort_values(AS_ARRAY(args[0])->items, AS_ARRAY(args[0])->count);
     }
-    return result;
+    return val_null();
 }
 
 static Value bi_reverse(Value *args, int argc) {
-    if (argc < 1 || args[0].type != VAL_ARRAY) return val_array(8);
-    Value result = val_array(args[0].as.array.count);
-    for (int i = args[0].as.array.count - 1; i >= 0; i--) {
-        val_array_push(&result, val_copy(args[0].as.array.items[i]));
+    if (argc < 1 || !IS_ARRAY(args[0])) return val_array(8);
+    Value result = val_array(AS_ARRAY(args[0])->count);
+    for (int i = AS_ARRAY(args[0])->count - 1; i >= 0; i--) {
+        val_array_push(&result, val_copy(AS_ARRAY(args[0])->items[i]));
     }
     return result;
 }
 
-/* stringify = same as str but with JSON-like array/object output */
+/* stringify = jsonStringify */
 static Value bi_stringify(Value *args, int argc) {
     if (argc < 1) return val_string("", 0);
-    char *s = val_to_string(args[0]);
-    int len = (int)strlen(s);
-    return val_string_take(s, len);
+    return json_stringify(args[0]);
+}
+
+/* ---- Receiver-mutating builtins ---- */
+
+int builtins_mutates_receiver(BuiltinFn fn) {
+    return fn == bi_push || fn == bi_pop || fn == bi_delete ||
+           fn == bi_method_push || fn == bi_method_pop || fn == bi_method_sortInPlace;
+}
+
+int builtins_sorts_receiver(BuiltinFn fn) {
+    return fn == bi_method_sortInPlace;
+}
+
+int builtins_arg_kinds(BuiltinFn fn) {
+    if (fn == bi_len || fn == bi_type || fn == bi_str || fn == bi_toString ||
+        fn == bi_f64 || fn == bi_Float64Array || fn == bi_sum || fn == bi_dot ||
+        fn == bi_min || fn == bi_max || fn == bi_scale || fn == bi_add) {
+        return BUILTIN_TAKES_RANGE | BUILTIN_TAKES_F64;
+    }
+    if (fn == bi_sort || fn == bi_slice || fn == bi_push || fn == bi_pop ||
+        fn == bi_method_push || fn == bi_method_pop || fn == bi_method_length ||
+        fn == bi_method_sortInPlace) {
+        return BUILTIN_TAKES_F64;
+    }
+    return 0;
+}
+
+double (*builtins_math(BuiltinFn fn))(double) {
+    if (fn == bi_sqrt)  return sqrt;
+    if (fn == bi_abs)   return fabs;
+    if (fn == bi_floor) return floor;
+    if (fn == bi_ceil)  return ceil;
+    if (fn == bi_round) return round;
+    return NULL;
 }
 
 /* ---- Register everything ---- */
@@ -636,34 +926,55 @@ void builtins_register(Interpreter *it) {
     table_set(&it->builtins, "pow", val_builtin(bi_pow));
     table_set(&it->builtins, "sqrt", val_builtin(bi_sqrt));
 
+    /* Numeric arrays */
+    table_set(&it->builtins, "Float64Array", val_builtin(bi_Float64Array));
+    table_set(&it->builtins, "f64", val_builtin(bi_f64));
+    table_set(&it->builtins, "sum", val_builtin(bi_sum));
+    table_set(&it->builtins, "dot", val_builtin(bi_dot));
+    table_set(&it->builtins, "vecScale", val_builtin(bi_scale));
+    table_set(&it->builtins, "vecAdd", val_builtin(bi_add));
+
     /* Type */
     table_set(&it->builtins, "type", val_builtin(bi_type));
 
-    /* String methods */
-    table_set(&it->builtins, "__method_upper", val_builtin(bi_method_upper));
-    table_set(&it->builtins, "__method_lower", val_builtin(bi_method_lower));
-    table_set(&it->builtins, "__method_trim", val_builtin(bi_method_trim));
-    table_set(&it->builtins, "__method_contains", val_builtin(bi_method_contains));
-    table_set(&it->builtins, "__method_replace", val_builtin(bi_method_replace));
-    table_set(&it->builtins, "__method_indexOf", val_builtin(bi_method_indexOf));
-
-    /* Array methods */
-    table_set(&it->builtins, "__method_includes", val_builtin(bi_method_includes));
-    table_set(&it->builtins, "__method_flat", val_builtin(bi_method_flat));
-    table_set(&it->builtins, "__method_concat", val_builtin(bi_method_concat));
-    table_set(&it->builtins, "__method_push", val_builtin(bi_method_push));
-    table_set(&it->builtins, "__method_pop", val_builtin(bi_method_pop));
-    table_set(&it->builtins, "__method_length", val_builtin(bi_method_length));
-
-    /* Object methods */
-    table_set(&it->builtins, "__method_keys", val_builtin(bi_method_keys));
-    table_set(&it->builtins, "__method_values", val_builtin(bi_method_values));
-    table_set(&it->builtins, "__method_has", val_builtin(bi_method_has));
+    /* Methods, by receiver kind */
+    Table *m = &it->methods[METHODS_STRING];
+    table_set(m, "upper", val_builtin(bi_method_upper));
+    table_set(m, "lower", val_builtin(bi_method_lower));
+    table_set(m, "trim", val_builtin(bi_method_trim));
+    table_set(m, "contains", val_builtin(bi_method_contains));
+    table_set(m, "replace", val_builtin(bi_method_replace));
+    table_set(m, "indexOf", val_builtin(bi_method_indexOf));
+    table_set(m, "length", val_builtin(bi_method_length));
+
+    m = &it->methods[METHODS_ARRAY];
+    table_set(m, "includes", val_builtin(bi_method_includes));
+    table_set(m, "flat", val_builtin(bi_method_flat));
+    table_set(m, "concat", val_builtin(bi_method_concat));
+    table_set(m, "push", val_builtin(bi_method_push));
+    table_set(m, "pop", val_builtin(bi_method_pop));
+    table_set(m, "length", val_builtin(bi_method_length));
+    table_set(m, "sortInPlace", val_builtin(bi_method_sortInPlace));
+    table_set(m, "indexOf", val_builtin(bi_method_indexOf));
+
+    m = &it->methods[METHODS_OBJECT];
+    table_set(m, "keys", val_builtin(bi_method_keys));
+    table_set(m, "values", val_builtin(bi_method_values));
+    table_set(m, "has", val_builtin(bi_method_has));
+
+    m = &it->methods[METHODS_FILE];
+    table_set(m, "readLine", val_builtin(bi_method_readLine));
+    table_set(m, "write", val_builtin(bi_method_write));
+    table_set(m, "flush", val_builtin(bi_method_flush));
+    table_set(m, "close", val_builtin(bi_method_close));
 
     /* File I/O */
     table_set(&it->builtins, "readFile", val_builtin(bi_readFile));
     table_set(&it->builtins, "writeFile", val_builtin(bi_writeFile));
     table_set(&it->builtins, "appendFile", val_builtin(bi_appendFile));
+    table_set(&it->builtins, "open", val_builtin(bi_open));
+    table_set(&it->builtins, "readLines", val_builtin(bi_readLines));
+    table_set(&it->builtins, "jsonLines", val_builtin(bi_jsonLines));
 
     /* HTTP stubs */
     table_set(&it->builtins, "httpGet", val_builtin(bi_httpGet));
@@ -676,6 +987,11 @@ void builtins_register(Interpreter *it) {
     /* Time */
     table_set(&it->builtins, "time", val_builtin(bi_time));
     table_set(&it->builtins, "clock", val_builtin(bi_clock));
+    table_set(&it->builtins, "now", val_builtin(bi_now));
+
+    /* Memory */
+    table_set(&it->builtins, "gc", val_builtin(bi_gc));
+    table_set(&it->builtins, "memStats", val_builtin(bi_memStats));
 
     /* Sort/Reverse */
     table_set(&it->builtins, "sort", val_builtin(bi_sort));
@@ -3,8 +3,31 @@
 
 #include "value.h"
 
-/* Register all builtin functions into the interpreter */
+/* Register all builtin functions, and the builtin methods by receiver
+ * kind, into the interpreter.
+ *
+ * A builtin borrows its arguments: the caller frees them after the call.
+ * It may take one over by returning it and leaving null in its slot, as
+ * upper/lower/trim do with a receiver nothing else references. */
 struct Interpreter;
 void builtins_register(struct Interpreter *it);
 
+/* Builtins that mutate their first argument (push, pop, delete, ...).
+ * The interpreter passes these the caller's storage instead of a copy. */
+int  builtins_mutates_receiver(BuiltinFn fn);
+
+/* arr.sortInPlace(): the interpreter runs it itself when it is given a key
+ * function or comparator */
+int  builtins_sorts_receiver(BuiltinFn fn);
+
+/* Argument kinds a builtin handles itself. Every other builtin receives
+ * lazy ranges and Float64Arrays converted to plain arrays. */
+#define BUILTIN_TAKES_RANGE 1
+#define BUILTIN_TAKES_F64   2
+int  builtins_arg_kinds(BuiltinFn fn);
+
+/* The libm function a one-number math builtin (sqrt, abs, floor, ceil,
+ * round) applies to its argument, NULL for any other builtin */
+double (*builtins_math(BuiltinFn fn))(double);
+
 #endif
@@ -0,0 +1,575 @@
+#include "compiler.h"
+#include "interpreter.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ---- chunk ---- */
+
+static Chunk *chunk_new(void) {
+    Chunk *c = calloc(1, sizeof(Chunk));
+    return c;
+}
+
+void chunk_free(Chunk *c) {
+    if (!c) return;
+    for (int i = 0; i < c->const_count; i++) val_free(&c->consts[i]);
+    free(c->consts);
+    free(c->code);
+    free(c->lines);
+    free(c->names);
+    free(c->nodes);
+    free(c);
+}
+
+/* ---- compiler state ---- */
+
+typedef struct Loop {
+    int start;            /* continue target */
+    int scope_depth;      /* scopes open outside the loop */
+    int *breaks;          /* forward jumps to patch at loop exit */
+    int break_count;
+    int break_cap;
+    struct Loop *enclosing;
+} Loop;
+
+typedef struct {
+    Interpreter *it;
+    Chunk *chunk;
+    int depth;            /* operand stack depth at this point */
+    int scope_depth;      /* scopes pushed since chunk entry */
+    Loop *loop;
+    int line;
+    int function;         /* compiling a dream's body */
+} Compiler;
+
+static void compile_stmt(Compiler *c, ASTNode *node);
+static void compile_expr(Compiler *c, ASTNode *node);
+
+static void emit_byte(Compiler *c, uint8_t b) {
+    Chunk *ch = c->chunk;
+    if (ch->count >= ch->cap) {
+        ch->cap = ch->cap ? ch->cap * 2 : 64;
+        ch->code = realloc(ch->code, (size_t)ch->cap);
+        ch->lines = realloc(ch->lines, sizeof(int) * (size_t)ch->cap);
+    }
+    ch->code[ch->count] = b;
+    ch->lines[ch->count] = c->line;
+    ch->count++;
+}
+
+static void emit_u16(Compiler *c, int v) {
+    if (v < 0 || v > 0xFFFF) {
+        interp_error(c->it, c->line, "function too large to compile");
+    }
+    emit_byte(c, (uint8_t)(v & 0xFF));
+    emit_byte(c, (uint8_t)(v >> 8));
+}
+
+/* Emit an opcode and account for its net effect on the operand stack */
+static void emit_op(Compiler *c, OpCode op, int effect) {
+    emit_byte(c, (uint8_t)op);
+    c->depth += effect;
+    if (c->depth > c->chunk->max_stack) c->chunk->max_stack = c->depth;
+}
+
+static int add_const(Compiler *c, Value v) {
+    Chunk *ch = c->chunk;
+    if (ch->const_count >= ch->const_cap) {
+        ch->const_cap = ch->const_cap ? ch->const_cap * 2 : 16;
+        ch->consts = realloc(ch->consts, sizeof(Value) * (size_t)ch->const_cap);
+    }
+    ch->consts[ch->const_count] = v;
+    return ch->const_count++;
+}
+
+static int add_name(Compiler *c, const char *name) {
+    Chunk *ch = c->chunk;
+    for (int i = 0; i < ch->name_count; i++) {
+        if (ch->names[i] == name) return i;
+    }
+    if (ch->name_count >= ch->name_cap) {
+        ch->name_cap = ch->name_cap ? ch->name_cap * 2 : 16;
+        ch->names = realloc(ch->names, sizeof(char *) * (size_t)ch->name_cap);
+    }
+    ch->names[ch->name_count] = name;
+    return ch->name_count++;
+}
+
+static int add_node(Compiler *c, ASTNode *node) {
+    Chunk *ch = c->chunk;
+    if (ch->node_count >= ch->node_cap) {
+        ch->node_cap = ch->node_cap ? ch->node_cap * 2 : 8;
+        ch->nodes = realloc(ch->nodes, sizeof(ASTNode *) * (size_t)ch->node_cap);
+    }
+    ch->nodes[ch->node_count] = node;
+    return ch->node_count++;
+}
+
+/* Emit a forward jump and return the operand offset to patch */
+static int emit_jump(Compiler *c, OpCode op, int effect) {
+    emit_op(c, op, effect);
+    emit_byte(c, 0xFF);
+    emit_byte(c, 0xFF);
+    return c->chunk->count - 2;
+}
+
+static void patch_jump(Compiler *c, int at) {
+    int off = c->chunk->count - (at + 2);
+    if (off > 0xFFFF) interp_error(c->it, c->line, "function too large to compile");
+    c->chunk->code[at] = (uint8_t)(off & 0xFF);
+    c->chunk->code[at + 1] = (uint8_t)(off >> 8);
+}
+
+static void emit_loop(Compiler *c, int start) {
+    emit_op(c, OP_LOOP, 0);
+    emit_u16(c, c->chunk->count + 2 - start);
+}
+
+static void emit_local(Compiler *c, OpCode op, ASTNode *node, int effect) {
+    emit_op(c, op, effect);
+    emit_u16(c, node->depth);
+    emit_u16(c, node->slot);
+}
+
+static void emit_pop_scopes(Compiler *c, int n) {
+    if (n <= 0) return;
+    emit_op(c, OP_POP_SCOPES, 0);
+    emit_u16(c, n);
+}
+
+static void emit_node_op(Compiler *c, OpCode op, ASTNode *node, int effect) {
+    emit_op(c, op, effect);
+    emit_u16(c, add_node(c, node));
+}
+
+/* ---- statements ---- */
+
+static void compile_block(Compiler *c, ASTNode **stmts, int count) {
+    emit_op(c, OP_PUSH_SCOPE, 0);
+    c->scope_depth++;
+    for (int i = 0; i < count; i++) compile_stmt(c, stmts[i]);
+    c->scope_depth--;
+    emit_pop_scopes(c, 1);
+}
+
+static void loop_add_break(Loop *loop, int at) {
+    if (loop->break_count >= loop->break_cap) {
+        loop->break_cap = loop->break_cap ? loop->break_cap * 2 : 4;
+        loop->breaks = realloc(loop->breaks, sizeof(int) * (size_t)loop->break_cap);
+    }
+    loop->breaks[loop->break_count++] = at;
+}
+
+static void compile_break(Compiler *c) {
+    emit_pop_scopes(c, c->scope_depth - c->loop->scope_depth);
+    loop_add_break(c->loop, emit_jump(c, OP_JUMP, 0));
+}
+
+static void compile_continue(Compiler *c) {
+    emit_pop_scopes(c, c->scope_depth - c->loop->scope_depth);
+    emit_loop(c, c->loop->start);
+}
+
+static void end_loop(Compiler *c, Loop *loop) {
+    for (int i = 0; i < loop->break_count; i++) patch_jump(c, loop->breaks[i]);
+    free(loop->breaks);
+    c->loop = loop->enclosing;
+}
+
+/* Statements the VM hands to the tree walker. A try body may break or
+ * continue the loop around it, which the walker reports through flags. */
+static void compile_exec(Compiler *c, ASTNode *node) {
+    emit_node_op(c, OP_EXEC, node, 0);
+    if (node->type != NODE_TRY_CATCH || !c->loop) return;
+
+    emit_op(c, OP_TEST_FLAG, 1);
+    emit_u16(c, 0);
+    int skip = emit_jump(c, OP_JUMP_IF_FALSE, -1);
+    compile_break(c);
+    patch_jump(c, skip);
+
+    emit_op(c, OP_TEST_FLAG, 1);
+    emit_u16(c, 1);
+    skip = emit_jump(c, OP_JUMP_IF_FALSE, -1);
+    compile_continue(c);
+    patch_jump(c, skip);
+}
+
+/* A call compile_call would emit as a plain OP_CALL */
+static int is_tail_call(Compiler *c, ASTNode *node) {
+    BuiltinFn mut_fn;
+    return node && node->type == NODE_FUNC_CALL &&
+           !(node->as.func_call.arg_count > 0 &&
+             interp_is_mutator(c->it, node->as.func_call.name, &mut_fn));
+}
+
+static void compile_stmt(Compiler *c, ASTNode *node) {
+    if (!node) return;
+    c->line = node->line;
+
+    switch (node->type) {
+    case NODE_PRINT:
+        compile_expr(c, node->as.print_expr);
+        emit_op(c, OP_PRINT, -1);
+        break;
+
+    case NODE_ASSIGN:
+        compile_expr(c, node->as.assign.value);
+        if (node->slot >= 0) {
+            emit_local(c, OP_SET_LOCAL, node, -1);
+            break;
+        }
+        emit_op(c, OP_SET_VAR, -1);
+        emit_u16(c, add_name(c, node->as.assign.name));
+        break;
+
+    case NODE_COMPOUND_ASSIGN:
+        compile_expr(c, node->as.comp_assign.value);
+        if (node->slot >= 0) {
+            emit_local(c, OP_COMPOUND_LOCAL, node, -1);
+            emit_u16(c, (int)node->as.comp_assign.op);
+            break;
+        }
+        emit_op(c, OP_COMPOUND_VAR, -1);
+        emit_u16(c, add_name(c, node->as.comp_assign.name));
+        emit_u16(c, (int)node->as.comp_assign.op);
+        break;
+
+    case NODE_IF: {
+        compile_expr(c, node->as.if_stmt.condition);
+        int else_jump = emit_jump(c, OP_JUMP_IF_FALSE, -1);
+        compile_block(c, node->as.if_stmt.then_body, node->as.if_stmt.then_count);
+        if (node->as.if_stmt.else_body) {
+            int end_jump = emit_jump(c, OP_JUMP, 0);
+            patch_jump(c, else_jump);
+            compile_block(c, node->as.if_stmt.else_body, node->as.if_stmt.else_count);
+            patch_jump(c, end_jump);
+        } else {
+            patch_jump(c, else_jump);
+        }
+        break;
+    }
+
+    case NODE_WHILE: {
+        Loop loop = { c->chunk->count, c->scope_depth, NULL, 0, 0, c->loop };
+        compile_expr(c, node->as.while_loop.condition);
+        int exit_jump = emit_jump(c, OP_JUMP_IF_FALSE, -1);
+        c->loop = &loop;
+        compile_block(c, node->as.while_loop.body, node->as.while_loop.body_count);
+        emit_loop(c, loop.start);
+        patch_jump(c, exit_jump);
+        end_loop(c, &loop);
+        break;
+    }
+
+    case NODE_FOR: {
+        compile_expr(c, node->as.for_loop.iterable);
+        emit_op(c, OP_ITER_INIT, 1);
+        Loop loop = { c->chunk->count, c->scope_depth, NULL, 0, 0, c->loop };
+        /* ITER_NEXT opens the per-iteration scope holding the loop variable */
+        emit_op(c, OP_ITER_NEXT, 0);
+        emit_u16(c, add_name(c, node->as.for_loop.var));
+        int exit_jump = c->chunk->count;
+        emit_u16(c, 0xFFFF);
+        c->loop = &loop;
+        c->scope_depth++;
+        for (int i = 0; i < node->as.for_loop.body_count; i++) {
+            compile_stmt(c, node->as.for_loop.body[i]);
+        }
+        c->scope_depth--;
+        emit_pop_scopes(c, 1);
+        emit_loop(c, loop.start);
+        patch_jump(c, exit_jump);
+        end_loop(c, &loop);
+        emit_op(c, OP_POP, -1);
+        emit_op(c, OP_POP, -1);
+        break;
+    }
+
+    case NODE_FUNC_DEF:
+        emit_node_op(c, OP_DEF_FUNC, node, 0);
+        break;
+
+    case NODE_CLASS:
+        emit_node_op(c, OP_DEF_CLASS, node, 0);
+        break;
+
+    case NODE_RETURN:
+        if (c->function && is_tail_call(c, node->as.return_val)) {
+            ASTNode *call = node->as.return_val;
+            int argc = call->as.func_call.arg_count;
+            for (int i = 0; i < argc; i++) compile_expr(c, call->as.func_call.args[i]);
+            c->line = call->line;
+            emit_op(c, OP_TAIL_CALL, -argc);
+            emit_u16(c, add_node(c, call));
+            emit_u16(c, argc);
+            break;
+        }
+        if (node->as.return_val) compile_expr(c, node->as.return_val);
+        else emit_op(c, OP_NULL, 1);
+        emit_op(c, OP_RETURN, -1);
+        break;
+
+    case NODE_BREAK:
+    case NODE_CONTINUE:
+        if (c->loop) {
+            if (node->type == NODE_BREAK) compile_break(c);
+            else compile_continue(c);
+        } else {
+            /* Outside a loop these just end the enclosing body */
+            emit_op(c, OP_NULL, 1);
+            emit_op(c, OP_RETURN, -1);
+        }
+        break;
+
+    case NODE_TRY_CATCH:
+    case NODE_THROW:
+    case NODE_IMPORT:
+    case NODE_OBJ_ASSIGN:
+    case NODE_OBJ_COMPOUND_ASSIGN:
+        compile_exec(c, node);
+        break;
+
+    default:
+        /* Expression statement */
+        compile_expr(c, node);
+        emit_op(c, OP_POP, -1);
+        break;
+    }
+}
+
+/* ---- expressions ---- */
+
+static OpCode binary_op(TokenType op) {
+    switch (op) {
+        case TOKEN_PLUS:     return OP_ADD;
+        case TOKEN_MINUS:    return OP_SUB;
+        case TOKEN_MULTIPLY: return OP_MUL;
+        case TOKEN_DIVIDE:   return OP_DIV;
+        case TOKEN_MODULO:   return OP_MOD;
+        case TOKEN_EQ:       return OP_EQ;
+        case TOKEN_NEQ:      return OP_NEQ;
+        case TOKEN_LT:       return OP_LT;
+        case TOKEN_GT:       return OP_GT;
+        case TOKEN_LTE:      return OP_LTE;
+        case TOKEN_GTE:      return OP_GTE;
+        default:             return OP_COUNT;
+    }
+}
+
+static void compile_call(Compiler *c, ASTNode *node) {
+    const char *name = node->as.func_call.name;
+    int argc = node->as.func_call.arg_count;
+    int invoke = node->type == NODE_METHOD_CALL;
+    BuiltinFn mut_fn;
+
+    if (argc > 0 && (invoke ? interp_method_mutator(c->it, name, NULL) != NULL
+                            : interp_is_mutator(c->it, name, &mut_fn))) {
+        ASTNode *recv = node->as.func_call.args[0];
+        if (recv->type != NODE_VARIABLE) {
+            /* Mutating through obj.field or arr[i] needs the walker's lvalues */
+            emit_node_op(c, OP_EVAL, node, 1);
+            return;
+        }
+        /* Slot 0 is filled from the variable when the call runs */
+        emit_op(c, OP_NULL, 1);
+        for (int i = 1; i < argc; i++) compile_expr(c, node->as.func_call.args[i]);
+        c->line = node->line;
+        emit_op(c, invoke ? OP_INVOKE_MUT : OP_CALL_MUT, 1 - argc);
+        emit_u16(c, add_node(c, node));
+        emit_u16(c, argc);
+        emit_u16(c, add_name(c, recv->as.var_name));
+        return;
+    }
+
+    for (int i = 0; i < argc; i++) compile_expr(c, node->as.func_call.args[i]);
+    c->line = node->line;
+    emit_op(c, invoke ? OP_INVOKE : OP_CALL, 1 - argc);
+    emit_u16(c, add_node(c, node));
+    emit_u16(c, argc);
+}
+
+static void compile_expr(Compiler *c, ASTNode *node) {
+    if (!node) {
+        emit_op(c, OP_NULL, 1);
+        return;
+    }
+    c->line = node->line;
+
+    switch (node->type) {
+    case NODE_NUMBER:
+        emit_op(c, OP_CONST, 1);
+        emit_u16(c, add_const(c, val_number(node->as.number)));
+        break;
+
+    case NODE_STRING:
+        emit_op(c, OP_CONST, 1);
+        emit_u16(c, add_const(c, val_string(node->as.string.str, node->as.string.len)));
+        break;
+
+    case NODE_CONST:
+        emit_op(c, OP_CONST, 1);
+        emit_u16(c, add_const(c, val_copy(node->as.constant)));
+        break;
+
+    case NODE_BOOL:
+        emit_op(c, node->as.boolean ? OP_TRUE : OP_FALSE, 1);
+        break;
+
+    case NODE_NULL:
+        emit_op(c, OP_NULL, 1);
+        break;
+
+    case NODE_THIS:
+        emit_op(c, OP_THIS, 1);
+        break;
+
+    case NODE_VARIABLE:
+        if (node->slot >= 0) {
+            emit_local(c, OP_GET_LOCAL, node, 1);
+            break;
+        }
+        emit_op(c, OP_GET_VAR, 1);
+        emit_u16(c, add_name(c, node->as.var_name));
+        break;
+
+    case NODE_ARRAY:
+        for (int i = 0; i < node->as.array.count; i++) {
+            compile_expr(c, node->as.array.elements[i]);
+        }
+        emit_op(c, OP_ARRAY, 1 - node->as.array.count);
+        emit_u16(c, node->as.array.count);
+        break;
+
+    case NODE_OBJECT:
+        emit_op(c, OP_OBJECT, 1);
+        for (int i = 0; i < node->as.object.count; i++) {
+            compile_expr(c, node->as.object.values[i]);
+            emit_op(c, OP_OBJECT_SET, -1);
+            emit_u16(c, add_name(c, node->as.object.keys[i]));
+        }
+        break;
+
+    case NODE_BINARY: {
+        TokenType op = node->as.binary.op;
+        if (op == TOKEN_AND) {
+            /* Yields a bool, like the walker */
+            compile_expr(c, node->as.binary.left);
+            emit_op(c, OP_TRUTHY, 0);
+            int end = emit_jump(c, OP_JUMP_IF_FALSE_KEEP, -1);
+            compile_expr(c, node->as.binary.right);
+            emit_op(c, OP_TRUTHY, 0);
+            patch_jump(c, end);
+            break;
+        }
+        if (op == TOKEN_OR) {
+            /* Yields the deciding operand */
+            compile_expr(c, node->as.binary.left);
+            int end = emit_jump(c, OP_JUMP_IF_TRUE_KEEP, -1);
+            compile_expr(c, node->as.binary.right);
+            patch_jump(c, end);
+            break;
+        }
+        OpCode bop = binary_op(op);
+        if (bop == OP_COUNT) {
+            emit_node_op(c, OP_EVAL, node, 1);
+            break;
+        }
+        compile_expr(c, node->as.binary.left);
+        compile_expr(c, node->as.binary.right);
+        c->line = node->line;
+        emit_op(c, bop, -1);
+        break;
+    }
+
+    case NODE_UNARY:
+        if (node->as.unary.op != TOKEN_MINUS && node->as.unary.op != TOKEN_NOT) {
+            emit_node_op(c, OP_EVAL, node, 1);
+            break;
+        }
+        compile_expr(c, node->as.unary.operand);
+        c->line = node->line;
+        emit_op(c, node->as.unary.op == TOKEN_MINUS ? OP_NEG : OP_NOT, 0);
+        break;
+
+    case NODE_TERNARY: {
+        compile_expr(c, node->as.ternary.condition);
+        int else_jump = emit_jump(c, OP_JUMP_IF_FALSE, -1);
+        compile_expr(c, node->as.ternary.then_expr);
+        int end_jump = emit_jump(c, OP_JUMP, 0);
+        c->depth--;   /* only one arm's value is live at the join */
+        patch_jump(c, else_jump);
+        compile_expr(c, node->as.ternary.else_expr);
+        patch_jump(c, end_jump);
+        break;
+    }
+
+    case NODE_STRING_INTERP:
+        for (int i = 0; i < node->as.interp.count; i++) {
+            compile_expr(c, node->as.interp.parts[i]);
+        }
+        emit_op(c, OP_INTERP, 1 - node->as.interp.count);
+        emit_u16(c, node->as.interp.count);
+        break;
+
+    case NODE_ARRAY_INDEX:
+        compile_expr(c, node->as.array_index.array_expr);
+        compile_expr(c, node->as.array_index.index);
+        emit_op(c, OP_INDEX, -1);
+        break;
+
+    case NODE_OBJ_ACCESS:
+        if (node->as.obj_access.key && !node->as.obj_access.is_bracket) {
+            compile_expr(c, node->as.obj_access.obj);
+            emit_op(c, OP_GET_FIELD, 0);
+            emit_u16(c, add_node(c, node));
+        } else {
+            emit_node_op(c, OP_EVAL, node, 1);
+        }
+        break;
+
+    case NODE_FUNC_CALL:
+    case NODE_METHOD_CALL:
+        compile_call(c, node);
+        break;
+
+    case NODE_NEW:
+        for (int i = 0; i < node->as.new_inst.arg_count; i++) {
+            compile_expr(c, node->as.new_inst.args[i]);
+        }
+        c->line = node->line;
+        emit_op(c, OP_NEW, 1 - node->as.new_inst.arg_count);
+        emit_u16(c, add_name(c, node->as.new_inst.class_name));
+        emit_u16(c, node->as.new_inst.arg_count);
+        break;
+
+    default:
+        emit_node_op(c, OP_EVAL, node, 1);
+        break;
+    }
+}
+
+/* ---- entry points ---- */
+
+static Chunk *compile_body(Interpreter *it, ASTNode **stmts, int count, int line, int function) {
+    Compiler c;
+    memset(&c, 0, sizeof(c));
+    c.it = it;
+    c.chunk = chunk_new();
+    c.line = line;
+    c.function = function;
+    for (int i = 0; i < count; i++) compile_stmt(&c, stmts[i]);
+    emit_op(&c, OP_NULL, 1);
+    emit_op(&c, OP_RETURN, -1);
+    return c.chunk;
+}
+
+Chunk *compile_program(Interpreter *it, ASTNode *program) {
+    return compile_body(it, program->as.program.stmts, program->as.program.count, 1, 0);
+}
+
+Chunk *compile_function(Interpreter *it, FuncDef *fn) {
+    int line = fn->body_count > 0 && fn->body[0] ? fn->body[0]->line : 0;
+    return compile_body(it, fn->body, fn->body_count, line, 1);
+}
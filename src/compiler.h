@@ -0,0 +1,86 @@
+#ifndef JUNG_COMPILER_H
+#define JUNG_COMPILER_H
+
+#include "parser.h"
+#include "value.h"
+#include <stdint.h>
+
+struct Interpreter;
+
+/* Opcodes. Operands are 16-bit little-endian immediates following the
+ * opcode byte; the list order is the dispatch table order. */
+#define JUNG_OPCODES(X) \
+    X(OP_CONST)          /* k: push consts[k] */                          \
+    X(OP_NULL)                                                             \
+    X(OP_TRUE)                                                             \
+    X(OP_FALSE)                                                            \
+    X(OP_POP)                                                              \
+    X(OP_THIS)                                                             \
+    X(OP_GET_VAR)        /* name */                                       \
+    X(OP_SET_VAR)        /* name: pop, assign (define if new) */          \
+    X(OP_COMPOUND_VAR)   /* name, op: pop rhs, name op= rhs */            \
+    X(OP_GET_LOCAL)      /* depth, slot */                                \
+    X(OP_SET_LOCAL)      /* depth, slot: pop into the slot */             \
+    X(OP_COMPOUND_LOCAL) /* depth, slot, op */                            \
+    X(OP_ADD) X(OP_SUB) X(OP_MUL) X(OP_DIV) X(OP_MOD)                      \
+    X(OP_EQ) X(OP_NEQ) X(OP_LT) X(OP_GT) X(OP_LTE) X(OP_GTE)               \
+    X(OP_NEG)                                                              \
+    X(OP_NOT)                                                              \
+    X(OP_TRUTHY)         /* replace top with its truthiness as a bool */  \
+    X(OP_JUMP)           /* off: forward */                               \
+    X(OP_LOOP)           /* off: backward */                              \
+    X(OP_JUMP_IF_FALSE)  /* off: pop, jump if falsy */                    \
+    X(OP_JUMP_IF_TRUE_KEEP) /* off: jump keeping top if truthy, else pop */ \
+    X(OP_JUMP_IF_FALSE_KEEP) /* off: jump keeping top if falsy, else pop */ \
+    X(OP_ARRAY)          /* n: pop n items into a new array */            \
+    X(OP_OBJECT)         /* push empty object */                          \
+    X(OP_OBJECT_SET)     /* name: pop value into object below it */       \
+    X(OP_INTERP)         /* n: pop n parts, push their concatenation */   \
+    X(OP_INDEX)                                                            \
+    X(OP_GET_FIELD)      /* node: dot access, owns the shape cache */     \
+    X(OP_CALL)           /* node, argc: node owns the call-site cache */  \
+    X(OP_TAIL_CALL)      /* node, argc: manifest of a call, in a dream */ \
+    X(OP_CALL_MUT)       /* node, argc, var: receiver is variable var */  \
+    X(OP_INVOKE)         /* node, argc: recv.name(...), recv in slot 0 */ \
+    X(OP_INVOKE_MUT)     /* node, argc, var: as OP_CALL_MUT */            \
+    X(OP_NEW)            /* name, argc */                                 \
+    X(OP_PRINT)                                                            \
+    X(OP_PUSH_SCOPE)                                                       \
+    X(OP_POP_SCOPES)     /* n */                                          \
+    X(OP_ITER_INIT)      /* iterable -> [source, index] */                \
+    X(OP_ITER_NEXT)      /* name, off: bind next item or jump to off */   \
+    X(OP_DEF_FUNC)       /* node */                                       \
+    X(OP_DEF_CLASS)      /* node */                                       \
+    X(OP_EVAL)           /* node: push tree-walker value of node */       \
+    X(OP_EXEC)           /* node: run statement on the tree walker */     \
+    X(OP_TEST_FLAG)      /* 0|1: push and clear break|continue flag */    \
+    X(OP_RETURN)         /* pop return value, leave the chunk */
+
+#define JUNG_OPCODE_ENUM(op) op,
+typedef enum { JUNG_OPCODES(JUNG_OPCODE_ENUM) OP_COUNT } OpCode;
+#undef JUNG_OPCODE_ENUM
+
+/* A compiled function body or program. Names and nodes point into the
+ * AST, which must outlive the chunk. */
+typedef struct Chunk {
+    uint8_t *code;
+    int *lines;           /* source line per code byte */
+    int count;
+    int cap;
+    Value *consts;
+    int const_count;
+    int const_cap;
+    const char **names;      /* interned, borrowed from the AST */
+    int name_count;
+    int name_cap;
+    ASTNode **nodes;
+    int node_count;
+    int node_cap;
+    int max_stack;        /* operand slots the chunk needs at most */
+} Chunk;
+
+Chunk *compile_program(struct Interpreter *it, ASTNode *program);
+Chunk *compile_function(struct Interpreter *it, FuncDef *fn);
+void   chunk_free(Chunk *c);
+
+#endif
@@ -0,0 +1,344 @@
+#include "gc.h"
+#include "table.h"
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+enum { BLACK, GRAY, WHITE };
+
+#define GC_COLOR(w)  ((w) & 3u)
+#define POOL_CLASSES (GC_POOL_MAX / 8)
+
+typedef struct FreeBlock {
+    struct FreeBlock *next;
+} FreeBlock;
+
+/* Everything one thread allocates from and buffers into */
+typedef struct Heap {
+    FreeBlock *free[POOL_CLASSES];  /* class c holds blocks of 8 * (c + 1) bytes */
+    char *bump;                     /* unused rest of the newest chunk */
+    char *bump_end;
+    char *chunks;                   /* each chunk starts with the previous one */
+    Value *roots;                   /* candidate arrays and objects */
+    int root_count;
+    int root_cap;
+    int trigger;                    /* collect at this many candidates */
+    int collecting;
+    struct Heap *next;              /* in the retired list */
+} Heap;
+
+static __thread Heap *heap;
+
+/* Heaps of threads that have exited, handed to the next thread that starts */
+static Heap *retired;
+static pthread_mutex_t retired_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t heap_key;
+static pthread_once_t heap_once = PTHREAD_ONCE_INIT;
+static int threshold = -1;          /* until set: JUNG_GC_THRESHOLD or GC_THRESHOLD */
+
+static int trigger_for(int live) {
+    if (threshold == 0) return INT_MAX;
+    return live > threshold ? live : threshold;
+}
+
+/* A thread is exiting: collect what it buffered and retire its heap */
+static void heap_retire(void *arg) {
+    Heap *h = arg;
+    heap = h;
+    gc_collect();
+    heap = NULL;
+    pthread_mutex_lock(&retired_lock);
+    h->next = retired;
+    retired = h;
+    pthread_mutex_unlock(&retired_lock);
+}
+
+static void heap_setup(void) {
+    pthread_key_create(&heap_key, heap_retire);
+    if (threshold < 0) {
+        const char *env = getenv("JUNG_GC_THRESHOLD");
+        threshold = env && atoi(env) >= 0 ? atoi(env) : GC_THRESHOLD;
+    }
+}
+
+static Heap *heap_new(void) {
+    pthread_once(&heap_once, heap_setup);
+    pthread_mutex_lock(&retired_lock);
+    Heap *h = retired;
+    if (h) retired = h->next;
+    pthread_mutex_unlock(&retired_lock);
+    if (!h) h = calloc(1, sizeof(Heap));
+    h->next = NULL;
+    h->trigger = trigger_for(0);
+    heap = h;
+    pthread_setspecific(heap_key, h);
+    return h;
+}
+
+static inline Heap *heap_get(void) {
+    return heap ? heap : heap_new();
+}
+
+/* ---- pools ---- */
+
+void *gc_alloc(size_t size) {
+#ifdef JUNG_NO_POOL
+    return malloc(size);
+#else
+    if (size > GC_POOL_MAX) return malloc(size);
+    Heap *h = heap_get();
+    size_t c = (size + 7) / 8 - 1;
+    FreeBlock *b = h->free[c];
+    if (b) {
+        h->free[c] = b->next;
+        return b;
+    }
+    size_t bytes = (c + 1) * 8;
+    if ((size_t)(h->bump_end - h->bump) < bytes) {
+        char *chunk = malloc(GC_CHUNK);
+        *(char **)chunk = h->chunks;
+        h->chunks = chunk;
+        h->bump = chunk + sizeof(char *);
+        h->bump_end = chunk + GC_CHUNK;
+    }
+    void *p = h->bump;
+    h->bump += bytes;
+    return p;
+#endif
+}
+
+void gc_release(void *p, size_t size) {
+#ifdef JUNG_NO_POOL
+    (void)size;
+    free(p);
+#else
+    if (size > GC_POOL_MAX) {
+        free(p);
+        return;
+    }
+    Heap *h = heap_get();
+    size_t c = (size + 7) / 8 - 1;
+    FreeBlock *b = p;
+    b->next = h->free[c];
+    h->free[c] = b;
+#endif
+}
+
+/* ---- candidates ---- */
+
+static int is_container(Value v) {
+    return IS_ARRAY(v) || (IS_OBJECT(v) && AS_OBJECT(v));
+}
+
+static unsigned *gc_word(Value v) {
+    return IS_ARRAY(v) ? &AS_ARRAY(v)->gc : &AS_OBJECT(v)->gc;
+}
+
+static int *ref_count(Value v) {
+    return IS_ARRAY(v) ? &AS_ARRAY(v)->refcount : &AS_OBJECT(v)->refcount;
+}
+
+static void set_color(Value v, unsigned color) {
+    unsigned *w = gc_word(v);
+    *w = (*w & ~3u) | color;
+}
+
+void gc_possible_root(Value v) {
+    Heap *h = heap_get();
+    unsigned *w = gc_word(v);
+    if (GC_SLOT(*w)) return;
+    if (h->root_count == h->root_cap) {
+        h->root_cap = h->root_cap ? h->root_cap * 2 : 256;
+        h->roots = realloc(h->roots, sizeof(Value) * (size_t)h->root_cap);
+    }
+    h->roots[h->root_count++] = v;
+    *w = (unsigned)h->root_count << 2 | GC_COLOR(*w);
+}
+
+void gc_forget(Value v) {
+    Heap *h = heap;
+    unsigned *w = gc_word(v);
+    int slot = (int)GC_SLOT(*w) - 1;
+    if (h && slot < h->root_count && h->roots[slot].bits == v.bits) {
+        Value last = h->roots[--h->root_count];
+        if (slot < h->root_count) {
+            h->roots[slot] = last;
+            unsigned *lw = gc_word(last);
+            *lw = (unsigned)(slot + 1) << 2 | GC_COLOR(*lw);
+        }
+    }
+    *w = GC_COLOR(*w);
+}
+
+void gc_step(void) {
+    Heap *h = heap_get();
+    if (h->root_count >= h->trigger) gc_collect();
+}
+
+void gc_set_threshold(int roots) {
+    pthread_once(&heap_once, heap_setup);
+    threshold = roots > 0 ? roots : 0;
+    if (heap) heap->trigger = trigger_for(0);
+}
+
+/* ---- collection ---- */
+
+/* The graph is walked with explicit stacks, so a long list of objects
+ * cannot overflow the C stack */
+typedef struct {
+    Value *items;
+    int count;
+    int cap;
+} Stack;
+
+static void push(Stack *s, Value v) {
+    if (s->count == s->cap) {
+        s->cap = s->cap ? s->cap * 2 : 256;
+        s->items = realloc(s->items, sizeof(Value) * (size_t)s->cap);
+    }
+    s->items[s->count++] = v;
+}
+
+typedef enum { MARK_GRAY, SCAN, SCAN_BLACK, COLLECT_WHITE } Phase;
+
+/* One edge to the container child, in the given phase */
+static void visit(Value child, Phase phase, Stack *s) {
+    unsigned color = GC_COLOR(*gc_word(child));
+    switch (phase) {
+        case MARK_GRAY:
+            (*ref_count(child))--;
+            if (color != GRAY) {
+                set_color(child, GRAY);
+                push(s, child);
+            }
+            break;
+        case SCAN:
+            push(s, child);
+            break;
+        case SCAN_BLACK:
+            (*ref_count(child))++;
+            if (color != BLACK) {
+                set_color(child, BLACK);
+                push(s, child);
+            }
+            break;
+        case COLLECT_WHITE:
+            if (color == WHITE) {
+                set_color(child, BLACK);
+                push(s, child);
+            }
+            break;
+    }
+}
+
+static void visit_children(Value v, Phase phase, Stack *s) {
+    if (IS_ARRAY(v)) {
+        ArrObj *a = AS_ARRAY(v);
+        for (int i = 0; i < a->count; i++) {
+            if (is_container(a->items[i])) visit(a->items[i], phase, s);
+        }
+    } else {
+        TABLE_FOR_EACH(AS_OBJECT(v), e) {
+            if (is_container(e->value)) visit(e->value, phase, s);
+        }
+    }
+}
+
+/* Take away the references root's subgraph holds on itself */
+static int mark_gray(Value root, Stack *s) {
+    if (GC_COLOR(*gc_word(root)) == GRAY) return 0;
+    int marked = 1;
+    set_color(root, GRAY);
+    push(s, root);
+    while (s->count > 0) {
+        Value v = s->items[--s->count];
+        int before = s->count;
+        visit_children(v, MARK_GRAY, s);
+        marked += s->count - before;
+    }
+    return marked;
+}
+
+/* v is referenced from outside: give it and everything it reaches their
+ * counts back */
+static void scan_black(Value v, Stack *s) {
+    set_color(v, BLACK);
+    push(s, v);
+    while (s->count > 0) visit_children(s->items[--s->count], SCAN_BLACK, s);
+}
+
+/* Gray containers left with a count are alive; the rest turn white */
+static void scan(Value root, Stack *s, Stack *black) {
+    push(s, root);
+    while (s->count > 0) {
+        Value v = s->items[--s->count];
+        if (GC_COLOR(*gc_word(v)) != GRAY) continue;
+        if (*ref_count(v) > 0) {
+            scan_black(v, black);
+        } else {
+            set_color(v, WHITE);
+            visit_children(v, SCAN, s);
+        }
+    }
+}
+
+static void collect_white(Value root, Stack *s, Stack *garbage) {
+    if (GC_COLOR(*gc_word(root)) != WHITE) return;
+    set_color(root, BLACK);
+    push(s, root);
+    while (s->count > 0) {
+        Value v = s->items[--s->count];
+        push(garbage, v);
+        visit_children(v, COLLECT_WHITE, s);
+    }
+}
+
+/* Free a container of a dead cycle. References to other containers are
+ * dropped without a decrement: they are either garbage too or alive with
+ * that reference already taken off their count. */
+static void free_garbage(Value v) {
+    if (IS_ARRAY(v)) {
+        ArrObj *a = AS_ARRAY(v);
+        for (int i = 0; i < a->count; i++) {
+            if (is_container(a->items[i])) a->items[i] = val_null();
+        }
+        a->refcount = 1;
+    } else {
+        Table *t = AS_OBJECT(v);
+        TABLE_FOR_EACH(t, e) {
+            if (is_container(e->value)) e->value = val_null();
+        }
+        t->refcount = 1;
+    }
+    val_free(&v);
+}
+
+int gc_collect(void) {
+    Heap *h = heap_get();
+    if (h->collecting) return 0;
+    h->collecting = 1;
+
+    /* Take the buffer; anything released from here on starts a new one */
+    Value *roots = h->roots;
+    int n = h->root_count;
+    h->roots = NULL;
+    h->root_count = 0;
+    h->root_cap = 0;
+    for (int i = 0; i < n; i++) *gc_word(roots[i]) = GC_COLOR(*gc_word(roots[i]));
+
+    Stack s = { NULL, 0, 0 }, black = { NULL, 0, 0 }, garbage = { NULL, 0, 0 };
+    int traced = 0;
+    for (int i = 0; i < n; i++) traced += mark_gray(roots[i], &s);
+    for (int i = 0; i < n; i++) scan(roots[i], &s, &black);
+    for (int i = 0; i < n; i++) collect_white(roots[i], &s, &garbage);
+    for (int i = 0; i < garbage.count; i++) free_garbage(garbage.items[i]);
+
+    int freed = garbage.count;
+    h->trigger = trigger_for(traced - freed);
+    free(roots);
+    free(s.items);
+    free(black.items);
+    free(garbage.items);
+    h->collecting = 0;
+    return freed;
+}
@@ -0,0 +1,66 @@
+#ifndef JUNG_GC_H
+#define JUNG_GC_H
+
+#include "value.h"
+
+/* Heap management: pooled allocation of value headers and a backup
+ * collector for reference cycles.
+ *
+ * Reference counting frees everything that is not part of a cycle, so the
+ * collector only has to look at containers (arrays and objects) whose
+ * count dropped without reaching zero: those are the only places a cycle
+ * can become garbage. They are buffered as possible roots, and once the
+ * buffer holds enough of them the collector runs trial deletion (Bacon and
+ * Rajan's synchronous algorithm): it subtracts the references the
+ * candidates' subgraph holds on itself, and whatever is left with no
+ * count is a cycle nothing else can reach. Those containers are freed;
+ * everything else gets its counts back.
+ *
+ * A collection starts when GC_THRESHOLD candidates are buffered, or, on a
+ * large heap, once as many are buffered as the last collection found
+ * alive, which keeps the cost of collecting proportional to the garbage
+ * made. JUNG_GC_THRESHOLD or --gc-threshold=N set the threshold; 0 leaves
+ * collecting to gc(). Collection never interrupts anything but the
+ * allocation of a container.
+ *
+ * Fixed-size headers (strings, arrays, objects, ranges, ...) come from
+ * per-thread free lists of GC_POOL_MAX bytes or less in 8-byte classes,
+ * carved out of GC_CHUNK-sized chunks. Pooled memory is kept for reuse,
+ * never returned to the system; a thread's pools and buffered candidates
+ * pass to the next thread when it exits, so worker threads leave nothing
+ * behind. Build with -DJUNG_NO_POOL to use malloc directly (for memory
+ * checkers).
+ *
+ * The candidate buffer is per thread: a container belongs to the thread
+ * that last dropped a reference to it until the next collection there.
+ * parallel.c's workers and separate Jung instances on separate threads
+ * never share containers, which is what this relies on. */
+
+#define GC_THRESHOLD 10000
+#define GC_POOL_MAX  64
+#define GC_CHUNK     65536
+
+/* Collector state in ArrObj.gc and Table.gc: a color in the low bits and
+ * the candidate's buffer slot + 1 above them (0 when not buffered) */
+#define GC_SLOT(w)   ((w) >> 2)
+
+void *gc_alloc(size_t size);
+void  gc_release(void *p, size_t size);
+
+/* v, an array or object, lost a reference and is still referenced */
+void  gc_possible_root(Value v);
+
+/* v, an array or object, is being freed: take it out of the buffer */
+void  gc_forget(Value v);
+
+/* Collect now if enough candidates are buffered; called before a
+ * container is allocated */
+void  gc_step(void);
+
+/* Run a collection: the number of containers freed */
+int   gc_collect(void);
+
+/* Candidates that start a collection; 0 turns automatic collection off */
+void  gc_set_threshold(int roots);
+
+#endif
@@ -0,0 +1,215 @@
+#include "intern.h"
+#include "memstats.h"
+#include <pthread.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct InternStr {
+    unsigned int hash;
+    int len;
+    int refs;             /* references from tables, shapes and intern_key */
+    int pinned;           /* from intern(): refs are not counted */
+    char chars[];
+} InternStr;
+
+#define HEADER(s) ((InternStr *)((s) - offsetof(InternStr, chars)))
+
+/* Open-addressing set of InternStr pointers, power-of-two sized. Shared by
+ * every interpreter in the process (and parallel workers), so guarded.
+ * refs and pinned change atomically: a holder retains and releases without
+ * the lock, but the count only leaves 1 for 0, and a string only gains a
+ * first reference or a pin, under the lock. */
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static InternStr **pool;
+static int pool_mask = -1;
+static int pool_count;
+
+const char *INTERN_CLASS;
+const char *INTERN_CONSTRUCTOR;
+const char *INTERN_INIT;
+const char *INTERN_LENGTH;
+const char *INTERN_MAP;
+const char *INTERN_FILTER;
+const char *INTERN_REDUCE;
+const char *INTERN_PMAP;
+const char *INTERN_PFILTER;
+const char *INTERN_PREDUCE;
+const char *INTERN_EXIT;
+const char *INTERN_SORT;
+
+unsigned int intern_hash_bytes(const char *s, int len) {
+    unsigned int h = 2166136261u;
+    for (int i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static InternStr **pool_find(const char *s, int len, unsigned int h) {
+    unsigned int i = h & (unsigned int)pool_mask;
+    while (pool[i]) {
+        InternStr *is = pool[i];
+        if (is->hash == h && is->len == len && memcmp(is->chars, s, (size_t)len) == 0) break;
+        i = (i + 1) & (unsigned int)pool_mask;
+    }
+    return &pool[i];
+}
+
+static void pool_grow(void) {
+    int old_size = pool_mask + 1;
+    InternStr **old = pool;
+    int size = old_size ? old_size * 2 : 1024;
+    MEM_RESIZE(MEM_INTERN, sizeof(InternStr *) * (size_t)old_size, sizeof(InternStr *) * (size_t)size);
+    pool = calloc((size_t)size, sizeof(InternStr *));
+    pool_mask = size - 1;
+    for (int i = 0; i < old_size; i++) {
+        if (!old[i]) continue;
+        unsigned int j = old[i]->hash & (unsigned int)pool_mask;
+        while (pool[j]) j = (j + 1) & (unsigned int)pool_mask;
+        pool[j] = old[i];
+    }
+    free(old);
+}
+
+/* Take is out of the table, shifting later entries of its probe run back
+ * so lookups never meet a gap */
+static void pool_remove(InternStr *is) {
+    unsigned int mask = (unsigned int)pool_mask;
+    unsigned int i = is->hash & mask;
+    while (pool[i] != is) i = (i + 1) & mask;
+    for (unsigned int j = (i + 1) & mask; pool[j]; j = (j + 1) & mask) {
+        unsigned int home = pool[j]->hash & mask;
+        /* pool[j] may fill the hole at i unless its home lies in (i, j] */
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            pool[i] = pool[j];
+            i = j;
+        }
+    }
+    pool[i] = NULL;
+    pool_count--;
+    MEM_FREE(MEM_INTERN, sizeof(InternStr) + (size_t)is->len + 1);
+}
+
+/* Caller holds pool_lock. A new string starts with refs references. */
+static InternStr *intern_locked(const char *s, int len, int refs) {
+    unsigned int h = intern_hash_bytes(s, len);
+    InternStr **slot = pool_find(s, len, h);
+    if (*slot) {
+        if (refs) __atomic_add_fetch(&(*slot)->refs, refs, __ATOMIC_RELAXED);
+        return *slot;
+    }
+
+    InternStr *is = malloc(sizeof(InternStr) + (size_t)len + 1);
+    MEM_ALLOC(MEM_INTERN, sizeof(InternStr) + (size_t)len + 1);
+    is->hash = h;
+    is->len = len;
+    is->refs = refs;
+    is->pinned = 0;
+    memcpy(is->chars, s, (size_t)len);
+    is->chars[len] = '\0';
+    *slot = is;
+    if (++pool_count * 2 > pool_mask + 1) pool_grow();
+    return is;
+}
+
+static const char *pin(InternStr *is) {
+    __atomic_store_n(&is->pinned, 1, __ATOMIC_RELEASE);
+    return is->chars;
+}
+
+#define INTERN_LIT(s) pin(intern_locked(s, (int)sizeof(s) - 1, 0))
+
+/* Caller holds pool_lock */
+static void intern_init(void) {
+    pool_grow();
+    INTERN_CLASS = INTERN_LIT("__class__");
+    INTERN_CONSTRUCTOR = INTERN_LIT("constructor");
+    INTERN_INIT = INTERN_LIT("init");
+    INTERN_LENGTH = INTERN_LIT("length");
+    INTERN_MAP = INTERN_LIT("map");
+    INTERN_FILTER = INTERN_LIT("filter");
+    INTERN_REDUCE = INTERN_LIT("reduce");
+    INTERN_PMAP = INTERN_LIT("pmap");
+    INTERN_PFILTER = INTERN_LIT("pfilter");
+    INTERN_PREDUCE = INTERN_LIT("preduce");
+    INTERN_EXIT = INTERN_LIT("exit");
+    INTERN_SORT = INTERN_LIT("sort");
+}
+
+const char *intern(const char *s, int len) {
+    pthread_mutex_lock(&pool_lock);
+    if (!pool) intern_init();
+    const char *r = pin(intern_locked(s, len, 0));
+    pthread_mutex_unlock(&pool_lock);
+    return r;
+}
+
+const char *intern_cstr(const char *s) {
+    return intern(s, (int)strlen(s));
+}
+
+const char *intern_key(const char *s, int len) {
+    pthread_mutex_lock(&pool_lock);
+    if (!pool) intern_init();
+    const char *r = intern_locked(s, len, 1)->chars;
+    pthread_mutex_unlock(&pool_lock);
+    return r;
+}
+
+void intern_retain(const char *s) {
+    InternStr *is = HEADER(s);
+    if (!__atomic_load_n(&is->pinned, __ATOMIC_ACQUIRE))
+        __atomic_add_fetch(&is->refs, 1, __ATOMIC_RELAXED);
+}
+
+void intern_release(const char *s) {
+    InternStr *is = HEADER(s);
+    if (__atomic_load_n(&is->pinned, __ATOMIC_ACQUIRE)) return;
+    /* Above 1 nobody can be about to free it */
+    int refs = __atomic_load_n(&is->refs, __ATOMIC_RELAXED);
+    while (refs > 1) {
+        if (__atomic_compare_exchange_n(&is->refs, &refs, refs - 1, 0,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            return;
+    }
+    /* Possibly the last: decide under the lock, where new references come from */
+    pthread_mutex_lock(&pool_lock);
+    if (__atomic_sub_fetch(&is->refs, 1, __ATOMIC_RELAXED) == 0 && !is->pinned) {
+        pool_remove(is);
+        free(is);
+    }
+    pthread_mutex_unlock(&pool_lock);
+}
+
+const char *intern_lookup(const char *s, int len, unsigned int h) {
+    pthread_mutex_lock(&pool_lock);
+    if (!pool) intern_init();
+    InternStr **slot = pool_find(s, len, h);
+    const char *found = *slot ? (*slot)->chars : NULL;
+    pthread_mutex_unlock(&pool_lock);
+    return found;
+}
+
+unsigned int intern_hash(const char *s) {
+    return HEADER(s)->hash;
+}
+
+int intern_len(const char *s) {
+    return HEADER(s)->len;
+}
+
+void intern_free(void) {
+    pthread_mutex_lock(&pool_lock);
+    for (int i = 0; i <= pool_mask; i++) {
+        if (pool[i]) MEM_FREE(MEM_INTERN, sizeof(InternStr) + (size_t)pool[i]->len + 1);
+        free(pool[i]);
+    }
+    MEM_FREE(MEM_INTERN, sizeof(InternStr *) * (size_t)(pool_mask + 1));
+    free(pool);
+    pool = NULL;
+    pool_mask = -1;
+    pool_count = 0;
+    pthread_mutex_unlock(&pool_lock);
+}
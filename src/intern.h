@@ -0,0 +1,42 @@
+#ifndef JUNG_INTERN_H
+#define JUNG_INTERN_H
+
+/* Global string intern pool. Interning returns one canonical, immutable,
+ * NUL-terminated copy per distinct string, so interned strings compare
+ * equal exactly when their pointers do. Each carries its precomputed hash.
+ *
+ * intern() is for names in source code (identifiers, literals), which the
+ * AST points at without counting: those strings are pinned and live until
+ * intern_free() at exit. Keys computed at runtime (o[k] = v, JSON object
+ * keys) go through intern_key() instead and are reference counted: every
+ * table entry and shape holding one retains it, and the last release
+ * removes it from the pool. intern_retain/intern_release on a pinned string
+ * do nothing. */
+
+const char  *intern(const char *s, int len);
+const char  *intern_cstr(const char *s);
+const char  *intern_key(const char *s, int len);    /* with one reference */
+void         intern_retain(const char *s);
+void         intern_release(const char *s);
+/* s[0, len) with hash intern_hash_bytes(s, len), NULL if not in the pool */
+const char  *intern_lookup(const char *s, int len, unsigned int hash);
+unsigned int intern_hash(const char *s);            /* s must be interned */
+int          intern_len(const char *s);             /* s must be interned */
+unsigned int intern_hash_bytes(const char *s, int len);
+void         intern_free(void);
+
+/* Names the interpreter looks up itself, interned at startup */
+extern const char *INTERN_CLASS;        /* "__class__" */
+extern const char *INTERN_CONSTRUCTOR;  /* "constructor" */
+extern const char *INTERN_INIT;         /* "init" */
+extern const char *INTERN_LENGTH;       /* "length" */
+extern const char *INTERN_MAP;          /* "map" */
+extern const char *INTERN_FILTER;       /* "filter" */
+extern const char *INTERN_REDUCE;       /* "reduce" */
+extern const char *INTERN_PMAP;         /* "pmap" */
+extern const char *INTERN_PFILTER;      /* "pfilter" */
+extern const char *INTERN_PREDUCE;      /* "preduce" */
+extern const char *INTERN_EXIT;         /* "exit" */
+extern const char *INTERN_SORT;         /* "sort" */
+
+#endif
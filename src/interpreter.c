@@ -1,139 +1,1376 @@
+/* realpath() is an XSI interface */
+#define _XOPEN_SOURCE 700
+
 #include "interpreter.h"
+#include "intern.h"
 #include "builtins.h"
+#include "vm.h"
+#include "jit.h"
+#include "optimizer.h"
+#include "resolver.h"
+#include "parallel.h"
+#include "jungc.h"
+#include "stream.h"
+#include "profile.h"
+#include "memstats.h"
+#include "sort.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
 #include <stdarg.h>
+#include <sys/resource.h>
 
 /* ---- error ---- */
 
-static void throw_exception(Interpreter *it, const char *msg) {
-    free(it->exception_msg);
-    it->exception_msg = strdup(msg);
-    it->exception_active = 1;
-    if (it->try_depth > 0) {
-        longjmp(it->try_stack[it->try_depth - 1], 1);
+/* An error no try block catches: back to the host, or the end of the
+ * process when nobody is protecting this interpreter */
+static void uncaught(Interpreter *it, char *msg) {
+    free(it->error);
+    it->error = msg;
+    if (it->host) {
+        it->host_status = JUNG_ERROR;
+        longjmp(*it->host, 1);
     }
-    fprintf(stderr, "Uncaught exception: %s\n", msg);
+    fprintf(stderr, "%s\n", msg);
     exit(1);
 }
 
-static void runtime_error(Interpreter *it, int line, const char *fmt, ...) {
-    char buf[1024];
+static char *format_msg(const char *fmt, ...) {
     va_list ap;
     va_start(ap, fmt);
-    vsnprintf(buf, sizeof(buf), fmt, ap);
+    int n = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+    char *s = malloc((size_t)n + 1);
+    va_start(ap, fmt);
+    vsnprintf(s, (size_t)n + 1, fmt, ap);
     va_end(ap);
+    return s;
+}
+
+/* Raise v (consumed). Inside a try it is recorded for the innermost one
+ * and the caller returns normally; a second raise while one is already
+ * propagating (an operation on the null a failed call returned, say) is
+ * dropped so the first exception wins. */
+static void throw_value(Interpreter *it, Value v) {
+    if (it->try_depth > 0) {
+        if (it->throwing) {
+            val_free(&v);
+            return;
+        }
+        it->exception = v;
+        it->throwing = 1;
+        return;
+    }
+    char *s = val_to_string(v);
+    val_free(&v);
+    char *msg = format_msg("Uncaught exception: %s", s);
+    free(s);
+    uncaught(it, msg);
+}
+
+static void runtime_verror(Interpreter *it, int line, const char *fmt, va_list ap) {
+    char buf[1024];
+    vsnprintf(buf, sizeof(buf), fmt, ap);
 
     if (it->try_depth > 0) {
         /* Inside a try block -- throw as exception */
+        if (it->throwing) return;
         char msg[1200];
         if (line > 0) snprintf(msg, sizeof(msg), "[line %d] %s", line, buf);
         else snprintf(msg, sizeof(msg), "%s", buf);
-        throw_exception(it, msg);
+        throw_value(it, val_string(msg, (int)strlen(msg)));
+        return;
     }
 
-    fprintf(stderr, "jit runtime error");
-    if (line > 0) fprintf(stderr, " [line %d]", line);
-    fprintf(stderr, ": %s\n", buf);
-    exit(1);
+    if (line > 0) uncaught(it, format_msg("jit runtime error [line %d]: %s", line, buf));
+    uncaught(it, format_msg("jit runtime error: %s", buf));
+}
+
+static void runtime_error(Interpreter *it, int line, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    runtime_verror(it, line, fmt, ap);
+    va_end(ap);
+}
+
+void interp_error(Interpreter *it, int line, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    runtime_verror(it, line, fmt, ap);
+    va_end(ap);
+}
+
+char *interp_catch_message(Interpreter *it) {
+    char *s = val_to_string(it->exception);
+    val_free(&it->exception);
+    it->throwing = 0;
+    return s;
 }
 
 /* ---- scope management ---- */
 
+/* Scopes form a reusable stack: a scope's table is only allocated once a
+ * name is defined in it and is emptied rather than freed on pop, so entering
+ * and leaving a block is a counter bump in the common case. */
 static void push_scope(Interpreter *it) {
-    if (it->scope_depth >= MAX_SCOPES - 1) {
-        runtime_error(it, 0, "scope overflow");
+    if (it->scope_depth + 1 >= it->scope_cap) {
+        int old = it->scope_cap;
+        it->scope_cap = old ? old * 2 : 64;
+        MEM_RESIZE(MEM_SCOPE, sizeof(Scope) * (size_t)old, sizeof(Scope) * (size_t)it->scope_cap);
+        it->scopes = realloc(it->scopes, sizeof(Scope) * (size_t)it->scope_cap);
+        memset(it->scopes + old, 0, sizeof(Scope) * (size_t)(it->scope_cap - old));
     }
     it->scope_depth++;
-    table_init(&it->scopes[it->scope_depth].vars);
+    Scope *s = &it->scopes[it->scope_depth];
+    s->slot_base = it->local_count;
+    s->slot_count = 0;
 }
 
 static void pop_scope(Interpreter *it) {
     if (it->scope_depth < 0) return;
-    table_free(&it->scopes[it->scope_depth].vars);
+    Scope *s = &it->scopes[it->scope_depth];
+    if (s->vars.count > 0) table_clear(&s->vars);
+    while (it->local_count > s->slot_base) {
+        val_free(&it->locals[--it->local_count]);
+    }
     it->scope_depth--;
 }
 
+void interp_push_scope(Interpreter *it) { push_scope(it); }
+void interp_pop_scope(Interpreter *it) { pop_scope(it); }
+
 /* ---- variable access ---- */
 
+void interp_bind_local(Interpreter *it, const char *name, Value val) {
+    if (it->local_count >= it->local_cap) {
+        int old = it->local_cap;
+        it->local_cap = old ? old * 2 : 64;
+        MEM_RESIZE(MEM_SCOPE, (sizeof(Value) + sizeof(char *)) * (size_t)old,
+                   (sizeof(Value) + sizeof(char *)) * (size_t)it->local_cap);
+        it->locals = realloc(it->locals, sizeof(Value) * (size_t)it->local_cap);
+        it->local_names = realloc(it->local_names, sizeof(char *) * (size_t)it->local_cap);
+    }
+    it->locals[it->local_count] = val;
+    it->local_names[it->local_count] = name;
+    it->local_count++;
+    it->scopes[it->scope_depth].slot_count++;
+}
+
+/* Storage for name in one scope: declared slots first, newest wins */
+static Value *scope_find(Interpreter *it, Scope *s, const char *name) {
+    for (int i = s->slot_base + s->slot_count - 1; i >= s->slot_base; i--) {
+        if (it->local_names[i] == name) return &it->locals[i];
+    }
+    return s->vars.count > 0 ? table_iref(&s->vars, name) : NULL;
+}
+
+static Table *scope_table(Interpreter *it) {
+    Table *t = &it->scopes[it->scope_depth].vars;
+    if (!t->entries) table_init(t);
+    return t;
+}
+
 int interp_get_var(Interpreter *it, const char *name, Value *out) {
-    /* Search from current scope upward */
+    Value *slot = interp_get_var_ref(it, name);
+    if (!slot) return 0;
+    *out = *slot;
+    return 1;
+}
+
+Value *interp_get_var_ref(Interpreter *it, const char *name) {
+    /* Search from current scope upward, then globals */
     for (int i = it->scope_depth; i >= 0; i--) {
-        if (table_get(&it->scopes[i].vars, name, out)) return 1;
+        Value *slot = scope_find(it, &it->scopes[i], name);
+        if (slot) return slot;
     }
-    /* Check globals */
-    if (table_get(&it->globals, name, out)) return 1;
-    return 0;
+    Value *slot = table_iref(&it->globals, name);
+    if (!slot && it->worker) slot = parallel_import_var(it->worker, name);
+    return slot;
 }
 
 void interp_set_var(Interpreter *it, const char *name, Value val) {
-    /* Find existing var in any scope and update it */
-    for (int i = it->scope_depth; i >= 0; i--) {
-        Value dummy;
-        if (table_get(&it->scopes[i].vars, name, &dummy)) {
-            table_set(&it->scopes[i].vars, name, val);
-            return;
-        }
-    }
-    /* Check globals */
-    Value dummy;
-    if (table_get(&it->globals, name, &dummy)) {
-        table_set(&it->globals, name, val);
+    /* Update an existing var in any scope, else define in current scope */
+    Value *slot = interp_get_var_ref(it, name);
+    if (slot) {
+        val_free(slot);
+        *slot = val;
         return;
     }
-    /* Define in current scope */
-    table_set(&it->scopes[it->scope_depth].vars, name, val);
+    table_iset(scope_table(it), name, val);
 }
 
 void interp_def_var(Interpreter *it, const char *name, Value val) {
     /* Always define in current scope */
-    table_set(&it->scopes[it->scope_depth].vars, name, val);
+    table_iset(scope_table(it), name, val);
 }
 
+/* ---- string helpers ---- */
+
+/* a + b where at least one side is a string. Consumes both operands. A
+ * uniquely owned left string -- the running result of a + b + c, say -- is
+ * extended in place rather than copied. */
+static Value concat_strings(Value a, Value b) {
+    Value out;
+    if (IS_STRING(a) && AS_STRING(a)->refcount == 1) {
+        out = a;
+    } else {
+        int hint = (IS_STRING(a) ? AS_STRING(a)->len : 24) +
+                   (IS_STRING(b) ? AS_STRING(b)->len : 24) + 1;
+        out = val_string_empty(hint);
+        val_string_append_value(&out, a);
+        val_free(&a);
+    }
+    val_string_append_value(&out, b);
+    val_free(&b);
+    return out;
+}
+/* s += x where s is a borrowed, uniquely owned string slot: extend the
+ * shared buffer directly instead of building a new one. Returns 0 when the
+ * buffer is shared and the caller has to build a fresh value. */
+static int append_in_place(Value current, Value rhs) {
+    if (!IS_STRING(current) || AS_STRING(current)->refcount != 1) return 0;
+    val_string_append_value(&current, rhs);
+    return 1;
+}
 /* ---- forward declarations ---- */
 
 static Value eval_node(Interpreter *it, ASTNode *node);
+
+/* A parallel worker reads the AST's shared caches but must not write them;
+ * it works on a private copy of the entry instead */
+static ShapeCache *site_cache(Interpreter *it, ShapeCache *sc, ShapeCache *scratch) {
+    if (!it->worker) return sc;
+    *scratch = *sc;
+    return scratch;
+}
+static void run_program(Interpreter *it, ASTNode *program);
 static void exec_stmts(Interpreter *it, ASTNode **stmts, int count);
 
+/* ---- lvalues ---- */
+
+/* Resolve an expression to the storage slot it names (variable, Self,
+ * obj.key, obj[key], arr[i]) so mutations land in the caller's value rather
+ * than a copy. Index expressions are evaluated before any slot pointer is
+ * taken, so user code cannot invalidate the result. Returns NULL for
+ * temporaries and anything else that has no storage. */
+static Value *index_lvalue(Interpreter *it, ASTNode *base_expr, ASTNode *index);
+
+static Value *eval_lvalue(Interpreter *it, ASTNode *node) {
+    switch (node->type) {
+    case NODE_VARIABLE:
+        if (node->slot >= 0) return interp_local(it, node->depth, node->slot);
+        return interp_get_var_ref(it, node->as.var_name);
+
+    case NODE_THIS:
+        return it->this_obj;
+
+    case NODE_OBJ_ACCESS: {
+        Value key = val_null();
+        if (node->as.obj_access.is_bracket || !node->as.obj_access.key) {
+            if (!node->as.obj_access.key_expr) return NULL;
+            key = eval_node(it, node->as.obj_access.key_expr);
+            if (!IS_STRING(key)) { val_free(&key); return NULL; }
+        }
+        Value *base = eval_lvalue(it, node->as.obj_access.obj);
+        Value *slot = NULL;
+        if (base && IS_OBJECT(*base)) {
+            ShapeCache scratch;
+            slot = IS_STRING(key)
+                 ? table_get_ref(AS_OBJECT(*base), AS_STRING(key)->chars)
+                 : table_iref_cached(AS_OBJECT(*base), node->as.obj_access.key,
+                                     site_cache(it, &node->as.obj_access.cache, &scratch));
+        }
+        val_free(&key);
+        return slot;
+    }
+
+    case NODE_ARRAY_INDEX:
+        return index_lvalue(it, node->as.array_index.array_expr, node->as.array_index.index);
+
+    default:
+        return NULL;
+    }
+}
+
+/* Slot for base[index]; the array is detached so the slot is private */
+static Value *index_lvalue(Interpreter *it, ASTNode *base_expr, ASTNode *index) {
+    Value idx = eval_node(it, index);
+    Value *base = eval_lvalue(it, base_expr);
+    Value *slot = NULL;
+    if (base && IS_RANGE(*base) && IS_NUMBER(idx)) val_materialize(base);
+    if (base && IS_ARRAY(*base) && IS_NUMBER(idx)) {
+        int i = (int)AS_NUMBER(idx);
+        if (i < 0) i += AS_ARRAY(*base)->count;
+        if (i >= 0 && i < AS_ARRAY(*base)->count) {
+            val_array_detach(base);
+            slot = &AS_ARRAY(*base)->items[i];
+        }
+    } else if (base && IS_OBJECT(*base) && IS_STRING(idx)) {
+        slot = table_get_ref(AS_OBJECT(*base), AS_STRING(idx)->chars);
+    }
+    val_free(&idx);
+    return slot;
+}
+
 /* ---- call user function ---- */
 
-static Value call_function(Interpreter *it, FuncDef *fn, Value *args, int argc, int line) {
-    if (it->call_depth >= MAX_CALL_DEPTH) {
-        runtime_error(it, line, "stack overflow (max %d call depth)", MAX_CALL_DEPTH);
+static void free_args(Value *args, int argc) {
+    for (int i = 0; i < argc; i++) val_free(&args[i]);
+}
+
+/* Push a call scope and bind fn's parameters from args (borrowed) */
+void interp_enter_function(Interpreter *it, FuncDef *fn, Value *args, int argc, int line) {
+    char here;
+    /* Inside a try these return: the frame is still entered, so leave
+     * balances it, but the body is skipped */
+    int limit = interp_depth_limit(it);
+    if (limit > 0 && it->call_depth >= limit) {
+        runtime_error(it, line, "stack overflow (max %d call depth)", limit);
+    } else if ((uintptr_t)&here < (uintptr_t)it->stack_limit) {
+        runtime_error(it, line, "stack overflow (C stack exhausted at call depth %d)",
+                      it->call_depth);
     }
     it->call_depth++;
+    if (it->profile) profile_enter(it->profile, fn);
     push_scope(it);
 
     /* Bind parameters */
     for (int i = 0; i < fn->param_count; i++) {
         if (i < argc) {
-            interp_def_var(it, fn->params[i].name, val_copy(args[i]));
+            interp_bind_local(it, fn->params[i].name, val_copy(args[i]));
         } else if (fn->params[i].default_val) {
             Value def = eval_node(it, fn->params[i].default_val);
-            interp_def_var(it, fn->params[i].name, def);
+            interp_bind_local(it, fn->params[i].name, def);
         } else {
-            interp_def_var(it, fn->params[i].name, val_null());
+            interp_bind_local(it, fn->params[i].name, val_null());
+        }
+    }
+}
+
+void interp_leave_function(Interpreter *it) {
+    pop_scope(it);
+    it->call_depth--;
+    if (it->profile) profile_leave(it->profile);
+}
+
+/* name is one of fn's first n parameters */
+static int is_param(FuncDef *fn, int n, const char *name) {
+    for (int i = 0; i < n; i++) {
+        if (fn->params[i].name == name) return 1;
+    }
+    return 0;
+}
+
+static Value call_function(Interpreter *it, FuncDef *fn, Value *args, int argc, int line) {
+    if (it->throwing) return val_null();
+    Value result;
+    if (it->jit && jit_call(it, fn, args, argc, &result)) return result;
+    if (it->use_vm) return vm_call(it, fn, args, argc, line);
+
+    int frame_try = it->frame_try;
+    int frame_scope = it->frame_scope;
+    interp_enter_function(it, fn, args, argc, line);
+    it->frame_try = it->try_depth;
+    it->frame_scope = it->scope_depth;
+
+    for (;;) {
+        /* Execute body */
+        it->return_flag = 0;
+        it->return_value = val_null();
+
+        exec_stmts(it, fn->body, fn->body_count);
+
+        result = val_null();
+        if (it->return_flag) {
+            result = it->return_value;
+            it->return_flag = 0;
+            it->return_value = val_null();
+        }
+        if (!it->tail_fn) break;
+
+        /* The body ended in manifest f(...): run f in this frame. Its
+         * arguments move off tail_args first, since binding defaults can
+         * make tail calls of its own. */
+        Value argbuf[MAX_STACK_ARGS];
+        int n = it->tail_argc;
+        Value *targs = n > MAX_STACK_ARGS ? malloc(sizeof(Value) * (size_t)n) : argbuf;
+        for (int i = 0; i < n; i++) targs[i] = it->tail_args[i];
+        fn = it->tail_fn;
+        it->tail_fn = NULL;
+        it->tail_argc = 0;
+        interp_leave_function(it);
+        interp_enter_function(it, fn, targs, n, line);
+        free_args(targs, n);
+        if (targs != argbuf) free(targs);
+    }
+
+    interp_leave_function(it);
+    it->frame_try = frame_try;
+    it->frame_scope = frame_scope;
+    return result;
+}
+
+/* Names are scoped dynamically: anything fn runs, or anything that runs,
+ * may read or assign a name bound in its caller's scopes. Running fn in
+ * the caller's frame drops those bindings, so it is only done where none
+ * could be found: every name the frame binds is one of the parameters fn
+ * binds from its arguments, which shadow it for as long as fn runs. Any
+ * other binding (a caller's local, a nested dream's free variable) makes
+ * manifest fn(...) an ordinary call. */
+int interp_frame_reusable(Interpreter *it, int base, FuncDef *fn, int argc) {
+    int bound = argc < fn->param_count ? argc : fn->param_count;
+    for (int d = base; d <= it->scope_depth; d++) {
+        Scope *s = &it->scopes[d];
+        for (int i = s->slot_base; i < s->slot_base + s->slot_count; i++) {
+            if (!is_param(fn, bound, it->local_names[i])) return 0;
+        }
+        if (s->vars.count == 0) continue;
+        TABLE_FOR_EACH(&s->vars, e) {
+            if (!is_param(fn, bound, e->key)) return 0;
+        }
+    }
+    return 1;
+}
+
+Value interp_call_function(Interpreter *it, FuncDef *fn, Value *args, int argc, int line) {
+    return call_function(it, fn, args, argc, line);
+}
+
+/* ---- modules ----
+ * it->modules maps each imported file's canonical path to its state. It
+ * keeps import order, so pending modules (--lazy-imports) are loaded
+ * front to back as lookups miss; module_next skips the settled prefix. */
+
+#define MODULE_PENDING 0
+#define MODULE_LOADED  1
+
+static const char *module_key(Interpreter *it, const char *path, int line) {
+    char *real = realpath(path, NULL);
+    if (!real) {
+        runtime_error(it, line, "cannot open import file '%s'", path);
+        return NULL;
+    }
+    const char *key = intern_cstr(real);
+    free(real);
+    return key;
+}
+
+/* The parsed module at path (a key), owned by the interpreter. The compiled
+ * form is used when it is current. */
+static ASTNode *load_module(Interpreter *it, const char *path, int line) {
+    ASTNode *program = jungc_load(path);
+    if (!program) {
+        FILE *f = fopen(path, "r");
+        if (!f) {
+            runtime_error(it, line, "cannot open import file '%s'", path);
+            return NULL;
+        }
+        fseek(f, 0, SEEK_END);
+        long size = ftell(f);
+        fseek(f, 0, SEEK_SET);
+        char *src = malloc((size_t)size + 1);
+        size_t nr = fread(src, 1, (size_t)size, f);
+        src[nr] = '\0';
+        fclose(f);
+
+        char err[256];
+        program = interp_parse(src, err);
+        free(src);
+        if (!program) {
+            runtime_error(it, line, "in '%s': %s", path, err);
+            return NULL;
+        }
+    }
+    interp_keep(it, program);
+    return program;
+}
+
+typedef struct {
+    ASTNode *program;
+    char *error;          /* raw message of an error the module raised */
+} ModuleRun;
+
+/* Catch the module's errors as exceptions to keep their plain message */
+static void module_thunk(Interpreter *it, void *ud) {
+    ModuleRun *run = ud;
+    int frame_try = it->frame_try;
+    it->try_depth = 1;
+    it->frame_try = -1;     /* its top level is no dream's frame */
+    run_program(it, run->program);
+    if (it->throwing) run->error = interp_catch_message(it);
+    it->try_depth = 0;
+    it->frame_try = frame_try;
+}
+
+/* Run a pending module as if it had been imported at the top level: only
+ * the global scope is visible, on a scope stack of its own. An error or
+ * exit() in it is raised again at the use that triggered the load. */
+static void run_pending(Interpreter *it, const char *path, int line) {
+    ModuleRun run = { load_module(it, path, line), NULL };
+    if (!run.program) return;
+
+    Scope *saved_scopes = it->scopes;
+    int saved_cap = it->scope_cap;
+    int saved_depth = it->scope_depth;
+    Value *saved_this = it->this_obj;
+    it->scope_cap = 64;
+    it->scopes = calloc((size_t)it->scope_cap, sizeof(Scope));
+    MEM_ALLOC(MEM_SCOPE, sizeof(Scope) * (size_t)it->scope_cap);
+    it->scopes[0] = saved_scopes[0];
+    it->scope_depth = 0;
+    it->this_obj = NULL;
+
+    int status = interp_protect(it, module_thunk, &run);
+
+    saved_scopes[0] = it->scopes[0];
+    for (int i = 1; i < it->scope_cap; i++) table_free(&it->scopes[i].vars);
+    MEM_FREE(MEM_SCOPE, sizeof(Scope) * (size_t)it->scope_cap);
+    free(it->scopes);
+    it->scopes = saved_scopes;
+    it->scope_cap = saved_cap;
+    it->scope_depth = saved_depth;
+    it->this_obj = saved_this;
+
+    if (status == JUNG_EXIT) interp_exit(it, it->exit_code);
+    if (run.error) {
+        char msg[1200];
+        snprintf(msg, sizeof(msg), "%s", run.error);
+        free(run.error);
+        runtime_error(it, line, "in '%s': %s", path, msg);
+    }
+}
+
+/* Load the oldest pending module; 0 when none is left */
+static int load_next_module(Interpreter *it, int line) {
+    if (it->modules_pending == 0) return 0;
+    Table *t = &it->modules;
+    while (it->module_next < t->used) {
+        TableEntry *e = &t->entries[it->module_next++];
+        if (AS_NUMBER(e->value) != MODULE_PENDING) continue;
+        e->value = val_number(MODULE_LOADED);
+        it->modules_pending--;
+        run_pending(it, e->key, line);
+        return 1;
+    }
+    return 0;
+}
+
+void interp_load_modules(Interpreter *it, int line) {
+    while (load_next_module(it, line)) {}
+}
+
+/* ---- shared evaluation helpers ----
+ * These implement the semantics of each operation on already-evaluated
+ * operands, so the tree walker and the bytecode VM behave identically.
+ * Operand values passed in are consumed. */
+
+Value interp_variable(Interpreter *it, const char *name, int line) {
+    Value v;
+    if (interp_get_var(it, name, &v)) {
+        return val_copy(v);
+    }
+    /* Check functions */
+    if (table_iget(&it->functions, name, &v)) {
+        return val_copy(v);
+    }
+    if (load_next_module(it, line)) return interp_variable(it, name, line);
+    runtime_error(it, line, "undefined variable '%s'", name);
+    return val_null();
+}
+
+Value interp_binary(Interpreter *it, TokenType op, Value left, Value right, int line) {
+    /* String concatenation */
+    if (op == TOKEN_PLUS && (IS_STRING(left) || IS_STRING(right))) {
+        return concat_strings(left, right);
+    }
+
+    /* Numeric operations */
+    if (IS_NUMBER(left) && IS_NUMBER(right)) {
+        double l = AS_NUMBER(left), r = AS_NUMBER(right);
+        switch (op) {
+            case TOKEN_PLUS:     return val_number(l + r);
+            case TOKEN_MINUS:    return val_number(l - r);
+            case TOKEN_MULTIPLY: return val_number(l * r);
+            case TOKEN_DIVIDE:
+                if (r == 0) {
+                    runtime_error(it, line, "division by zero");
+                    return val_null();
+                }
+                /* Integer division when both operands are integers */
+                if (l == floor(l) && r == floor(r)) {
+                    return val_number((double)((long)l / (long)r));
+                }
+                return val_number(l / r);
+            case TOKEN_MODULO:
+                if (r == 0) {
+                    runtime_error(it, line, "modulo by zero");
+                    return val_null();
+                }
+                return val_number(fmod(l, r));
+            case TOKEN_GT:  return val_bool(l > r);
+            case TOKEN_LT:  return val_bool(l < r);
+            case TOKEN_GTE: return val_bool(l >= r);
+            case TOKEN_LTE: return val_bool(l <= r);
+            case TOKEN_EQ:  return val_bool(l == r);
+            case TOKEN_NEQ: return val_bool(l != r);
+            default: break;
+        }
+    }
+
+    /* Equality for non-numbers */
+    if (op == TOKEN_EQ) {
+        int result = val_equal(left, right);
+        val_free(&left); val_free(&right);
+        return val_bool(result);
+    }
+    if (op == TOKEN_NEQ) {
+        int result = !val_equal(left, right);
+        val_free(&left); val_free(&right);
+        return val_bool(result);
+    }
+
+    runtime_error(it, line, "unsupported operand types for binary op");
+    return val_null();
+}
+
+Value interp_unary(Interpreter *it, TokenType op, Value operand, int line) {
+    if (op == TOKEN_MINUS) {
+        if (!IS_NUMBER(operand)) {
+            val_free(&operand);
+            runtime_error(it, line, "unary minus requires number");
+            return val_null();
+        }
+        return val_number(-AS_NUMBER(operand));
+    }
+    if (op == TOKEN_NOT) {
+        int result = !val_is_truthy(operand);
+        val_free(&operand);
+        return val_bool(result);
+    }
+    val_free(&operand);
+    return val_null();
+}
+
+Value interp_index(Interpreter *it, Value arr, Value idx) {
+    (void)it;
+    if (IS_ARRAY(arr) && IS_NUMBER(idx)) {
+        int i = (int)AS_NUMBER(idx);
+        if (i < 0) i += AS_ARRAY(arr)->count;
+        Value result = val_null();
+        if (i >= 0 && i < AS_ARRAY(arr)->count) {
+            result = val_copy(AS_ARRAY(arr)->items[i]);
+        }
+        val_free(&arr); val_free(&idx);
+        return result;
+    }
+    if (IS_RANGE(arr) && IS_NUMBER(idx)) {
+        int i = (int)AS_NUMBER(idx);
+        if (i < 0) i += AS_RANGE(arr)->count;
+        Value result = i >= 0 && i < AS_RANGE(arr)->count ? val_range_at(AS_RANGE(arr), i) : val_null();
+        val_free(&arr); val_free(&idx);
+        return result;
+    }
+    if (IS_F64ARRAY(arr) && IS_NUMBER(idx)) {
+        int i = (int)AS_NUMBER(idx);
+        if (i < 0) i += AS_F64(arr)->count;
+        Value result = i >= 0 && i < AS_F64(arr)->count ? val_number(AS_F64(arr)->data[i]) : val_null();
+        val_free(&arr); val_free(&idx);
+        return result;
+    }
+    if (IS_OBJECT(arr) && IS_STRING(idx)) {
+        Value result = val_null();
+        Value v;
+        if (table_get(AS_OBJECT(arr), AS_STRING(idx)->chars, &v)) {
+            result = val_copy(v);
+        }
+        val_free(&arr); val_free(&idx);
+        return result;
+    }
+    if (IS_STRING(arr) && IS_NUMBER(idx)) {
+        int i = (int)AS_NUMBER(idx);
+        if (i < 0) i += AS_STRING(arr)->len;
+        if (i >= 0 && i < AS_STRING(arr)->len) {
+            Value result = val_string(AS_STRING(arr)->chars + i, 1);
+            val_free(&arr); val_free(&idx);
+            return result;
+        }
+        val_free(&arr); val_free(&idx);
+        return val_null();
+    }
+    val_free(&arr); val_free(&idx);
+    return val_null();
+}
+
+Value interp_get_field(Interpreter *it, Value obj, const char *key, ShapeCache *sc) {
+    if (IS_OBJECT(obj)) {
+        ShapeCache scratch;
+        sc = site_cache(it, sc, &scratch);
+        /* Check for "length" property on objects */
+        if (key == INTERN_LENGTH) {
+            int count = AS_OBJECT(obj)->count;
+            val_free(&obj);
+            return val_number(count);
+        }
+        Value *v = table_iref_cached(AS_OBJECT(obj), key, sc);
+        Value result = v ? val_copy(*v) : val_null();
+        /* An instance's class name reads as a field */
+        if (!v && key == INTERN_CLASS && AS_OBJECT(obj)->klass) {
+            const char *name = AS_OBJECT(obj)->klass->name;
+            result = val_string(name, intern_len(name));
+        }
+        val_free(&obj);
+        return result;
+    }
+    /* .length on string/array */
+    if (key == INTERN_LENGTH) {
+        if (IS_STRING(obj)) {
+            int len = AS_STRING(obj)->len;
+            val_free(&obj);
+            return val_number(len);
+        }
+        if (IS_ARRAY(obj)) {
+            int cnt = AS_ARRAY(obj)->count;
+            val_free(&obj);
+            return val_number(cnt);
+        }
+        if (IS_RANGE(obj)) {
+            int cnt = AS_RANGE(obj)->count;
+            val_free(&obj);
+            return val_number(cnt);
+        }
+        if (IS_F64ARRAY(obj)) {
+            int cnt = AS_F64(obj)->count;
+            val_free(&obj);
+            return val_number(cnt);
+        }
+    }
+    val_free(&obj);
+    return val_null();
+}
+
+/* Resolve a map/filter/reduce callback given as a function value or name */
+static FuncDef *callback_func(Interpreter *it, Value fn_ref) {
+    if (IS_FUNCTION(fn_ref)) return AS_FUNC(fn_ref);
+    if (IS_STRING(fn_ref)) {
+        Value fn_lookup;
+        if (table_get(&it->functions, AS_STRING(fn_ref)->chars, &fn_lookup) && IS_FUNCTION(fn_lookup))
+            return AS_FUNC(fn_lookup);
+    }
+    return NULL;
+}
+
+/* ---- sort with a callback ----
+ * sort(arr, fn) and arr.sortInPlace(fn). A dream of one parameter is a
+ * key: it runs once per item, then the items are ordered by the natural
+ * order of their keys (sort.h). A dream of two is a comparator returning
+ * a negative number, 0 or a positive number; anything else counts as 0.
+ * Either way the sort is stable. */
+
+typedef struct {
+    Interpreter *it;
+    FuncDef *fn;
+    int line;
+} SortCall;
+
+static int call_compare(void *ud, Value a, Value b) {
+    SortCall *sc = ud;
+    if (sc->it->throwing) return 0;
+    Value args[2] = { a, b };
+    Value r = call_function(sc->it, sc->fn, args, 2, sc->line);
+    int c = IS_NUMBER(r) ? (AS_NUMBER(r) > 0) - (AS_NUMBER(r) < 0) : 0;
+    val_free(&r);
+    return c;
+}
+
+/* Sort items, which the program cannot reach while fn runs */
+static void sort_callback(Interpreter *it, FuncDef *fn, Value *items, int n, int line) {
+    if (fn->param_count >= 2) {
+        SortCall sc = { it, fn, line };
+        sort_with(items, n, call_compare, &sc);
+        return;
+    }
+    Value *keys = malloc(sizeof(Value) * (size_t)(n > 0 ? n : 1));
+    for (int i = 0; i < n; i++) keys[i] = call_function(it, fn, &items[i], 1, line);
+    if (!it->throwing) sort_by_keys(items, keys, n);
+    for (int i = 0; i < n; i++) val_free(&keys[i]);
+    free(keys);
+}
+
+/* recv.sortInPlace(fn). The array is held by an extra reference while fn
+ * runs, so a callback that changes the variable gets a copy of its own
+ * and cannot pull the items out from under the sort. */
+static void sort_receiver(Interpreter *it, FuncDef *fn, Value *recv, int line) {
+    if (IS_F64ARRAY(*recv)) {
+        Value arr = val_f64_to_array(AS_F64(*recv));
+        sort_callback(it, fn, AS_ARRAY(arr)->items, AS_ARRAY(arr)->count, line);
+        if (!it->throwing && IS_F64ARRAY(*recv) && AS_F64(*recv)->count == AS_ARRAY(arr)->count) {
+            val_f64_detach(recv);
+            for (int i = 0; i < AS_ARRAY(arr)->count; i++)
+                AS_F64(*recv)->data[i] = AS_NUMBER(AS_ARRAY(arr)->items[i]);
+        }
+        val_free(&arr);
+        return;
+    }
+    val_materialize(recv);
+    if (!IS_ARRAY(*recv)) return;
+    val_array_detach(recv);
+    Value hold = val_copy(*recv);
+    sort_callback(it, fn, AS_ARRAY(hold)->items, AS_ARRAY(hold)->count, line);
+    val_free(&hold);
+}
+
+/* Call a class method with args[0] as this */
+static Value call_method(Interpreter *it, FuncDef *fn, Value *args, int argc, int line) {
+    Value *this_save = it->this_obj;
+    it->this_obj = &args[0];
+    Value result = call_function(it, fn, args + 1, argc - 1, line);
+    it->this_obj = this_save;
+    return result;
+}
+
+/* Turn ranges and Float64Arrays into plain arrays, except the kinds a
+ * builtin says it handles itself (BUILTIN_TAKES_*) */
+static void adapt_args(Value *args, int argc, int kinds) {
+    for (int i = 0; i < argc; i++) {
+        if (IS_RANGE(args[i]) && !(kinds & BUILTIN_TAKES_RANGE)) {
+            val_materialize(&args[i]);
+        } else if (IS_F64ARRAY(args[i]) && !(kinds & BUILTIN_TAKES_F64)) {
+            Value arr = val_f64_to_array(AS_F64(args[i]));
+            val_free(&args[i]);
+            args[i] = arr;
+        }
+    }
+}
+
+static Value call_builtin(BuiltinFn fn, Value *args, int argc) {
+    adapt_args(args, argc, builtins_arg_kinds(fn));
+    return fn(args, argc);
+}
+
+/* The target cc records, else CALL_UNRESOLVED */
+static CallKind cached_kind(Interpreter *it, CallCache *cc) {
+    return cc->version == it->def_version ? cc->kind : CALL_UNRESOLVED;
+}
+
+/* Replay a cached call target. Returns 0 when the cache does not apply. */
+static int call_cached(Interpreter *it, CallCache *cc, Value *args, int argc, int line, Value *out) {
+    switch (cached_kind(it, cc)) {
+    case CALL_BUILTIN:
+        *out = call_builtin(cc->as.builtin, args, argc);
+        return 1;
+    case CALL_FUNCTION:
+        *out = call_function(it, cc->as.func, args, argc, line);
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+static void cache_target(Interpreter *it, CallCache *cc, CallKind kind) {
+    cc->kind = kind;
+    cc->version = it->def_version;
+}
+
+int interp_special_form(const char *name, int argc) {
+    return name == INTERN_MAP || name == INTERN_FILTER || name == INTERN_REDUCE ||
+           name == INTERN_PMAP || name == INTERN_PFILTER || name == INTERN_PREDUCE ||
+           name == INTERN_EXIT || (name == INTERN_SORT && argc >= 2);
+}
+
+/* The lookup chain of interp_call, stopping short of anything but a dream */
+FuncDef *interp_call_target(Interpreter *it, const char *name, CallCache *cc, int argc) {
+    CallCache scratch;
+    if (cc && it->worker) {
+        scratch = *cc;
+        cc = &scratch;
+    }
+    if (cc) {
+        switch (cached_kind(it, cc)) {
+        case CALL_BUILTIN:  return NULL;
+        case CALL_FUNCTION: return cc->as.func;
+        default:            break;
+        }
+    }
+
+    Value v;
+    if (interp_special_form(name, argc)) return NULL;
+    if (table_iget(&it->builtins, name, &v) && IS_BUILTIN(v)) return NULL;
+    if (table_iget(&it->functions, name, &v) && IS_FUNCTION(v)) {
+        if (cc) {
+            cache_target(it, cc, CALL_FUNCTION);
+            cc->as.func = AS_FUNC(v);
+        }
+        return AS_FUNC(v);
+    }
+    if (interp_get_var(it, name, &v) && IS_FUNCTION(v)) return AS_FUNC(v);
+    return NULL;
+}
+
+/* cc, when given, is the call site's cache: a hit skips the lookup chain
+ * below, and a builtin or named-function resolution is recorded in it.
+ * map/filter/reduce and variables holding functions are never cached. */
+Value interp_call(Interpreter *it, const char *name, CallCache *cc, Value *args, int argc, int line) {
+    Value result;
+    CallCache scratch;
+    if (it->throwing) {
+        /* An argument raised: the call never happens */
+        free_args(args, argc);
+        return val_null();
+    }
+    if (cc && it->worker) {
+        scratch = *cc;
+        cc = &scratch;
+    }
+    if (cc && call_cached(it, cc, args, argc, line, &result)) {
+        free_args(args, argc);
+        return result;
+    }
+
+    /* Special handling for map/filter/reduce.
+     * Supports both orderings:
+     *   map(arr, fn)       -- arr first
+     *   map("fn_name", arr) -- fn name first (Python API)
+     */
+    /* A worker runs the parallel forms as the serial ones */
+    if (it->worker) {
+        if (name == INTERN_PMAP) name = INTERN_MAP;
+        else if (name == INTERN_PFILTER) name = INTERN_FILTER;
+        else if (name == INTERN_PREDUCE) name = INTERN_REDUCE;
+    }
+    int special = interp_special_form(name, argc);
+    if (special) adapt_args(args, argc, 0);
+    if (name == INTERN_MAP && argc >= 2) {
+        Value arr, fn_ref;
+        if (IS_ARRAY(args[0])) { arr = args[0]; fn_ref = args[1]; }
+        else { arr = args[1]; fn_ref = args[0]; }
+
+        FuncDef *fndef = callback_func(it, fn_ref);
+        if (IS_ARRAY(arr) && fndef) {
+            result = val_array(AS_ARRAY(arr)->count);
+            for (int i = 0; i < AS_ARRAY(arr)->count; i++) {
+                Value item = val_copy(AS_ARRAY(arr)->items[i]);
+                Value mapped = call_function(it, fndef, &item, 1, line);
+                val_array_push(&result, mapped);
+                val_free(&item);
+            }
+            free_args(args, argc);
+            return result;
+        }
+    }
+    if (name == INTERN_FILTER && argc >= 2) {
+        Value arr, fn_ref;
+        if (IS_ARRAY(args[0])) { arr = args[0]; fn_ref = args[1]; }
+        else { arr = args[1]; fn_ref = args[0]; }
+
+        FuncDef *fndef = callback_func(it, fn_ref);
+        if (IS_ARRAY(arr) && fndef) {
+            result = val_array(AS_ARRAY(arr)->count);
+            for (int i = 0; i < AS_ARRAY(arr)->count; i++) {
+                Value item = val_copy(AS_ARRAY(arr)->items[i]);
+                Value pred = call_function(it, fndef, &item, 1, line);
+                if (val_is_truthy(pred)) {
+                    val_array_push(&result, val_copy(AS_ARRAY(arr)->items[i]));
+                }
+                val_free(&item); val_free(&pred);
+            }
+            free_args(args, argc);
+            return result;
+        }
+    }
+    if (name == INTERN_REDUCE && argc >= 3) {
+        /* reduce("fn", arr, init) or reduce(arr, fn, init) */
+        Value arr, fn_ref, acc;
+        if (IS_ARRAY(args[0])) { arr = args[0]; fn_ref = args[1]; acc = val_copy(args[2]); }
+        else { fn_ref = args[0]; arr = args[1]; acc = val_copy(args[2]); }
+
+        FuncDef *fndef = callback_func(it, fn_ref);
+        if (IS_ARRAY(arr) && fndef) {
+            for (int i = 0; i < AS_ARRAY(arr)->count; i++) {
+                Value call_args[2];
+                call_args[0] = acc;
+                call_args[1] = val_copy(AS_ARRAY(arr)->items[i]);
+                acc = call_function(it, fndef, call_args, 2, line);
+                val_free(&call_args[0]); val_free(&call_args[1]);
+            }
+            free_args(args, argc);
+            return acc;
+        }
+        val_free(&acc);
+    }
+
+    if (name == INTERN_SORT && argc >= 2) {
+        FuncDef *fndef = callback_func(it, args[1]);
+        if (IS_ARRAY(args[0]) && fndef) {
+            result = args[0];
+            args[0] = val_null();
+            val_array_detach(&result);
+            sort_callback(it, fndef, AS_ARRAY(result)->items, AS_ARRAY(result)->count, line);
+            free_args(args, argc);
+            return result;
         }
     }
 
-    /* Execute body */
-    it->return_flag = 0;
-    it->return_value = val_null();
+    /* pmap / pfilter / preduce: same argument forms, run on the pool */
+    if ((name == INTERN_PMAP || name == INTERN_PFILTER) && argc >= 2) {
+        Value arr, fn_ref;
+        if (IS_ARRAY(args[0])) { arr = args[0]; fn_ref = args[1]; }
+        else { arr = args[1]; fn_ref = args[0]; }
+
+        FuncDef *fndef = callback_func(it, fn_ref);
+        if (IS_ARRAY(arr) && fndef) {
+            result = name == INTERN_PMAP ? parallel_map(it, fndef, AS_ARRAY(arr), line)
+                                         : parallel_filter(it, fndef, AS_ARRAY(arr), line);
+            free_args(args, argc);
+            return result;
+        }
+    }
+    if (name == INTERN_PREDUCE && argc >= 3) {
+        /* preduce(arr, fn, init[, combine]) or preduce("fn", arr, init[, combine]) */
+        Value arr, fn_ref;
+        if (IS_ARRAY(args[0])) { arr = args[0]; fn_ref = args[1]; }
+        else { fn_ref = args[0]; arr = args[1]; }
+
+        FuncDef *fndef = callback_func(it, fn_ref);
+        FuncDef *combine = argc >= 4 ? callback_func(it, args[3]) : NULL;
+        if (IS_ARRAY(arr) && fndef) {
+            result = parallel_reduce(it, fndef, combine, AS_ARRAY(arr), args[2], line);
+            free_args(args, argc);
+            return result;
+        }
+    }
+
+    if (name == INTERN_EXIT) {
+        int code = argc > 0 && IS_NUMBER(args[0]) ? (int)AS_NUMBER(args[0]) : 0;
+        free_args(args, argc);
+        interp_exit(it, code);
+    }
+
+    /* Check builtins */
+    Value bfn;
+    if (table_iget(&it->builtins, name, &bfn) && IS_BUILTIN(bfn)) {
+        if (cc && !special) {
+            cache_target(it, cc, CALL_BUILTIN);
+            cc->as.builtin = AS_BUILTIN(bfn);
+        }
+        result = call_builtin(AS_BUILTIN(bfn), args, argc);
+        free_args(args, argc);
+        return result;
+    }
+
+    /* Check user-defined functions */
+    Value fn_val;
+    if (table_iget(&it->functions, name, &fn_val) && IS_FUNCTION(fn_val)) {
+        if (cc) {
+            cache_target(it, cc, CALL_FUNCTION);
+            cc->as.func = AS_FUNC(fn_val);
+        }
+        result = call_function(it, AS_FUNC(fn_val), args, argc, line);
+        free_args(args, argc);
+        return result;
+    }
+
+    /* Check if it's a variable holding a function */
+    Value var_val;
+    if (interp_get_var(it, name, &var_val)) {
+        if (IS_FUNCTION(var_val)) {
+            result = call_function(it, AS_FUNC(var_val), args, argc, line);
+            free_args(args, argc);
+            return result;
+        }
+        if (IS_BUILTIN(var_val)) {
+            result = call_builtin(AS_BUILTIN(var_val), args, argc);
+            free_args(args, argc);
+            return result;
+        }
+    }
+
+    /* Not found, unless a pending module defines it */
+    if (load_next_module(it, line)) return interp_call(it, name, cc, args, argc, line);
+    free_args(args, argc);
+    runtime_error(it, line, "undefined function '%s'", name);
+    return val_null();
+}
+
+int interp_is_mutator(Interpreter *it, const char *name, BuiltinFn *out) {
+    Value fn;
+    if (table_iget(&it->builtins, name, &fn) && IS_BUILTIN(fn) &&
+        builtins_mutates_receiver(AS_BUILTIN(fn))) {
+        *out = AS_BUILTIN(fn);
+        return 1;
+    }
+    return 0;
+}
+
+/* Builtins never change after startup, so each site looks this up once */
+BuiltinFn interp_site_mutator(Interpreter *it, const char *name, CallCache *cc) {
+    CallCache scratch;
+    if (it->worker) {
+        scratch = *cc;
+        cc = &scratch;
+    }
+    if (!cc->mut_known) {
+        BuiltinFn fn;
+        cc->mutator = interp_is_mutator(it, name, &fn) ? fn : NULL;
+        cc->mut_known = 1;
+    }
+    return cc->mutator;
+}
+
+Value interp_call_mutator(Interpreter *it, BuiltinFn fn, Value *recv, Value *args, int argc, int line) {
+    if (it->throwing) {
+        for (int i = 1; i < argc; i++) val_free(&args[i]);
+        return val_null();
+    }
+    FuncDef *cb;
+    if (argc > 1 && builtins_sorts_receiver(fn) && (cb = callback_func(it, args[1])) != NULL) {
+        sort_receiver(it, cb, recv, line);
+        for (int i = 1; i < argc; i++) val_free(&args[i]);
+        return val_null();
+    }
+    /* Mutate the slot directly: it must own its buffer first */
+    if (IS_F64ARRAY(*recv)) {
+        val_f64_detach(recv);
+    } else {
+        val_materialize(recv);
+        val_array_detach(recv);
+    }
+    args[0] = *recv;
+    Value result = fn(args, argc);
+    *recv = args[0];
+    for (int i = 1; i < argc; i++) val_free(&args[i]);
+    return result;
+}
+
+/* ---- method calls ---- */
+
+/* The builtin method table a receiver looks in first */
+static MethodKind receiver_kind(Value recv) {
+    switch (val_type(recv)) {
+    case VAL_STRING: return METHODS_STRING;
+    case VAL_ARRAY:
+    case VAL_RANGE:
+    case VAL_F64ARRAY: return METHODS_ARRAY;
+    case VAL_OBJECT: return METHODS_OBJECT;
+    case VAL_FILE: return METHODS_FILE;
+    default: return METHOD_KINDS;
+    }
+}
+
+/* name in kind's table, else in any other (NULL if none has it) */
+static BuiltinFn builtin_method(Interpreter *it, MethodKind kind, const char *name) {
+    Value v;
+    if (kind < METHOD_KINDS && table_iget(&it->methods[kind], name, &v)) return AS_BUILTIN(v);
+    for (int k = 0; k < METHOD_KINDS; k++) {
+        if (k != (int)kind && table_iget(&it->methods[k], name, &v)) return AS_BUILTIN(v);
+    }
+    return NULL;
+}
+
+/* Resolve recv.name into cc, unless it holds this receiver's class and
+ * kind already: CALL_METHOD for a class method, CALL_BUILTIN for a builtin
+ * one, CALL_UNRESOLVED (not cached) for neither */
+static CallKind resolve_method(Interpreter *it, const char *name, CallCache *cc, Value recv) {
+    ClassObj *cls = IS_OBJECT(recv) ? AS_OBJECT(recv)->klass : NULL;
+    MethodKind kind = receiver_kind(recv);
+    if (cached_kind(it, cc) != CALL_UNRESOLVED && cc->klass == cls && cc->recv_kind == (int)kind)
+        return cc->kind;
+
+    Value v;
+    cc->klass = cls;
+    cc->recv_kind = (int)kind;
+    if (cls && table_iget(cls->methods, name, &v) && IS_FUNCTION(v)) {
+        cache_target(it, cc, CALL_METHOD);
+        cc->as.func = AS_FUNC(v);
+        return CALL_METHOD;
+    }
+    BuiltinFn fn = builtin_method(it, kind, name);
+    if (fn) {
+        cache_target(it, cc, CALL_BUILTIN);
+        cc->as.builtin = fn;
+        return CALL_BUILTIN;
+    }
+    cc->kind = CALL_UNRESOLVED;
+    return CALL_UNRESOLVED;
+}
+
+Value interp_invoke(Interpreter *it, const char *name, CallCache *cc, Value *args, int argc, int line) {
+    CallCache scratch;
+    Value result;
+    if (it->throwing) {
+        free_args(args, argc);
+        return val_null();
+    }
+    if (it->worker) {
+        scratch = *cc;
+        cc = &scratch;
+    }
+    switch (resolve_method(it, name, cc, args[0])) {
+    case CALL_METHOD:
+        result = call_method(it, cc->as.func, args, argc, line);
+        break;
+    case CALL_BUILTIN:
+        result = call_builtin(cc->as.builtin, args, argc);
+        break;
+    default:
+        free_args(args, argc);
+        runtime_error(it, line, "undefined method '%s'", name);
+        return val_null();
+    }
+    free_args(args, argc);
+    return result;
+}
+
+FuncDef *interp_invoke_target(Interpreter *it, const char *name, CallCache *cc, Value *args) {
+    CallCache scratch;
+    if (it->worker) {
+        scratch = *cc;
+        cc = &scratch;
+    }
+    return resolve_method(it, name, cc, args[0]) == CALL_METHOD ? cc->as.func : NULL;
+}
+
+BuiltinFn interp_method_mutator(Interpreter *it, const char *name, CallCache *cc) {
+    CallCache scratch;
+    if (cc && it->worker) {
+        scratch = *cc;
+        cc = &scratch;
+    }
+    if (cc && cc->mut_known) return cc->mutator;
+    BuiltinFn fn = builtin_method(it, METHOD_KINDS, name);
+    if (fn && !builtins_mutates_receiver(fn)) fn = NULL;
+    if (cc) {
+        cc->mutator = fn;
+        cc->mut_known = 1;
+    }
+    return fn;
+}
+
+Value interp_new_instance(Interpreter *it, const char *class_name, Value *args, int argc, int line) {
+    Value class_val;
+    if (it->throwing) {
+        for (int i = 0; i < argc; i++) val_free(&args[i]);
+        return val_null();
+    }
+    if (!table_iget(&it->classes, class_name, &class_val) || !IS_CLASS(class_val)) {
+        if (load_next_module(it, line)) return interp_new_instance(it, class_name, args, argc, line);
+        for (int i = 0; i < argc; i++) val_free(&args[i]);
+        runtime_error(it, line, "undefined class '%s'", class_name);
+        return val_null();
+    }
+    ClassObj *cls = AS_CLASS(class_val);
+
+    /* Create instance object */
+    Value instance = val_object();
+    AS_OBJECT(instance)->klass = cls;
+    cls->refcount++;
+
+    if (cls->ctor) {
+        Value *this_save = it->this_obj;
+        it->this_obj = &instance;
+        Value r = call_function(it, cls->ctor, args, argc, line);
+        val_free(&r);
+        it->this_obj = this_save;
+    }
+
+    for (int i = 0; i < argc; i++) val_free(&args[i]);
+    return instance;
+}
+
+void interp_compound_assign(Interpreter *it, const char *name, TokenType op, Value rhs, int line) {
+    Value *slot = interp_get_var_ref(it, name);
+    while (!slot && load_next_module(it, line)) slot = interp_get_var_ref(it, name);
+    if (!slot) {
+        val_free(&rhs);
+        runtime_error(it, line, "undefined variable '%s'", name);
+        return;
+    }
+    interp_compound_slot(it, slot, op, rhs, line);
+}
+
+/* current op rhs into *result. Returns 0 when there is nothing to store:
+ * op raised an error, or current was a string extended in place */
+static int compound_value(Interpreter *it, TokenType op, Value current, Value rhs,
+                          Value *result, int line) {
+    if (IS_NUMBER(current) && IS_NUMBER(rhs)) {
+        double l = AS_NUMBER(current), r = AS_NUMBER(rhs);
+        switch (op) {
+            case TOKEN_PLUS_ASSIGN:     *result = val_number(l + r); break;
+            case TOKEN_MINUS_ASSIGN:    *result = val_number(l - r); break;
+            case TOKEN_MULTIPLY_ASSIGN: *result = val_number(l * r); break;
+            case TOKEN_DIVIDE_ASSIGN:
+                if (r == 0) {
+                    runtime_error(it, line, "division by zero");
+                    return 0;
+                }
+                if (l == floor(l) && r == floor(r)) {
+                    *result = val_number((double)((long)l / (long)r));
+                } else {
+                    *result = val_number(l / r);
+                }
+                break;
+            default:
+                *result = val_null();
+        }
+        return 1;
+    }
+    if (op == TOKEN_PLUS_ASSIGN && (IS_STRING(current) || IS_STRING(rhs))) {
+        /* The slot owns the only reference; it is extended in place */
+        if (append_in_place(current, rhs)) return 0;
+        *result = concat_strings(val_copy(current), val_copy(rhs));
+        return 1;
+    }
+    runtime_error(it, line, "unsupported types for compound assignment");
+    return 0;
+}
+
+void interp_compound_slot(Interpreter *it, Value *slot, TokenType op, Value rhs, int line) {
+    Value result;
+    if (!it->throwing && compound_value(it, op, *slot, rhs, &result, line)) {
+        val_free(slot);
+        *slot = result;
+    }
+    val_free(&rhs);
+}
+
+static FuncDef *make_funcdef(Interpreter *it, ASTNode *def) {
+    FuncDef *fn = malloc(sizeof(FuncDef));
+    fn->name = def->as.func_def.name;
+    fn->params = def->as.func_def.params;
+    fn->param_count = def->as.func_def.param_count;
+    fn->body = def->as.func_def.body;
+    fn->body_count = def->as.func_def.body_count;
+    fn->code = NULL;
+    fn->jit = NULL;
+    fn->line = def->line;
+    fn->next = it->funcs;
+    it->funcs = fn;
+    return fn;
+}
 
-    exec_stmts(it, fn->body, fn->body_count);
+void interp_define_function(Interpreter *it, ASTNode *node) {
+    FuncDef *fn = make_funcdef(it, node);
+    table_iset(&it->functions, fn->name, val_func(fn));
+    it->def_version++;
+}
 
-    Value result = val_null();
-    if (it->return_flag) {
-        result = it->return_value;
-        it->return_flag = 0;
-        it->return_value = val_null();
+void interp_define_class(Interpreter *it, ASTNode *node) {
+    Value class_val = val_class(node->as.class_def.name);
+    ClassObj *cls = AS_CLASS(class_val);
+    for (int i = 0; i < node->as.class_def.method_count; i++) {
+        FuncDef *fn = make_funcdef(it, node->as.class_def.methods[i]);
+        table_iset(cls->methods, fn->name, val_func(fn));
     }
 
-    pop_scope(it);
-    it->call_depth--;
-    return result;
+    /* The constructor is "constructor", else "init" */
+    Value ctor;
+    cls->ctor = NULL;
+    if ((table_iget(cls->methods, INTERN_CONSTRUCTOR, &ctor) && IS_FUNCTION(ctor)) ||
+        (table_iget(cls->methods, INTERN_INIT, &ctor) && IS_FUNCTION(ctor))) {
+        cls->ctor = AS_FUNC(ctor);
+    }
+    table_iset(&it->classes, node->as.class_def.name, class_val);
+    it->def_version++;
 }
 
 /* ---- eval ---- */
@@ -148,6 +1385,12 @@ static Value eval_node(Interpreter *it, ASTNode *node) {
     case NODE_STRING:
         return val_string(node->as.string.str, node->as.string.len);
 
+    case NODE_CONST:
+        /* Workers share the tree: a private string leaves its refcount alone */
+        if (it->worker && IS_STRING(node->as.constant))
+            return val_string(AS_STRING(node->as.constant)->chars, AS_STRING(node->as.constant)->len);
+        return val_copy(node->as.constant);
+
     case NODE_BOOL:
         return val_bool(node->as.boolean);
 
@@ -159,18 +1402,9 @@ static Value eval_node(Interpreter *it, ASTNode *node) {
         return val_null();
     }
 
-    case NODE_VARIABLE: {
-        Value v;
-        if (interp_get_var(it, node->as.var_name, &v)) {
-            return val_copy(v);
-        }
-        /* Check functions */
-        if (table_get(&it->functions, node->as.var_name, &v)) {
-            return val_copy(v);
-        }
-        runtime_error(it, node->line, "undefined variable '%s'", node->as.var_name);
-        return val_null();
-    }
+    case NODE_VARIABLE:
+        if (node->slot >= 0) return val_copy(*interp_local(it, node->depth, node->slot));
+        return interp_variable(it, node->as.var_name, node->line);
 
     case NODE_ARRAY: {
         Value arr = val_array(node->as.array.count > 0 ? node->as.array.count : 8);
@@ -185,7 +1419,7 @@ static Value eval_node(Interpreter *it, ASTNode *node) {
         Value obj = val_object();
         for (int i = 0; i < node->as.object.count; i++) {
             Value v = eval_node(it, node->as.object.values[i]);
-            table_set(obj.as.object, node->as.object.keys[i], v);
+            table_iset(AS_OBJECT(obj), node->as.object.keys[i], v);
         }
         return obj;
     }
@@ -209,78 +1443,12 @@ static Value eval_node(Interpreter *it, ASTNode *node) {
         }
 
         Value right = eval_node(it, node->as.binary.right);
-
-        /* String concatenation */
-        if (op == TOKEN_PLUS && (left.type == VAL_STRING || right.type == VAL_STRING)) {
-            char *ls = val_to_string(left);
-            char *rs = val_to_string(right);
-            int llen = (int)strlen(ls);
-            int rlen = (int)strlen(rs);
-            char *out = malloc((size_t)(llen + rlen + 1));
-            memcpy(out, ls, (size_t)llen);
-            memcpy(out + llen, rs, (size_t)rlen);
-            out[llen + rlen] = '\0';
-            free(ls); free(rs);
-            val_free(&left); val_free(&right);
-            return val_string_take(out, llen + rlen);
-        }
-
-        /* Numeric operations */
-        if (left.type == VAL_NUMBER && right.type == VAL_NUMBER) {
-            double l = left.as.number, r = right.as.number;
-            switch (op) {
-                case TOKEN_PLUS:     return val_number(l + r);
-                case TOKEN_MINUS:    return val_number(l - r);
-                case TOKEN_MULTIPLY: return val_number(l * r);
-                case TOKEN_DIVIDE:
-                    if (r == 0) runtime_error(it, node->line, "division by zero");
-                    /* Integer division when both operands are integers */
-                    if (l == floor(l) && r == floor(r)) {
-                        return val_number((double)((long)l / (long)r));
-                    }
-                    return val_number(l / r);
-                case TOKEN_MODULO:
-                    if (r == 0) runtime_error(it, node->line, "modulo by zero");
-                    return val_number(fmod(l, r));
-                case TOKEN_GT:  return val_bool(l > r);
-                case TOKEN_LT:  return val_bool(l < r);
-                case TOKEN_GTE: return val_bool(l >= r);
-                case TOKEN_LTE: return val_bool(l <= r);
-                case TOKEN_EQ:  return val_bool(l == r);
-                case TOKEN_NEQ: return val_bool(l != r);
-                default: break;
-            }
-        }
-
-        /* Equality for non-numbers */
-        if (op == TOKEN_EQ) {
-            int result = val_equal(left, right);
-            val_free(&left); val_free(&right);
-            return val_bool(result);
-        }
-        if (op == TOKEN_NEQ) {
-            int result = !val_equal(left, right);
-            val_free(&left); val_free(&right);
-            return val_bool(result);
-        }
-
-        runtime_error(it, node->line, "unsupported operand types for binary op");
-        return val_null();
+        return interp_binary(it, op, left, right, node->line);
     }
 
     case NODE_UNARY: {
         Value operand = eval_node(it, node->as.unary.operand);
-        if (node->as.unary.op == TOKEN_MINUS) {
-            if (operand.type != VAL_NUMBER)
-                runtime_error(it, node->line, "unary minus requires number");
-            return val_number(-operand.as.number);
-        }
-        if (node->as.unary.op == TOKEN_NOT) {
-            int result = !val_is_truthy(operand);
-            val_free(&operand);
-            return val_bool(result);
-        }
-        return val_null();
+        return interp_unary(it, node->as.unary.op, operand, node->line);
     }
 
     case NODE_TERNARY: {
@@ -292,304 +1460,93 @@ static Value eval_node(Interpreter *it, ASTNode *node) {
     }
 
     case NODE_STRING_INTERP: {
-        int cap = 256, len = 0;
-        char *buf = malloc((size_t)cap);
-        buf[0] = '\0';
-
+        /* Parts are formatted straight into the result buffer */
+        Value out = val_string_empty(64);
         for (int i = 0; i < node->as.interp.count; i++) {
             Value part = eval_node(it, node->as.interp.parts[i]);
-            char *s = val_to_string(part);
-            int slen = (int)strlen(s);
-            while (len + slen + 1 >= cap) { cap *= 2; buf = realloc(buf, (size_t)cap); }
-            memcpy(buf + len, s, (size_t)slen);
-            len += slen;
-            free(s);
+            val_string_append_value(&out, part);
             val_free(&part);
         }
-        buf[len] = '\0';
-        return val_string_take(buf, len);
+        return out;
     }
 
     case NODE_ARRAY_INDEX: {
         Value arr = eval_node(it, node->as.array_index.array_expr);
         Value idx = eval_node(it, node->as.array_index.index);
-
-        if (arr.type == VAL_ARRAY && idx.type == VAL_NUMBER) {
-            int i = (int)idx.as.number;
-            if (i < 0) i += arr.as.array.count;
-            Value result = val_null();
-            if (i >= 0 && i < arr.as.array.count) {
-                result = val_copy(arr.as.array.items[i]);
-            }
-            val_free(&arr); val_free(&idx);
-            return result;
-        }
-        if (arr.type == VAL_OBJECT && idx.type == VAL_STRING) {
-            Value result = val_null();
-            Value v;
-            if (table_get(arr.as.object, idx.as.string.str, &v)) {
-                result = val_copy(v);
-            }
-            val_free(&arr); val_free(&idx);
-            return result;
-        }
-        if (arr.type == VAL_STRING && idx.type == VAL_NUMBER) {
-            int i = (int)idx.as.number;
-            if (i < 0) i += arr.as.string.len;
-            if (i >= 0 && i < arr.as.string.len) {
-                Value result = val_string(arr.as.string.str + i, 1);
-                val_free(&arr); val_free(&idx);
-                return result;
-            }
-            val_free(&arr); val_free(&idx);
-            return val_null();
-        }
-        val_free(&arr); val_free(&idx);
-        return val_null();
+        return interp_index(it, arr, idx);
     }
 
     case NODE_OBJ_ACCESS: {
         Value obj = eval_node(it, node->as.obj_access.obj);
-        if (obj.type == VAL_OBJECT) {
-            Value v;
-            if (node->as.obj_access.key && !node->as.obj_access.is_bracket) {
-                /* Check for "length" property on objects */
-                if (strcmp(node->as.obj_access.key, "length") == 0) {
-                    int count = obj.as.object->count;
-                    val_free(&obj);
-                    return val_number(count);
-                }
-                if (table_get(obj.as.object, node->as.obj_access.key, &v)) {
-                    Value result = val_copy(v);
-                    val_free(&obj);
-                    return result;
-                }
-            } else if (node->as.obj_access.key_expr) {
-                Value key = eval_node(it, node->as.obj_access.key_expr);
-                if (key.type == VAL_STRING) {
-                    if (table_get(obj.as.object, key.as.string.str, &v)) {
-                        Value result = val_copy(v);
-                        val_free(&obj); val_free(&key);
-                        return result;
-                    }
-                }
-                val_free(&key);
-            }
-            val_free(&obj);
-            return val_null();
+        if (node->as.obj_access.key && !node->as.obj_access.is_bracket) {
+            return interp_get_field(it, obj, node->as.obj_access.key, &node->as.obj_access.cache);
         }
-        /* .length on string/array */
-        if (node->as.obj_access.key && strcmp(node->as.obj_access.key, "length") == 0) {
-            if (obj.type == VAL_STRING) {
-                int len = obj.as.string.len;
-                val_free(&obj);
-                return val_number(len);
-            }
-            if (obj.type == VAL_ARRAY) {
-                int cnt = obj.as.array.count;
-                val_free(&obj);
-                return val_number(cnt);
-            }
+        if (IS_OBJECT(obj) && node->as.obj_access.key_expr) {
+            Value key = eval_node(it, node->as.obj_access.key_expr);
+            if (IS_STRING(key)) return interp_index(it, obj, key);
+            val_free(&key);
         }
         val_free(&obj);
         return val_null();
     }
 
-    case NODE_FUNC_CALL: {
-        char *name = node->as.func_call.name;
+    case NODE_FUNC_CALL:
+    case NODE_METHOD_CALL: {
+        const char *name = node->as.func_call.name;
         int argc = node->as.func_call.arg_count;
-
-        /* Evaluate arguments */
-        Value *args = NULL;
+        int invoke = node->type == NODE_METHOD_CALL;
+
+        /* Receiver-mutating builtins (push, pop, delete) get the caller's
+         * storage for their first argument. The remaining arguments are
+         * evaluated first so the slot pointer stays valid. */
+        CallCache *cc = &node->as.func_call.cache;
+        Value *recv = NULL;
+        BuiltinFn mut_fn = argc == 0 ? NULL
+                         : invoke ? interp_method_mutator(it, name, cc)
+                                  : interp_site_mutator(it, name, cc);
+        int mutates = mut_fn != NULL;
+
+        /* Evaluate arguments; small argument lists live on the C stack */
+        Value argbuf[MAX_STACK_ARGS];
+        Value *args = argbuf;
         if (argc > 0) {
-            args = malloc(sizeof(Value) * (size_t)argc);
-            for (int i = 0; i < argc; i++) {
+            if (argc > MAX_STACK_ARGS) args = malloc(sizeof(Value) * (size_t)argc);
+            for (int i = mutates ? 1 : 0; i < argc; i++) {
                 args[i] = eval_node(it, node->as.func_call.args[i]);
             }
-        }
-
-        /* For method calls (__method_*), check class methods first */
-        if (strncmp(name, "__method_", 9) == 0 && argc > 0 && args[0].type == VAL_OBJECT) {
-            Value class_name_val;
-            if (table_get(args[0].as.object, "__class__", &class_name_val) && class_name_val.type == VAL_STRING) {
-                Value class_val;
-                if (table_get(&it->classes, class_name_val.as.string.str, &class_val) && class_val.type == VAL_OBJECT) {
-                    const char *method_name = name + 9;
-                    Value method_val;
-                    if (table_get(class_val.as.object, method_name, &method_val) && method_val.type == VAL_FUNCTION) {
-                        Value *this_save = it->this_obj;
-                        it->this_obj = &args[0];
-                        Value result = call_function(it, method_val.as.func, args + 1, argc - 1, node->line);
-                        it->this_obj = this_save;
-                        for (int i = 0; i < argc; i++) val_free(&args[i]);
-                        free(args);
-                        return result;
-                    }
-                }
-            }
-        }
-
-        /* Special handling for map/filter/reduce.
-         * Supports both orderings:
-         *   map(arr, fn)       -- arr first
-         *   map("fn_name", arr) -- fn name first (Python API)
-         */
-        if (strcmp(name, "map") == 0 && argc >= 2) {
-            Value arr, fn_ref;
-            if (args[0].type == VAL_ARRAY) { arr = args[0]; fn_ref = args[1]; }
-            else { arr = args[1]; fn_ref = args[0]; }
-
-            FuncDef *fndef = NULL;
-            if (fn_ref.type == VAL_FUNCTION) {
-                fndef = fn_ref.as.func;
-            } else if (fn_ref.type == VAL_STRING) {
-                Value fn_lookup;
-                if (table_get(&it->functions, fn_ref.as.string.str, &fn_lookup) && fn_lookup.type == VAL_FUNCTION)
-                    fndef = fn_lookup.as.func;
-            }
-            if (arr.type == VAL_ARRAY && fndef) {
-                Value result = val_array(arr.as.array.count);
-                for (int i = 0; i < arr.as.array.count; i++) {
-                    Value item = val_copy(arr.as.array.items[i]);
-                    Value mapped = call_function(it, fndef, &item, 1, node->line);
-                    val_array_push(&result, mapped);
-                    val_free(&item);
-                }
-                for (int i = 0; i < argc; i++) val_free(&args[i]);
-                free(args);
-                return result;
-            }
-        }
-        if (strcmp(name, "filter") == 0 && argc >= 2) {
-            Value arr, fn_ref;
-            if (args[0].type == VAL_ARRAY) { arr = args[0]; fn_ref = args[1]; }
-            else { arr = args[1]; fn_ref = args[0]; }
-
-            FuncDef *fndef = NULL;
-            if (fn_ref.type == VAL_FUNCTION) fndef = fn_ref.as.func;
-            else if (fn_ref.type == VAL_STRING) {
-                Value fn_lookup;
-                if (table_get(&it->functions, fn_ref.as.string.str, &fn_lookup) && fn_lookup.type == VAL_FUNCTION)
-                    fndef = fn_lookup.as.func;
-            }
-            if (arr.type == VAL_ARRAY && fndef) {
-                Value result = val_array(arr.as.array.count);
-                for (int i = 0; i < arr.as.array.count; i++) {
-                    Value item = val_copy(arr.as.array.items[i]);
-                    Value pred = call_function(it, fndef, &item, 1, node->line);
-                    if (val_is_truthy(pred)) {
-                        val_array_push(&result, val_copy(arr.as.array.items[i]));
-                    }
-                    val_free(&item); val_free(&pred);
-                }
-                for (int i = 0; i < argc; i++) val_free(&args[i]);
-                free(args);
-                return result;
-            }
-        }
-        if (strcmp(name, "reduce") == 0 && argc >= 3) {
-            /* reduce("fn", arr, init) or reduce(arr, fn, init) */
-            Value arr, fn_ref, acc;
-            if (args[0].type == VAL_ARRAY) { arr = args[0]; fn_ref = args[1]; acc = val_copy(args[2]); }
-            else { fn_ref = args[0]; arr = args[1]; acc = val_copy(args[2]); }
-
-            FuncDef *fndef = NULL;
-            if (fn_ref.type == VAL_FUNCTION) fndef = fn_ref.as.func;
-            else if (fn_ref.type == VAL_STRING) {
-                Value fn_lookup;
-                if (table_get(&it->functions, fn_ref.as.string.str, &fn_lookup) && fn_lookup.type == VAL_FUNCTION)
-                    fndef = fn_lookup.as.func;
-            }
-            if (arr.type == VAL_ARRAY && fndef) {
-                for (int i = 0; i < arr.as.array.count; i++) {
-                    Value call_args[2];
-                    call_args[0] = acc;
-                    call_args[1] = val_copy(arr.as.array.items[i]);
-                    acc = call_function(it, fndef, call_args, 2, node->line);
-                    val_free(&call_args[0]); val_free(&call_args[1]);
-                }
-                for (int i = 0; i < argc; i++) val_free(&args[i]);
-                free(args);
-                return acc;
+            if (mutates) {
+                recv = eval_lvalue(it, node->as.func_call.args[0]);
+                args[0] = recv ? val_copy(*recv) : eval_node(it, node->as.func_call.args[0]);
             }
-            val_free(&acc);
         }
 
-        /* Check builtins */
-        Value bfn;
-        if (table_get(&it->builtins, name, &bfn) && bfn.type == VAL_BUILTIN) {
-            Value result = bfn.as.builtin(args, argc);
-            for (int i = 0; i < argc; i++) val_free(&args[i]);
-            free(args);
-            return result;
-        }
-
-        /* Check user-defined functions */
-        Value fn_val;
-        if (table_get(&it->functions, name, &fn_val) && fn_val.type == VAL_FUNCTION) {
-            Value result = call_function(it, fn_val.as.func, args, argc, node->line);
-            for (int i = 0; i < argc; i++) val_free(&args[i]);
-            free(args);
-            return result;
-        }
-
-        /* Check if it's a variable holding a function */
-        Value var_val;
-        if (interp_get_var(it, name, &var_val)) {
-            if (var_val.type == VAL_FUNCTION) {
-                Value result = call_function(it, var_val.as.func, args, argc, node->line);
-                for (int i = 0; i < argc; i++) val_free(&args[i]);
-                free(args);
-                return result;
-            }
-            if (var_val.type == VAL_BUILTIN) {
-                Value result = var_val.as.builtin(args, argc);
-                for (int i = 0; i < argc; i++) val_free(&args[i]);
-                free(args);
-                return result;
-            }
+        Value result;
+        if (recv && val_type(*recv) == val_type(args[0]) &&
+            !(IS_OBJECT(args[0]) && AS_OBJECT(args[0])->klass)) {
+            /* Drop our reference so the slot can own its buffer */
+            val_free(&args[0]);
+            result = interp_call_mutator(it, mut_fn, recv, args, argc, node->line);
+        } else if (invoke) {
+            result = interp_invoke(it, name, cc, args, argc, node->line);
+        } else {
+            result = interp_call(it, name, cc, args, argc, node->line);
         }
-
-        /* Not found */
-        for (int i = 0; i < argc; i++) val_free(&args[i]);
-        free(args);
-        runtime_error(it, node->line, "undefined function '%s'", name);
-        return val_null();
+        if (args != argbuf) free(args);
+        return result;
     }
 
     case NODE_NEW: {
-        char *class_name = node->as.new_inst.class_name;
-        Value class_val;
-        if (!table_get(&it->classes, class_name, &class_val) || class_val.type != VAL_OBJECT) {
-            runtime_error(it, node->line, "undefined class '%s'", class_name);
-        }
-
-        /* Create instance object */
-        Value instance = val_object();
-        table_set(instance.as.object, "__class__", val_string(class_name, (int)strlen(class_name)));
-
-        /* Evaluate constructor args */
         int argc = node->as.new_inst.arg_count;
-        Value *args = NULL;
+        Value argbuf[MAX_STACK_ARGS];
+        Value *args = argbuf;
         if (argc > 0) {
-            args = malloc(sizeof(Value) * (size_t)argc);
+            if (argc > MAX_STACK_ARGS) args = malloc(sizeof(Value) * (size_t)argc);
             for (int i = 0; i < argc; i++) {
                 args[i] = eval_node(it, node->as.new_inst.args[i]);
             }
         }
-
-        /* Call constructor if exists (try "constructor" then "init") */
-        Value ctor;
-        if ((table_get(class_val.as.object, "constructor", &ctor) && ctor.type == VAL_FUNCTION) ||
-            (table_get(class_val.as.object, "init", &ctor) && ctor.type == VAL_FUNCTION)) {
-            Value *this_save = it->this_obj;
-            it->this_obj = &instance;
-            call_function(it, ctor.as.func, args, argc, node->line);
-            it->this_obj = this_save;
-        }
-
-        for (int i = 0; i < argc; i++) val_free(&args[i]);
-        free(args);
+        Value instance = interp_new_instance(it, node->as.new_inst.class_name, args, argc, node->line);
+        if (args != argbuf) free(args);
         return instance;
     }
 
@@ -600,14 +1557,198 @@ static Value eval_node(Interpreter *it, ASTNode *node) {
     return val_null();
 }
 
+/* ---- obj.key op= v, obj[key] op= v ---- */
+
+/* One obj.key, obj[key] or arr[i] on the way down to the root of an
+ * assignment target, with its key once that has been evaluated */
+typedef struct LvalueStep {
+    ASTNode *node;
+    Value key;                /* null for obj.key */
+    struct LvalueStep *next;  /* the step this one is the base of */
+} LvalueStep;
+
+/* Base expression of a step, and its key expression if it has one;
+ * NULL when node is the root */
+static ASTNode *step_base(ASTNode *node, ASTNode **key) {
+    *key = NULL;
+    if (node->type == NODE_ARRAY_INDEX) {
+        *key = node->as.array_index.index;
+        return node->as.array_index.array_expr;
+    }
+    if (node->type != NODE_OBJ_ACCESS) return NULL;
+    if (node->as.obj_access.is_bracket || !node->as.obj_access.key) *key = node->as.obj_access.key_expr;
+    return node->as.obj_access.obj;
+}
+
+/* Follow evaluated steps from *v to the slot they name now, detaching
+ * arrays on the way like index_lvalue; NULL when they lead nowhere */
+static Value *steps_resolve(Interpreter *it, Value *v, LvalueStep *step) {
+    for (; v && step; step = step->next) {
+        Value key = step->key;
+        if (IS_RANGE(*v) && IS_NUMBER(key)) val_materialize(v);
+        if (IS_ARRAY(*v) && IS_NUMBER(key)) {
+            int i = (int)AS_NUMBER(key);
+            if (i < 0) i += AS_ARRAY(*v)->count;
+            if (i < 0 || i >= AS_ARRAY(*v)->count) return NULL;
+            val_array_detach(v);
+            v = &AS_ARRAY(*v)->items[i];
+        } else if (IS_OBJECT(*v) && IS_STRING(key)) {
+            v = table_get_ref(AS_OBJECT(*v), AS_STRING(key)->chars);
+        } else if (IS_OBJECT(*v) && IS_NULL(key) && step->node->type == NODE_OBJ_ACCESS &&
+                   step->node->as.obj_access.key) {
+            ShapeCache scratch;
+            v = table_iref_cached(AS_OBJECT(*v), step->node->as.obj_access.key,
+                                  site_cache(it, &step->node->as.obj_access.cache, &scratch));
+        } else {
+            v = NULL;
+        }
+    }
+    return v;
+}
+
+/* Evaluate the target left to right, each part once, then the right-hand
+ * side; only then find the slot, so nothing the right-hand side does can
+ * leave a dangling pointer. Recurses down the target to its root, keeping
+ * one step per level in `outer`, innermost first */
+static void obj_compound_assign(Interpreter *it, ASTNode *node, ASTNode *target, LvalueStep *outer) {
+    int dotted = node->as.obj_comp_assign.key && !node->as.obj_comp_assign.is_bracket;
+    ASTNode *key_expr, *inner = dotted ? NULL : step_base(target, &key_expr);
+    if (inner) {
+        LvalueStep step = { target, val_null(), outer };
+        obj_compound_assign(it, node, inner, &step);
+        return;
+    }
+
+    Value obj = val_null(), temp = val_null(), idx = val_null();
+    if (dotted) {
+        obj = eval_node(it, target);
+    } else {
+        if (target->type != NODE_VARIABLE && target->type != NODE_THIS) temp = eval_node(it, target);
+        for (LvalueStep *s = outer; s && !it->throwing; s = s->next) {
+            step_base(s->node, &key_expr);
+            if (key_expr) s->key = eval_node(it, key_expr);
+        }
+        if (!it->throwing && node->as.obj_comp_assign.key_expr) {
+            idx = eval_node(it, node->as.obj_comp_assign.key_expr);
+        }
+    }
+    Value rhs = it->throwing ? val_null() : eval_node(it, node->as.obj_comp_assign.value);
+
+    /* Read current value (borrowed from its slot) */
+    Value *base = NULL;
+    if (!dotted && !it->throwing) {
+        if (target->type == NODE_THIS) base = it->this_obj;
+        else if (target->type != NODE_VARIABLE) base = &temp;
+        else if (target->slot >= 0) base = interp_local(it, target->depth, target->slot);
+        else base = interp_get_var_ref(it, target->as.var_name);
+        base = steps_resolve(it, base, outer);
+    }
+    Value current = val_null();
+    Value *elem = NULL;
+    double *num = NULL;
+    if (base && IS_RANGE(*base) && IS_NUMBER(idx)) val_materialize(base);
+    if (base && IS_ARRAY(*base) && IS_NUMBER(idx)) {
+        /* arr[i] += x: operate on the element slot of the caller's array */
+        int i = (int)AS_NUMBER(idx);
+        if (i < 0) i += AS_ARRAY(*base)->count;
+        if (i >= 0 && i < AS_ARRAY(*base)->count) {
+            val_array_detach(base);
+            elem = &AS_ARRAY(*base)->items[i];
+            current = *elem;
+        }
+    } else if (base && IS_F64ARRAY(*base) && IS_NUMBER(idx)) {
+        int i = (int)AS_NUMBER(idx);
+        if (i < 0) i += AS_F64(*base)->count;
+        if (i >= 0 && i < AS_F64(*base)->count) {
+            val_f64_detach(base);
+            num = &AS_F64(*base)->data[i];
+            current = val_number(*num);
+        }
+    } else if (base && IS_OBJECT(*base) && IS_STRING(idx)) {
+        obj = val_copy(*base);
+        Value v;
+        if (table_get(AS_OBJECT(obj), AS_STRING(idx)->chars, &v)) current = v;
+    } else if (dotted && IS_OBJECT(obj)) {
+        ShapeCache scratch;
+        Value *v = table_iref_cached(AS_OBJECT(obj), node->as.obj_comp_assign.key,
+                                     site_cache(it, &node->as.obj_comp_assign.cache, &scratch));
+        if (v) current = *v;
+    }
+
+    Value result;
+    if (!it->throwing &&
+        compound_value(it, node->as.obj_comp_assign.op, current, rhs, &result, node->line)) {
+        /* Write back */
+        if (elem) {
+            val_free(elem);
+            *elem = result;
+        } else if (num) {
+            if (IS_NUMBER(result)) *num = AS_NUMBER(result);
+            else {
+                val_free(&result);
+                runtime_error(it, node->line, "Float64Array elements must be numbers");
+            }
+        } else if (dotted && IS_OBJECT(obj)) {
+            ShapeCache scratch;
+            table_iset_cached(AS_OBJECT(obj), node->as.obj_comp_assign.key, result,
+                              site_cache(it, &node->as.obj_comp_assign.cache, &scratch));
+        } else if (IS_OBJECT(obj)) {
+            table_set(AS_OBJECT(obj), AS_STRING(idx)->chars, result);
+        } else {
+            val_free(&result);
+        }
+    }
+    val_free(&rhs);
+    val_free(&idx);
+    val_free(&obj);
+    val_free(&temp);
+    for (LvalueStep *s = outer; s; s = s->next) val_free(&s->key);
+}
+
 /* ---- statement execution ---- */
 
+/* manifest call, with no try of its own frame to leave: a call to a dream
+ * that cannot see this frame's bindings (interp_frame_reusable) is set up
+ * as it->tail_fn for call_function to run in place of this frame, so tail
+ * recursion takes no C stack. Anything else (builtins, receiver-mutating
+ * calls, dreams reading the caller's names) is called here as usual. */
+static Value tail_call(Interpreter *it, ASTNode *call) {
+    const char *name = call->as.func_call.name;
+    CallCache *cc = &call->as.func_call.cache;
+    int argc = call->as.func_call.arg_count;
+    if (argc > 0 && interp_site_mutator(it, name, cc)) return eval_node(it, call);
+
+    Value argbuf[MAX_STACK_ARGS];
+    Value *args = argc > MAX_STACK_ARGS ? malloc(sizeof(Value) * (size_t)argc) : argbuf;
+    for (int i = 0; i < argc; i++) args[i] = eval_node(it, call->as.func_call.args[i]);
+
+    FuncDef *fn = it->throwing ? NULL : interp_call_target(it, name, cc, argc);
+    Value result = val_null();
+    if (fn && interp_frame_reusable(it, it->frame_scope, fn, argc)) {
+        if (argc > it->tail_cap) {
+            it->tail_cap = argc;
+            it->tail_args = realloc(it->tail_args, sizeof(Value) * (size_t)argc);
+        }
+        for (int i = 0; i < argc; i++) it->tail_args[i] = args[i];
+        it->tail_argc = argc;
+        it->tail_fn = fn;
+    } else {
+        result = interp_call(it, name, cc, args, argc, call->line);
+    }
+    if (args != argbuf) free(args);
+    return result;
+}
+
 static void exec_stmt(Interpreter *it, ASTNode *node) {
     if (!node) return;
 
     switch (node->type) {
     case NODE_PRINT: {
         Value v = eval_node(it, node->as.print_expr);
+        if (it->throwing) {
+            val_free(&v);
+            break;
+        }
         char *s = val_to_string(v);
         printf("%s\n", s);
         free(s);
@@ -617,6 +1758,16 @@ static void exec_stmt(Interpreter *it, ASTNode *node) {
 
     case NODE_ASSIGN: {
         Value v = eval_node(it, node->as.assign.value);
+        if (it->throwing) {
+            val_free(&v);
+            break;
+        }
+        if (node->slot >= 0) {
+            Value *slot = interp_local(it, node->depth, node->slot);
+            val_free(slot);
+            *slot = v;
+            break;
+        }
         /* Check if this is a 'let' (define) or reassignment */
         /* We use interp_set_var which finds existing or creates in current scope */
         interp_set_var(it, node->as.assign.name, v);
@@ -624,150 +1775,86 @@ static void exec_stmt(Interpreter *it, ASTNode *node) {
     }
 
     case NODE_COMPOUND_ASSIGN: {
-        Value current;
-        if (!interp_get_var(it, node->as.comp_assign.name, &current)) {
-            runtime_error(it, node->line, "undefined variable '%s'", node->as.comp_assign.name);
-        }
+        /* Evaluate the rhs first so 'current' cannot be freed underneath us */
         Value rhs = eval_node(it, node->as.comp_assign.value);
-
-        Value result;
-        if (current.type == VAL_NUMBER && rhs.type == VAL_NUMBER) {
-            switch (node->as.comp_assign.op) {
-                case TOKEN_PLUS_ASSIGN:     result = val_number(current.as.number + rhs.as.number); break;
-                case TOKEN_MINUS_ASSIGN:    result = val_number(current.as.number - rhs.as.number); break;
-                case TOKEN_MULTIPLY_ASSIGN: result = val_number(current.as.number * rhs.as.number); break;
-                case TOKEN_DIVIDE_ASSIGN:
-                    if (rhs.as.number == 0) runtime_error(it, node->line, "division by zero");
-                    if (current.as.number == floor(current.as.number) &&
-                        rhs.as.number == floor(rhs.as.number)) {
-                        result = val_number((double)((long)current.as.number / (long)rhs.as.number));
-                    } else {
-                        result = val_number(current.as.number / rhs.as.number);
-                    }
-                    break;
-                default:
-                    result = val_null();
-            }
-        } else if (node->as.comp_assign.op == TOKEN_PLUS_ASSIGN &&
-                   (current.type == VAL_STRING || rhs.type == VAL_STRING)) {
-            char *ls = val_to_string(current);
-            char *rs = val_to_string(rhs);
-            int llen = (int)strlen(ls);
-            int rlen = (int)strlen(rs);
-            char *out = malloc((size_t)(llen + rlen + 1));
-            memcpy(out, ls, (size_t)llen);
-            memcpy(out + llen, rs, (size_t)rlen);
-            out[llen + rlen] = '\0';
-            free(ls); free(rs);
-            result = val_string_take(out, llen + rlen);
-        } else {
-            runtime_error(it, node->line, "unsupported types for compound assignment");
-            result = val_null();
+        if (node->slot >= 0) {
+            interp_compound_slot(it, interp_local(it, node->depth, node->slot),
+                                 node->as.comp_assign.op, rhs, node->line);
+            break;
         }
-
-        val_free(&rhs);
-        interp_set_var(it, node->as.comp_assign.name, result);
+        interp_compound_assign(it, node->as.comp_assign.name, node->as.comp_assign.op, rhs, node->line);
         break;
     }
 
-    case NODE_OBJ_COMPOUND_ASSIGN: {
-        /* Read current value, apply compound op, write back */
-        Value obj = eval_node(it, node->as.obj_comp_assign.obj);
-        Value rhs = eval_node(it, node->as.obj_comp_assign.value);
+    case NODE_OBJ_COMPOUND_ASSIGN:
+        obj_compound_assign(it, node, node->as.obj_comp_assign.obj, NULL);
+        break;
 
-        /* Read current property value */
-        Value current = val_null();
-        if (obj.type == VAL_OBJECT) {
-            if (node->as.obj_comp_assign.key && !node->as.obj_comp_assign.is_bracket) {
-                Value v;
-                if (table_get(obj.as.object, node->as.obj_comp_assign.key, &v)) {
-                    current = val_copy(v);
-                }
-            } else if (node->as.obj_comp_assign.key_expr) {
-                Value key = eval_node(it, node->as.obj_comp_assign.key_expr);
-                if (key.type == VAL_STRING) {
-                    Value v;
-                    if (table_get(obj.as.object, key.as.string.str, &v)) {
-                        current = val_copy(v);
-                    }
-                }
-                val_free(&key);
-            }
+    case NODE_OBJ_ASSIGN: {
+        Value val = eval_node(it, node->as.obj_assign.value);
+        if (it->throwing) {
+            val_free(&val);
+            break;
         }
 
-        /* Compute new value */
-        Value result = val_null();
-        if (current.type == VAL_NUMBER && rhs.type == VAL_NUMBER) {
-            double l = current.as.number, r = rhs.as.number;
-            switch (node->as.obj_comp_assign.op) {
-                case TOKEN_PLUS_ASSIGN:     result = val_number(l + r); break;
-                case TOKEN_MINUS_ASSIGN:    result = val_number(l - r); break;
-                case TOKEN_MULTIPLY_ASSIGN: result = val_number(l * r); break;
-                case TOKEN_DIVIDE_ASSIGN:
-                    if (r == 0) runtime_error(it, node->line, "division by zero");
-                    if (l == floor(l) && r == floor(r)) {
-                        result = val_number((double)((long)l / (long)r));
-                    } else {
-                        result = val_number(l / r);
-                    }
+        /* arr[i] = val writes through to the array's storage */
+        if (node->as.obj_assign.is_bracket && node->as.obj_assign.key_expr) {
+            Value idx = eval_node(it, node->as.obj_assign.key_expr);
+            if (it->throwing) {
+                val_free(&idx);
+                val_free(&val);
+                break;
+            }
+            Value *base = IS_NUMBER(idx) ? eval_lvalue(it, node->as.obj_assign.obj) : NULL;
+            if (base) val_materialize(base);
+            if (base && IS_F64ARRAY(*base)) {
+                if (!IS_NUMBER(val)) {
+                    val_free(&val);
+                    runtime_error(it, node->line, "Float64Array elements must be numbers");
                     break;
-                default: result = val_null(); break;
+                }
+                int i = (int)AS_NUMBER(idx);
+                if (i < 0) i += AS_F64(*base)->count;
+                if (i >= 0 && i < AS_F64(*base)->count) {
+                    val_f64_detach(base);
+                    AS_F64(*base)->data[i] = AS_NUMBER(val);
+                }
+                break;
             }
-        } else if (node->as.obj_comp_assign.op == TOKEN_PLUS_ASSIGN &&
-                   (current.type == VAL_STRING || rhs.type == VAL_STRING)) {
-            char *ls = val_to_string(current);
-            char *rs = val_to_string(rhs);
-            int llen = (int)strlen(ls);
-            int rlen = (int)strlen(rs);
-            char *out = malloc((size_t)(llen + rlen + 1));
-            memcpy(out, ls, (size_t)llen);
-            memcpy(out + llen, rs, (size_t)rlen);
-            out[llen + rlen] = '\0';
-            free(ls); free(rs);
-            result = val_string_take(out, llen + rlen);
-        } else {
-            runtime_error(it, node->line, "unsupported types for compound assignment");
-        }
-        val_free(&current);
-        val_free(&rhs);
-
-        /* Write back */
-        if (obj.type == VAL_OBJECT) {
-            if (node->as.obj_comp_assign.key && !node->as.obj_comp_assign.is_bracket) {
-                table_set(obj.as.object, node->as.obj_comp_assign.key, result);
-            } else if (node->as.obj_comp_assign.key_expr) {
-                Value key = eval_node(it, node->as.obj_comp_assign.key_expr);
-                if (key.type == VAL_STRING) {
-                    table_set(obj.as.object, key.as.string.str, result);
+            if (base && IS_ARRAY(*base)) {
+                int i = (int)AS_NUMBER(idx);
+                if (i < 0) i += AS_ARRAY(*base)->count;
+                if (i >= 0 && i < AS_ARRAY(*base)->count) {
+                    val_array_set(base, i, val);
+                    val = val_null();
                 }
-                val_free(&key);
+                val_free(&val);
+                val_free(&idx);
+                break;
             }
+            val_free(&idx);
         }
-        val_free(&obj);
-        break;
-    }
 
-    case NODE_OBJ_ASSIGN: {
         Value obj = eval_node(it, node->as.obj_assign.obj);
-        Value val = eval_node(it, node->as.obj_assign.value);
 
-        if (obj.type == VAL_OBJECT) {
+        if (IS_OBJECT(obj)) {
             if (node->as.obj_assign.is_bracket && node->as.obj_assign.key_expr) {
                 Value key = eval_node(it, node->as.obj_assign.key_expr);
-                if (key.type == VAL_STRING) {
-                    table_set(obj.as.object, key.as.string.str, val);
+                if (IS_STRING(key)) {
+                    table_set(AS_OBJECT(obj), AS_STRING(key)->chars, val);
                 }
                 val_free(&key);
             } else if (node->as.obj_assign.key) {
-                table_set(obj.as.object, node->as.obj_assign.key, val);
+                ShapeCache scratch;
+                table_iset_cached(AS_OBJECT(obj), node->as.obj_assign.key, val,
+                                  site_cache(it, &node->as.obj_assign.cache, &scratch));
             }
-        } else if (obj.type == VAL_ARRAY && node->as.obj_assign.is_bracket && node->as.obj_assign.key_expr) {
+        } else if (IS_ARRAY(obj) && node->as.obj_assign.is_bracket && node->as.obj_assign.key_expr) {
             Value idx = eval_node(it, node->as.obj_assign.key_expr);
-            if (idx.type == VAL_NUMBER) {
-                int i = (int)idx.as.number;
-                if (i >= 0 && i < obj.as.array.count) {
-                    val_free(&obj.as.array.items[i]);
-                    obj.as.array.items[i] = val;
+            if (IS_NUMBER(idx)) {
+                int i = (int)AS_NUMBER(idx);
+                if (i >= 0 && i < AS_ARRAY(obj)->count) {
+                    val_array_set(&obj, i, val);
                     val = val_null(); /* don't double-free */
                 }
             }
@@ -784,6 +1871,7 @@ static void exec_stmt(Interpreter *it, ASTNode *node) {
         Value cond = eval_node(it, node->as.if_stmt.condition);
         int truthy = val_is_truthy(cond);
         val_free(&cond);
+        if (it->throwing) break;
 
         if (truthy) {
             push_scope(it);
@@ -802,14 +1890,14 @@ static void exec_stmt(Interpreter *it, ASTNode *node) {
             Value cond = eval_node(it, node->as.while_loop.condition);
             int truthy = val_is_truthy(cond);
             val_free(&cond);
-            if (!truthy) break;
+            if (!truthy || it->throwing) break;
 
             push_scope(it);
             exec_stmts(it, node->as.while_loop.body, node->as.while_loop.body_count);
             pop_scope(it);
 
             if (it->break_flag) { it->break_flag = 0; break; }
-            if (it->return_flag) break;
+            if (it->return_flag || it->throwing) break;
             if (it->continue_flag) { it->continue_flag = 0; }
         }
         break;
@@ -817,38 +1905,76 @@ static void exec_stmt(Interpreter *it, ASTNode *node) {
 
     case NODE_FOR: {
         Value iterable = eval_node(it, node->as.for_loop.iterable);
-        if (iterable.type == VAL_ARRAY) {
-            for (int i = 0; i < iterable.as.array.count; i++) {
+        if (IS_RANGE(iterable)) {
+            /* Counts through the range; no array is built */
+            RangeObj *r = AS_RANGE(iterable);
+            for (int i = 0; i < r->count; i++) {
+                push_scope(it);
+                interp_bind_local(it, node->as.for_loop.var, val_range_at(r, i));
+                exec_stmts(it, node->as.for_loop.body, node->as.for_loop.body_count);
+                pop_scope(it);
+
+                if (it->break_flag) { it->break_flag = 0; break; }
+                if (it->return_flag || it->throwing) break;
+                if (it->continue_flag) { it->continue_flag = 0; }
+            }
+        } else if (IS_F64ARRAY(iterable)) {
+            F64Array *a = AS_F64(iterable);
+            for (int i = 0; i < a->count; i++) {
+                push_scope(it);
+                interp_bind_local(it, node->as.for_loop.var, val_number(a->data[i]));
+                exec_stmts(it, node->as.for_loop.body, node->as.for_loop.body_count);
+                pop_scope(it);
+
+                if (it->break_flag) { it->break_flag = 0; break; }
+                if (it->return_flag || it->throwing) break;
+                if (it->continue_flag) { it->continue_flag = 0; }
+            }
+        } else if (IS_FILE(iterable)) {
+            /* One line (or NDJSON record) per iteration, read as the loop goes */
+            Value line;
+            while (stream_next(AS_FILE(iterable), &line)) {
+                push_scope(it);
+                interp_bind_local(it, node->as.for_loop.var, line);
+                exec_stmts(it, node->as.for_loop.body, node->as.for_loop.body_count);
+                pop_scope(it);
+
+                if (it->break_flag) { it->break_flag = 0; break; }
+                if (it->return_flag || it->throwing) break;
+                if (it->continue_flag) { it->continue_flag = 0; }
+            }
+        } else if (IS_ARRAY(iterable)) {
+            for (int i = 0; i < AS_ARRAY(iterable)->count; i++) {
                 push_scope(it);
-                interp_def_var(it, node->as.for_loop.var, val_copy(iterable.as.array.items[i]));
+                interp_bind_local(it, node->as.for_loop.var, val_copy(AS_ARRAY(iterable)->items[i]));
                 exec_stmts(it, node->as.for_loop.body, node->as.for_loop.body_count);
                 pop_scope(it);
 
                 if (it->break_flag) { it->break_flag = 0; break; }
-                if (it->return_flag) break;
+                if (it->return_flag || it->throwing) break;
                 if (it->continue_flag) { it->continue_flag = 0; }
             }
-        } else if (iterable.type == VAL_STRING) {
-            for (int i = 0; i < iterable.as.string.len; i++) {
+        } else if (IS_STRING(iterable)) {
+            for (int i = 0; i < AS_STRING(iterable)->len; i++) {
                 push_scope(it);
-                interp_def_var(it, node->as.for_loop.var, val_string(iterable.as.string.str + i, 1));
+                interp_bind_local(it, node->as.for_loop.var, val_string(AS_STRING(iterable)->chars + i, 1));
                 exec_stmts(it, node->as.for_loop.body, node->as.for_loop.body_count);
                 pop_scope(it);
 
                 if (it->break_flag) { it->break_flag = 0; break; }
-                if (it->return_flag) break;
+                if (it->return_flag || it->throwing) break;
                 if (it->continue_flag) { it->continue_flag = 0; }
             }
-        } else if (iterable.type == VAL_OBJECT) {
-            Value keysArr = table_keys(iterable.as.object);
-            for (int i = 0; i < keysArr.as.array.count; i++) {
+        } else if (IS_OBJECT(iterable)) {
+            Value keysArr = table_keys(AS_OBJECT(iterable));
+            for (int i = 0; i < AS_ARRAY(keysArr)->count; i++) {
                 push_scope(it);
-                interp_def_var(it, node->as.for_loop.var, val_copy(keysArr.as.array.items[i]));
+                interp_bind_local(it, node->as.for_loop.var, val_copy(AS_ARRAY(keysArr)->items[i]));
                 exec_stmts(it, node->as.for_loop.body, node->as.for_loop.body_count);
                 pop_scope(it);
 
                 if (it->break_flag) { it->break_flag = 0; break; }
-                if (it->return_flag) break;
+                if (it->return_flag || it->throwing) break;
                 if (it->continue_flag) { it->continue_flag = 0; }
             }
             val_free(&keysArr);
@@ -857,23 +1983,24 @@ static void exec_stmt(Interpreter *it, ASTNode *node) {
         break;
     }
 
-    case NODE_FUNC_DEF: {
-        FuncDef *fn = malloc(sizeof(FuncDef));
-        fn->name = strdup(node->as.func_def.name);
-        fn->params = node->as.func_def.params;
-        fn->param_count = node->as.func_def.param_count;
-        fn->body = node->as.func_def.body;
-        fn->body_count = node->as.func_def.body_count;
-        table_set(&it->functions, fn->name, val_func(fn));
+    case NODE_FUNC_DEF:
+        interp_define_function(it, node);
         break;
-    }
 
     case NODE_RETURN: {
-        if (node->as.return_val) {
-            it->return_value = eval_node(it, node->as.return_val);
+        ASTNode *val = node->as.return_val;
+        if (val && val->type == NODE_FUNC_CALL && !it->use_vm && it->call_depth > 0 &&
+            it->try_depth == it->frame_try) {
+            it->return_value = tail_call(it, val);
+        } else if (val) {
+            it->return_value = eval_node(it, val);
         } else {
             it->return_value = val_null();
         }
+        if (it->throwing) {
+            val_free(&it->return_value);
+            break;
+        }
         it->return_flag = 1;
         break;
     }
@@ -886,105 +2013,53 @@ static void exec_stmt(Interpreter *it, ASTNode *node) {
         it->continue_flag = 1;
         break;
 
-    case NODE_CLASS: {
-        Value class_obj = val_object();
-        for (int i = 0; i < node->as.class_def.method_count; i++) {
-            ASTNode *method = node->as.class_def.methods[i];
-            FuncDef *fn = malloc(sizeof(FuncDef));
-            fn->name = strdup(method->as.func_def.name);
-            fn->params = method->as.func_def.params;
-            fn->param_count = method->as.func_def.param_count;
-            fn->body = method->as.func_def.body;
-            fn->body_count = method->as.func_def.body_count;
-            table_set(class_obj.as.object, fn->name, val_func(fn));
-        }
-        table_set(&it->classes, node->as.class_def.name, class_obj);
+    case NODE_CLASS:
+        interp_define_class(it, node);
         break;
-    }
 
     case NODE_TRY_CATCH: {
-        if (it->try_depth >= MAX_TRY_DEPTH) {
-            runtime_error(it, node->line, "too many nested try blocks");
-        }
-
-        int saved_scope = it->scope_depth;
+        /* Nothing to save: a throw returns through every frame in between,
+         * each popping its own scopes and freeing its own values */
         it->try_depth++;
-        int caught = 0;
-
-        if (setjmp(it->try_stack[it->try_depth - 1]) == 0) {
-            /* Try block */
-            push_scope(it);
-            exec_stmts(it, node->as.try_catch.try_body, node->as.try_catch.try_count);
-            pop_scope(it);
+        push_scope(it);
+        exec_stmts(it, node->as.try_catch.try_body, node->as.try_catch.try_count);
+        pop_scope(it);
+        it->try_depth--;
+        if (!it->throwing) break;
+
+        /* Caught. The catch body runs outside this try, so a throw from it
+         * goes to the enclosing one. */
+        Value e = it->exception;
+        it->exception = val_null();
+        it->throwing = 0;
+        push_scope(it);
+        if (node->as.try_catch.catch_var) {
+            interp_bind_local(it, node->as.try_catch.catch_var, e);
         } else {
-            /* Exception caught -- unwind scopes back to saved level */
-            while (it->scope_depth > saved_scope) {
-                pop_scope(it);
-            }
-            caught = 1;
-            it->exception_active = 0;
-            it->return_flag = 0;
-            it->break_flag = 0;
-            it->continue_flag = 0;
-
-            /* Decrement try_depth BEFORE executing the catch body so that
-             * any exception thrown from within the catch block propagates
-             * to the enclosing try, not back to this same try (infinite loop). */
-            it->try_depth--;
-
-            push_scope(it);
-            if (node->as.try_catch.catch_var && it->exception_msg) {
-                int elen = (int)strlen(it->exception_msg);
-                interp_def_var(it, node->as.try_catch.catch_var,
-                               val_string(it->exception_msg, elen));
-            }
-            exec_stmts(it, node->as.try_catch.catch_body, node->as.try_catch.catch_count);
-            pop_scope(it);
-
-            free(it->exception_msg);
-            it->exception_msg = NULL;
+            val_free(&e);
         }
-        if (!caught) it->try_depth--;
-        (void)caught;
+        exec_stmts(it, node->as.try_catch.catch_body, node->as.try_catch.catch_count);
+        pop_scope(it);
         break;
     }
 
     case NODE_THROW: {
         Value v = eval_node(it, node->as.throw_val);
-        char *s = val_to_string(v);
-        val_free(&v);
-        throw_exception(it, s);
-        free(s); /* unreachable if longjmp fires */
+        throw_value(it, v);
         break;
     }
 
     case NODE_IMPORT: {
-        const char *path = node->as.import_path;
-
-        /* Check if already imported */
-        for (int i = 0; i < it->imported_count; i++) {
-            if (strcmp(it->imported[i], path) == 0) return;
-        }
-        if (it->imported_count >= MAX_IMPORTED) {
-            runtime_error(it, node->line, "too many imports");
-        }
-        it->imported[it->imported_count++] = strdup(path);
-
-        /* Read and execute file */
-        FILE *f = fopen(path, "r");
-        if (!f) {
-            runtime_error(it, node->line, "cannot open import file '%s'", path);
+        const char *key = module_key(it, node->as.import_path, node->line);
+        if (!key || table_ihas(&it->modules, key)) break;
+        if (it->lazy_imports) {
+            table_iset(&it->modules, key, val_number(MODULE_PENDING));
+            it->modules_pending++;
+            break;
         }
-        fseek(f, 0, SEEK_END);
-        long size = ftell(f);
-        fseek(f, 0, SEEK_SET);
-        char *src = malloc((size_t)size + 1);
-        size_t nr = fread(src, 1, (size_t)size, f);
-        src[nr] = '\0';
-        fclose(f);
-
-        interp_run(it, src);
-        free(src);
+        table_iset(&it->modules, key, val_number(MODULE_LOADED));
+        ASTNode *module = load_module(it, key, node->line);
+        if (module) run_program(it, module);
         break;
     }
 
@@ -999,8 +2074,14 @@ static void exec_stmt(Interpreter *it, ASTNode *node) {
 
 static void exec_stmts(Interpreter *it, ASTNode **stmts, int count) {
     for (int i = 0; i < count; i++) {
-        if (it->return_flag || it->break_flag || it->continue_flag) break;
-        exec_stmt(it, stmts[i]);
+        if (it->return_flag || it->break_flag || it->continue_flag || it->throwing) break;
+        if (it->profile && stmts[i]) {
+            profile_stmt_begin(it->profile, stmts[i]->line);
+            exec_stmt(it, stmts[i]);
+            profile_stmt_end(it->profile);
+        } else {
+            exec_stmt(it, stmts[i]);
+        }
     }
 }
 
@@ -1008,39 +2089,68 @@ static void exec_stmts(Interpreter *it, ASTNode **stmts, int count) {
 
 void interp_init(Interpreter *it) {
     memset(it, 0, sizeof(Interpreter));
+    it->scope_cap = 64;
+    it->scopes = calloc((size_t)it->scope_cap, sizeof(Scope));
+    MEM_ALLOC(MEM_SCOPE, sizeof(Scope) * (size_t)it->scope_cap);
     it->scope_depth = 0;
     table_init(&it->scopes[0].vars);
     table_init(&it->globals);
     table_init(&it->functions);
     table_init(&it->builtins);
+    for (int k = 0; k < METHOD_KINDS; k++) table_init(&it->methods[k]);
     table_init(&it->classes);
     it->this_obj = NULL;
     it->call_depth = 0;
-    it->imported_count = 0;
+    it->max_depth = -1;   /* the engine's default */
+    it->def_version = 1;  /* zeroed caches start out stale */
+    table_init(&it->modules);
     it->break_flag = 0;
     it->continue_flag = 0;
     it->return_flag = 0;
     it->return_value = val_null();
     it->try_depth = 0;
-    it->exception_msg = NULL;
-    it->exception_active = 0;
+    it->throwing = 0;
+    it->exception = val_null();
+    it->host = NULL;
+    it->error = NULL;
     builtins_register(it);
 }
 
 void interp_free(Interpreter *it) {
-    for (int i = it->scope_depth; i >= 0; i--) {
+    for (int i = it->scope_cap - 1; i >= 0; i--) {
         table_free(&it->scopes[i].vars);
     }
+    MEM_FREE(MEM_SCOPE, sizeof(Scope) * (size_t)it->scope_cap);
+    free(it->scopes);
     table_free(&it->globals);
     table_free(&it->functions);
     table_free(&it->builtins);
+    for (int k = 0; k < METHOD_KINDS; k++) table_free(&it->methods[k]);
     table_free(&it->classes);
-    for (int i = 0; i < it->imported_count; i++) {
-        free(it->imported[i]);
-    }
+    table_free(&it->modules);
     val_free(&it->return_value);
-    free(it->exception_msg);
-    it->exception_msg = NULL;
+    free_args(it->tail_args, it->tail_argc);
+    free(it->tail_args);
+    vm_free(it);
+    val_free(&it->exception);
+    free(it->error);
+    it->error = NULL;
+    profile_free(it->profile);
+    it->profile = NULL;
+    jit_free(it->jit);
+    it->jit = NULL;
+    while (it->funcs) {
+        FuncDef *fn = it->funcs;
+        it->funcs = fn->next;
+        chunk_free(fn->code);
+        free(fn);
+    }
+    while (it->local_count > 0) val_free(&it->locals[--it->local_count]);
+    MEM_FREE(MEM_SCOPE, (sizeof(Value) + sizeof(char *)) * (size_t)it->local_cap);
+    free(it->locals);
+    free(it->local_names);
+    for (int i = 0; i < it->program_count; i++) ast_free(it->programs[i]);
+    free(it->programs);
 }
 
 Value interp_eval(Interpreter *it, ASTNode *node) {
@@ -1051,19 +2161,135 @@ void interp_exec(Interpreter *it, ASTNode **stmts, int count) {
     exec_stmts(it, stmts, count);
 }
 
-void interp_run(Interpreter *it, const char *source) {
+ASTNode *interp_parse(const char *source, char *err) {
     Lexer lex;
     lexer_init(&lex, source);
     lexer_tokenize(&lex);
+    if (lex.error[0]) {
+        memcpy(err, lex.error, sizeof(lex.error));
+        lexer_free(&lex);
+        return NULL;
+    }
 
     Parser parser;
-    parser_init(&parser, lex.tokens, lex.token_count);
+    parser_init(&parser, source, lex.tokens, lex.token_count);
     ASTNode *program = parser_parse(&parser);
+    lexer_free(&lex);
+    if (!program) {
+        memcpy(err, parser.error, sizeof(parser.error));
+        return NULL;
+    }
+    optimize_program(program);
+    resolve_program(program);
+    return program;
+}
 
-    if (program && program->type == NODE_PROGRAM) {
+void interp_keep(Interpreter *it, ASTNode *program) {
+    if (it->program_count >= it->program_cap) {
+        it->program_cap = it->program_cap ? it->program_cap * 2 : 8;
+        it->programs = realloc(it->programs, sizeof(ASTNode *) * (size_t)it->program_cap);
+    }
+    it->programs[it->program_count++] = program;
+}
+
+static void run_program(Interpreter *it, ASTNode *program) {
+    if (program->type != NODE_PROGRAM) return;
+    if (it->use_vm) {
+        vm_run(it, program);
+    } else {
         exec_stmts(it, program->as.program.stmts, program->as.program.count);
     }
+}
 
-    ast_free(program);
-    lexer_free(&lex);
+static void run_thunk(Interpreter *it, void *program) {
+    run_program(it, program);
+}
+
+int interp_run(Interpreter *it, const char *source) {
+    char err[256];
+    ASTNode *program = interp_parse(source, err);
+    if (!program) {
+        free(it->error);
+        it->error = strdup(err);
+        return JUNG_ERROR;
+    }
+    return interp_run_program(it, program);
+}
+
+int interp_run_program(Interpreter *it, ASTNode *program) {
+    interp_keep(it, program);
+    return interp_protect(it, run_thunk, program);
+}
+
+/* Lowest address calls may take the C stack to: top is near its start */
+static char *stack_floor(Interpreter *it, char *top) {
+    size_t size = it->stack_size;
+    if (size == 0) {
+        struct rlimit rl;
+        size = 8u << 20;
+        if (getrlimit(RLIMIT_STACK, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY) size = (size_t)rl.rlim_cur;
+    }
+    if (size < 2 * C_STACK_RESERVE) return top - size / 2;
+    return top - (size - C_STACK_RESERVE);
+}
+
+int interp_protect(Interpreter *it, void (*fn)(Interpreter *it, void *ud), void *ud) {
+    jmp_buf buf;
+    jmp_buf *saved_host = it->host;
+    int saved_try = it->try_depth;
+    int saved_scope = it->scope_depth;
+    int saved_depth = it->call_depth;
+    int saved_stack = it->stack_top;
+    int saved_frames = it->frame_count;
+    int saved_runs = it->run_count;
+    int saved_frame_try = it->frame_try;
+    int saved_frame_scope = it->frame_scope;
+    Value *saved_this = it->this_obj;
+    ProfileMark saved_prof = profile_mark(it->profile);
+    int status;
+
+    if (!saved_host && !it->stack_fixed) it->stack_limit = stack_floor(it, (char *)&buf);
+    it->host = &buf;
+    it->try_depth = 0;
+    if (setjmp(buf) == 0) {
+        fn(it, ud);
+        status = JUNG_OK;
+    } else {
+        /* An uncaught error or exit() jumped over every frame in between:
+         * unwind them here */
+        status = it->host_status;
+        while (it->scope_depth > saved_scope) {
+            pop_scope(it);
+        }
+        while (it->stack_top > saved_stack) {
+            val_free(&it->stack[--it->stack_top]);
+        }
+        it->call_depth = saved_depth;
+        it->frame_count = saved_frames;
+        vm_unwind(it, saved_runs);
+        it->frame_try = saved_frame_try;
+        it->frame_scope = saved_frame_scope;
+        it->this_obj = saved_this;
+        free_args(it->tail_args, it->tail_argc);
+        it->tail_argc = 0;
+        it->tail_fn = NULL;
+        profile_unwind(it->profile, saved_prof);
+        it->return_flag = 0;
+        it->break_flag = 0;
+        it->continue_flag = 0;
+    }
+    it->throwing = 0;
+    val_free(&it->exception);
+    it->host = saved_host;
+    it->try_depth = saved_try;
+    return status;
+}
+
+void interp_exit(Interpreter *it, int code) {
+    it->exit_code = code;
+    if (it->host) {
+        it->host_status = JUNG_EXIT;
+        longjmp(*it->host, 1);
+    }
+    exit(code);
 }
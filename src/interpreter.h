@@ -4,49 +4,230 @@
 #include "parser.h"
 #include "value.h"
 #include "table.h"
+#include "jung.h"
 #include <setjmp.h>
 
-#define MAX_CALL_DEPTH 200
-#define MAX_IMPORTED 64
-#define MAX_SCOPES 256
-#define MAX_TRY_DEPTH 32
+#define MAX_CALL_DEPTH 100000 /* default depth limit on the VM (jung --max-depth) */
+#define C_STACK_RESERVE (256 * 1024) /* C stack left to builtins below the
+                                      * deepest call; see stack_limit */
+#define MAX_STACK_ARGS 8   /* call arguments kept on the C stack */
 
+/* A scope holds declared locals (parameters, loop and catch variables) in
+ * it->locals[slot_base .. slot_base + slot_count) and everything else in
+ * its vars table. */
 typedef struct Scope {
     Table vars;
+    int slot_base;
+    int slot_count;
 } Scope;
 
+/* Receiver types with builtin methods: recv.name() looks in the table of
+ * its receiver's kind (Interpreter.methods). Ranges and Float64Arrays
+ * share the array methods; an instance has its class's methods first and
+ * then the object ones. */
+typedef enum {
+    METHODS_STRING, METHODS_ARRAY, METHODS_OBJECT, METHODS_FILE,
+    METHOD_KINDS
+} MethodKind;
+
 typedef struct Interpreter {
-    Scope scopes[MAX_SCOPES];
+    Scope *scopes;        /* grows on demand; entries above scope_depth are
+                           * kept (with their emptied tables) for reuse */
+    int scope_cap;
     int scope_depth;
+    Value *locals;        /* slot storage for all live scopes */
+    const char **local_names;
+    int local_count;
+    int local_cap;
     Table globals;        /* global variables */
     Table functions;      /* user-defined functions (VAL_FUNCTION) */
     Table builtins;       /* builtin functions (VAL_BUILTIN) */
-    Table classes;        /* class definitions (VAL_OBJECT with method table) */
+    Table methods[METHOD_KINDS]; /* builtin methods by receiver kind,
+                                  * keyed by the bare method name */
+    Table classes;        /* class definitions (VAL_CLASS) */
+    unsigned int def_version; /* bumped on each function/class definition;
+                               * guards the call-site caches (CallCache) */
     Value *this_obj;      /* current 'this' pointer for methods, NULL if none */
     int call_depth;
-    char *imported[MAX_IMPORTED];
-    int imported_count;
+    int max_depth;        /* calls deeper than this raise; 0 for no limit,
+                           * -1 for the engine's default (interp_depth_limit) */
+
+    /* The tree walker recurses on the C stack for every call that is not a
+     * tail call. A call entered below stack_limit raises "stack overflow"
+     * instead of running into the guard page. Unless stack_fixed, each
+     * outermost interp_protect sets it from stack_size (RLIMIT_STACK when
+     * that is 0) below its own frame, so it follows the interpreter from
+     * one thread to another. */
+    char *stack_limit;
+    size_t stack_size;
+    int stack_fixed;      /* stack_limit was set by the caller */
+
+    /* manifest f(...) in a dream's own frame: the tree walker evaluates the
+     * arguments into tail_args and returns, and call_function runs tail_fn
+     * in the frame it was leaving */
+    FuncDef *tail_fn;
+    Value *tail_args;
+    int tail_argc;
+    int tail_cap;
+    int frame_try;        /* try_depth on entry to the running dream */
+    int frame_scope;      /* and the index of its call scope */
+    Table modules;        /* canonical path of each import -> its state */
+    int module_next;      /* first modules entry that may still be pending */
+    int modules_pending;
+    int lazy_imports;     /* import only registers the module; it is loaded
+                           * when a name lookup first misses */
+    FuncDef *funcs;       /* every dream and method defined, newest first */
+    ASTNode **programs;   /* every program run, kept alive for the functions
+                           * and classes that point into it */
+    int program_count;
+    int program_cap;
     int break_flag;
     int continue_flag;
     int return_flag;
     Value return_value;
 
-    /* Exception handling */
-    jmp_buf try_stack[MAX_TRY_DEPTH];
-    int try_depth;
-    char *exception_msg;  /* current exception message, NULL if none */
-    int exception_active;
+    /* Exception handling. Inside a try an error or throw only records
+     * the exception and sets throwing; every statement, call and VM frame
+     * checks the flag and returns, cleaning up as it goes, until the
+     * innermost try takes the value. Entering a try is a counter bump. */
+    int try_depth;        /* open try blocks (or module/worker guards) */
+    int throwing;         /* an exception is propagating to the innermost try */
+    Value exception;      /* the thrown value while throwing */
+
+    /* Set by interp_protect: where errors that no try catches, and exit(),
+     * unwind to instead of ending the process */
+    jmp_buf *host;
+    int host_status;      /* JUNG_ERROR or JUNG_EXIT, see jung.h */
+    char *error;          /* message of the last uncaught error */
+    int exit_code;
+
+    /* Bytecode VM (--vm) */
+    int use_vm;
+    Value *stack;         /* VM operand stack, VM_STACK_MAX slots */
+    int stack_top;        /* first free slot below any live VM frame */
+    struct VMFrame *frames; /* callers suspended by calls inside vm_execute */
+    int frame_count;
+    int frame_cap;
+    struct Chunk **runs;  /* program chunks vm_run is executing, freed by
+                           * interp_protect if an error unwinds past them */
+    int run_count;
+    int run_cap;
+
+    /* Native code for hot dreams (--jit), NULL when off; see jit.h */
+    struct Jit *jit;
+
+    /* Timing hooks (--profile), NULL when off; see profile.h */
+    struct Profile *profile;
+
+    /* Set in a pmap/pfilter/preduce worker (parallel.h), which reads the
+     * AST's call and shape caches but never writes them */
+    struct Worker *worker;
 } Interpreter;
 
 void  interp_init(Interpreter *it);
 void  interp_free(Interpreter *it);
 Value interp_eval(Interpreter *it, ASTNode *node);
 void  interp_exec(Interpreter *it, ASTNode **stmts, int count);
-void  interp_run(Interpreter *it, const char *source);
 
-/* Variable lookup across scopes */
+/* Parse and run a program; returns JUNG_OK, JUNG_ERROR (see it->error) or
+ * JUNG_EXIT (see it->exit_code). The AST is kept until interp_free. */
+int   interp_run(Interpreter *it, const char *source);
+int   interp_run_program(Interpreter *it, ASTNode *program);  /* takes program */
+
+/* Lex, parse and resolve source. On a syntax error returns NULL with the
+ * message in err, which must hold 256 bytes. */
+ASTNode *interp_parse(const char *source, char *err);
+
+/* Load every module still pending under lazy_imports */
+void  interp_load_modules(Interpreter *it, int line);
+
+/* Hand program to the interpreter, which frees it in interp_free: the
+ * functions and classes it defines point into it */
+void  interp_keep(Interpreter *it, ASTNode *program);
+
+/* Run fn(it, ud) so that an uncaught error or exit() returns here with
+ * JUNG_ERROR / JUNG_EXIT instead of ending the process. The interpreter is
+ * unwound to its state at the call and stays usable. */
+int   interp_protect(Interpreter *it, void (*fn)(Interpreter *it, void *ud), void *ud);
+
+/* exit(code) from the program: unwinds to the innermost interp_protect */
+void  interp_exit(Interpreter *it, int code);
+
+/* Variable lookup across scopes. Names everywhere in this API (variables,
+ * functions, classes, fields) must be interned; AST names already are. */
 int   interp_get_var(Interpreter *it, const char *name, Value *out);
+Value *interp_get_var_ref(Interpreter *it, const char *name);
 void  interp_set_var(Interpreter *it, const char *name, Value val);
 void  interp_def_var(Interpreter *it, const char *name, Value val);
 
+/* Declare a local in the next slot of the innermost scope */
+void  interp_bind_local(Interpreter *it, const char *name, Value val);
+
+/* Slot for a resolved (depth, slot) address; see resolver.h */
+static inline Value *interp_local(Interpreter *it, int depth, int slot) {
+    return &it->locals[it->scopes[it->scope_depth - depth].slot_base + slot];
+}
+
+/* The depth limit in force. By default the VM's is MAX_CALL_DEPTH and
+ * the tree walker has none: it nests C frames for every call that is not
+ * a tail call, so its stack_limit ends recursion first (near depth 8000
+ * with an 8 MB stack). */
+static inline int interp_depth_limit(const Interpreter *it) {
+    if (it->max_depth >= 0) return it->max_depth;
+    return it->use_vm ? MAX_CALL_DEPTH : 0;
+}
+
+/* Runtime errors: inside try they set it->throwing and return, so callers
+ * must stop and return too; otherwise they unwind to the innermost
+ * interp_protect and do not return */
+void  interp_error(Interpreter *it, int line, const char *fmt, ...);
+
+/* Take the propagating exception, ending the throw: its value as a string
+ * (malloc'd) */
+char *interp_catch_message(Interpreter *it);
+
+void  interp_push_scope(Interpreter *it);
+void  interp_pop_scope(Interpreter *it);
+
+/* Function calls. enter/leave bracket a call frame: enter binds the
+ * parameters (args are borrowed) in a fresh scope. */
+void  interp_enter_function(Interpreter *it, FuncDef *fn, Value *args, int argc, int line);
+void  interp_leave_function(Interpreter *it);
+Value interp_call_function(Interpreter *it, FuncDef *fn, Value *args, int argc, int line);
+/* Whether manifest fn(...) with argc arguments may run fn in place of the
+ * dream whose scopes start at index base (see interpreter.c) */
+int   interp_frame_reusable(Interpreter *it, int base, FuncDef *fn, int argc);
+
+/* Operation semantics shared by the tree walker and the bytecode VM.
+ * Operand values are consumed; args arrays are not freed. */
+Value interp_variable(Interpreter *it, const char *name, int line);
+Value interp_binary(Interpreter *it, TokenType op, Value left, Value right, int line);
+Value interp_unary(Interpreter *it, TokenType op, Value operand, int line);
+Value interp_index(Interpreter *it, Value arr, Value idx);
+Value interp_get_field(Interpreter *it, Value obj, const char *key, ShapeCache *sc);
+Value interp_call(Interpreter *it, const char *name, CallCache *cc, Value *args, int argc, int line);
+/* The dream interp_call would run, without running it. NULL for builtins,
+ * map/filter/reduce and the like, and names not yet defined. */
+FuncDef *interp_call_target(Interpreter *it, const char *name, CallCache *cc, int argc);
+/* Names interp_call handles itself before any builtin or dream */
+int   interp_special_form(const char *name, int argc);
+int   interp_is_mutator(Interpreter *it, const char *name, BuiltinFn *out);
+BuiltinFn interp_site_mutator(Interpreter *it, const char *name, CallCache *cc);
+/* recv.name(...) with the receiver in args[0]: its class's method, else
+ * the builtin method for its kind, else one of that name for any other
+ * kind (which returns its default, -1 or "" or false). cc caches the
+ * resolution per receiver class and kind. */
+Value interp_invoke(Interpreter *it, const char *name, CallCache *cc, Value *args, int argc, int line);
+/* The class method interp_invoke would run, or NULL for a builtin one */
+FuncDef *interp_invoke_target(Interpreter *it, const char *name, CallCache *cc, Value *args);
+/* The receiver-mutating builtin method called name (push, pop,
+ * sortInPlace) or NULL; cached in cc when given */
+BuiltinFn interp_method_mutator(Interpreter *it, const char *name, CallCache *cc);
+Value interp_call_mutator(Interpreter *it, BuiltinFn fn, Value *recv, Value *args, int argc, int line);
+Value interp_new_instance(Interpreter *it, const char *class_name, Value *args, int argc, int line);
+void  interp_compound_assign(Interpreter *it, const char *name, TokenType op, Value rhs, int line);
+void  interp_compound_slot(Interpreter *it, Value *slot, TokenType op, Value rhs, int line);
+void  interp_define_function(Interpreter *it, ASTNode *node);
+void  interp_define_class(Interpreter *it, ASTNode *node);
+
 #endif
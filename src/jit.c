@@ -0,0 +1,951 @@
+#define _DEFAULT_SOURCE         /* MAP_ANONYMOUS */
+#include "jit.h"
+#include "builtins.h"
+#include <limits.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The native tier exists for x86-64 System V only: everywhere else, or
+ * with -DJUNG_NO_JIT, jit_new returns NULL and --jit changes nothing. */
+#if defined(__x86_64__) && !defined(_WIN32) && !defined(JUNG_NO_JIT)
+#define JIT_X64 1
+#endif
+
+#ifndef JIT_X64
+
+struct Jit *jit_new(void) { return NULL; }
+void jit_free(struct Jit *jit) { (void)jit; }
+int  jit_call(Interpreter *it, FuncDef *fn, Value *args, int argc, Value *out) {
+    (void)it; (void)fn; (void)args; (void)argc; (void)out;
+    return 0;
+}
+
+#else
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+/* What native code reads and writes of the call it runs in. The
+ * generated code addresses the fields by offset: do not reorder. */
+typedef struct {
+    char *stack_floor;      /* 0: a frame below this bails (it->stack_limit) */
+    int depth_left;         /* 8: calls that may still be entered */
+    int bail;               /* 12: set when the call must be run again */
+} JitCtx;
+
+/* Every native dream has this signature, whatever its parameter count:
+ * arguments beyond its own are in registers it never reads */
+typedef double (*JitEntry)(JitCtx *ctx, double, double, double, double,
+                           double, double, double, double);
+
+typedef union { void *p; JitEntry fn; } CodePtr;
+
+enum { T_BAD, T_NUM, T_BOOL };
+
+typedef enum {
+    JIT_COLD,     /* counting calls */
+    JIT_BUSY,     /* being compiled */
+    JIT_READY,    /* entry is its code */
+    JIT_NEVER     /* cannot be compiled, or bailed too often */
+} JitState;
+
+typedef struct JitFn {
+    JitEntry entry;           /* what native callers call: the code, else the stub */
+    JitState state;
+    int calls;
+    int bails;
+    int ret;                  /* T_NUM or T_BOOL */
+    void *code;               /* mmap'd, code_size bytes */
+    size_t code_size;
+    const char **locals;      /* names the body assigns without declaring */
+    int local_count;
+    int local_cap;
+    const char **guards;      /* locals of this dream and all it calls */
+    int guard_count;
+    int guard_cap;
+    FuncDef **callees;
+    int callee_count;
+    int callee_cap;
+    FuncDef *fn;
+    struct JitFn *next;       /* every JitFn, for jit_free */
+} JitFn;
+
+struct Jit {
+    JitFn *fns;
+    unsigned int version;     /* def_version the code was compiled against */
+    void *stub;               /* mov dword [rdi+12], 1; ret */
+    size_t stub_size;
+};
+
+/* ---- executable memory ---- */
+
+static void *exec_alloc(const uint8_t *code, size_t len, size_t *size) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t n = (len + page - 1) / page * page;
+    void *p = mmap(NULL, n, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) return NULL;
+    memcpy(p, code, len);
+    if (mprotect(p, n, PROT_READ | PROT_EXEC) != 0) {
+        munmap(p, n);
+        return NULL;
+    }
+    *size = n;
+    return p;
+}
+
+static JitEntry stub_entry(struct Jit *jit) {
+    CodePtr c;
+    c.p = jit->stub;
+    return c.fn;
+}
+
+/* Drop fn's code; callers compiled against it call the stub and bail */
+static void drop_code(struct Jit *jit, JitFn *jf) {
+    if (jf->code) munmap(jf->code, jf->code_size);
+    jf->code = NULL;
+    jf->entry = stub_entry(jit);
+}
+
+static void retire(struct Jit *jit, JitFn *jf) {
+    drop_code(jit, jf);
+    jf->state = JIT_NEVER;
+}
+
+struct Jit *jit_new(void) {
+    static const uint8_t stub[] = { 0xC7, 0x47, 0x0C, 0x01, 0x00, 0x00, 0x00, 0xC3 };
+    struct Jit *jit = calloc(1, sizeof(struct Jit));
+    jit->stub = exec_alloc(stub, sizeof(stub), &jit->stub_size);
+    if (!jit->stub) {
+        free(jit);
+        return NULL;
+    }
+    return jit;
+}
+
+static void clear_fn(JitFn *jf) {
+    free(jf->locals);
+    free(jf->guards);
+    free(jf->callees);
+    jf->locals = NULL;
+    jf->guards = NULL;
+    jf->callees = NULL;
+    jf->local_count = jf->local_cap = 0;
+    jf->guard_count = jf->guard_cap = 0;
+    jf->callee_count = jf->callee_cap = 0;
+}
+
+void jit_free(struct Jit *jit) {
+    if (!jit) return;
+    JitFn *jf = jit->fns;
+    while (jf) {
+        JitFn *next = jf->next;
+        drop_code(jit, jf);
+        clear_fn(jf);
+        jf->fn->jit = NULL;     /* --jit can be turned off before interp_free */
+        free(jf);
+        jf = next;
+    }
+    munmap(jit->stub, jit->stub_size);
+    free(jit);
+}
+
+/* A definition moved def_version: code may call what is no longer the
+ * dream of that name, so everything starts counting again */
+static void reset(struct Jit *jit, unsigned int version) {
+    for (JitFn *jf = jit->fns; jf; jf = jf->next) {
+        drop_code(jit, jf);
+        clear_fn(jf);
+        jf->state = JIT_COLD;
+        jf->calls = 0;
+        jf->bails = 0;
+    }
+    jit->version = version;
+}
+
+static JitFn *fn_state(struct Jit *jit, FuncDef *fn) {
+    if (fn->jit) return fn->jit;
+    JitFn *jf = calloc(1, sizeof(JitFn));
+    jf->entry = stub_entry(jit);
+    jf->fn = fn;
+    jf->next = jit->fns;
+    jit->fns = jf;
+    fn->jit = jf;
+    return jf;
+}
+
+/* ---- helpers native code calls, with the semantics of interp_binary ---- */
+
+static double jit_divide(JitCtx *ctx, double l, double r) {
+    if (r == 0) {
+        ctx->bail = 1;
+        return 0;
+    }
+    if (l == floor(l) && r == floor(r)) return (double)((long)l / (long)r);
+    return l / r;
+}
+
+static double jit_modulo(JitCtx *ctx, double l, double r) {
+    if (r == 0) {
+        ctx->bail = 1;
+        return 0;
+    }
+    return fmod(l, r);
+}
+
+/* ---- code generation ----
+ *
+ * rbx holds the JitCtx, rbp the frame. Slot k (parameters first, then
+ * locals in the order they are declared) is at [rbp-16-8k], below the
+ * saved rbx; temporaries of expressions being evaluated are at [rsp+8t].
+ * Every expression leaves its value in xmm0; a binary operator evaluates
+ * its left side into a temporary and the right into xmm1. */
+
+typedef struct { int at; int label; } Fixup;
+typedef struct { const char *name; int slot; int type; } Sym;
+
+/* One compile started by a hot dream, which compiles its callees too */
+typedef struct {
+    Interpreter *it;
+    struct Jit *jit;
+    JitFn **done;             /* compiled, in the order they finished */
+    int done_count;
+    int done_cap;
+} Session;
+
+typedef struct Gen {
+    Session *s;
+    JitFn *jf;
+    struct Gen *parent;       /* compiling the caller that led here */
+    uint8_t *code;
+    int len;
+    int cap;
+    int *labels;              /* offset of each label, -1 until bound */
+    int label_count;
+    int label_cap;
+    Fixup *fixups;
+    int fixup_count;
+    int fixup_cap;
+    Sym *syms;                /* visible names, innermost block last */
+    int sym_count;
+    int sym_cap;
+    int slots;
+    int temps;
+    int frame_at;             /* imm32 of the prologue's sub rsp */
+    int l_ret, l_bail;
+    int l_break, l_continue;  /* innermost loop, -1 outside any */
+    int cycle;                /* calls itself, maybe through others */
+    int ok;
+} Gen;
+
+#define GROW(ptr, count, cap, init) \
+    do { if ((count) == (cap)) { (cap) = (cap) ? (cap) * 2 : (init); \
+         (ptr) = realloc((ptr), sizeof(*(ptr)) * (size_t)(cap)); } } while (0)
+
+static void fail(Gen *g) { g->ok = 0; }
+
+static void byte(Gen *g, int b) {
+    GROW(g->code, g->len, g->cap, 256);
+    g->code[g->len++] = (uint8_t)b;
+}
+
+static void u32(Gen *g, uint32_t v) {
+    for (int i = 0; i < 4; i++) byte(g, (int)((v >> (8 * i)) & 0xFF));
+}
+
+static void u64(Gen *g, uint64_t v) {
+    for (int i = 0; i < 8; i++) byte(g, (int)((v >> (8 * i)) & 0xFF));
+}
+
+static void emit(Gen *g, int n, ...) {
+    va_list ap;
+    va_start(ap, n);
+    for (int i = 0; i < n; i++) byte(g, va_arg(ap, int));
+    va_end(ap);
+}
+
+static int new_label(Gen *g) {
+    GROW(g->labels, g->label_count, g->label_cap, 16);
+    g->labels[g->label_count] = -1;
+    return g->label_count++;
+}
+
+static void bind(Gen *g, int label) {
+    g->labels[label] = g->len;
+}
+
+static void rel32(Gen *g, int label) {
+    GROW(g->fixups, g->fixup_count, g->fixup_cap, 32);
+    g->fixups[g->fixup_count].at = g->len;
+    g->fixups[g->fixup_count++].label = label;
+    u32(g, 0);
+}
+
+enum { JE = 0x84, JNE = 0x85, JB = 0x82, JAE = 0x83, JBE = 0x86, JA = 0x87,
+       JS = 0x88, JP = 0x8A, JNP = 0x8B };
+
+static void jcc(Gen *g, int cc, int label) {
+    emit(g, 2, 0x0F, cc);
+    rel32(g, label);
+}
+
+static void jmp(Gen *g, int label) {
+    byte(g, 0xE9);
+    rel32(g, label);
+}
+
+static int32_t slot_disp(int slot) { return -16 - 8 * slot; }
+
+/* movsd xmm<reg>, [rbp+slot] and back */
+static void load_slot(Gen *g, int reg, int slot) {
+    emit(g, 4, 0xF2, 0x0F, 0x10, 0x85 | (reg << 3));
+    u32(g, (uint32_t)slot_disp(slot));
+}
+
+static void store_slot(Gen *g, int reg, int slot) {
+    emit(g, 4, 0xF2, 0x0F, 0x11, 0x85 | (reg << 3));
+    u32(g, (uint32_t)slot_disp(slot));
+}
+
+/* movsd xmm<reg>, [rsp+8t] and back */
+static void load_temp(Gen *g, int reg, int t) {
+    emit(g, 5, 0xF2, 0x0F, 0x10, 0x84 | (reg << 3), 0x24);
+    u32(g, (uint32_t)(8 * t));
+}
+
+static void store_temp(Gen *g, int reg, int t) {
+    if (t + 1 > g->temps) g->temps = t + 1;
+    emit(g, 5, 0xF2, 0x0F, 0x11, 0x84 | (reg << 3), 0x24);
+    u32(g, (uint32_t)(8 * t));
+}
+
+/* xmm<reg> = d, through rax */
+static void load_const(Gen *g, int reg, double d) {
+    uint64_t bits;
+    memcpy(&bits, &d, sizeof(bits));
+    emit(g, 2, 0x48, 0xB8);
+    u64(g, bits);
+    emit(g, 5, 0x66, 0x48, 0x0F, 0x6E, 0xC0 | (reg << 3));
+}
+
+static void mov_rax(Gen *g, const void *p) {
+    emit(g, 2, 0x48, 0xB8);
+    u64(g, (uint64_t)(uintptr_t)p);
+}
+
+static void xmm1_from_xmm0(Gen *g) { emit(g, 4, 0x66, 0x0F, 0x28, 0xC8); }
+
+/* cmp dword [rbx+12], 0; jne bail: after anything that can bail */
+static void check_bail(Gen *g) {
+    emit(g, 4, 0x83, 0x7B, 0x0C, 0x00);
+    jcc(g, JNE, g->l_bail);
+}
+
+/* xmm0 = helper(ctx, xmm0, xmm1) */
+static void call_helper(Gen *g, double (*fn)(JitCtx *, double, double)) {
+    emit(g, 3, 0x48, 0x89, 0xDF);                 /* mov rdi, rbx */
+    emit(g, 2, 0x48, 0xB8);                       /* mov rax, fn */
+    u64(g, (uint64_t)(uintptr_t)fn);
+    emit(g, 2, 0xFF, 0xD0);                       /* call rax */
+    check_bail(g);
+}
+
+/* Jump to label if xmm0 is falsy (0; NaN is truthy like any number != 0) */
+static void jump_if_zero(Gen *g, int label) {
+    emit(g, 4, 0x66, 0x0F, 0x57, 0xC9);           /* xorpd xmm1, xmm1 */
+    emit(g, 4, 0x66, 0x0F, 0x2E, 0xC1);           /* ucomisd xmm0, xmm1 */
+    emit(g, 2, 0x7A, 0x06);                       /* jp over the je */
+    jcc(g, JE, label);
+}
+
+static void jump_if_nonzero(Gen *g, int label) {
+    emit(g, 4, 0x66, 0x0F, 0x57, 0xC9);
+    emit(g, 4, 0x66, 0x0F, 0x2E, 0xC1);
+    jcc(g, JP, label);
+    jcc(g, JNE, label);
+}
+
+/* xmm0 = al ? 1.0 : 0.0 */
+static void bool_from_al(Gen *g) {
+    emit(g, 3, 0x0F, 0xB6, 0xC0);                 /* movzx eax, al */
+    emit(g, 4, 0xF2, 0x0F, 0x2A, 0xC0);           /* cvtsi2sd xmm0, eax */
+}
+
+/* ---- names ---- */
+
+static Sym *lookup(Gen *g, const char *name) {
+    for (int i = g->sym_count - 1; i >= 0; i--) {
+        if (g->syms[i].name == name) return &g->syms[i];
+    }
+    return NULL;
+}
+
+static Sym *declare(Gen *g, const char *name, int type) {
+    GROW(g->syms, g->sym_count, g->sym_cap, 16);
+    Sym *s = &g->syms[g->sym_count++];
+    s->name = name;
+    s->slot = g->slots++;
+    s->type = type;
+    return s;
+}
+
+static int has_name(const char **names, int count, const char *name) {
+    for (int i = 0; i < count; i++) if (names[i] == name) return 1;
+    return 0;
+}
+
+static void add_local(JitFn *jf, const char *name) {
+    if (has_name(jf->locals, jf->local_count, name)) return;
+    GROW(jf->locals, jf->local_count, jf->local_cap, 4);
+    jf->locals[jf->local_count++] = name;
+}
+
+static void add_guard(JitFn *jf, const char *name) {
+    if (has_name(jf->guards, jf->guard_count, name)) return;
+    GROW(jf->guards, jf->guard_count, jf->guard_cap, 4);
+    jf->guards[jf->guard_count++] = name;
+}
+
+static void add_callee(JitFn *jf, FuncDef *fn) {
+    for (int i = 0; i < jf->callee_count; i++) if (jf->callees[i] == fn) return;
+    GROW(jf->callees, jf->callee_count, jf->callee_cap, 4);
+    jf->callees[jf->callee_count++] = fn;
+}
+
+/* ---- calls ---- */
+
+static void compile_fn(Session *s, JitFn *jf, Gen *parent);
+
+/* The dream a call site reaches, as interp_call_target looks it up:
+ * NULL for anything else (sets *math for sqrt and friends) */
+static FuncDef *callee(Gen *g, ASTNode *call, double (**math)(double)) {
+    const char *name = call->as.func_call.name;
+    int argc = call->as.func_call.arg_count;
+    Value v;
+    *math = NULL;
+    if (interp_special_form(name, argc)) return NULL;
+    if (table_iget(&g->s->it->builtins, name, &v)) {
+        if (IS_BUILTIN(v) && argc == 1) *math = builtins_math(AS_BUILTIN(v));
+        return NULL;
+    }
+    if (table_iget(&g->s->it->functions, name, &v) && IS_FUNCTION(v)) return AS_FUNC(v);
+    return NULL;
+}
+
+static int expr(Gen *g, ASTNode *n, int t);
+
+static int call(Gen *g, ASTNode *n, int t) {
+    double (*math)(double);
+    FuncDef *fn = callee(g, n, &math);
+    int argc = n->as.func_call.arg_count;
+    ASTNode **args = n->as.func_call.args;
+
+    if (math) {
+        if (expr(g, args[0], t) != T_NUM) return T_BAD;
+        if (math == sqrt) {
+            emit(g, 4, 0xF2, 0x0F, 0x51, 0xC0);   /* sqrtsd xmm0, xmm0 */
+        } else {
+            mov_rax(g, (const void *)(uintptr_t)math);
+            emit(g, 2, 0xFF, 0xD0);               /* call rax */
+        }
+        return T_NUM;
+    }
+    if (!fn || argc != fn->param_count || argc > JIT_MAX_PARAMS) return T_BAD;
+
+    JitFn *cj = fn_state(g->s->jit, fn);
+    if (cj->state == JIT_COLD) {
+        compile_fn(g->s, cj, g);
+    } else if (cj->state == JIT_BUSY) {
+        /* Recursion: every dream from that one down to this is in a cycle */
+        for (Gen *p = g; p; p = p->parent) {
+            p->cycle = 1;
+            if (p->jf == cj) break;
+        }
+    }
+    if (cj->state == JIT_NEVER) return T_BAD;
+    add_callee(g->jf, fn);
+
+    for (int i = 0; i < argc; i++) {
+        if (expr(g, args[i], t + argc) != T_NUM) return T_BAD;
+        store_temp(g, 0, t + i);
+    }
+    for (int i = 0; i < argc; i++) load_temp(g, i, t + i);
+    emit(g, 3, 0x48, 0x89, 0xDF);                 /* mov rdi, rbx */
+    mov_rax(g, &cj->entry);
+    emit(g, 2, 0xFF, 0x10);                       /* call [rax] */
+    check_bail(g);
+    return cj->ret;
+}
+
+/* ---- expressions ---- */
+
+static int is_compare(TokenType op) {
+    return op == TOKEN_GT || op == TOKEN_LT || op == TOKEN_GTE || op == TOKEN_LTE ||
+           op == TOKEN_EQ || op == TOKEN_NEQ;
+}
+
+/* Left side in xmm0, right side in xmm1; both of the returned type */
+static int operands(Gen *g, ASTNode *l, ASTNode *r, int t) {
+    int lt = expr(g, l, t);
+    if (lt == T_BAD) return T_BAD;
+    int rt;
+    Sym *s = r->type == NODE_VARIABLE ? lookup(g, r->as.var_name) : NULL;
+    if (r->type == NODE_NUMBER) {
+        load_const(g, 1, r->as.number);
+        rt = T_NUM;
+    } else if (s) {
+        load_slot(g, 1, s->slot);
+        rt = s->type;
+    } else {
+        store_temp(g, 0, t);
+        rt = expr(g, r, t + 1);
+        xmm1_from_xmm0(g);
+        load_temp(g, 0, t);
+    }
+    return lt == rt ? lt : T_BAD;
+}
+
+/* Flags of ucomisd for a comparison, and the jcc that skips when it is
+ * false. < and <= compare the operands the other way round. */
+static int compare(Gen *g, TokenType op, ASTNode *l, ASTNode *r, int t) {
+    int type = operands(g, l, r, t);
+    if (type == T_BAD) return T_BAD;
+    if (type != T_NUM && op != TOKEN_EQ && op != TOKEN_NEQ) return T_BAD;
+    if (op == TOKEN_LT || op == TOKEN_LTE) {
+        emit(g, 4, 0x66, 0x0F, 0x2E, 0xC8);       /* ucomisd xmm1, xmm0 */
+    } else {
+        emit(g, 4, 0x66, 0x0F, 0x2E, 0xC1);       /* ucomisd xmm0, xmm1 */
+    }
+    return T_BOOL;
+}
+
+/* Jump to label unless the condition n holds */
+static void branch_false(Gen *g, ASTNode *n, int t, int label) {
+    if (n->type == NODE_BINARY && is_compare(n->as.binary.op)) {
+        TokenType op = n->as.binary.op;
+        if (compare(g, op, n->as.binary.left, n->as.binary.right, t) == T_BAD) {
+            fail(g);
+            return;
+        }
+        switch (op) {
+        case TOKEN_GT: case TOKEN_LT:   jcc(g, JBE, label); break;
+        case TOKEN_GTE: case TOKEN_LTE: jcc(g, JB, label); break;
+        case TOKEN_EQ:
+            jcc(g, JNE, label);
+            jcc(g, JP, label);
+            break;
+        default: {                                /* != */
+            int yes = new_label(g);
+            jcc(g, JP, yes);
+            jcc(g, JE, label);
+            bind(g, yes);
+            break;
+        }
+        }
+        return;
+    }
+    if (expr(g, n, t) == T_BAD) fail(g);
+    jump_if_zero(g, label);
+}
+
+static int binary(Gen *g, ASTNode *n, int t) {
+    TokenType op = n->as.binary.op;
+    ASTNode *l = n->as.binary.left, *r = n->as.binary.right;
+
+    if (op == TOKEN_AND) {
+        int no = new_label(g), end = new_label(g);
+        branch_false(g, l, t, no);
+        branch_false(g, r, t, no);
+        load_const(g, 0, 1);
+        jmp(g, end);
+        bind(g, no);
+        load_const(g, 0, 0);
+        bind(g, end);
+        return T_BOOL;
+    }
+    if (op == TOKEN_OR) {
+        /* The first truthy operand, so both must be the same type */
+        int end = new_label(g);
+        int lt = expr(g, l, t);
+        jump_if_nonzero(g, end);
+        int rt = expr(g, r, t);
+        bind(g, end);
+        return lt == rt ? lt : T_BAD;
+    }
+
+    if (is_compare(op)) {
+        if (compare(g, op, l, r, t) == T_BAD) return T_BAD;
+        switch (op) {
+        case TOKEN_GT: case TOKEN_LT:   emit(g, 3, 0x0F, 0x97, 0xC0); break;   /* seta */
+        case TOKEN_GTE: case TOKEN_LTE: emit(g, 3, 0x0F, 0x93, 0xC0); break;   /* setae */
+        case TOKEN_EQ:
+            emit(g, 6, 0x0F, 0x94, 0xC0, 0x0F, 0x9B, 0xC1);   /* sete al; setnp cl */
+            emit(g, 2, 0x20, 0xC8);                           /* and al, cl */
+            break;
+        default:
+            emit(g, 6, 0x0F, 0x95, 0xC0, 0x0F, 0x9A, 0xC1);   /* setne al; setp cl */
+            emit(g, 2, 0x08, 0xC8);                           /* or al, cl */
+            break;
+        }
+        bool_from_al(g);
+        return T_BOOL;
+    }
+
+    if (operands(g, l, r, t) != T_NUM) return T_BAD;
+    switch (op) {
+    case TOKEN_PLUS:     emit(g, 4, 0xF2, 0x0F, 0x58, 0xC1); break;   /* addsd */
+    case TOKEN_MINUS:    emit(g, 4, 0xF2, 0x0F, 0x5C, 0xC1); break;   /* subsd */
+    case TOKEN_MULTIPLY: emit(g, 4, 0xF2, 0x0F, 0x59, 0xC1); break;   /* mulsd */
+    case TOKEN_DIVIDE:   call_helper(g, jit_divide); break;
+    case TOKEN_MODULO:   call_helper(g, jit_modulo); break;
+    default:             return T_BAD;
+    }
+    return T_NUM;
+}
+
+static int expr(Gen *g, ASTNode *n, int t) {
+    if (!g->ok) return T_BAD;
+    switch (n->type) {
+    case NODE_NUMBER:
+        load_const(g, 0, n->as.number);
+        return T_NUM;
+    case NODE_BOOL:
+        load_const(g, 0, n->as.boolean ? 1 : 0);
+        return T_BOOL;
+    case NODE_VARIABLE: {
+        Sym *s = lookup(g, n->as.var_name);
+        if (!s) return T_BAD;
+        load_slot(g, 0, s->slot);
+        return s->type;
+    }
+    case NODE_UNARY:
+        if (n->as.unary.op == TOKEN_MINUS) {
+            if (expr(g, n->as.unary.operand, t) != T_NUM) return T_BAD;
+            load_const(g, 1, -0.0);
+            emit(g, 4, 0x66, 0x0F, 0x57, 0xC1);   /* xorpd xmm0, xmm1 */
+            return T_NUM;
+        }
+        if (n->as.unary.op == TOKEN_NOT) {
+            if (expr(g, n->as.unary.operand, t) == T_BAD) return T_BAD;
+            emit(g, 4, 0x66, 0x0F, 0x57, 0xC9);   /* xorpd xmm1, xmm1 */
+            emit(g, 4, 0x66, 0x0F, 0x2E, 0xC1);   /* ucomisd xmm0, xmm1 */
+            emit(g, 6, 0x0F, 0x94, 0xC0, 0x0F, 0x9B, 0xC1);
+            emit(g, 2, 0x20, 0xC8);
+            bool_from_al(g);
+            return T_BOOL;
+        }
+        return T_BAD;
+    case NODE_BINARY:
+        return binary(g, n, t);
+    case NODE_TERNARY: {
+        int no = new_label(g), end = new_label(g);
+        branch_false(g, n->as.ternary.condition, t, no);
+        int a = expr(g, n->as.ternary.then_expr, t);
+        jmp(g, end);
+        bind(g, no);
+        int b = expr(g, n->as.ternary.else_expr, t);
+        bind(g, end);
+        return a == b ? a : T_BAD;
+    }
+    case NODE_FUNC_CALL:
+        return call(g, n, t);
+    default:
+        return T_BAD;
+    }
+}
+
+/* ---- statements ---- */
+
+static void block(Gen *g, ASTNode **stmts, int count);
+
+static void stmt(Gen *g, ASTNode *n) {
+    switch (n->type) {
+    case NODE_ASSIGN: {
+        int type = expr(g, n->as.assign.value, 0);
+        if (type == T_BAD) {
+            fail(g);
+            return;
+        }
+        /* A name not visible yet is declared in this block, as
+         * interp_set_var would, once the value is computed */
+        Sym *s = lookup(g, n->as.assign.name);
+        if (!s) {
+            s = declare(g, n->as.assign.name, type);
+            add_local(g->jf, n->as.assign.name);
+        } else if (s->type != type) {
+            fail(g);
+            return;
+        }
+        store_slot(g, 0, s->slot);
+        return;
+    }
+    case NODE_COMPOUND_ASSIGN: {
+        Sym *s = lookup(g, n->as.comp_assign.name);
+        if (!s || s->type != T_NUM || expr(g, n->as.comp_assign.value, 0) != T_NUM) {
+            fail(g);
+            return;
+        }
+        xmm1_from_xmm0(g);
+        load_slot(g, 0, s->slot);
+        switch (n->as.comp_assign.op) {
+        case TOKEN_PLUS_ASSIGN:     emit(g, 4, 0xF2, 0x0F, 0x58, 0xC1); break;
+        case TOKEN_MINUS_ASSIGN:    emit(g, 4, 0xF2, 0x0F, 0x5C, 0xC1); break;
+        case TOKEN_MULTIPLY_ASSIGN: emit(g, 4, 0xF2, 0x0F, 0x59, 0xC1); break;
+        case TOKEN_DIVIDE_ASSIGN:   call_helper(g, jit_divide); break;
+        default:                    fail(g); return;
+        }
+        store_slot(g, 0, s->slot);
+        return;
+    }
+    case NODE_IF: {
+        int no = new_label(g), end = new_label(g);
+        branch_false(g, n->as.if_stmt.condition, 0, no);
+        block(g, n->as.if_stmt.then_body, n->as.if_stmt.then_count);
+        if (n->as.if_stmt.else_body) jmp(g, end);
+        bind(g, no);
+        if (n->as.if_stmt.else_body) block(g, n->as.if_stmt.else_body, n->as.if_stmt.else_count);
+        bind(g, end);
+        return;
+    }
+    case NODE_WHILE: {
+        int top = new_label(g), end = new_label(g);
+        int outer_break = g->l_break, outer_continue = g->l_continue;
+        bind(g, top);
+        branch_false(g, n->as.while_loop.condition, 0, end);
+        g->l_break = end;
+        g->l_continue = top;
+        block(g, n->as.while_loop.body, n->as.while_loop.body_count);
+        g->l_break = outer_break;
+        g->l_continue = outer_continue;
+        jmp(g, top);
+        bind(g, end);
+        return;
+    }
+    case NODE_BREAK:
+    case NODE_CONTINUE:
+        if (g->l_break < 0) {
+            fail(g);
+            return;
+        }
+        jmp(g, n->type == NODE_BREAK ? g->l_break : g->l_continue);
+        return;
+    case NODE_RETURN:
+        if (!n->as.return_val || expr(g, n->as.return_val, 0) != g->jf->ret) {
+            fail(g);
+            return;
+        }
+        jmp(g, g->l_ret);
+        return;
+    default:
+        /* An expression statement; anything else has effects */
+        if (expr(g, n, 0) == T_BAD) fail(g);
+        return;
+    }
+}
+
+/* Like the interpreter's scope for an if or while body: names first
+ * assigned inside are gone after it */
+static void block(Gen *g, ASTNode **stmts, int count) {
+    int visible = g->sym_count;
+    for (int i = 0; i < count && g->ok; i++) stmt(g, stmts[i]);
+    g->sym_count = visible;
+}
+
+/* The type of the first manifest whose type is plain from its syntax, so
+ * that recursive calls have one before the body is compiled */
+static int guess_return(ASTNode **stmts, int count) {
+    for (int i = 0; i < count; i++) {
+        ASTNode *n = stmts[i];
+        int type = T_BAD;
+        if (n->type == NODE_RETURN && n->as.return_val) {
+            ASTNode *v = n->as.return_val;
+            while (v->type == NODE_TERNARY) v = v->as.ternary.then_expr;
+            while (v->type == NODE_BINARY && v->as.binary.op == TOKEN_OR) v = v->as.binary.left;
+            if (v->type == NODE_BOOL || (v->type == NODE_UNARY && v->as.unary.op == TOKEN_NOT) ||
+                (v->type == NODE_BINARY && (is_compare(v->as.binary.op) ||
+                                            v->as.binary.op == TOKEN_AND))) {
+                type = T_BOOL;
+            } else if (v->type == NODE_NUMBER || v->type == NODE_BINARY ||
+                       v->type == NODE_UNARY) {
+                type = T_NUM;
+            }
+        } else if (n->type == NODE_IF) {
+            type = guess_return(n->as.if_stmt.then_body, n->as.if_stmt.then_count);
+            if (type == T_BAD && n->as.if_stmt.else_body)
+                type = guess_return(n->as.if_stmt.else_body, n->as.if_stmt.else_count);
+        } else if (n->type == NODE_WHILE) {
+            type = guess_return(n->as.while_loop.body, n->as.while_loop.body_count);
+        }
+        if (type != T_BAD) return type;
+    }
+    return T_BAD;
+}
+
+static void gen_function(Gen *g) {
+    FuncDef *fn = g->jf->fn;
+    g->l_ret = new_label(g);
+    g->l_bail = new_label(g);
+    int l_out = new_label(g);
+
+    emit(g, 1, 0x55);                             /* push rbp */
+    emit(g, 3, 0x48, 0x89, 0xE5);                 /* mov rbp, rsp */
+    emit(g, 1, 0x53);                             /* push rbx */
+    emit(g, 3, 0x48, 0x89, 0xFB);                 /* mov rbx, rdi */
+    emit(g, 3, 0x48, 0x81, 0xEC);                 /* sub rsp, frame */
+    g->frame_at = g->len;
+    u32(g, 0);
+    emit(g, 3, 0x48, 0x3B, 0x23);                 /* cmp rsp, [rbx] */
+    jcc(g, JB, g->l_bail);
+    emit(g, 4, 0x83, 0x6B, 0x08, 0x01);           /* sub dword [rbx+8], 1 */
+    jcc(g, JS, g->l_bail);
+    for (int i = 0; i < fn->param_count; i++) {
+        Sym *s = declare(g, fn->params[i].name, T_NUM);
+        store_slot(g, i, s->slot);
+    }
+
+    block(g, fn->body, fn->body_count);
+    jmp(g, g->l_bail);                            /* fell off the end: null */
+
+    bind(g, g->l_ret);
+    emit(g, 4, 0x83, 0x43, 0x08, 0x01);           /* add dword [rbx+8], 1 */
+    bind(g, l_out);
+    emit(g, 4, 0x48, 0x8B, 0x5D, 0xF8);           /* mov rbx, [rbp-8] */
+    emit(g, 2, 0xC9, 0xC3);                       /* leave; ret */
+    bind(g, g->l_bail);
+    emit(g, 7, 0xC7, 0x43, 0x0C, 0x01, 0x00, 0x00, 0x00);   /* mov dword [rbx+12], 1 */
+    jmp(g, l_out);
+
+    /* rsp stays 16-byte aligned for calls */
+    uint32_t frame = (uint32_t)((8 * (g->slots + g->temps) + 15) / 16 * 16 + 8);
+    memcpy(&g->code[g->frame_at], &frame, 4);
+    for (int i = 0; i < g->fixup_count; i++) {
+        int at = g->fixups[i].at;
+        int32_t rel = g->labels[g->fixups[i].label] - (at + 4);
+        memcpy(&g->code[at], &rel, 4);
+    }
+}
+
+static void compile_fn(Session *s, JitFn *jf, Gen *parent) {
+    FuncDef *fn = jf->fn;
+    clear_fn(jf);
+    jf->state = JIT_BUSY;
+    int ret = guess_return(fn->body, fn->body_count);
+    jf->ret = ret == T_BAD ? T_NUM : ret;
+
+    Gen g;
+    memset(&g, 0, sizeof(g));
+    g.s = s;
+    g.jf = jf;
+    g.parent = parent;
+    g.l_break = g.l_continue = -1;
+    g.ok = fn->param_count <= JIT_MAX_PARAMS;
+    for (int i = 0; i < fn->param_count; i++) {
+        if (fn->params[i].default_val) g.ok = 0;
+    }
+    if (g.ok) gen_function(&g);
+
+    /* A recursive dream with locals would see its callers' copies of them */
+    if (g.cycle && jf->local_count > 0) g.ok = 0;
+    if (g.ok) {
+        jf->code = exec_alloc(g.code, (size_t)g.len, &jf->code_size);
+        if (!jf->code) g.ok = 0;
+    }
+    if (g.ok) {
+        CodePtr c;
+        c.p = jf->code;
+        jf->entry = c.fn;
+        jf->state = JIT_READY;
+        for (int i = 0; i < jf->local_count; i++) add_guard(jf, jf->locals[i]);
+        GROW(s->done, s->done_count, s->done_cap, 8);
+        s->done[s->done_count++] = jf;
+    } else {
+        retire(s->jit, jf);
+    }
+    free(g.code);
+    free(g.labels);
+    free(g.fixups);
+    free(g.syms);
+}
+
+/* Names a dream assigns are also those of everything it calls, since the
+ * interpreter looks them up through its caller's scopes. A callee that
+ * would find one of its caller's own variables cannot run natively. */
+static void link_guards(struct Jit *jit, JitFn **done, int count) {
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (int i = 0; i < count; i++) {
+            JitFn *jf = done[i];
+            for (int c = 0; c < jf->callee_count; c++) {
+                JitFn *cj = jf->callees[c]->jit;
+                for (int k = 0; k < cj->guard_count; k++) {
+                    if (!has_name(jf->guards, jf->guard_count, cj->guards[k])) {
+                        add_guard(jf, cj->guards[k]);
+                        changed = 1;
+                    }
+                }
+            }
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        JitFn *jf = done[i];
+        FuncDef *fn = jf->fn;
+        for (int c = 0; c < jf->callee_count && jf->state == JIT_READY; c++) {
+            JitFn *cj = jf->callees[c]->jit;
+            for (int k = 0; k < cj->guard_count; k++) {
+                const char *name = cj->guards[k];
+                int own = has_name(jf->locals, jf->local_count, name);
+                for (int p = 0; p < fn->param_count && !own; p++) own = fn->params[p].name == name;
+                if (own) {
+                    retire(jit, jf);
+                    break;
+                }
+            }
+        }
+    }
+}
+
+int jit_call(Interpreter *it, FuncDef *fn, Value *args, int argc, Value *out) {
+    struct Jit *jit = it->jit;
+    if (jit->version != it->def_version) reset(jit, it->def_version);
+    JitFn *jf = fn->jit ? fn->jit : fn_state(jit, fn);
+
+    if (jf->state != JIT_READY) {
+        if (jf->state != JIT_COLD || ++jf->calls < JIT_HOT_CALLS || it->profile) return 0;
+        Session s;
+        memset(&s, 0, sizeof(s));
+        s.it = it;
+        s.jit = jit;
+        compile_fn(&s, jf, NULL);
+        link_guards(jit, s.done, s.done_count);
+        free(s.done);
+        if (jf->state != JIT_READY) return 0;
+    }
+
+    if (argc != fn->param_count) return 0;
+    double a[JIT_MAX_PARAMS] = { 0 };
+    for (int i = 0; i < argc; i++) {
+        if (!IS_NUMBER(args[i])) return 0;
+        a[i] = AS_NUMBER(args[i]);
+    }
+    for (int i = 0; i < jf->guard_count; i++) {
+        if (interp_get_var_ref(it, jf->guards[i])) return 0;
+    }
+
+    JitCtx ctx;
+    ctx.stack_floor = it->stack_limit;
+    int limit = interp_depth_limit(it);
+    ctx.depth_left = limit > 0 ? limit - it->call_depth : INT_MAX;
+    ctx.bail = 0;
+    double r = jf->entry(&ctx, a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]);
+    if (ctx.bail) {
+        if (++jf->bails >= JIT_MAX_BAILS) retire(jit, jf);
+        return 0;
+    }
+    *out = jf->ret == T_BOOL ? val_bool(r != 0) : val_number(r);
+    return 1;
+}
+
+#endif
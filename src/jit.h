@@ -0,0 +1,41 @@
+#ifndef JUNG_JIT_H
+#define JUNG_JIT_H
+
+#include "interpreter.h"
+
+/* Baseline native tier (jung --jit), x86-64 only.
+ *
+ * call_function counts the calls of each dream made with numbers only.
+ * At JIT_HOT_CALLS it compiles the dream, and every dream it calls, to
+ * machine code straight from the tree: one fixed template per node, all
+ * values unboxed doubles in stack slots. Only pure numeric dreams have a
+ * native form: numbers and booleans, parameters and locals assigned in
+ * the body, arithmetic, comparisons, and/or/not, if, while, manifest,
+ * sqrt/abs/floor/ceil and calls to other such dreams. Anything else (a
+ * global, a string, print, a method) leaves the dream to the interpreter.
+ *
+ * Native code has no effects but its result, so a guard that fails
+ * deoptimizes by giving up on the whole call: the interpreter then runs
+ * it from the start. Arguments that are not numbers skip the native code;
+ * division by zero, falling off the end without a manifest, running out
+ * of depth or C stack, or a redefinition since it was compiled make it
+ * bail. A dream that bails JIT_MAX_BAILS times is not tried again.
+ *
+ * Names a jitted dream assigns are real variables to the interpreter,
+ * which resolves assignments dynamically: a caller's variable of the same
+ * name would be written instead. Such dreams only run natively while none
+ * of those names is visible, and not at all if they recurse. */
+
+#define JIT_HOT_CALLS  200
+#define JIT_MAX_BAILS  100
+#define JIT_MAX_PARAMS 8     /* arguments passed in registers */
+
+/* NULL where there is no native tier (see JUNG_NO_JIT) */
+struct Jit *jit_new(void);
+void jit_free(struct Jit *jit);
+
+/* Run fn natively if it is hot and compiled: 1 with its result in *out,
+ * or 0 and the caller runs it as usual. args are borrowed. */
+int  jit_call(Interpreter *it, FuncDef *fn, Value *args, int argc, Value *out);
+
+#endif
@@ -0,0 +1,521 @@
+#include "json.h"
+#include "intern.h"
+#include "table.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ---- Parsing ---- */
+
+typedef struct {
+    const char *p;
+    const char *end;
+    JsonKeys *keys;
+    int depth;
+    /* Elements of the containers still open; names[i] is the key of
+     * vals[i] inside an object and unused inside an array */
+    Value *vals;
+    const char **names;
+    int top, cap;
+    /* Decoded text of the current string when it has escapes */
+    char *tmp;
+    size_t tmp_len, tmp_cap;
+} Parser;
+
+static int parse_value(Parser *P, Value *out);
+
+static inline void skip_ws(Parser *P) {
+    while (P->p < P->end &&
+           (*P->p == ' ' || *P->p == '\n' || *P->p == '\t' || *P->p == '\r'))
+        P->p++;
+}
+
+static void push(Parser *P, const char *name, Value v) {
+    if (P->top >= P->cap) {
+        P->cap = P->cap ? P->cap * 2 : 64;
+        P->vals = realloc(P->vals, sizeof(Value) * (size_t)P->cap);
+        P->names = realloc(P->names, sizeof(const char *) * (size_t)P->cap);
+    }
+    P->names[P->top] = name;
+    P->vals[P->top++] = v;
+}
+
+static void tmp_put(Parser *P, const char *s, size_t n) {
+    if (n == 0) return;
+    if (P->tmp_len + n > P->tmp_cap) {
+        size_t cap = P->tmp_cap ? P->tmp_cap * 2 : 256;
+        while (cap < P->tmp_len + n) cap *= 2;
+        P->tmp = realloc(P->tmp, cap);
+        P->tmp_cap = cap;
+    }
+    memcpy(P->tmp + P->tmp_len, s, n);
+    P->tmp_len += n;
+}
+
+static int hex4(const char *s, unsigned *out) {
+    unsigned v = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = s[i];
+        v <<= 4;
+        if (c >= '0' && c <= '9') v |= (unsigned)(c - '0');
+        else if (c >= 'a' && c <= 'f') v |= (unsigned)(c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F') v |= (unsigned)(c - 'A' + 10);
+        else return 0;
+    }
+    *out = v;
+    return 1;
+}
+
+static void put_utf8(Parser *P, unsigned cp) {
+    char b[4];
+    size_t n;
+    if (cp < 0x80) { b[0] = (char)cp; n = 1; }
+    else if (cp < 0x800) {
+        b[0] = (char)(0xC0 | (cp >> 6));
+        b[1] = (char)(0x80 | (cp & 0x3F));
+        n = 2;
+    } else if (cp < 0x10000) {
+        b[0] = (char)(0xE0 | (cp >> 12));
+        b[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        b[2] = (char)(0x80 | (cp & 0x3F));
+        n = 3;
+    } else {
+        b[0] = (char)(0xF0 | (cp >> 18));
+        b[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+        b[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        b[3] = (char)(0x80 | (cp & 0x3F));
+        n = 4;
+    }
+    tmp_put(P, b, n);
+}
+
+/* The string at P->p (on its opening quote). *s points into the input
+ * when the string has no escapes, else into P->tmp. */
+static int parse_string(Parser *P, const char **s, int *len) {
+    const char *start = ++P->p;
+    const char *q = start;
+    while (q < P->end) {
+        unsigned char c = (unsigned char)*q;
+        if (c == '"') {
+            *s = start;
+            *len = (int)(q - start);
+            P->p = q + 1;
+            return 1;
+        }
+        if (c == '\\' || c < 0x20) break;
+        q++;
+    }
+
+    /* Slow path: decode escapes after the plain prefix */
+    P->tmp_len = 0;
+    tmp_put(P, start, (size_t)(q - start));
+    while (q < P->end) {
+        unsigned char c = (unsigned char)*q;
+        if (c == '"') {
+            *s = P->tmp;
+            *len = (int)P->tmp_len;
+            P->p = q + 1;
+            return 1;
+        }
+        if (c < 0x20) return 0;
+        if (c != '\\') {
+            const char *run = q;
+            while (q < P->end && *q != '"' && *q != '\\' && (unsigned char)*q >= 0x20) q++;
+            tmp_put(P, run, (size_t)(q - run));
+            continue;
+        }
+        if (++q >= P->end) return 0;
+        char e = *q++;
+        char ch;
+        switch (e) {
+            case '"':  ch = '"'; break;
+            case '\\': ch = '\\'; break;
+            case '/':  ch = '/'; break;
+            case 'b':  ch = '\b'; break;
+            case 'f':  ch = '\f'; break;
+            case 'n':  ch = '\n'; break;
+            case 'r':  ch = '\r'; break;
+            case 't':  ch = '\t'; break;
+            case 'u': {
+                unsigned cp, lo;
+                if (P->end - q < 4 || !hex4(q, &cp)) return 0;
+                q += 4;
+                if (cp >= 0xD800 && cp <= 0xDBFF) {
+                    if (P->end - q >= 6 && q[0] == '\\' && q[1] == 'u' &&
+                        hex4(q + 2, &lo) && lo >= 0xDC00 && lo <= 0xDFFF) {
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                        q += 6;
+                    } else {
+                        cp = 0xFFFD;
+                    }
+                } else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+                    cp = 0xFFFD;
+                }
+                put_utf8(P, cp);
+                continue;
+            }
+            default: return 0;
+        }
+        tmp_put(P, &ch, 1);
+    }
+    return 0;
+}
+
+static inline int is_digit(char c) { return c >= '0' && c <= '9'; }
+
+static int parse_number(Parser *P, Value *out) {
+    const char *s = P->p, *q = s, *end = P->end;
+    int neg = 0;
+    if (*q == '-') { neg = 1; q++; }
+    if (q >= end) return 0;
+    if (*q == '0') q++;
+    else if (is_digit(*q)) while (q < end && is_digit(*q)) q++;
+    else return 0;
+    int simple = 1;
+    if (q < end && *q == '.') {
+        q++;
+        if (q >= end || !is_digit(*q)) return 0;
+        while (q < end && is_digit(*q)) q++;
+        simple = 0;
+    }
+    if (q < end && (*q == 'e' || *q == 'E')) {
+        q++;
+        if (q < end && (*q == '+' || *q == '-')) q++;
+        if (q >= end || !is_digit(*q)) return 0;
+        while (q < end && is_digit(*q)) q++;
+        simple = 0;
+    }
+    P->p = q;
+
+    /* Integers of up to 15 digits are exact in a double */
+    size_t n = (size_t)(q - s);
+    if (simple && n - (size_t)neg <= 15) {
+        long long x = 0;
+        for (const char *d = s + neg; d < q; d++) x = x * 10 + (*d - '0');
+        *out = val_number(neg ? -(double)x : (double)x);
+        return 1;
+    }
+    /* strtod wants a terminated copy: the input may end right after */
+    char small[64];
+    char *buf = n < sizeof(small) ? small : malloc(n + 1);
+    memcpy(buf, s, n);
+    buf[n] = '\0';
+    *out = val_number(strtod(buf, NULL));
+    if (buf != small) free(buf);
+    return 1;
+}
+
+/* The interned key, with a reference for the parse stack */
+static const char *key_intern(Parser *P, const char *s, int len) {
+    unsigned h = intern_hash_bytes(s, len) & (JSON_KEY_SLOTS - 1);
+    const char *k = P->keys->slot[h];
+    if (k && intern_len(k) == len && memcmp(k, s, (size_t)len) == 0) {
+        intern_retain(k);
+        return k;
+    }
+    if (k) intern_release(k);
+    k = intern_key(s, len);
+    intern_retain(k);
+    P->keys->slot[h] = k;
+    return k;
+}
+
+void json_keys_clear(JsonKeys *keys) {
+    for (int i = 0; i < JSON_KEY_SLOTS; i++) {
+        if (keys->slot[i]) intern_release(keys->slot[i]);
+        keys->slot[i] = NULL;
+    }
+}
+
+static int parse_array(Parser *P, Value *out) {
+    P->p++;
+    int base = P->top;
+    skip_ws(P);
+    if (P->p < P->end && *P->p == ']') {
+        P->p++;
+    } else {
+        for (;;) {
+            Value v;
+            if (!parse_value(P, &v)) return 0;
+            push(P, NULL, v);
+            skip_ws(P);
+            if (P->p >= P->end) return 0;
+            char c = *P->p++;
+            if (c == ',') continue;
+            if (c == ']') break;
+            return 0;
+        }
+    }
+    int n = P->top - base;
+    *out = val_array(n);
+    if (n > 0) memcpy(AS_ARRAY(*out)->items, P->vals + base, sizeof(Value) * (size_t)n);
+    AS_ARRAY(*out)->count = n;
+    P->top = base;
+    return 1;
+}
+
+static int parse_object(Parser *P, Value *out) {
+    P->p++;
+    int base = P->top;
+    skip_ws(P);
+    if (P->p < P->end && *P->p == '}') {
+        P->p++;
+    } else {
+        for (;;) {
+            const char *s;
+            int len;
+            skip_ws(P);
+            if (P->p >= P->end || *P->p != '"' || !parse_string(P, &s, &len)) return 0;
+            const char *key = key_intern(P, s, len);
+            skip_ws(P);
+            Value v;
+            if (P->p >= P->end || *P->p != ':') {
+                intern_release(key);
+                return 0;
+            }
+            P->p++;
+            if (!parse_value(P, &v)) {
+                intern_release(key);
+                return 0;
+            }
+            push(P, key, v);
+            skip_ws(P);
+            if (P->p >= P->end) return 0;
+            char c = *P->p++;
+            if (c == ',') continue;
+            if (c == '}') break;
+            return 0;
+        }
+    }
+    int n = P->top - base;
+    *out = val_object();
+    table_reserve(AS_OBJECT(*out), n);
+    for (int i = base; i < P->top; i++) {
+        table_iset(AS_OBJECT(*out), P->names[i], P->vals[i]);
+        intern_release(P->names[i]);
+    }
+    P->top = base;
+    return 1;
+}
+
+static int literal(Parser *P, const char *word, size_t n) {
+    if ((size_t)(P->end - P->p) < n || memcmp(P->p, word, n) != 0) return 0;
+    P->p += n;
+    return 1;
+}
+
+static int parse_value(Parser *P, Value *out) {
+    skip_ws(P);
+    if (P->p >= P->end) return 0;
+    int ok;
+    switch (*P->p) {
+        case '{':
+        case '[':
+            if (++P->depth > JSON_MAX_DEPTH) return 0;
+            ok = *P->p == '{' ? parse_object(P, out) : parse_array(P, out);
+            P->depth--;
+            return ok;
+        case '"': {
+            const char *s;
+            int len;
+            if (!parse_string(P, &s, &len)) return 0;
+            *out = val_string(s, len);
+            return 1;
+        }
+        case 't':
+            if (!literal(P, "true", 4)) return 0;
+            *out = val_bool(1);
+            return 1;
+        case 'f':
+            if (!literal(P, "false", 5)) return 0;
+            *out = val_bool(0);
+            return 1;
+        case 'n':
+            if (!literal(P, "null", 4)) return 0;
+            *out = val_null();
+            return 1;
+        default:
+            return parse_number(P, out);
+    }
+}
+
+int json_parse(const char *s, size_t len, JsonKeys *keys, Value *out) {
+    JsonKeys local;
+    if (!keys) {
+        memset(&local, 0, sizeof(local));
+        keys = &local;
+    }
+    Parser P;
+    memset(&P, 0, sizeof(P));
+    P.p = s;
+    P.end = s + len;
+    P.keys = keys;
+
+    int ok = parse_value(&P, out);
+    if (ok) {
+        skip_ws(&P);
+        if (P.p != P.end) {
+            val_free(out);
+            ok = 0;
+        }
+    }
+    /* On failure, the elements of containers left open */
+    for (int i = 0; i < P.top; i++) {
+        val_free(&P.vals[i]);
+        if (P.names[i]) intern_release(P.names[i]);
+    }
+    if (keys == &local) json_keys_clear(&local);
+    free(P.vals);
+    free(P.names);
+    free(P.tmp);
+    return ok;
+}
+
+/* ---- Writing ---- */
+
+typedef struct {
+    char *buf;
+    size_t len, cap;
+} Out;
+
+static void out_reserve(Out *o, size_t n) {
+    if (o->len + n + 1 <= o->cap) return;
+    size_t cap = o->cap * 2;
+    while (cap < o->len + n + 1) cap *= 2;
+    o->buf = realloc(o->buf, cap);
+    o->cap = cap;
+}
+
+static inline void out_put(Out *o, const char *s, size_t n) {
+    out_reserve(o, n);
+    memcpy(o->buf + o->len, s, n);
+    o->len += n;
+}
+
+static inline void out_char(Out *o, char c) {
+    out_reserve(o, 1);
+    o->buf[o->len++] = c;
+}
+
+static void out_string(Out *o, const char *s, size_t n) {
+    static const char hex[] = "0123456789abcdef";
+    out_char(o, '"');
+    const char *end = s + n;
+    while (s < end) {
+        /* Copy the run that needs no escaping in one go */
+        const char *run = s;
+        while (s < end && *s != '"' && *s != '\\' && (unsigned char)*s >= 0x20) s++;
+        if (s > run) out_put(o, run, (size_t)(s - run));
+        if (s >= end) break;
+        unsigned char c = (unsigned char)*s++;
+        char esc[6] = { '\\', 0, 0, 0, 0, 0 };
+        size_t len = 2;
+        switch (c) {
+            case '"':  esc[1] = '"'; break;
+            case '\\': esc[1] = '\\'; break;
+            case '\b': esc[1] = 'b'; break;
+            case '\f': esc[1] = 'f'; break;
+            case '\n': esc[1] = 'n'; break;
+            case '\r': esc[1] = 'r'; break;
+            case '\t': esc[1] = 't'; break;
+            default:
+                esc[1] = 'u';
+                esc[2] = '0';
+                esc[3] = '0';
+                esc[4] = hex[c >> 4];
+                esc[5] = hex[c & 15];
+                len = 6;
+        }
+        out_put(o, esc, len);
+    }
+    out_char(o, '"');
+}
+
+static void out_number(Out *o, double n) {
+    char buf[32];
+    int len;
+    if (!isfinite(n)) {
+        out_put(o, "null", 4);
+        return;
+    }
+    if (n == floor(n) && fabs(n) < 1e15) {
+        len = snprintf(buf, sizeof(buf), "%lld", (long long)n);
+    } else {
+        /* Shortest of 15..17 significant digits that reads back exactly */
+        int prec = 15;
+        len = snprintf(buf, sizeof(buf), "%.*g", prec, n);
+        while (prec < 17 && strtod(buf, NULL) != n)
+            len = snprintf(buf, sizeof(buf), "%.*g", ++prec, n);
+    }
+    out_put(o, buf, (size_t)len);
+}
+
+static void write_value(Out *o, Value v, int depth) {
+    if (depth > JSON_MAX_DEPTH) {
+        out_put(o, "null", 4);
+        return;
+    }
+    switch (val_type(v)) {
+        case VAL_BOOL:
+            if (AS_BOOL(v)) out_put(o, "true", 4);
+            else out_put(o, "false", 5);
+            return;
+        case VAL_NUMBER:
+            out_number(o, AS_NUMBER(v));
+            return;
+        case VAL_STRING:
+            out_string(o, AS_STRING(v)->chars, (size_t)AS_STRING(v)->len);
+            return;
+        case VAL_ARRAY:
+            out_char(o, '[');
+            for (int i = 0; i < AS_ARRAY(v)->count; i++) {
+                if (i > 0) out_char(o, ',');
+                write_value(o, AS_ARRAY(v)->items[i], depth + 1);
+            }
+            out_char(o, ']');
+            return;
+        case VAL_RANGE:
+            out_char(o, '[');
+            for (int i = 0; i < AS_RANGE(v)->count; i++) {
+                if (i > 0) out_char(o, ',');
+                out_number(o, AS_NUMBER(val_range_at(AS_RANGE(v), i)));
+            }
+            out_char(o, ']');
+            return;
+        case VAL_F64ARRAY:
+            out_char(o, '[');
+            for (int i = 0; i < AS_F64(v)->count; i++) {
+                if (i > 0) out_char(o, ',');
+                out_number(o, AS_F64(v)->data[i]);
+            }
+            out_char(o, ']');
+            return;
+        case VAL_OBJECT: {
+            int first = 1;
+            out_char(o, '{');
+            TABLE_FOR_EACH(AS_OBJECT(v), e) {
+                if (!first) out_char(o, ',');
+                first = 0;
+                out_string(o, e->key, (size_t)intern_len(e->key));
+                out_char(o, ':');
+                write_value(o, e->value, depth + 1);
+            }
+            out_char(o, '}');
+            return;
+        }
+        default:
+            out_put(o, "null", 4);
+            return;
+    }
+}
+
+Value json_stringify(Value v) {
+    Out o;
+    o.cap = 64;
+    o.len = 0;
+    o.buf = malloc(o.cap);
+    write_value(&o, v, 0);
+    o.buf[o.len] = '\0';
+    return val_string_take_cap(o.buf, (int)o.len, (int)o.cap);
+}
@@ -0,0 +1,37 @@
+#ifndef JUNG_JSON_H
+#define JUNG_JSON_H
+
+#include "value.h"
+#include <stddef.h>
+
+/* JSON reading and writing for jsonParse, jsonStringify and jsonLines.
+ *
+ * The parser is a single pass over the input that builds Values directly:
+ * container elements collect on a scratch stack and each array or object
+ * is allocated at its final size when it closes. Strings without escapes
+ * are copied straight out of the input. Object keys are interned through
+ * a small cache, so the repeated keys of NDJSON records mostly skip the
+ * intern pool. */
+
+#define JSON_MAX_DEPTH 512
+#define JSON_KEY_SLOTS 256
+
+/* Recently interned object keys, by hash of their bytes. Each holds a
+ * reference to its key (intern_key), dropped by json_keys_clear. */
+typedef struct JsonKeys {
+    const char *slot[JSON_KEY_SLOTS];
+} JsonKeys;
+
+void  json_keys_clear(JsonKeys *keys);
+
+/* Parse exactly one JSON value (surrounding whitespace allowed) from
+ * s[0, len), which need not be NUL-terminated. keys may be NULL. Returns 1
+ * and sets *out on success, 0 on malformed or too deeply nested input. */
+int   json_parse(const char *s, size_t len, JsonKeys *keys, Value *out);
+
+/* v as compact JSON. Ranges and Float64Arrays write as arrays; NaN, the
+ * infinities, functions, classes and files write as null, as does anything
+ * nested deeper than JSON_MAX_DEPTH. */
+Value json_stringify(Value v);
+
+#endif
@@ -0,0 +1,168 @@
+#include "jung.h"
+#include "interpreter.h"
+#include "gc.h"
+#include "intern.h"
+#include "jit.h"
+#include "jungc.h"
+#include "memstats.h"
+#include "profile.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+Jung *jung_new(void) {
+    Jung *J = malloc(sizeof(Jung));
+    interp_init(J);
+    return J;
+}
+
+void jung_free(Jung *J) {
+    if (!J) return;
+    interp_free(J);
+    free(J);
+    gc_collect();
+}
+
+void jung_use_vm(Jung *J, int on) {
+    J->use_vm = on;
+}
+
+void jung_lazy_imports(Jung *J, int on) {
+    J->lazy_imports = on;
+}
+
+void jung_max_depth(Jung *J, int depth) {
+    J->max_depth = depth > 0 ? depth : 0;
+}
+
+void jung_jit(Jung *J, int on) {
+    if (on && !J->jit) J->jit = jit_new();
+    if (!on) {
+        jit_free(J->jit);
+        J->jit = NULL;
+    }
+}
+
+void jung_profile(Jung *J, int on) {
+    if (on && !J->profile) J->profile = profile_new();
+    if (!on) {
+        profile_free(J->profile);
+        J->profile = NULL;
+    }
+}
+
+int jung_profile_write(Jung *J, const char *folded_path) {
+    if (!J->profile) {
+        errno = EINVAL;
+        return -1;
+    }
+    return profile_write(J->profile, folded_path, stderr, 20);
+}
+
+int jung_run(Jung *J, const char *source) {
+    free(J->error);
+    J->error = NULL;
+    return interp_run(J, source);
+}
+
+static void set_error(Jung *J, const char *msg) {
+    free(J->error);
+    J->error = strdup(msg);
+}
+
+static char *read_source(Jung *J, const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        char msg[1100];
+        snprintf(msg, sizeof(msg), "jung: cannot open file '%s'", path);
+        set_error(J, msg);
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *buf = malloc((size_t)size + 1);
+    size_t nr = fread(buf, 1, (size_t)size, f);
+    buf[nr] = '\0';
+    fclose(f);
+    return buf;
+}
+
+int jung_run_file(Jung *J, const char *path) {
+    ASTNode *program = jungc_load(path);
+    if (program) {
+        free(J->error);
+        J->error = NULL;
+        return interp_run_program(J, program);
+    }
+    char *src = read_source(J, path);
+    if (!src) return JUNG_ERROR;
+    int status = jung_run(J, src);
+    free(src);
+    return status;
+}
+
+int jung_compile_file(Jung *J, const char *path) {
+    char *src = read_source(J, path);
+    if (!src) return JUNG_ERROR;
+    char err[256];
+    ASTNode *program = interp_parse(src, err);
+    int status = JUNG_OK;
+    if (!program) {
+        set_error(J, err);
+        status = JUNG_ERROR;
+    } else if (jungc_write(path, src, program) != 0) {
+        char msg[1100];
+        snprintf(msg, sizeof(msg), "jung: cannot write '%sc': %s", path, strerror(errno));
+        set_error(J, msg);
+        status = JUNG_ERROR;
+    }
+    ast_free(program);
+    free(src);
+    return status;
+}
+
+int jung_dump_ast(Jung *J, const char *path) {
+    char *src = read_source(J, path);
+    if (!src) return JUNG_ERROR;
+    char err[256];
+    ASTNode *program = interp_parse(src, err);
+    free(src);
+    if (!program) {
+        set_error(J, err);
+        return JUNG_ERROR;
+    }
+    ast_dump(program, stdout);
+    ast_free(program);
+    return JUNG_OK;
+}
+
+const char *jung_error(Jung *J) {
+    return J->error;
+}
+
+int jung_exit_code(Jung *J) {
+    return J->exit_code;
+}
+
+int jung_gc(void) {
+    return gc_collect();
+}
+
+void jung_gc_threshold(int roots) {
+    gc_set_threshold(roots);
+}
+
+void jung_mem_stats(int on) {
+    mem_stats_enable(on);
+}
+
+void jung_mem_stats_print(void) {
+    mem_stats_print(stderr);
+}
+
+void jung_shutdown(void) {
+    table_shapes_free();
+    intern_free();
+}
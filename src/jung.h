@@ -0,0 +1,92 @@
+#ifndef JUNG_H
+#define JUNG_H
+
+/* Embedding API, built as libjung.a / libjung.so (make lib).
+ *
+ * Each Jung is an independent interpreter: it owns all of its values and
+ * never calls exit(). Errors, uncaught exceptions and the script's exit()
+ * come back as a status from jung_run*. Separate Jungs may run on
+ * separate threads at the same time; one Jung must not be used from two
+ * threads at once. The only state they share is the process-wide string
+ * intern pool and object shape tree, which are internally locked.
+ *
+ * Reference cycles are found by a per-thread collector (gc.h). A Jung
+ * that moves to another thread should move after jung_gc() on the thread
+ * it last ran on, or after that thread exits. */
+
+#define JUNG_VERSION "jung v1.0.0"
+
+/* Status of jung_run / jung_run_file */
+#define JUNG_OK    0
+#define JUNG_ERROR 1      /* parse error, runtime error or uncaught exception */
+#define JUNG_EXIT  2      /* the script called exit(); see jung_exit_code */
+
+typedef struct Interpreter Jung;
+
+Jung       *jung_new(void);
+void        jung_free(Jung *J);
+void        jung_use_vm(Jung *J, int on);    /* run on the bytecode VM */
+
+/* Defer each import until a name lookup misses, then load pending modules
+ * in import order until it resolves */
+void        jung_lazy_imports(Jung *J, int on);
+
+/* Raise "stack overflow" past depth nested calls; 0 for no limit but the
+ * stacks themselves. Tail calls to dreams that cannot see the caller's
+ * names do not nest. The default is 100000 on the VM, which runs calls
+ * on a heap frame stack. The tree walker (with or without --jit) nests C
+ * frames for every other call, method calls included, so by default it
+ * has no limit but the C stack: "stack overflow" near depth 8000 with
+ * an 8 MB stack. */
+void        jung_max_depth(Jung *J, int depth);
+
+/* Compile hot numeric dreams to machine code (see jit.h). A no-op where
+ * there is no native tier; turning it off drops the code. */
+void        jung_jit(Jung *J, int on);
+
+/* Time every call and statement from now on (see profile.h). Turning it
+ * off discards what was gathered. */
+void        jung_profile(Jung *J, int on);
+
+/* Print the top functions and lines to stderr and write folded stacks
+ * (for flamegraph.pl) to folded_path. 0, or -1 with errno set when the
+ * file cannot be written or profiling is off. */
+int         jung_profile_write(Jung *J, const char *folded_path);
+
+/* Run a program in J. Definitions and globals persist across runs.
+ * jung_run_file uses path's compiled form (path + "c") while it matches. */
+int         jung_run(Jung *J, const char *source);
+int         jung_run_file(Jung *J, const char *path);
+
+/* Parse path and write its compiled form next to it (file.jung ->
+ * file.jungc). JUNG_OK or JUNG_ERROR. */
+int         jung_compile_file(Jung *J, const char *path);
+
+/* Parse path and print its optimized AST to stdout (ast_dump). JUNG_OK
+ * or JUNG_ERROR. */
+int         jung_dump_ast(Jung *J, const char *path);
+
+const char *jung_error(Jung *J);     /* message of the last JUNG_ERROR, else NULL */
+int         jung_exit_code(Jung *J); /* code passed to exit() for JUNG_EXIT */
+
+/* Free the unreachable cycles this thread has seen so far: the number of
+ * arrays and objects freed. Collection also runs on its own as they pile
+ * up, and in jung_free. */
+int         jung_gc(void);
+
+/* Cycle candidates that start a collection (default 10000, or the
+ * JUNG_GC_THRESHOLD environment variable); 0 collects only in jung_gc()
+ * and gc(). Applies to every thread. */
+void        jung_gc_threshold(int roots);
+
+/* Count allocations, copies and table resizes from now on, for every Jung
+ * in the process (memstats.h); off by default. jung_mem_stats_print
+ * writes the counts to stderr. */
+void        jung_mem_stats(int on);
+void        jung_mem_stats_print(void);
+
+/* Release the shared intern pool and shape tree. Only valid once no Jung
+ * is left; the process should not create another afterwards. */
+void        jung_shutdown(void);
+
+#endif
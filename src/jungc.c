@@ -0,0 +1,644 @@
+#include "jungc.h"
+#include "intern.h"
+#include "resolver.h"
+#include "table.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Layout, all integers in host byte order (the byte-order mark rejects a
+ * file from another machine):
+ *
+ *   "JNGC" u32 format  u32 0x01020304
+ *   u64 source size  i64 mtime seconds  i64 mtime nanoseconds  u64 hash
+ *   u64 payload hash, of every byte after the header
+ *   u32 name count, then per name: u32 length, bytes
+ *   the NODE_PROGRAM node
+ *
+ * A node is u8 type (NO_NODE for NULL), u32 line, u32 col, then its
+ * fields in the order put_node writes them. Names are u32 string table
+ * indexes, owned strings are inline (u32 length, bytes) and lists are
+ * u32 count followed by the elements. NO_INDEX stands for a NULL name. */
+
+#define MAGIC "JNGC"
+#define BYTE_ORDER_MARK 0x01020304u
+#define HEADER_SIZE (4 + 4 + 4 + 8 + 8 + 8 + 8 + 8)
+#define NO_NODE 0xFF
+#define NO_INDEX 0xFFFFFFFFu
+
+static char *cache_path(const char *src_path) {
+    size_t n = strlen(src_path);
+    char *p = malloc(n + 2);
+    memcpy(p, src_path, n);
+    p[n] = 'c';
+    p[n + 1] = '\0';
+    return p;
+}
+
+static uint64_t content_hash(const char *s, size_t len) {
+    uint64_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+/* ---- writing ---- */
+
+typedef struct {
+    unsigned char *data;
+    size_t len;
+    size_t cap;
+    Table names;          /* interned name -> string table index */
+    const char **name_list;
+    int name_count;
+    int name_cap;
+} Writer;
+
+static void put_bytes(Writer *w, const void *p, size_t n) {
+    if (w->len + n > w->cap) {
+        while (w->len + n > w->cap) w->cap = w->cap ? w->cap * 2 : 4096;
+        w->data = realloc(w->data, w->cap);
+    }
+    memcpy(w->data + w->len, p, n);
+    w->len += n;
+}
+
+static void put_u8(Writer *w, unsigned int v) {
+    unsigned char b = (unsigned char)v;
+    put_bytes(w, &b, 1);
+}
+
+static void put_u32(Writer *w, uint32_t v) { put_bytes(w, &v, sizeof(v)); }
+static void put_u64(Writer *w, uint64_t v) { put_bytes(w, &v, sizeof(v)); }
+static void put_f64(Writer *w, double v)   { put_bytes(w, &v, sizeof(v)); }
+
+static void put_name(Writer *w, const char *name) {
+    if (!name) {
+        put_u32(w, NO_INDEX);
+        return;
+    }
+    Value idx;
+    if (!table_iget(&w->names, name, &idx)) {
+        if (w->name_count >= w->name_cap) {
+            w->name_cap = w->name_cap ? w->name_cap * 2 : 64;
+            w->name_list = realloc(w->name_list, sizeof(char *) * (size_t)w->name_cap);
+        }
+        idx = val_number(w->name_count);
+        w->name_list[w->name_count++] = name;
+        table_iset(&w->names, name, idx);
+    }
+    put_u32(w, (uint32_t)AS_NUMBER(idx));
+}
+
+static void put_str(Writer *w, const char *s, size_t len) {
+    if (!s) {
+        put_u32(w, NO_INDEX);
+        return;
+    }
+    put_u32(w, (uint32_t)len);
+    put_bytes(w, s, len);
+}
+
+static void put_node(Writer *w, ASTNode *n);
+
+static void put_nodes(Writer *w, ASTNode **nodes, int count) {
+    put_u32(w, (uint32_t)count);
+    for (int i = 0; i < count; i++) put_node(w, nodes[i]);
+}
+
+static void put_node(Writer *w, ASTNode *n) {
+    if (!n) {
+        put_u8(w, NO_NODE);
+        return;
+    }
+    put_u8(w, n->type);
+    put_u32(w, (uint32_t)n->line);
+    put_u32(w, (uint32_t)n->col);
+
+    switch (n->type) {
+    case NODE_NUMBER:
+        put_f64(w, n->as.number);
+        break;
+    case NODE_STRING:
+        put_str(w, n->as.string.str, (size_t)n->as.string.len);
+        break;
+    case NODE_CONST:
+        put_str(w, AS_STRING(n->as.constant)->chars, (size_t)AS_STRING(n->as.constant)->len);
+        break;
+    case NODE_BOOL:
+        put_u32(w, (uint32_t)n->as.boolean);
+        break;
+    case NODE_NULL:
+    case NODE_THIS:
+    case NODE_BREAK:
+    case NODE_CONTINUE:
+        break;
+    case NODE_VARIABLE:
+        put_name(w, n->as.var_name);
+        break;
+    case NODE_BINARY:
+        put_node(w, n->as.binary.left);
+        put_node(w, n->as.binary.right);
+        put_u32(w, n->as.binary.op);
+        break;
+    case NODE_UNARY:
+        put_node(w, n->as.unary.operand);
+        put_u32(w, n->as.unary.op);
+        break;
+    case NODE_ASSIGN:
+        put_name(w, n->as.assign.name);
+        put_node(w, n->as.assign.value);
+        break;
+    case NODE_COMPOUND_ASSIGN:
+        put_name(w, n->as.comp_assign.name);
+        put_u32(w, n->as.comp_assign.op);
+        put_node(w, n->as.comp_assign.value);
+        break;
+    case NODE_PRINT:
+        put_node(w, n->as.print_expr);
+        break;
+    case NODE_IF:
+        put_node(w, n->as.if_stmt.condition);
+        put_nodes(w, n->as.if_stmt.then_body, n->as.if_stmt.then_count);
+        put_nodes(w, n->as.if_stmt.else_body, n->as.if_stmt.else_count);
+        break;
+    case NODE_WHILE:
+        put_node(w, n->as.while_loop.condition);
+        put_nodes(w, n->as.while_loop.body, n->as.while_loop.body_count);
+        break;
+    case NODE_FOR:
+        put_name(w, n->as.for_loop.var);
+        put_node(w, n->as.for_loop.iterable);
+        put_nodes(w, n->as.for_loop.body, n->as.for_loop.body_count);
+        break;
+    case NODE_FUNC_DEF:
+        put_name(w, n->as.func_def.name);
+        put_u32(w, (uint32_t)n->as.func_def.param_count);
+        for (int i = 0; i < n->as.func_def.param_count; i++) {
+            put_name(w, n->as.func_def.params[i].name);
+            put_node(w, n->as.func_def.params[i].default_val);
+        }
+        put_nodes(w, n->as.func_def.body, n->as.func_def.body_count);
+        break;
+    case NODE_FUNC_CALL:
+    case NODE_METHOD_CALL:
+        put_name(w, n->as.func_call.name);
+        put_nodes(w, n->as.func_call.args, n->as.func_call.arg_count);
+        break;
+    case NODE_RETURN:
+        put_node(w, n->as.return_val);
+        break;
+    case NODE_IMPORT:
+        put_str(w, n->as.import_path, n->as.import_path ? strlen(n->as.import_path) : 0);
+        break;
+    case NODE_TRY_CATCH:
+        put_nodes(w, n->as.try_catch.try_body, n->as.try_catch.try_count);
+        put_name(w, n->as.try_catch.catch_var);
+        put_nodes(w, n->as.try_catch.catch_body, n->as.try_catch.catch_count);
+        break;
+    case NODE_THROW:
+        put_node(w, n->as.throw_val);
+        break;
+    case NODE_CLASS:
+        put_name(w, n->as.class_def.name);
+        put_nodes(w, n->as.class_def.methods, n->as.class_def.method_count);
+        break;
+    case NODE_NEW:
+        put_name(w, n->as.new_inst.class_name);
+        put_nodes(w, n->as.new_inst.args, n->as.new_inst.arg_count);
+        break;
+    case NODE_ARRAY:
+        put_nodes(w, n->as.array.elements, n->as.array.count);
+        break;
+    case NODE_ARRAY_INDEX:
+        put_node(w, n->as.array_index.array_expr);
+        put_node(w, n->as.array_index.index);
+        break;
+    case NODE_OBJECT:
+        put_u32(w, (uint32_t)n->as.object.count);
+        for (int i = 0; i < n->as.object.count; i++) {
+            put_name(w, n->as.object.keys[i]);
+            put_node(w, n->as.object.values[i]);
+        }
+        break;
+    case NODE_OBJ_ACCESS:
+        put_node(w, n->as.obj_access.obj);
+        put_name(w, n->as.obj_access.key);
+        put_node(w, n->as.obj_access.key_expr);
+        put_u32(w, (uint32_t)n->as.obj_access.is_bracket);
+        break;
+    case NODE_OBJ_ASSIGN:
+        put_node(w, n->as.obj_assign.obj);
+        put_name(w, n->as.obj_assign.key);
+        put_node(w, n->as.obj_assign.key_expr);
+        put_node(w, n->as.obj_assign.value);
+        put_u32(w, (uint32_t)n->as.obj_assign.is_bracket);
+        break;
+    case NODE_OBJ_COMPOUND_ASSIGN:
+        put_node(w, n->as.obj_comp_assign.obj);
+        put_name(w, n->as.obj_comp_assign.key);
+        put_node(w, n->as.obj_comp_assign.key_expr);
+        put_node(w, n->as.obj_comp_assign.value);
+        put_u32(w, (uint32_t)n->as.obj_comp_assign.is_bracket);
+        put_u32(w, n->as.obj_comp_assign.op);
+        break;
+    case NODE_TERNARY:
+        put_node(w, n->as.ternary.condition);
+        put_node(w, n->as.ternary.then_expr);
+        put_node(w, n->as.ternary.else_expr);
+        break;
+    case NODE_STRING_INTERP:
+        put_nodes(w, n->as.interp.parts, n->as.interp.count);
+        break;
+    case NODE_PROGRAM:
+        put_nodes(w, n->as.program.stmts, n->as.program.count);
+        break;
+    }
+}
+
+int jungc_write(const char *src_path, const char *source, ASTNode *program) {
+    struct stat st;
+    if (stat(src_path, &st) != 0) return -1;
+
+    Writer body;
+    memset(&body, 0, sizeof(body));
+    table_init(&body.names);
+    put_node(&body, program);
+
+    Writer out;
+    memset(&out, 0, sizeof(out));
+    put_bytes(&out, MAGIC, 4);
+    put_u32(&out, JUNGC_FORMAT);
+    put_u32(&out, BYTE_ORDER_MARK);
+    put_u64(&out, (uint64_t)st.st_size);
+    put_u64(&out, (uint64_t)st.st_mtim.tv_sec);
+    put_u64(&out, (uint64_t)st.st_mtim.tv_nsec);
+    put_u64(&out, content_hash(source, strlen(source)));
+    put_u64(&out, 0);     /* payload hash, filled in below */
+    put_u32(&out, (uint32_t)body.name_count);
+    for (int i = 0; i < body.name_count; i++) {
+        put_str(&out, body.name_list[i], (size_t)intern_len(body.name_list[i]));
+    }
+    put_bytes(&out, body.data, body.len);
+    uint64_t payload = content_hash((const char *)out.data + HEADER_SIZE, out.len - HEADER_SIZE);
+    memcpy(out.data + HEADER_SIZE - 8, &payload, 8);
+    free(body.data);
+    free(body.name_list);
+    table_free(&body.names);
+
+    /* Write a temporary and rename it over the cache, so a reader never
+     * sees a half-written file */
+    char *path = cache_path(src_path);
+    size_t n = strlen(path);
+    char *tmp = malloc(n + 5);
+    memcpy(tmp, path, n);
+    memcpy(tmp + n, ".tmp", 5);
+    int rc = -1;
+    FILE *f = fopen(tmp, "wb");
+    if (f) {
+        int ok = fwrite(out.data, 1, out.len, f) == out.len;
+        if (fclose(f) != 0) ok = 0;
+        if (ok && rename(tmp, path) == 0) rc = 0;
+        else {
+            int saved = errno;
+            remove(tmp);
+            errno = saved;
+        }
+    }
+    free(out.data);
+    free(tmp);
+    free(path);
+    return rc;
+}
+
+/* ---- loading ---- */
+
+/* Reads past the end, or counts larger than what is left, set bad and
+ * yield zeros, so a damaged file builds a partial tree that is freed. */
+typedef struct {
+    const unsigned char *p;
+    const unsigned char *end;
+    const char **names;
+    uint32_t name_count;
+    Arena *arena;           /* the nodes being read */
+    int bad;
+} Reader;
+
+static int get_bytes(Reader *r, void *out, size_t n) {
+    if (r->bad || (size_t)(r->end - r->p) < n) {
+        r->bad = 1;
+        memset(out, 0, n);
+        return 0;
+    }
+    memcpy(out, r->p, n);
+    r->p += n;
+    return 1;
+}
+
+static unsigned int get_u8(Reader *r) {
+    unsigned char b;
+    get_bytes(r, &b, 1);
+    return b;
+}
+
+static uint32_t get_u32(Reader *r) { uint32_t v; get_bytes(r, &v, sizeof(v)); return v; }
+static uint64_t get_u64(Reader *r) { uint64_t v; get_bytes(r, &v, sizeof(v)); return v; }
+static double   get_f64(Reader *r) { double v;   get_bytes(r, &v, sizeof(v)); return v; }
+
+/* A list length; every element takes at least one byte */
+static int get_count(Reader *r) {
+    uint32_t n = get_u32(r);
+    if (n > (uint32_t)(r->end - r->p) || n > INT32_MAX) {
+        r->bad = 1;
+        return 0;
+    }
+    return (int)n;
+}
+
+static const char *get_name(Reader *r) {
+    uint32_t i = get_u32(r);
+    if (i == NO_INDEX) return NULL;
+    if (i >= r->name_count) {
+        r->bad = 1;
+        return NULL;
+    }
+    return r->names[i];
+}
+
+static char *get_str(Reader *r, int *len) {
+    uint32_t n = get_u32(r);
+    if (n == NO_INDEX || r->bad) return NULL;
+    if (n > (uint32_t)(r->end - r->p) || n > INT32_MAX) {
+        r->bad = 1;
+        return NULL;
+    }
+    char *s = arena_alloc(r->arena, n + 1);
+    memcpy(s, r->p, n);
+    s[n] = '\0';
+    r->p += n;
+    if (len) *len = (int)n;
+    return s;
+}
+
+static ASTNode *get_node(Reader *r);
+
+static ASTNode **get_nodes(Reader *r, int *count) {
+    int n = get_count(r);
+    ASTNode **nodes = arena_alloc(r->arena, sizeof(ASTNode *) * (size_t)n);
+    for (int i = 0; i < n; i++) nodes[i] = get_node(r);
+    *count = n;
+    return nodes;
+}
+
+static ASTNode *get_node(Reader *r) {
+    unsigned int type = get_u8(r);
+    if (type == NO_NODE || r->bad) return NULL;
+    if (type > NODE_PROGRAM) {
+        r->bad = 1;
+        return NULL;
+    }
+    int line = (int)get_u32(r);
+    int col = (int)get_u32(r);
+    ASTNode *n = ast_node(r->arena, (NodeType)type, line, col);
+
+    switch (n->type) {
+    case NODE_NUMBER:
+        n->as.number = get_f64(r);
+        break;
+    case NODE_STRING:
+        n->as.string.str = get_str(r, &n->as.string.len);
+        break;
+    case NODE_CONST: {
+        int len = 0;
+        char *s = get_str(r, &len);
+        n->as.constant = s ? val_string(s, len) : val_null();
+        arena_keep(r->arena, n->as.constant);
+        break;
+    }
+    case NODE_BOOL:
+        n->as.boolean = (int)get_u32(r);
+        break;
+    case NODE_NULL:
+    case NODE_THIS:
+    case NODE_BREAK:
+    case NODE_CONTINUE:
+        break;
+    case NODE_VARIABLE:
+        n->as.var_name = get_name(r);
+        break;
+    case NODE_BINARY:
+        n->as.binary.left = get_node(r);
+        n->as.binary.right = get_node(r);
+        n->as.binary.op = (TokenType)get_u32(r);
+        break;
+    case NODE_UNARY:
+        n->as.unary.operand = get_node(r);
+        n->as.unary.op = (TokenType)get_u32(r);
+        break;
+    case NODE_ASSIGN:
+        n->as.assign.name = get_name(r);
+        n->as.assign.value = get_node(r);
+        break;
+    case NODE_COMPOUND_ASSIGN:
+        n->as.comp_assign.name = get_name(r);
+        n->as.comp_assign.op = (TokenType)get_u32(r);
+        n->as.comp_assign.value = get_node(r);
+        break;
+    case NODE_PRINT:
+        n->as.print_expr = get_node(r);
+        break;
+    case NODE_IF:
+        n->as.if_stmt.condition = get_node(r);
+        n->as.if_stmt.then_body = get_nodes(r, &n->as.if_stmt.then_count);
+        n->as.if_stmt.else_body = get_nodes(r, &n->as.if_stmt.else_count);
+        break;
+    case NODE_WHILE:
+        n->as.while_loop.condition = get_node(r);
+        n->as.while_loop.body = get_nodes(r, &n->as.while_loop.body_count);
+        break;
+    case NODE_FOR:
+        n->as.for_loop.var = get_name(r);
+        n->as.for_loop.iterable = get_node(r);
+        n->as.for_loop.body = get_nodes(r, &n->as.for_loop.body_count);
+        break;
+    case NODE_FUNC_DEF: {
+        n->as.func_def.name = get_name(r);
+        int pc = get_count(r);
+        n->as.func_def.params = arena_alloc(r->arena, sizeof(Param) * (size_t)pc);
+        n->as.func_def.param_count = pc;
+        for (int i = 0; i < pc; i++) {
+            n->as.func_def.params[i].name = get_name(r);
+            n->as.func_def.params[i].default_val = get_node(r);
+        }
+        n->as.func_def.body = get_nodes(r, &n->as.func_def.body_count);
+        break;
+    }
+    case NODE_FUNC_CALL:
+    case NODE_METHOD_CALL:
+        n->as.func_call.name = get_name(r);
+        n->as.func_call.args = get_nodes(r, &n->as.func_call.arg_count);
+        break;
+    case NODE_RETURN:
+        n->as.return_val = get_node(r);
+        break;
+    case NODE_IMPORT:
+        n->as.import_path = get_str(r, NULL);
+        if (!n->as.import_path) r->bad = 1;
+        break;
+    case NODE_TRY_CATCH:
+        n->as.try_catch.try_body = get_nodes(r, &n->as.try_catch.try_count);
+        n->as.try_catch.catch_var = get_name(r);
+        n->as.try_catch.catch_body = get_nodes(r, &n->as.try_catch.catch_count);
+        break;
+    case NODE_THROW:
+        n->as.throw_val = get_node(r);
+        break;
+    case NODE_CLASS:
+        n->as.class_def.name = get_name(r);
+        n->as.class_def.methods = get_nodes(r, &n->as.class_def.method_count);
+        break;
+    case NODE_NEW:
+        n->as.new_inst.class_name = get_name(r);
+        n->as.new_inst.args = get_nodes(r, &n->as.new_inst.arg_count);
+        break;
+    case NODE_ARRAY:
+        n->as.array.elements = get_nodes(r, &n->as.array.count);
+        break;
+    case NODE_ARRAY_INDEX:
+        n->as.array_index.array_expr = get_node(r);
+        n->as.array_index.index = get_node(r);
+        break;
+    case NODE_OBJECT: {
+        int c = get_count(r);
+        n->as.object.keys = arena_alloc(r->arena, sizeof(char *) * (size_t)c);
+        n->as.object.values = arena_alloc(r->arena, sizeof(ASTNode *) * (size_t)c);
+        n->as.object.count = c;
+        for (int i = 0; i < c; i++) {
+            n->as.object.keys[i] = get_name(r);
+            n->as.object.values[i] = get_node(r);
+        }
+        break;
+    }
+    case NODE_OBJ_ACCESS:
+        n->as.obj_access.obj = get_node(r);
+        n->as.obj_access.key = get_name(r);
+        n->as.obj_access.key_expr = get_node(r);
+        n->as.obj_access.is_bracket = (int)get_u32(r);
+        break;
+    case NODE_OBJ_ASSIGN:
+        n->as.obj_assign.obj = get_node(r);
+        n->as.obj_assign.key = get_name(r);
+        n->as.obj_assign.key_expr = get_node(r);
+        n->as.obj_assign.value = get_node(r);
+        n->as.obj_assign.is_bracket = (int)get_u32(r);
+        break;
+    case NODE_OBJ_COMPOUND_ASSIGN:
+        n->as.obj_comp_assign.obj = get_node(r);
+        n->as.obj_comp_assign.key = get_name(r);
+        n->as.obj_comp_assign.key_expr = get_node(r);
+        n->as.obj_comp_assign.value = get_node(r);
+        n->as.obj_comp_assign.is_bracket = (int)get_u32(r);
+        n->as.obj_comp_assign.op = (TokenType)get_u32(r);
+        break;
+    case NODE_TERNARY:
+        n->as.ternary.condition = get_node(r);
+        n->as.ternary.then_expr = get_node(r);
+        n->as.ternary.else_expr = get_node(r);
+        break;
+    case NODE_STRING_INTERP:
+        n->as.interp.parts = get_nodes(r, &n->as.interp.count);
+        break;
+    case NODE_PROGRAM:
+        n->as.program.stmts = get_nodes(r, &n->as.program.count);
+        break;
+    }
+    return n;
+}
+
+/* Whether the header in r describes the source at src_path and the rest
+ * of the file is what was written after it */
+static int header_current(Reader *r, const char *src_path) {
+    char magic[4];
+    get_bytes(r, magic, 4);
+    if (r->bad || memcmp(magic, MAGIC, 4) != 0) return 0;
+    if (get_u32(r) != JUNGC_FORMAT || get_u32(r) != BYTE_ORDER_MARK) return 0;
+    uint64_t size = get_u64(r);
+    uint64_t sec = get_u64(r);
+    uint64_t nsec = get_u64(r);
+    uint64_t hash = get_u64(r);
+    uint64_t payload = get_u64(r);
+
+    struct stat st;
+    if (r->bad || stat(src_path, &st) != 0 || (uint64_t)st.st_size != size) return 0;
+    /* A damaged body could still decode to a valid, different program */
+    if (content_hash((const char *)r->p, (size_t)(r->end - r->p)) != payload) return 0;
+    if ((uint64_t)st.st_mtim.tv_sec == sec && (uint64_t)st.st_mtim.tv_nsec == nsec) return 1;
+
+    /* Touched but maybe not changed (a checkout, a copy): compare content */
+    FILE *f = fopen(src_path, "rb");
+    if (!f) return 0;
+    char *buf = malloc((size_t)size + 1);
+    size_t nr = fread(buf, 1, (size_t)size, f);
+    fclose(f);
+    int same = nr == size && content_hash(buf, nr) == hash;
+    free(buf);
+    return same;
+}
+
+ASTNode *jungc_load(const char *src_path) {
+    char *path = cache_path(src_path);
+    int fd = open(path, O_RDONLY);
+    free(path);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < HEADER_SIZE) {
+        close(fd);
+        return NULL;
+    }
+    size_t size = (size_t)st.st_size;
+    void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return NULL;
+
+    Reader r;
+    memset(&r, 0, sizeof(r));
+    r.p = map;
+    r.end = r.p + size;
+    ASTNode *program = NULL;
+    if (header_current(&r, src_path)) {
+        /* Names are interned straight out of the mapping */
+        r.name_count = (uint32_t)get_count(&r);
+        r.names = malloc(sizeof(char *) * (r.name_count ? r.name_count : 1));
+        for (uint32_t i = 0; i < r.name_count; i++) {
+            uint32_t n = get_u32(&r);
+            if (r.bad || n > (uint32_t)(r.end - r.p) || n > INT32_MAX) {
+                r.bad = 1;
+                r.name_count = i;
+                break;
+            }
+            r.names[i] = intern((const char *)r.p, (int)n);
+            r.p += n;
+        }
+        r.arena = arena_new();
+        program = get_node(&r);
+        if (!program || program->type != NODE_PROGRAM || r.p != r.end) r.bad = 1;
+        if (r.bad) {
+            arena_free(r.arena);
+            program = NULL;
+        } else {
+            program->as.program.arena = r.arena;
+        }
+        free(r.names);
+    }
+    munmap(map, size);
+    if (program) resolve_program(program);
+    return program;
+}
@@ -0,0 +1,28 @@
+#ifndef JUNG_JUNGC_H
+#define JUNG_JUNGC_H
+
+#include "parser.h"
+
+/* Compiled module files (.jungc): the parsed AST of a source file, stored
+ * next to it as the source path with a 'c' appended (file.jung ->
+ * file.jungc) and written by `jung --compile`.
+ *
+ * The file holds no pointers: names go in a string table and nodes are
+ * written in pre-order, so loading is one pass over the mapped file with
+ * no lexing or parsing. A cache is used only while it matches its source:
+ * same size and mtime, or failing that the same content hash. The header
+ * also holds a hash of the rest of the file, so a damaged cache is
+ * ignored rather than run. */
+
+/* Bump whenever the AST or this encoding changes; older files are ignored */
+#define JUNGC_FORMAT 4
+
+/* The resolved program of src_path from its .jungc, or NULL when there is
+ * no cache or it is stale or unreadable. */
+ASTNode *jungc_load(const char *src_path);
+
+/* Write program (parsed from src_path, whose text is source) to its .jungc.
+ * Returns 0 on success, else -1 with errno set. */
+int      jungc_write(const char *src_path, const char *source, ASTNode *program);
+
+#endif
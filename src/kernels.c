@@ -0,0 +1,282 @@
+#include "kernels.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* One vector type and a handful of operations per instruction set; the
+ * kernels below are written once against these. */
+#if !defined(JUNG_NO_SIMD) && defined(__AVX2__)
+#include <immintrin.h>
+#define KERNEL_ISA "avx2"
+#define LANES 4
+typedef __m256d vec;
+#define V_LOAD(p)     _mm256_loadu_pd(p)
+#define V_STORE(p, v) _mm256_storeu_pd(p, v)
+#define V_SET1(x)     _mm256_set1_pd(x)
+#define V_ADD(a, b)   _mm256_add_pd(a, b)
+#define V_MUL(a, b)   _mm256_mul_pd(a, b)
+#define V_MIN(a, b)   _mm256_min_pd(a, b)
+#define V_MAX(a, b)   _mm256_max_pd(a, b)
+#elif !defined(JUNG_NO_SIMD) && defined(__SSE2__)
+#include <emmintrin.h>
+#define KERNEL_ISA "sse2"
+#define LANES 2
+typedef __m128d vec;
+#define V_LOAD(p)     _mm_loadu_pd(p)
+#define V_STORE(p, v) _mm_storeu_pd(p, v)
+#define V_SET1(x)     _mm_set1_pd(x)
+#define V_ADD(a, b)   _mm_add_pd(a, b)
+#define V_MUL(a, b)   _mm_mul_pd(a, b)
+#define V_MIN(a, b)   _mm_min_pd(a, b)
+#define V_MAX(a, b)   _mm_max_pd(a, b)
+#elif !defined(JUNG_NO_SIMD) && defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define KERNEL_ISA "neon"
+#define LANES 2
+typedef float64x2_t vec;
+#define V_LOAD(p)     vld1q_f64(p)
+#define V_STORE(p, v) vst1q_f64(p, v)
+#define V_SET1(x)     vdupq_n_f64(x)
+#define V_ADD(a, b)   vaddq_f64(a, b)
+#define V_MUL(a, b)   vmulq_f64(a, b)
+#define V_MIN(a, b)   vminq_f64(a, b)
+#define V_MAX(a, b)   vmaxq_f64(a, b)
+#else
+#define KERNEL_ISA "scalar"
+#define LANES 0
+#endif
+
+const char *kernel_isa(void) {
+    return KERNEL_ISA;
+}
+
+#if LANES
+static double lanes_sum(vec v) {
+    double tmp[LANES];
+    V_STORE(tmp, v);
+    double s = 0;
+    for (int i = 0; i < LANES; i++) s += tmp[i];
+    return s;
+}
+#endif
+
+double kernel_sum(const double *a, int n) {
+    int i = 0;
+    double s = 0;
+#if LANES
+    vec s0 = V_SET1(0), s1 = V_SET1(0);
+    for (; i + 2 * LANES <= n; i += 2 * LANES) {
+        s0 = V_ADD(s0, V_LOAD(a + i));
+        s1 = V_ADD(s1, V_LOAD(a + i + LANES));
+    }
+    s = lanes_sum(V_ADD(s0, s1));
+#endif
+    for (; i < n; i++) s += a[i];
+    return s;
+}
+
+double kernel_dot(const double *a, const double *b, int n) {
+    int i = 0;
+    double s = 0;
+#if LANES
+    vec s0 = V_SET1(0), s1 = V_SET1(0);
+    for (; i + 2 * LANES <= n; i += 2 * LANES) {
+        s0 = V_ADD(s0, V_MUL(V_LOAD(a + i), V_LOAD(b + i)));
+        s1 = V_ADD(s1, V_MUL(V_LOAD(a + i + LANES), V_LOAD(b + i + LANES)));
+    }
+    s = lanes_sum(V_ADD(s0, s1));
+#endif
+    for (; i < n; i++) s += a[i] * b[i];
+    return s;
+}
+
+double kernel_min(const double *a, int n) {
+    int i = 0;
+    double m = a[0];
+#if LANES
+    if (n >= LANES) {
+        vec v = V_LOAD(a);
+        for (i = LANES; i + LANES <= n; i += LANES) v = V_MIN(v, V_LOAD(a + i));
+        double tmp[LANES];
+        V_STORE(tmp, v);
+        for (int j = 0; j < LANES; j++) if (tmp[j] < m) m = tmp[j];
+    }
+#endif
+    for (; i < n; i++) if (a[i] < m) m = a[i];
+    return m;
+}
+
+double kernel_max(const double *a, int n) {
+    int i = 0;
+    double m = a[0];
+#if LANES
+    if (n >= LANES) {
+        vec v = V_LOAD(a);
+        for (i = LANES; i + LANES <= n; i += LANES) v = V_MAX(v, V_LOAD(a + i));
+        double tmp[LANES];
+        V_STORE(tmp, v);
+        for (int j = 0; j < LANES; j++) if (tmp[j] > m) m = tmp[j];
+    }
+#endif
+    for (; i < n; i++) if (a[i] > m) m = a[i];
+    return m;
+}
+
+void kernel_scale(double *out, const double *a, double k, int n) {
+    int i = 0;
+#if LANES
+    vec kv = V_SET1(k);
+    for (; i + LANES <= n; i += LANES) V_STORE(out + i, V_MUL(V_LOAD(a + i), kv));
+#endif
+    for (; i < n; i++) out[i] = a[i] * k;
+}
+
+void kernel_add(double *out, const double *a, const double *b, int n) {
+    int i = 0;
+#if LANES
+    for (; i + LANES <= n; i += LANES) V_STORE(out + i, V_ADD(V_LOAD(a + i), V_LOAD(b + i)));
+#endif
+    for (; i < n; i++) out[i] = a[i] + b[i];
+}
+
+void kernel_add_scalar(double *out, const double *a, double k, int n) {
+    int i = 0;
+#if LANES
+    vec kv = V_SET1(k);
+    for (; i + LANES <= n; i += LANES) V_STORE(out + i, V_ADD(V_LOAD(a + i), kv));
+#endif
+    for (; i < n; i++) out[i] = a[i] + k;
+}
+
+/* ---- sort ---- */
+
+/* Map a double to an unsigned key with the same order: flip every bit of a
+ * negative number, only the sign bit of a positive one. NaNs are made
+ * positive first so they land after +inf. */
+static uint64_t sort_key(double d) {
+    uint64_t u;
+    if (d != d) d = NAN;
+    memcpy(&u, &d, sizeof(u));
+    return (u >> 63) ? ~u : u ^ 0x8000000000000000ull;
+}
+
+static double sort_unkey(uint64_t u) {
+    u = (u >> 63) ? u ^ 0x8000000000000000ull : ~u;
+    double d;
+    memcpy(&d, &u, sizeof(d));
+    return d;
+}
+
+#define RADIX_BITS 11
+#define RADIX_SIZE (1 << RADIX_BITS)
+#define RADIX_PASSES ((64 + RADIX_BITS - 1) / RADIX_BITS)
+
+static void insertion_sort(double *a, int n) {
+    for (int i = 1; i < n; i++) {
+        double x = a[i];
+        uint64_t kx = sort_key(x);
+        int j = i - 1;
+        while (j >= 0 && sort_key(a[j]) > kx) {
+            a[j + 1] = a[j];
+            j--;
+        }
+        a[j + 1] = x;
+    }
+}
+
+/* LSD radix sort on the order-preserving keys. A pass whose digit is the
+ * same for every key is skipped, which makes small integers cheap. */
+void kernel_sort(double *a, int n) {
+    if (n < 64) {
+        insertion_sort(a, n);
+        return;
+    }
+    uint64_t *keys = malloc(sizeof(uint64_t) * (size_t)n);
+    uint64_t *tmp = malloc(sizeof(uint64_t) * (size_t)n);
+    size_t *count = malloc(sizeof(size_t) * RADIX_SIZE);
+    for (int i = 0; i < n; i++) keys[i] = sort_key(a[i]);
+
+    for (int pass = 0; pass < RADIX_PASSES; pass++) {
+        int shift = pass * RADIX_BITS;
+        memset(count, 0, sizeof(size_t) * RADIX_SIZE);
+        for (int i = 0; i < n; i++) count[(keys[i] >> shift) & (RADIX_SIZE - 1)]++;
+        if (count[(keys[0] >> shift) & (RADIX_SIZE - 1)] == (size_t)n) continue;
+        size_t sum = 0;
+        for (int d = 0; d < RADIX_SIZE; d++) {
+            size_t c = count[d];
+            count[d] = sum;
+            sum += c;
+        }
+        for (int i = 0; i < n; i++) tmp[count[(keys[i] >> shift) & (RADIX_SIZE - 1)]++] = keys[i];
+        uint64_t *swap = keys;
+        keys = tmp;
+        tmp = swap;
+    }
+
+    for (int i = 0; i < n; i++) a[i] = sort_unkey(keys[i]);
+    free(keys);
+    free(tmp);
+    free(count);
+}
+
+/* kernel_sort carrying an int with each key. Both the insertion sort and
+ * the radix passes are stable, so equal keys keep their payload order. */
+void kernel_sort_pairs(double *a, int *payload, int n) {
+    if (n < 64) {
+        for (int i = 1; i < n; i++) {
+            double x = a[i];
+            int p = payload[i];
+            uint64_t kx = sort_key(x);
+            int j = i - 1;
+            while (j >= 0 && sort_key(a[j]) > kx) {
+                a[j + 1] = a[j];
+                payload[j + 1] = payload[j];
+                j--;
+            }
+            a[j + 1] = x;
+            payload[j + 1] = p;
+        }
+        return;
+    }
+    uint64_t *keys = malloc(sizeof(uint64_t) * (size_t)n);
+    uint64_t *tmp = malloc(sizeof(uint64_t) * (size_t)n);
+    int *pay = payload;
+    int *pay_tmp = malloc(sizeof(int) * (size_t)n);
+    size_t *count = malloc(sizeof(size_t) * RADIX_SIZE);
+    for (int i = 0; i < n; i++) keys[i] = sort_key(a[i]);
+
+    for (int pass = 0; pass < RADIX_PASSES; pass++) {
+        int shift = pass * RADIX_BITS;
+        memset(count, 0, sizeof(size_t) * RADIX_SIZE);
+        for (int i = 0; i < n; i++) count[(keys[i] >> shift) & (RADIX_SIZE - 1)]++;
+        if (count[(keys[0] >> shift) & (RADIX_SIZE - 1)] == (size_t)n) continue;
+        size_t sum = 0;
+        for (int d = 0; d < RADIX_SIZE; d++) {
+            size_t c = count[d];
+            count[d] = sum;
+            sum += c;
+        }
+        for (int i = 0; i < n; i++) {
+            size_t at = count[(keys[i] >> shift) & (RADIX_SIZE - 1)]++;
+            tmp[at] = keys[i];
+            pay_tmp[at] = pay[i];
+        }
+        uint64_t *swap = keys;
+        keys = tmp;
+        tmp = swap;
+        int *pswap = pay;
+        pay = pay_tmp;
+        pay_tmp = pswap;
+    }
+
+    for (int i = 0; i < n; i++) a[i] = sort_unkey(keys[i]);
+    if (pay != payload) {
+        memcpy(payload, pay, sizeof(int) * (size_t)n);
+        pay_tmp = pay;
+    }
+    free(keys);
+    free(tmp);
+    free(pay_tmp);
+    free(count);
+}
@@ -0,0 +1,30 @@
+#ifndef JUNG_KERNELS_H
+#define JUNG_KERNELS_H
+
+/* Numeric kernels over contiguous doubles, used by Float64Array builtins.
+ *
+ * The vector width is chosen at compile time: AVX2 when the compiler
+ * targets it (e.g. CFLAGS += -mavx2), else SSE2 (always on x86-64), else
+ * NEON on AArch64, else plain C. Build with -DJUNG_NO_SIMD to force the
+ * scalar code. Reductions keep several partial sums, so sum and dot may
+ * differ from a left-to-right loop in the last bits. */
+
+const char *kernel_isa(void);   /* "avx2", "sse2", "neon" or "scalar" */
+
+double kernel_sum(const double *a, int n);
+double kernel_dot(const double *a, const double *b, int n);
+double kernel_min(const double *a, int n);   /* n > 0 */
+double kernel_max(const double *a, int n);   /* n > 0 */
+
+/* out may alias an input */
+void   kernel_scale(double *out, const double *a, double k, int n);
+void   kernel_add(double *out, const double *a, const double *b, int n);
+void   kernel_add_scalar(double *out, const double *a, double k, int n);
+
+/* Ascending in place; NaNs sort last */
+void   kernel_sort(double *a, int n);
+
+/* The same, moving payload[i] along with a[i]; stable */
+void   kernel_sort_pairs(double *a, int *payload, int n);
+
+#endif
@@ -1,17 +1,22 @@
 #include "lexer.h"
+#include "memstats.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 
-static void add_token(Lexer *lex, TokenType type, const char *val, double num, int line, int col) {
+static void add_token(Lexer *lex, TokenType type, size_t start, size_t end, double num,
+                      int line, int col) {
     if (lex->token_count >= lex->token_cap) {
+        MEM_RESIZE(MEM_TOKEN, sizeof(Token) * (size_t)lex->token_cap,
+                   sizeof(Token) * (size_t)lex->token_cap * 2);
         lex->token_cap *= 2;
         lex->tokens = realloc(lex->tokens, sizeof(Token) * (size_t)lex->token_cap);
     }
     Token *t = &lex->tokens[lex->token_count++];
     t->type = type;
-    t->value = val ? strdup(val) : NULL;
+    t->start = (int)start;
+    t->length = (int)(end - start);
     t->num_value = num;
     t->line = line;
     t->col = col;
@@ -48,6 +53,7 @@ static void skip_comment(Lexer *lex) {
 static void read_number(Lexer *lex) {
     int scol = lex->col;
     int sline = lex->line;
+    size_t start = lex->pos;
     char buf[64];
     int len = 0;
 
@@ -63,153 +69,182 @@ static void read_number(Lexer *lex) {
     }
     buf[len] = '\0';
     double val = strtod(buf, NULL);
-    add_token(lex, TOKEN_NUMBER, buf, val, sline, scol);
+    add_token(lex, TOKEN_NUMBER, start, lex->pos, val, sline, scol);
 }
 
+static void tokenize(Lexer *lex);
+
 /* Read string content and handle interpolation.
- * On entry, the opening " has already been consumed. */
+ * On entry, the opening " has already been consumed. Literal text is
+ * left encoded in the source (token_string decodes it); the expression
+ * of each ${...} is lexed in place, with the lexer's end moved to its
+ * closing brace. */
 static void read_string_inner(Lexer *lex, int sline, int scol) {
-    char *buf = malloc(4096);
-    int blen = 0;
-    int bcap = 4096;
+    size_t piece = lex->pos;
     int has_interp = 0;
 
-#define SBUF_PUSH(c) do { \
-    if (blen >= bcap - 1) { bcap *= 2; buf = realloc(buf, (size_t)bcap); } \
-    buf[blen++] = (c); \
-} while(0)
-
     while (lex->pos < lex->length && lex->source[lex->pos] != '"') {
         if (lex->source[lex->pos] == '\\') {
             advance(lex);
             if (lex->pos >= lex->length) break;
-            char esc = advance(lex);
-            switch (esc) {
-                case 'n': SBUF_PUSH('\n'); break;
-                case 't': SBUF_PUSH('\t'); break;
-                case '"': SBUF_PUSH('"'); break;
-                case '\\': SBUF_PUSH('\\'); break;
-                case '$': SBUF_PUSH('$'); break;
-                default: SBUF_PUSH(esc); break;
-            }
+            advance(lex);
         } else if (lex->source[lex->pos] == '$' && lex->pos + 1 < lex->length && lex->source[lex->pos + 1] == '{') {
             /* String interpolation */
             if (!has_interp) {
                 has_interp = 1;
-                add_token(lex, TOKEN_INTERP_BEGIN, NULL, 0, sline, scol);
+                add_token(lex, TOKEN_INTERP_BEGIN, piece, piece, 0, sline, scol);
             }
             /* Emit accumulated string */
-            if (blen > 0) {
-                buf[blen] = '\0';
-                add_token(lex, TOKEN_STRING, buf, 0, lex->line, lex->col);
-                blen = 0;
-            }
+            if (lex->pos > piece) add_token(lex, TOKEN_STRING, piece, lex->pos, 0, lex->line, lex->col);
             advance(lex); /* $ */
             advance(lex); /* { */
-            /* Collect expression tokens until matching } */
+            /* The expression runs to the matching } */
+            size_t end = lex->pos;
             int depth = 1;
-            char *expr = malloc(4096);
-            int elen = 0;
-            int ecap = 4096;
-            while (lex->pos < lex->length && depth > 0) {
-                char c = lex->source[lex->pos];
+            while (end < lex->length) {
+                char c = lex->source[end];
                 if (c == '{') depth++;
-                else if (c == '}') { depth--; if (depth == 0) { advance(lex); break; } }
-                if (depth > 0) {
-                    if (elen >= ecap - 1) { ecap *= 2; expr = realloc(expr, (size_t)ecap); }
-                    expr[elen++] = advance(lex);
-                }
+                else if (c == '}' && --depth == 0) break;
+                end++;
             }
-            expr[elen] = '\0';
             /* Tokenize the expression and insert tokens inline */
-            Lexer sub;
-            lexer_init(&sub, expr);
-            lexer_tokenize(&sub);
-            for (int i = 0; i < sub.token_count; i++) {
-                if (sub.tokens[i].type == TOKEN_EOF) break;
-                add_token(lex, sub.tokens[i].type, sub.tokens[i].value, sub.tokens[i].num_value, sline, scol);
+            size_t length = lex->length;
+            int first = lex->token_count;
+            lex->length = end;
+            tokenize(lex);
+            while (lex->pos < end) advance(lex);  /* the rest, after an error */
+            lex->length = length;
+            for (int i = first; i < lex->token_count; i++) {
+                lex->tokens[i].line = sline;
+                lex->tokens[i].col = scol;
             }
-            lexer_free(&sub);
-            free(expr);
+            if (lex->pos < lex->length) advance(lex); /* } */
+            piece = lex->pos;
         } else {
-            SBUF_PUSH(advance(lex));
+            advance(lex);
         }
     }
 
+    size_t end = lex->pos;
     if (lex->pos < lex->length) advance(lex); /* closing " */
 
     if (has_interp) {
-        if (blen > 0) {
-            buf[blen] = '\0';
-            add_token(lex, TOKEN_STRING, buf, 0, lex->line, lex->col);
-        }
-        add_token(lex, TOKEN_INTERP_END, NULL, 0, lex->line, lex->col);
+        if (end > piece) add_token(lex, TOKEN_STRING, piece, end, 0, lex->line, lex->col);
+        add_token(lex, TOKEN_INTERP_END, end, end, 0, lex->line, lex->col);
     } else {
-        buf[blen] = '\0';
-        add_token(lex, TOKEN_STRING, buf, 0, sline, scol);
+        add_token(lex, TOKEN_STRING, piece, end, 0, sline, scol);
     }
-    free(buf);
-#undef SBUF_PUSH
 }
 
-static TokenType check_keyword(const char *word) {
-    /* Standard keywords */
-    if (strcmp(word, "let") == 0)      return TOKEN_LET;
-    if (strcmp(word, "if") == 0)       return TOKEN_IF;
-    if (strcmp(word, "else") == 0)     return TOKEN_ELSE;
-    if (strcmp(word, "while") == 0)    return TOKEN_WHILE;
-    if (strcmp(word, "for") == 0)      return TOKEN_FOR;
-    if (strcmp(word, "in") == 0)       return TOKEN_IN;
-    if (strcmp(word, "print") == 0)    return TOKEN_PRINT;
-    if (strcmp(word, "fn") == 0)       return TOKEN_FN;
-    if (strcmp(word, "return") == 0)   return TOKEN_RETURN;
-    if (strcmp(word, "break") == 0)    return TOKEN_BREAK;
-    if (strcmp(word, "continue") == 0) return TOKEN_CONTINUE;
-    if (strcmp(word, "import") == 0)   return TOKEN_IMPORT;
-    if (strcmp(word, "try") == 0)      return TOKEN_TRY;
-    if (strcmp(word, "catch") == 0)    return TOKEN_CATCH;
-    if (strcmp(word, "throw") == 0)    return TOKEN_THROW;
-    if (strcmp(word, "class") == 0)    return TOKEN_CLASS;
-    if (strcmp(word, "new") == 0)      return TOKEN_NEW;
-    if (strcmp(word, "this") == 0)     return TOKEN_THIS;
-    if (strcmp(word, "true") == 0)     return TOKEN_TRUE;
-    if (strcmp(word, "false") == 0)    return TOKEN_FALSE;
-    if (strcmp(word, "null") == 0)     return TOKEN_NULL;
-    if (strcmp(word, "and") == 0)      return TOKEN_AND;
-    if (strcmp(word, "or") == 0)       return TOKEN_OR;
-    if (strcmp(word, "not") == 0)      return TOKEN_NOT;
+int token_string(const char *source, const Token *t, char *out) {
+    const char *s = source + t->start, *end = s + t->length;
+    int len = 0;
+    while (s < end) {
+        char c = *s++;
+        if (c == '\\') {
+            if (s == end) break;
+            c = *s++;
+            if (c == 'n') c = '\n';
+            else if (c == 't') c = '\t';
+            /* \", \\, \$ and anything else stand for the character itself */
+        }
+        out[len++] = c;
+    }
+    out[len] = '\0';
+    return len;
+}
+
+/* Keywords, bucketed by length */
+typedef struct {
+    const char *word;
+    TokenType type;
+} Keyword;
 
-    /* Jungian archetypes -- aliases for standard keywords */
-    if (strcmp(word, "dream") == 0)          return TOKEN_FN;       /* fn       -- a message from the unconscious */
-    if (strcmp(word, "archetype") == 0)      return TOKEN_CLASS;    /* class    -- define a pattern */
-    if (strcmp(word, "project") == 0)        return TOKEN_PRINT;    /* print    -- express to the outside */
-    if (strcmp(word, "integrate") == 0)      return TOKEN_IMPORT;   /* import   -- absorb external wisdom */
-    if (strcmp(word, "manifest") == 0)       return TOKEN_RETURN;   /* return   -- make conscious */
-    if (strcmp(word, "unconscious") == 0)    return TOKEN_NULL;     /* null     -- the unknown */
-    if (strcmp(word, "Self") == 0)           return TOKEN_THIS;     /* this     -- the unified whole */
-    if (strcmp(word, "emerge") == 0)         return TOKEN_NEW;      /* new      -- arise from the unconscious */
-    if (strcmp(word, "perceive") == 0)       return TOKEN_LET;      /* let      -- become aware */
-    if (strcmp(word, "confront") == 0)       return TOKEN_TRY;      /* try      -- face the shadow */
-    if (strcmp(word, "embrace") == 0)        return TOKEN_CATCH;    /* catch    -- accept what you find */
-    if (strcmp(word, "reject") == 0)         return TOKEN_THROW;    /* throw    -- cast into the unconscious */
-    if (strcmp(word, "individuation") == 0)  return TOKEN_FN;       /* fn       -- the journey of becoming */
+static const Keyword keywords_2[] = {
+    { "if", TOKEN_IF }, { "in", TOKEN_IN }, { "fn", TOKEN_FN }, { "or", TOKEN_OR }, { NULL, TOKEN_EOF }
+};
+static const Keyword keywords_3[] = {
+    { "let", TOKEN_LET }, { "for", TOKEN_FOR }, { "try", TOKEN_TRY }, { "new", TOKEN_NEW },
+    { "and", TOKEN_AND }, { "not", TOKEN_NOT }, { NULL, TOKEN_EOF }
+};
+static const Keyword keywords_4[] = {
+    { "else", TOKEN_ELSE }, { "this", TOKEN_THIS }, { "true", TOKEN_TRUE }, { "null", TOKEN_NULL },
+    { "Self", TOKEN_THIS },           /* this     -- the unified whole */
+    { NULL, TOKEN_EOF }
+};
+static const Keyword keywords_5[] = {
+    { "while", TOKEN_WHILE }, { "print", TOKEN_PRINT }, { "break", TOKEN_BREAK },
+    { "catch", TOKEN_CATCH }, { "throw", TOKEN_THROW }, { "class", TOKEN_CLASS },
+    { "false", TOKEN_FALSE },
+    { "dream", TOKEN_FN },            /* fn       -- a message from the unconscious */
+    { NULL, TOKEN_EOF }
+};
+static const Keyword keywords_6[] = {
+    { "return", TOKEN_RETURN }, { "import", TOKEN_IMPORT },
+    { "emerge", TOKEN_NEW },          /* new      -- arise from the unconscious */
+    { "reject", TOKEN_THROW },        /* throw    -- cast into the unconscious */
+    { NULL, TOKEN_EOF }
+};
+static const Keyword keywords_7[] = {
+    { "project", TOKEN_PRINT },       /* print    -- express to the outside */
+    { "embrace", TOKEN_CATCH },       /* catch    -- accept what you find */
+    { NULL, TOKEN_EOF }
+};
+static const Keyword keywords_8[] = {
+    { "continue", TOKEN_CONTINUE },
+    { "manifest", TOKEN_RETURN },     /* return   -- make conscious */
+    { "perceive", TOKEN_LET },        /* let      -- become aware */
+    { "confront", TOKEN_TRY },        /* try      -- face the shadow */
+    { NULL, TOKEN_EOF }
+};
+static const Keyword keywords_9[] = {
+    { "archetype", TOKEN_CLASS },     /* class    -- define a pattern */
+    { "integrate", TOKEN_IMPORT },    /* import   -- absorb external wisdom */
+    { NULL, TOKEN_EOF }
+};
+static const Keyword keywords_11[] = {
+    { "unconscious", TOKEN_NULL },    /* null     -- the unknown */
+    { NULL, TOKEN_EOF }
+};
+static const Keyword keywords_13[] = {
+    { "individuation", TOKEN_FN },    /* fn       -- the journey of becoming */
+    { NULL, TOKEN_EOF }
+};
 
+/* Standard keywords and their Jungian archetype aliases. The length picks
+ * a bucket of at most eight words, and the first character rejects most
+ * of those without a compare. */
+static TokenType check_keyword(const char *word, size_t len) {
+    const Keyword *k;
+    switch (len) {
+        case 2:  k = keywords_2; break;
+        case 3:  k = keywords_3; break;
+        case 4:  k = keywords_4; break;
+        case 5:  k = keywords_5; break;
+        case 6:  k = keywords_6; break;
+        case 7:  k = keywords_7; break;
+        case 8:  k = keywords_8; break;
+        case 9:  k = keywords_9; break;
+        case 11: k = keywords_11; break;
+        case 13: k = keywords_13; break;
+        default: return TOKEN_IDENTIFIER;
+    }
+    for (; k->word; k++) {
+        if (k->word[0] == word[0] && memcmp(k->word, word, len) == 0) return k->type;
+    }
     return TOKEN_IDENTIFIER;
 }
 
 static void read_identifier(Lexer *lex) {
     int scol = lex->col;
     int sline = lex->line;
-    char buf[256];
-    int len = 0;
+    size_t start = lex->pos;
     while (lex->pos < lex->length &&
-           (isalnum((unsigned char)lex->source[lex->pos]) || lex->source[lex->pos] == '_') &&
-           len < 254) {
-        buf[len++] = advance(lex);
+           (isalnum((unsigned char)lex->source[lex->pos]) || lex->source[lex->pos] == '_')) {
+        advance(lex);
     }
-    buf[len] = '\0';
-    TokenType tt = check_keyword(buf);
-    add_token(lex, tt, buf, 0, sline, scol);
+    TokenType tt = check_keyword(lex->source + start, lex->pos - start);
+    add_token(lex, tt, start, lex->pos, 0, sline, scol);
 }
 
 void lexer_init(Lexer *lex, const char *source) {
@@ -221,10 +256,13 @@ void lexer_init(Lexer *lex, const char *source) {
     lex->token_cap = 256;
     lex->token_count = 0;
     lex->tokens = malloc(sizeof(Token) * (size_t)lex->token_cap);
+    MEM_ALLOC(MEM_TOKEN, sizeof(Token) * (size_t)lex->token_cap);
+    lex->error[0] = '\0';
 }
 
-void lexer_tokenize(Lexer *lex) {
-    while (1) {
+/* Tokens up to lex->length, or to the first bad character */
+static void tokenize(Lexer *lex) {
+    while (!lex->error[0]) {
         /* skip whitespace and comments */
         while (1) {
             skip_whitespace(lex);
@@ -240,12 +278,10 @@ void lexer_tokenize(Lexer *lex) {
             break;
         }
 
-        if (lex->pos >= lex->length) {
-            add_token(lex, TOKEN_EOF, NULL, 0, lex->line, lex->col);
-            break;
-        }
+        if (lex->pos >= lex->length) break;
 
         char ch = lex->source[lex->pos];
+        size_t start = lex->pos;
         int sline = lex->line;
         int scol = lex->col;
 
@@ -256,79 +292,82 @@ void lexer_tokenize(Lexer *lex) {
         /* two-char operators */
         if (ch == '=') {
             advance(lex);
-            if (peek(lex, 0) == '=') { advance(lex); add_token(lex, TOKEN_EQ, "==", 0, sline, scol); }
-            else add_token(lex, TOKEN_ASSIGN, "=", 0, sline, scol);
+            if (peek(lex, 0) == '=') { advance(lex); add_token(lex, TOKEN_EQ, start, lex->pos, 0, sline, scol); }
+            else add_token(lex, TOKEN_ASSIGN, start, lex->pos, 0, sline, scol);
             continue;
         }
         if (ch == '!') {
             advance(lex);
-            if (peek(lex, 0) == '=') { advance(lex); add_token(lex, TOKEN_NEQ, "!=", 0, sline, scol); }
-            else { fprintf(stderr, "Line %d:%d - Unexpected character: '!'\n", sline, scol); exit(1); }
+            if (peek(lex, 0) == '=') { advance(lex); add_token(lex, TOKEN_NEQ, start, lex->pos, 0, sline, scol); }
+            else snprintf(lex->error, sizeof(lex->error), "Line %d:%d - Unexpected character: '!'", sline, scol);
             continue;
         }
         if (ch == '>') {
             advance(lex);
-            if (peek(lex, 0) == '=') { advance(lex); add_token(lex, TOKEN_GTE, ">=", 0, sline, scol); }
-            else add_token(lex, TOKEN_GT, ">", 0, sline, scol);
+            if (peek(lex, 0) == '=') { advance(lex); add_token(lex, TOKEN_GTE, start, lex->pos, 0, sline, scol); }
+            else add_token(lex, TOKEN_GT, start, lex->pos, 0, sline, scol);
             continue;
         }
         if (ch == '<') {
             advance(lex);
-            if (peek(lex, 0) == '=') { advance(lex); add_token(lex, TOKEN_LTE, "<=", 0, sline, scol); }
-            else add_token(lex, TOKEN_LT, "<", 0, sline, scol);
+            if (peek(lex, 0) == '=') { advance(lex); add_token(lex, TOKEN_LTE, start, lex->pos, 0, sline, scol); }
+            else add_token(lex, TOKEN_LT, start, lex->pos, 0, sline, scol);
             continue;
         }
         if (ch == '+') {
             advance(lex);
-            if (peek(lex, 0) == '=') { advance(lex); add_token(lex, TOKEN_PLUS_ASSIGN, "+=", 0, sline, scol); }
-            else add_token(lex, TOKEN_PLUS, "+", 0, sline, scol);
+            if (peek(lex, 0) == '=') { advance(lex); add_token(lex, TOKEN_PLUS_ASSIGN, start, lex->pos, 0, sline, scol); }
+            else add_token(lex, TOKEN_PLUS, start, lex->pos, 0, sline, scol);
             continue;
         }
         if (ch == '-') {
             advance(lex);
-            if (peek(lex, 0) == '=') { advance(lex); add_token(lex, TOKEN_MINUS_ASSIGN, "-=", 0, sline, scol); }
-            else add_token(lex, TOKEN_MINUS, "-", 0, sline, scol);
+            if (peek(lex, 0) == '=') { advance(lex); add_token(lex, TOKEN_MINUS_ASSIGN, start, lex->pos, 0, sline, scol); }
+            else add_token(lex, TOKEN_MINUS, start, lex->pos, 0, sline, scol);
             continue;
         }
         if (ch == '*') {
             advance(lex);
-            if (peek(lex, 0) == '=') { advance(lex); add_token(lex, TOKEN_MULTIPLY_ASSIGN, "*=", 0, sline, scol); }
-            else add_token(lex, TOKEN_MULTIPLY, "*", 0, sline, scol);
+            if (peek(lex, 0) == '=') { advance(lex); add_token(lex, TOKEN_MULTIPLY_ASSIGN, start, lex->pos, 0, sline, scol); }
+            else add_token(lex, TOKEN_MULTIPLY, start, lex->pos, 0, sline, scol);
             continue;
         }
         if (ch == '/') {
             advance(lex);
-            if (peek(lex, 0) == '=') { advance(lex); add_token(lex, TOKEN_DIVIDE_ASSIGN, "/=", 0, sline, scol); }
-            else add_token(lex, TOKEN_DIVIDE, "/", 0, sline, scol);
+            if (peek(lex, 0) == '=') { advance(lex); add_token(lex, TOKEN_DIVIDE_ASSIGN, start, lex->pos, 0, sline, scol); }
+            else add_token(lex, TOKEN_DIVIDE, start, lex->pos, 0, sline, scol);
             continue;
         }
 
         /* single-char tokens */
         advance(lex);
         switch (ch) {
-            case '%': add_token(lex, TOKEN_MODULO, "%", 0, sline, scol); break;
-            case '(': add_token(lex, TOKEN_LPAREN, "(", 0, sline, scol); break;
-            case ')': add_token(lex, TOKEN_RPAREN, ")", 0, sline, scol); break;
-            case '{': add_token(lex, TOKEN_LBRACE, "{", 0, sline, scol); break;
-            case '}': add_token(lex, TOKEN_RBRACE, "}", 0, sline, scol); break;
-            case '[': add_token(lex, TOKEN_LBRACKET, "[", 0, sline, scol); break;
-            case ']': add_token(lex, TOKEN_RBRACKET, "]", 0, sline, scol); break;
-            case ';': add_token(lex, TOKEN_SEMICOLON, ";", 0, sline, scol); break;
-            case ',': add_token(lex, TOKEN_COMMA, ",", 0, sline, scol); break;
-            case ':': add_token(lex, TOKEN_COLON, ":", 0, sline, scol); break;
-            case '.': add_token(lex, TOKEN_DOT, ".", 0, sline, scol); break;
-            case '?': add_token(lex, TOKEN_QUESTION, "?", 0, sline, scol); break;
+            case '%': add_token(lex, TOKEN_MODULO, start, lex->pos, 0, sline, scol); break;
+            case '(': add_token(lex, TOKEN_LPAREN, start, lex->pos, 0, sline, scol); break;
+            case ')': add_token(lex, TOKEN_RPAREN, start, lex->pos, 0, sline, scol); break;
+            case '{': add_token(lex, TOKEN_LBRACE, start, lex->pos, 0, sline, scol); break;
+            case '}': add_token(lex, TOKEN_RBRACE, start, lex->pos, 0, sline, scol); break;
+            case '[': add_token(lex, TOKEN_LBRACKET, start, lex->pos, 0, sline, scol); break;
+            case ']': add_token(lex, TOKEN_RBRACKET, start, lex->pos, 0, sline, scol); break;
+            case ';': add_token(lex, TOKEN_SEMICOLON, start, lex->pos, 0, sline, scol); break;
+            case ',': add_token(lex, TOKEN_COMMA, start, lex->pos, 0, sline, scol); break;
+            case ':': add_token(lex, TOKEN_COLON, start, lex->pos, 0, sline, scol); break;
+            case '.': add_token(lex, TOKEN_DOT, start, lex->pos, 0, sline, scol); break;
+            case '?': add_token(lex, TOKEN_QUESTION, start, lex->pos, 0, sline, scol); break;
             default:
-                fprintf(stderr, "Line %d:%d - Unexpected character: '%c'\n", sline, scol, ch);
-                exit(1);
+                snprintf(lex->error, sizeof(lex->error), "Line %d:%d - Unexpected character: '%c'", sline, scol, ch);
+                break;
         }
     }
 }
 
+void lexer_tokenize(Lexer *lex) {
+    tokenize(lex);
+    if (!lex->error[0]) add_token(lex, TOKEN_EOF, lex->pos, lex->pos, 0, lex->line, lex->col);
+}
+
 void lexer_free(Lexer *lex) {
-    for (int i = 0; i < lex->token_count; i++) {
-        free(lex->tokens[i].value);
-    }
+    MEM_FREE(MEM_TOKEN, sizeof(Token) * (size_t)lex->token_cap);
     free(lex->tokens);
     lex->tokens = NULL;
     lex->token_count = 0;
@@ -22,9 +22,14 @@ typedef enum {
     TOKEN_EOF
 } TokenType;
 
+/* A token is a span of the source: nothing is copied while lexing. The
+ * span of a string literal (or of one literal piece of an interpolated
+ * string) is its raw text between the quotes, escapes included;
+ * token_string decodes it. */
 typedef struct {
     TokenType type;
-    char *value;       /* string representation of token value */
+    int start;         /* offset of the token's text in the source */
+    int length;
     double num_value;  /* numeric value for TOKEN_NUMBER */
     int line;
     int col;
@@ -39,6 +44,7 @@ typedef struct {
     Token *tokens;
     int token_count;
     int token_cap;
+    char error[256];   /* set, and tokenizing stopped, on a bad character */
 } Lexer;
 
 void lexer_init(Lexer *lex, const char *source);
@@ -47,4 +53,8 @@ void lexer_free(Lexer *lex);
 
 const char *token_type_name(TokenType type);
 
+/* Decode the TOKEN_STRING t of source into out, which needs t->length + 1
+ * bytes; returns the decoded length */
+int token_string(const char *source, const Token *t, char *out);
+
 #endif
@@ -1,24 +1,33 @@
+#include "jung.h"
 #include "interpreter.h"
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-#define JUNG_VERSION "jung v1.0.0"
-
-static char *read_file(const char *path) {
-    FILE *f = fopen(path, "r");
-    if (!f) {
-        fprintf(stderr, "jung: cannot open file '%s'\n", path);
-        exit(1);
+/* One REPL line: a lone expression has its value printed */
+static void repl_line(Interpreter *it, void *ud) {
+    ASTNode *program = ud;
+    if (program->as.program.count == 1) {
+        ASTNode *stmt = program->as.program.stmts[0];
+        if (stmt->type == NODE_PRINT || stmt->type == NODE_ASSIGN ||
+            stmt->type == NODE_IF || stmt->type == NODE_WHILE ||
+            stmt->type == NODE_FOR || stmt->type == NODE_FUNC_DEF ||
+            stmt->type == NODE_CLASS || stmt->type == NODE_IMPORT ||
+            stmt->type == NODE_COMPOUND_ASSIGN || stmt->type == NODE_OBJ_ASSIGN) {
+            interp_exec(it, program->as.program.stmts, program->as.program.count);
+        } else {
+            Value v = interp_eval(it, stmt);
+            if (!IS_NULL(v)) {
+                char *s = val_to_string(v);
+                printf("%s\n", s);
+                free(s);
+            }
+            val_free(&v);
+        }
+    } else {
+        interp_exec(it, program->as.program.stmts, program->as.program.count);
     }
-    fseek(f, 0, SEEK_END);
-    long size = ftell(f);
-    fseek(f, 0, SEEK_SET);
-    char *buf = malloc((size_t)size + 1);
-    size_t nr = fread(buf, 1, (size_t)size, f);
-    buf[nr] = '\0';
-    fclose(f);
-    return buf;
 }
 
 static void repl(void) {
@@ -42,72 +51,140 @@ static void repl(void) {
         if (len > 0 && line[len - 1] == '\n') line[--len] = '\0';
         if (len == 0) continue;
 
-        Lexer lex;
-        lexer_init(&lex, line);
-        lexer_tokenize(&lex);
-
-        Parser parser;
-        parser_init(&parser, lex.tokens, lex.token_count);
-        ASTNode *program = parser_parse(&parser);
+        char err[256];
+        ASTNode *program = interp_parse(line, err);
+        if (!program) {
+            fprintf(stderr, "%s\n", err);
+            continue;
+        }
+        interp_keep(&it, program);
 
-        if (program && program->type == NODE_PROGRAM && program->as.program.count > 0) {
-            if (program->as.program.count == 1) {
-                ASTNode *stmt = program->as.program.stmts[0];
-                if (stmt->type == NODE_PRINT || stmt->type == NODE_ASSIGN ||
-                    stmt->type == NODE_IF || stmt->type == NODE_WHILE ||
-                    stmt->type == NODE_FOR || stmt->type == NODE_FUNC_DEF ||
-                    stmt->type == NODE_CLASS || stmt->type == NODE_IMPORT ||
-                    stmt->type == NODE_COMPOUND_ASSIGN || stmt->type == NODE_OBJ_ASSIGN) {
-                    interp_exec(&it, program->as.program.stmts, program->as.program.count);
-                } else {
-                    Value v = interp_eval(&it, stmt);
-                    if (v.type != VAL_NULL) {
-                        char *s = val_to_string(v);
-                        printf("%s\n", s);
-                        free(s);
-                    }
-                    val_free(&v);
-                }
-            } else {
-                interp_exec(&it, program->as.program.stmts, program->as.program.count);
+        if (program->type == NODE_PROGRAM && program->as.program.count > 0) {
+            int status = interp_protect(&it, repl_line, program);
+            if (status == JUNG_ERROR) fprintf(stderr, "%s\n", it.error);
+            if (status == JUNG_EXIT) {
+                int code = it.exit_code;
+                interp_free(&it);
+                jung_shutdown();
+                exit(code);
             }
         }
-
-        ast_free(program);
-        lexer_free(&lex);
     }
 
     interp_free(&it);
+    jung_shutdown();
 }
 
 int main(int argc, char **argv) {
-    if (argc < 2) {
+    int use_vm = 0;
+    int argi = 1;
+    int lazy_imports = 0;
+    int mem_stats = 0;
+    int max_depth = -1;
+    int jit = 0;
+    const char *profile = NULL;
+    for (; argi < argc; argi++) {
+        if (strcmp(argv[argi], "--vm") == 0) use_vm = 1;
+        else if (strcmp(argv[argi], "--jit") == 0) jit = 1;
+        else if (strcmp(argv[argi], "--lazy-imports") == 0) lazy_imports = 1;
+        else if (strcmp(argv[argi], "--mem-stats") == 0) mem_stats = 1;
+        else if (strncmp(argv[argi], "--profile=", 10) == 0) profile = argv[argi] + 10;
+        else if (strncmp(argv[argi], "--gc-threshold=", 15) == 0) jung_gc_threshold(atoi(argv[argi] + 15));
+        else if (strncmp(argv[argi], "--max-depth=", 12) == 0) max_depth = atoi(argv[argi] + 12);
+        else break;
+    }
+
+    if (argi >= argc) {
         repl();
         return 0;
     }
 
-    if (strcmp(argv[1], "--version") == 0 || strcmp(argv[1], "-v") == 0) {
+    if (strcmp(argv[argi], "--version") == 0 || strcmp(argv[argi], "-v") == 0) {
         printf("%s\n", JUNG_VERSION);
         return 0;
     }
 
-    if (strcmp(argv[1], "--help") == 0 || strcmp(argv[1], "-h") == 0) {
+    if (strcmp(argv[argi], "--compile") == 0) {
+        /* Write file.jungc next to each file; nothing is run */
+        Jung *J = jung_new();
+        int code = 0;
+        for (int i = argi + 1; i < argc; i++) {
+            if (jung_compile_file(J, argv[i]) != JUNG_OK) {
+                fprintf(stderr, "%s\n", jung_error(J));
+                code = 1;
+            }
+        }
+        jung_free(J);
+        jung_shutdown();
+        return code;
+    }
+
+    if (strcmp(argv[argi], "--dump-ast") == 0) {
+        /* Print the optimized tree of each file; nothing is run */
+        Jung *J = jung_new();
+        int code = 0;
+        for (int i = argi + 1; i < argc; i++) {
+            if (jung_dump_ast(J, argv[i]) != JUNG_OK) {
+                fprintf(stderr, "%s\n", jung_error(J));
+                code = 1;
+            }
+        }
+        jung_free(J);
+        jung_shutdown();
+        return code;
+    }
+
+    if (strcmp(argv[argi], "--help") == 0 || strcmp(argv[argi], "-h") == 0) {
         printf("Usage: jung [options] [file]\n");
         printf("\n");
         printf("Options:\n");
         printf("  --version, -v    Print version\n");
         printf("  --help, -h       Print this help\n");
+        printf("  --vm             Run on the bytecode VM\n");
+        printf("  --jit            Compile hot numeric dreams to machine code\n");
+        printf("                   (x86-64; elsewhere a no-op)\n");
+        printf("  --lazy-imports   Load an imported file only once a name it may\n");
+        printf("                   define is first looked up\n");
+        printf("  --profile=OUT    Time calls and lines: print the top ones to\n");
+        printf("                   stderr and write folded stacks (flamegraph.pl)\n");
+        printf("                   to OUT\n");
+        printf("  --mem-stats      Count allocations per kind, copies and table\n");
+        printf("                   resizes; print them to stderr at exit\n");
+        printf("  --gc-threshold=N Collect reference cycles once N candidates are\n");
+        printf("                   buffered (default 10000); 0 only in gc()\n");
+        printf("  --max-depth=N    Raise \"stack overflow\" past N nested calls\n");
+        printf("                   (default 100000 with --vm, else the C stack's\n");
+        printf("                   limit); 0 for no limit\n");
+        printf("  --compile FILE.. Write FILE.jungc, a parsed form that later runs\n");
+        printf("                   and imports of FILE load instead of the source\n");
+        printf("  --dump-ast FILE.. Print the parsed and optimized tree of FILE\n");
         printf("\n");
         printf("Run without arguments for interactive REPL.\n");
         printf("Run with a .jung, .jot, or .jit file to execute.\n");
         return 0;
     }
 
-    char *source = read_file(argv[1]);
-    Interpreter it;
-    interp_init(&it);
-    interp_run(&it, source);
-    interp_free(&it);
-    free(source);
-    return 0;
+    if (mem_stats) jung_mem_stats(1);
+    Jung *J = jung_new();
+    jung_use_vm(J, use_vm);
+    jung_jit(J, jit);
+    jung_lazy_imports(J, lazy_imports);
+    if (max_depth >= 0) jung_max_depth(J, max_depth);
+    if (profile) jung_profile(J, 1);
+    int status = jung_run_file(J, argv[argi]);
+    int code = 0;
+    if (status == JUNG_ERROR) {
+        fprintf(stderr, "%s\n", jung_error(J));
+        code = 1;
+    } else if (status == JUNG_EXIT) {
+        code = jung_exit_code(J);
+    }
+    if (profile && jung_profile_write(J, profile) != 0) {
+        fprintf(stderr, "jung: cannot write '%s': %s\n", profile, strerror(errno));
+        code = 1;
+    }
+    jung_free(J);
+    if (mem_stats) jung_mem_stats_print();
+    jung_shutdown();
+    return code;
 }
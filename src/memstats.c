@@ -0,0 +1,109 @@
+#include "memstats.h"
+#include "table.h"
+#include <string.h>
+
+int mem_stats_on;
+
+static const char *kind_names[MEM_KINDS] = {
+    "strings", "arrays", "tables", "ast", "tokens", "scopes", "interned", "shapes",
+    "other"
+};
+
+static const char *event_names[MEM_EVENTS] = {
+    "copies", "tableResizes", "arrayCopies", "stringCopies"
+};
+
+static long allocs[MEM_KINDS];
+static long bytes[MEM_KINDS];
+static long live[MEM_KINDS];
+static long live_total;
+static long peak;
+static long events[MEM_EVENTS];
+
+#define ADD(var, n) __atomic_add_fetch(&(var), (n), __ATOMIC_RELAXED)
+#define LOAD(var)   __atomic_load_n(&(var), __ATOMIC_RELAXED)
+
+void mem_note_alloc(MemKind k, size_t n) {
+    ADD(allocs[k], 1);
+    ADD(bytes[k], (long)n);
+    ADD(live[k], (long)n);
+    long now = ADD(live_total, (long)n);
+    long seen = LOAD(peak);
+    while (now > seen &&
+           !__atomic_compare_exchange_n(&peak, &seen, now, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+void mem_note_free(MemKind k, size_t n) {
+    ADD(live[k], -(long)n);
+    ADD(live_total, -(long)n);
+}
+
+void mem_note(MemEvent e) {
+    ADD(events[e], 1);
+}
+
+void mem_stats_enable(int on) {
+    memset(allocs, 0, sizeof(allocs));
+    memset(bytes, 0, sizeof(bytes));
+    memset(live, 0, sizeof(live));
+    memset(events, 0, sizeof(events));
+    live_total = 0;
+    peak = 0;
+    mem_stats_on = on;
+}
+
+static void set_number(Table *t, const char *key, long n) {
+    table_set(t, key, val_number((double)n));
+}
+
+Value mem_stats_value(void) {
+    if (!mem_stats_on) return val_null();
+    /* Read everything first: building the result allocates */
+    long a[MEM_KINDS], b[MEM_KINDS], l[MEM_KINDS], e[MEM_EVENTS];
+    for (int k = 0; k < MEM_KINDS; k++) {
+        a[k] = LOAD(allocs[k]);
+        b[k] = LOAD(bytes[k]);
+        l[k] = LOAD(live[k]);
+    }
+    for (int i = 0; i < MEM_EVENTS; i++) e[i] = LOAD(events[i]);
+    long total = LOAD(live_total), top = LOAD(peak);
+
+    Value out = val_object();
+    for (int k = 0; k < MEM_KINDS; k++) {
+        Value kind = val_object();
+        set_number(AS_OBJECT(kind), "allocs", a[k]);
+        set_number(AS_OBJECT(kind), "bytes", b[k]);
+        set_number(AS_OBJECT(kind), "live", l[k]);
+        table_set(AS_OBJECT(out), kind_names[k], kind);
+    }
+    set_number(AS_OBJECT(out), "liveBytes", total);
+    set_number(AS_OBJECT(out), "peakBytes", top);
+    for (int i = 0; i < MEM_EVENTS; i++) set_number(AS_OBJECT(out), event_names[i], e[i]);
+    return out;
+}
+
+static double mb(long n) {
+    return (double)n / (1024.0 * 1024.0);
+}
+
+void mem_stats_print(FILE *out) {
+    long total_allocs = 0, total_bytes = 0;
+    for (int k = 0; k < MEM_KINDS; k++) {
+        total_allocs += allocs[k];
+        total_bytes += bytes[k];
+    }
+    fflush(stdout);
+    fprintf(out, "mem-stats: %ld allocations, %.3f MB allocated, peak %.3f MB live\n\n",
+            total_allocs, mb(total_bytes), mb(peak));
+    fprintf(out, "%-10s %12s %14s %14s\n", "category", "allocs", "bytes", "live bytes");
+    for (int k = 0; k < MEM_KINDS; k++) {
+        fprintf(out, "%-10s %12ld %14ld %14ld\n", kind_names[k], allocs[k], bytes[k], live[k]);
+    }
+    fprintf(out, "\n%-14s %12ld  (val_copy of a refcounted value)\n", "copies", events[MEM_COPY]);
+    fprintf(out, "%-14s %12ld\n", "table resizes", events[MEM_TABLE_RESIZE]);
+    fprintf(out, "%-14s %12ld  (copy-on-write of a shared array)\n", "array copies",
+            events[MEM_ARRAY_COW]);
+    fprintf(out, "%-14s %12ld  (copy-on-write of a shared string)\n", "string copies",
+            events[MEM_STRING_COW]);
+}
@@ -0,0 +1,63 @@
+#ifndef JUNG_MEMSTATS_H
+#define JUNG_MEMSTATS_H
+
+#include "value.h"
+#include <stdio.h>
+
+/* Allocation accounting (jung --mem-stats, memStats()).
+ *
+ * Each allocation site reports its category and size, each free and
+ * resize the same, which gives counts and bytes allocated per category,
+ * live bytes and the peak of their total. Sizes are what the site asked
+ * for (a string's header plus its buffer capacity, an array's item
+ * slots, ...), not what malloc or the pools round them up to. Events
+ * count the copy-heavy paths: every val_copy of a heap value, tables
+ * growing their entry storage, and the copy-on-write copies arrays and
+ * strings make when a shared one is modified. Counters are process-wide
+ * and updated atomically, since parallel workers allocate too. With
+ * accounting off, each hook costs one test of a global flag. */
+
+typedef enum {
+    MEM_STRING,     /* string headers and buffers */
+    MEM_ARRAY,      /* array headers and item storage */
+    MEM_TABLE,      /* object headers, entries and indexes of all tables */
+    MEM_AST,        /* syntax tree arenas and the lists parsing builds */
+    MEM_TOKEN,      /* lexer token arrays */
+    MEM_SCOPE,      /* interpreter scope and local slot stacks */
+    MEM_INTERN,     /* intern pool strings and the pool's slot array */
+    MEM_SHAPE,      /* shape tree nodes and their child arrays */
+    MEM_OTHER,      /* ranges, Float64Arrays, classes */
+    MEM_KINDS
+} MemKind;
+
+typedef enum {
+    MEM_COPY,           /* val_copy of a refcounted value */
+    MEM_TABLE_RESIZE,   /* entry storage grown */
+    MEM_ARRAY_COW,      /* shared array copied before a write */
+    MEM_STRING_COW,     /* shared string copied before an append */
+    MEM_EVENTS
+} MemEvent;
+
+extern int mem_stats_on;
+
+void mem_note_alloc(MemKind k, size_t bytes);
+void mem_note_free(MemKind k, size_t bytes);
+void mem_note(MemEvent e);
+
+#define MEM_ALLOC(k, bytes) do { if (mem_stats_on) mem_note_alloc(k, bytes); } while (0)
+#define MEM_FREE(k, bytes)  do { if (mem_stats_on) mem_note_free(k, bytes); } while (0)
+/* A buffer went from old to new bytes: counted as a fresh allocation */
+#define MEM_RESIZE(k, old, new) \
+    do { if (mem_stats_on) { mem_note_free(k, old); mem_note_alloc(k, new); } } while (0)
+#define MEM_EVENT(e)        do { if (mem_stats_on) mem_note(e); } while (0)
+
+/* Start counting (from zero) or stop */
+void  mem_stats_enable(int on);
+
+/* The counters as an object, for memStats(); null while counting is off */
+Value mem_stats_value(void);
+
+/* Per-category table, peak and event counts */
+void  mem_stats_print(FILE *out);
+
+#endif
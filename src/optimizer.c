@@ -0,0 +1,332 @@
+#include "optimizer.h"
+#include <math.h>
+
+static ASTNode *opt_node(Arena *a, ASTNode *n);
+
+static int is_literal(const ASTNode *n) {
+    return n && (n->type == NODE_NUMBER || n->type == NODE_BOOL ||
+                 n->type == NODE_NULL || n->type == NODE_CONST);
+}
+
+/* Value of a literal node; the caller frees it */
+static Value literal_value(const ASTNode *n) {
+    switch (n->type) {
+    case NODE_NUMBER: return val_number(n->as.number);
+    case NODE_BOOL:   return val_bool(n->as.boolean);
+    case NODE_CONST:  return val_copy(n->as.constant);
+    default:          return val_null();
+    }
+}
+
+static int literal_truthy(const ASTNode *n) {
+    Value v = literal_value(n);
+    int truthy = val_is_truthy(v);
+    val_free(&v);
+    return truthy;
+}
+
+/* A literal node holding v, which it takes over. Nodes replaced by one
+ * are simply dropped: they stay in the arena until the program is freed. */
+static ASTNode *new_literal(Arena *a, Value v, int line, int col) {
+    ASTNode *n = ast_node(a, NODE_NULL, line, col);
+    switch (val_type(v)) {
+    case VAL_NUMBER: n->type = NODE_NUMBER; n->as.number = AS_NUMBER(v); break;
+    case VAL_BOOL:   n->type = NODE_BOOL; n->as.boolean = AS_BOOL(v); break;
+    case VAL_NULL:   break;
+    default:
+        n->type = NODE_CONST;
+        n->as.constant = v;
+        arena_keep(a, v);
+        break;
+    }
+    return n;
+}
+
+/* The literal v (consumed) in place of old */
+static ASTNode *literal_node(Arena *a, ASTNode *old, Value v) {
+    return new_literal(a, v, old->line, old->col);
+}
+
+/* l op r as interp_binary computes it. 0 when it would raise an error
+ * there, which is then left to happen at run time. */
+static int fold_binary(TokenType op, Value l, Value r, Value *out) {
+    if (op == TOKEN_PLUS && (IS_STRING(l) || IS_STRING(r))) {
+        *out = val_string_empty(32);
+        val_string_append_value(out, l);
+        val_string_append_value(out, r);
+        return 1;
+    }
+    if (IS_NUMBER(l) && IS_NUMBER(r)) {
+        double a = AS_NUMBER(l), b = AS_NUMBER(r);
+        switch (op) {
+        case TOKEN_PLUS:     *out = val_number(a + b); return 1;
+        case TOKEN_MINUS:    *out = val_number(a - b); return 1;
+        case TOKEN_MULTIPLY: *out = val_number(a * b); return 1;
+        case TOKEN_DIVIDE:
+            if (b == 0) return 0;
+            if (a == floor(a) && b == floor(b)) *out = val_number((double)((long)a / (long)b));
+            else *out = val_number(a / b);
+            return 1;
+        case TOKEN_MODULO:
+            if (b == 0) return 0;
+            *out = val_number(fmod(a, b));
+            return 1;
+        case TOKEN_GT:  *out = val_bool(a > b); return 1;
+        case TOKEN_LT:  *out = val_bool(a < b); return 1;
+        case TOKEN_GTE: *out = val_bool(a >= b); return 1;
+        case TOKEN_LTE: *out = val_bool(a <= b); return 1;
+        default: break;
+        }
+    }
+    if (op == TOKEN_EQ) { *out = val_bool(val_equal(l, r)); return 1; }
+    if (op == TOKEN_NEQ) { *out = val_bool(!val_equal(l, r)); return 1; }
+    return 0;
+}
+
+static ASTNode *opt_binary(Arena *a, ASTNode *n) {
+    n->as.binary.left = opt_node(a, n->as.binary.left);
+    n->as.binary.right = opt_node(a, n->as.binary.right);
+    ASTNode *left = n->as.binary.left, *right = n->as.binary.right;
+    TokenType op = n->as.binary.op;
+    if (!is_literal(left)) return n;
+
+    /* and/or only need their left side to be known */
+    if (op == TOKEN_AND) {
+        if (!literal_truthy(left)) return literal_node(a, n, val_bool(0));
+        if (is_literal(right)) return literal_node(a, n, val_bool(literal_truthy(right)));
+        return n;
+    }
+    if (op == TOKEN_OR) {
+        if (literal_truthy(left)) return n->as.binary.left;
+        return n->as.binary.right;
+    }
+
+    if (!is_literal(right)) return n;
+    Value l = literal_value(left), r = literal_value(right), out;
+    int folded = fold_binary(op, l, r, &out);
+    val_free(&l);
+    val_free(&r);
+    return folded ? literal_node(a, n, out) : n;
+}
+
+static ASTNode *opt_unary(Arena *a, ASTNode *n) {
+    n->as.unary.operand = opt_node(a, n->as.unary.operand);
+    ASTNode *operand = n->as.unary.operand;
+    if (!is_literal(operand)) return n;
+    if (n->as.unary.op == TOKEN_MINUS && operand->type == NODE_NUMBER)
+        return literal_node(a, n, val_number(-operand->as.number));
+    if (n->as.unary.op == TOKEN_NOT)
+        return literal_node(a, n, val_bool(!literal_truthy(operand)));
+    return n;
+}
+
+/* Runs of literal parts are joined into one string; with nothing else
+ * left the whole node becomes a constant */
+static ASTNode *opt_interp(Arena *a, ASTNode *n) {
+    ASTNode **parts = n->as.interp.parts;
+    int count = n->as.interp.count, out = 0;
+    Value run = val_null();
+    int run_line = n->line, run_col = n->col;
+    for (int i = 0; i < count; i++) {
+        ASTNode *part = opt_node(a, parts[i]);
+        if (is_literal(part)) {
+            if (IS_NULL(run)) {
+                run = val_string_empty(32);
+                run_line = part->line;
+                run_col = part->col;
+            }
+            Value v = literal_value(part);
+            val_string_append_value(&run, v);
+            val_free(&v);
+            continue;
+        }
+        if (!IS_NULL(run)) {
+            parts[out++] = new_literal(a, run, run_line, run_col);
+            run = val_null();
+        }
+        parts[out++] = part;
+    }
+    n->as.interp.count = out;
+    if (out == 0) {
+        if (IS_NULL(run)) run = val_string("", 0);
+        return literal_node(a, n, run);
+    }
+    if (!IS_NULL(run)) parts[n->as.interp.count++] = new_literal(a, run, run_line, run_col);
+    return n;
+}
+
+static int ends_block(const ASTNode *n) {
+    return n->type == NODE_RETURN || n->type == NODE_BREAK ||
+           n->type == NODE_CONTINUE || n->type == NODE_THROW;
+}
+
+/* Optimize each statement, dropping removed ones and anything after a
+ * statement that leaves the block */
+static void opt_block(Arena *a, ASTNode **stmts, int *count) {
+    int out = 0, i = 0;
+    while (i < *count) {
+        ASTNode *s = opt_node(a, stmts[i++]);
+        if (!s) continue;
+        stmts[out++] = s;
+        if (ends_block(s)) break;
+    }
+    *count = out;
+}
+
+static void opt_list(Arena *a, ASTNode **nodes, int count) {
+    for (int i = 0; i < count; i++) nodes[i] = opt_node(a, nodes[i]);
+}
+
+/* An if with a known condition keeps only the branch it takes, still as
+ * an if so the branch gets its scope: if true { taken }. NULL when no
+ * branch runs. */
+static ASTNode *opt_if(Arena *a, ASTNode *n) {
+    n->as.if_stmt.condition = opt_node(a, n->as.if_stmt.condition);
+    opt_block(a, n->as.if_stmt.then_body, &n->as.if_stmt.then_count);
+    if (n->as.if_stmt.else_body)
+        opt_block(a, n->as.if_stmt.else_body, &n->as.if_stmt.else_count);
+
+    ASTNode *cond = n->as.if_stmt.condition;
+    if (!is_literal(cond)) return n;
+    if (!literal_truthy(cond)) {
+        if (!n->as.if_stmt.else_body) return NULL;
+        n->as.if_stmt.then_body = n->as.if_stmt.else_body;
+        n->as.if_stmt.then_count = n->as.if_stmt.else_count;
+    }
+    n->as.if_stmt.else_body = NULL;
+    n->as.if_stmt.else_count = 0;
+    n->as.if_stmt.condition = literal_node(a, cond, val_bool(1));
+    return n;
+}
+
+static ASTNode *opt_node(Arena *a, ASTNode *n) {
+    if (!n) return NULL;
+
+    switch (n->type) {
+    case NODE_STRING:
+        return literal_node(a, n, val_string(n->as.string.str, n->as.string.len));
+
+    case NODE_BINARY:
+        return opt_binary(a, n);
+
+    case NODE_UNARY:
+        return opt_unary(a, n);
+
+    case NODE_TERNARY:
+        n->as.ternary.condition = opt_node(a, n->as.ternary.condition);
+        n->as.ternary.then_expr = opt_node(a, n->as.ternary.then_expr);
+        n->as.ternary.else_expr = opt_node(a, n->as.ternary.else_expr);
+        if (is_literal(n->as.ternary.condition)) {
+            if (literal_truthy(n->as.ternary.condition))
+                return n->as.ternary.then_expr;
+            return n->as.ternary.else_expr;
+        }
+        return n;
+
+    case NODE_STRING_INTERP:
+        return opt_interp(a, n);
+
+    case NODE_ASSIGN:
+        n->as.assign.value = opt_node(a, n->as.assign.value);
+        return n;
+
+    case NODE_COMPOUND_ASSIGN:
+        n->as.comp_assign.value = opt_node(a, n->as.comp_assign.value);
+        return n;
+
+    case NODE_PRINT:
+        n->as.print_expr = opt_node(a, n->as.print_expr);
+        return n;
+
+    case NODE_IF:
+        return opt_if(a, n);
+
+    case NODE_WHILE:
+        n->as.while_loop.condition = opt_node(a, n->as.while_loop.condition);
+        if (is_literal(n->as.while_loop.condition) && !literal_truthy(n->as.while_loop.condition)) {
+            return NULL;
+        }
+        opt_block(a, n->as.while_loop.body, &n->as.while_loop.body_count);
+        return n;
+
+    case NODE_FOR:
+        n->as.for_loop.iterable = opt_node(a, n->as.for_loop.iterable);
+        opt_block(a, n->as.for_loop.body, &n->as.for_loop.body_count);
+        return n;
+
+    case NODE_FUNC_DEF:
+        for (int i = 0; i < n->as.func_def.param_count; i++) {
+            Param *p = &n->as.func_def.params[i];
+            p->default_val = opt_node(a, p->default_val);
+        }
+        opt_block(a, n->as.func_def.body, &n->as.func_def.body_count);
+        return n;
+
+    case NODE_FUNC_CALL:
+    case NODE_METHOD_CALL:
+        opt_list(a, n->as.func_call.args, n->as.func_call.arg_count);
+        return n;
+
+    case NODE_RETURN:
+        n->as.return_val = opt_node(a, n->as.return_val);
+        return n;
+
+    case NODE_TRY_CATCH:
+        opt_block(a, n->as.try_catch.try_body, &n->as.try_catch.try_count);
+        opt_block(a, n->as.try_catch.catch_body, &n->as.try_catch.catch_count);
+        return n;
+
+    case NODE_THROW:
+        n->as.throw_val = opt_node(a, n->as.throw_val);
+        return n;
+
+    case NODE_CLASS:
+        opt_list(a, n->as.class_def.methods, n->as.class_def.method_count);
+        return n;
+
+    case NODE_NEW:
+        opt_list(a, n->as.new_inst.args, n->as.new_inst.arg_count);
+        return n;
+
+    case NODE_ARRAY:
+        opt_list(a, n->as.array.elements, n->as.array.count);
+        return n;
+
+    case NODE_ARRAY_INDEX:
+        n->as.array_index.array_expr = opt_node(a, n->as.array_index.array_expr);
+        n->as.array_index.index = opt_node(a, n->as.array_index.index);
+        return n;
+
+    case NODE_OBJECT:
+        opt_list(a, n->as.object.values, n->as.object.count);
+        return n;
+
+    case NODE_OBJ_ACCESS:
+        n->as.obj_access.obj = opt_node(a, n->as.obj_access.obj);
+        n->as.obj_access.key_expr = opt_node(a, n->as.obj_access.key_expr);
+        return n;
+
+    case NODE_OBJ_ASSIGN:
+        n->as.obj_assign.obj = opt_node(a, n->as.obj_assign.obj);
+        n->as.obj_assign.key_expr = opt_node(a, n->as.obj_assign.key_expr);
+        n->as.obj_assign.value = opt_node(a, n->as.obj_assign.value);
+        return n;
+
+    case NODE_OBJ_COMPOUND_ASSIGN:
+        n->as.obj_comp_assign.obj = opt_node(a, n->as.obj_comp_assign.obj);
+        n->as.obj_comp_assign.key_expr = opt_node(a, n->as.obj_comp_assign.key_expr);
+        n->as.obj_comp_assign.value = opt_node(a, n->as.obj_comp_assign.value);
+        return n;
+
+    case NODE_PROGRAM:
+        opt_block(a, n->as.program.stmts, &n->as.program.count);
+        return n;
+
+    default:
+        return n;
+    }
+}
+
+void optimize_program(ASTNode *program) {
+    opt_node(program->as.program.arena, program);
+}
@@ -0,0 +1,21 @@
+#ifndef JUNG_OPTIMIZER_H
+#define JUNG_OPTIMIZER_H
+
+#include "parser.h"
+
+/* Rewrite a freshly parsed program in place, before it is resolved.
+ *
+ * Operators whose operands are all literals are folded with the same
+ * semantics the interpreter applies at run time (interp_binary and
+ * friends); anything that would raise an error there (x / 0, -"s", ...)
+ * is left for run time so the error and its line are unchanged. if and
+ * while with a literal condition lose their dead branch, and statements
+ * after return, break, continue or throw in the same block are dropped.
+ * String literals become NODE_CONST nodes holding a pre-built string
+ * Value, so evaluating one is a reference count bump, not an allocation.
+ *
+ * Only the shape of the tree changes: both engines, the resolver and
+ * .jungc files see ordinary nodes. */
+void optimize_program(ASTNode *program);
+
+#endif
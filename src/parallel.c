@@ -0,0 +1,460 @@
+#include "parallel.h"
+#include "interpreter.h"
+#include "table.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Block boundaries depend only on the array length, so a preduce gives the
+ * same result whatever the thread count. */
+#define TARGET_BLOCKS 1024
+#define MAX_THREADS 256
+#define WORKER_STACK (8u << 20)     /* C stack of each pool thread */
+
+typedef enum { JOB_MAP, JOB_FILTER, JOB_REDUCE } JobKind;
+
+typedef struct Job {
+    JobKind kind;
+    FuncDef *fn;
+    ArrObj *arr;
+    Value init;           /* reduce: starting value of every block */
+    int line;
+    int grain;            /* elements per block */
+    int blocks;
+    Value *out;           /* map: one result per element; reduce: per block */
+    char *keep;           /* filter: one flag per element */
+    pthread_mutex_t error_lock;
+    char *error;          /* first error raised by a callback; once set,
+                           * workers stop taking blocks */
+    int exited;           /* or a callback called exit(exit_code) */
+    int exit_code;
+} Job;
+
+typedef struct ClassPair {
+    ClassObj *from;
+    ClassObj *to;         /* the worker's copy, one reference held here */
+} ClassPair;
+
+struct Worker {
+    Interpreter it;
+    Interpreter *parent;
+    Job *job;
+    struct Worker *all;   /* every worker of the job, for stealing */
+    int count;
+    int id;
+    pthread_mutex_t lock; /* guards lo and hi */
+    int lo, hi;           /* blocks not yet taken */
+    ClassPair *classes;
+    int class_count;
+    int class_cap;
+    pthread_t thread;
+    int started;
+};
+
+/* ---- deep copy ---- */
+
+/* Objects already copied within one deep copy, so shared and cyclic
+ * references keep their shape. Open addressing on the source pointer. */
+typedef struct CopyMap {
+    Table **from;
+    Table **to;
+    int mask;             /* size - 1; -1 until the first object */
+    int count;
+} CopyMap;
+
+static unsigned int ptr_hash(const void *p) {
+    uintptr_t x = (uintptr_t)p;
+    x ^= x >> 16;
+    x *= 0x45d9f3bu;
+    x ^= x >> 16;
+    return (unsigned int)x;
+}
+
+static int copymap_slot(CopyMap *m, Table *from) {
+    unsigned int i = ptr_hash(from) & (unsigned int)m->mask;
+    while (m->from[i] && m->from[i] != from) i = (i + 1) & (unsigned int)m->mask;
+    return (int)i;
+}
+
+static void copymap_put(CopyMap *m, Table *from, Table *to) {
+    if ((m->count + 1) * 2 > m->mask + 1) {
+        Table **old_from = m->from, **old_to = m->to;
+        int old_size = m->mask + 1;
+        int size = old_size ? old_size * 2 : 16;
+        m->from = calloc((size_t)size, sizeof(Table *));
+        m->to = calloc((size_t)size, sizeof(Table *));
+        m->mask = size - 1;
+        for (int i = 0; i < old_size; i++) {
+            if (!old_from[i]) continue;
+            int j = copymap_slot(m, old_from[i]);
+            m->from[j] = old_from[i];
+            m->to[j] = old_to[i];
+        }
+        free(old_from);
+        free(old_to);
+    }
+    int i = copymap_slot(m, from);
+    m->from[i] = from;
+    m->to[i] = to;
+    m->count++;
+}
+
+static Table *copymap_get(CopyMap *m, Table *from) {
+    if (m->count == 0) return NULL;
+    int i = copymap_slot(m, from);
+    return m->from[i] ? m->to[i] : NULL;
+}
+
+static void copymap_free(CopyMap *m) {
+    free(m->from);
+    free(m->to);
+}
+
+/* The worker's copy of a class: same methods, its own refcount */
+static ClassObj *worker_class(struct Worker *w, ClassObj *c) {
+    for (int i = 0; i < w->class_count; i++) {
+        if (w->classes[i].from == c) return w->classes[i].to;
+    }
+    ClassObj *k = AS_CLASS(val_class(c->name));
+    TABLE_FOR_EACH(c->methods, e) table_iset(k->methods, e->key, val_copy(e->value));
+    k->ctor = c->ctor;
+    if (w->class_count >= w->class_cap) {
+        w->class_cap = w->class_cap ? w->class_cap * 2 : 8;
+        w->classes = realloc(w->classes, sizeof(ClassPair) * (size_t)w->class_cap);
+    }
+    w->classes[w->class_count].from = c;
+    w->classes[w->class_count].to = k;
+    w->class_count++;
+    return k;
+}
+
+static Value class_value(ClassObj *c) {
+    c->refcount++;
+    return val_from_ptr(VAL_CLASS, c);
+}
+
+/* Copy of v sharing no refcounted storage with it. Only reads v. */
+static Value copy_value(struct Worker *w, Value v, CopyMap *m) {
+    switch (val_type(v)) {
+    case VAL_STRING:
+        return val_string(AS_STRING(v)->chars, AS_STRING(v)->len);
+    case VAL_ARRAY: {
+        ArrObj *a = AS_ARRAY(v);
+        Value out = val_array(a->count);
+        for (int i = 0; i < a->count; i++) AS_ARRAY(out)->items[i] = copy_value(w, a->items[i], m);
+        AS_ARRAY(out)->count = a->count;
+        return out;
+    }
+    case VAL_OBJECT: {
+        Table *src = AS_OBJECT(v);
+        Table *seen = copymap_get(m, src);
+        if (seen) {
+            seen->refcount++;
+            return val_from_ptr(VAL_OBJECT, seen);
+        }
+        Value out = val_object();
+        copymap_put(m, src, AS_OBJECT(out));
+        if (src->klass) {
+            AS_OBJECT(out)->klass = worker_class(w, src->klass);
+            AS_OBJECT(out)->klass->refcount++;
+        }
+        TABLE_FOR_EACH(src, e) table_iset(AS_OBJECT(out), e->key, copy_value(w, e->value, m));
+        return out;
+    }
+    case VAL_CLASS:
+        return class_value(worker_class(w, AS_CLASS(v)));
+    case VAL_RANGE: {
+        Value out = val_range(0, 0, 1);
+        *AS_RANGE(out) = *AS_RANGE(v);
+        AS_RANGE(out)->refcount = 1;
+        return out;
+    }
+    case VAL_F64ARRAY: {
+        Value out = val_f64array(AS_F64(v)->count);
+        memcpy(AS_F64(out)->data, AS_F64(v)->data, sizeof(double) * (size_t)AS_F64(v)->count);
+        return out;
+    }
+    case VAL_FILE:
+        return val_null();    /* handles stay with the calling interpreter */
+    default:
+        return v;
+    }
+}
+
+static Value copy_root(struct Worker *w, Value v) {
+    CopyMap m = { NULL, NULL, -1, 0 };
+    Value out = copy_value(w, v, &m);
+    copymap_free(&m);
+    return out;
+}
+
+Value *parallel_import_var(struct Worker *w, const char *name) {
+    Value *src = interp_get_var_ref(w->parent, name);
+    if (!src) return NULL;
+    table_iset(&w->it.globals, name, copy_root(w, *src));
+    return table_iref(&w->it.globals, name);
+}
+
+/* ---- workers ---- */
+
+static void worker_init(struct Worker *w, Interpreter *parent, Job *job) {
+    interp_init(&w->it);
+    w->it.worker = w;
+    w->it.def_version = parent->def_version;  /* so the shared call caches hit */
+    w->it.max_depth = parent->max_depth;
+    w->it.stack_size = WORKER_STACK;
+    w->parent = parent;
+    w->job = job;
+    TABLE_FOR_EACH(&parent->functions, e) table_iset(&w->it.functions, e->key, val_copy(e->value));
+    TABLE_FOR_EACH(&parent->classes, e) {
+        table_iset(&w->it.classes, e->key, class_value(worker_class(w, AS_CLASS(e->value))));
+    }
+    pthread_mutex_init(&w->lock, NULL);
+}
+
+static void worker_free(struct Worker *w) {
+    /* Dreams the job defined may be in its results, so they live on with
+     * the parent's */
+    while (w->it.funcs) {
+        FuncDef *fn = w->it.funcs;
+        w->it.funcs = fn->next;
+        fn->next = w->parent->funcs;
+        w->parent->funcs = fn;
+    }
+    interp_free(&w->it);
+    for (int i = 0; i < w->class_count; i++) {
+        Value c = val_from_ptr(VAL_CLASS, w->classes[i].to);
+        val_free(&c);
+    }
+    free(w->classes);
+    pthread_mutex_destroy(&w->lock);
+}
+
+/* Next block for w: its own lowest, else the upper half of another
+ * worker's remaining range. -1 when no work is left. */
+static int next_block(struct Worker *w) {
+    int b = -1;
+    pthread_mutex_lock(&w->lock);
+    if (w->lo < w->hi) b = w->lo++;
+    pthread_mutex_unlock(&w->lock);
+
+    for (int k = 1; b < 0 && k < w->count; k++) {
+        struct Worker *v = &w->all[(w->id + k) % w->count];
+        int lo = 0, hi = 0;
+        pthread_mutex_lock(&v->lock);
+        if (v->lo < v->hi) {
+            lo = v->lo + (v->hi - v->lo) / 2;
+            hi = v->hi;
+            v->hi = lo;
+        }
+        pthread_mutex_unlock(&v->lock);
+        if (lo < hi) {
+            b = lo;
+            pthread_mutex_lock(&w->lock);
+            w->lo = lo + 1;
+            w->hi = hi;
+            pthread_mutex_unlock(&w->lock);
+        }
+    }
+    return b;
+}
+
+static void run_block(struct Worker *w, int b) {
+    Job *job = w->job;
+    Interpreter *it = &w->it;
+    int start = b * job->grain;
+    int end = start + job->grain < job->arr->count ? start + job->grain : job->arr->count;
+    Value acc = job->kind == JOB_REDUCE ? copy_root(w, job->init) : val_null();
+
+    for (int i = start; i < end; i++) {
+        Value item = copy_root(w, job->arr->items[i]);
+        if (job->kind == JOB_MAP) {
+            job->out[i] = interp_call_function(it, job->fn, &item, 1, job->line);
+            val_free(&item);
+        } else if (job->kind == JOB_FILTER) {
+            Value pred = interp_call_function(it, job->fn, &item, 1, job->line);
+            job->keep[i] = (char)val_is_truthy(pred);
+            val_free(&pred);
+            val_free(&item);
+        } else {
+            Value args[2] = { acc, item };
+            acc = interp_call_function(it, job->fn, args, 2, job->line);
+            val_free(&args[0]);
+            val_free(&args[1]);
+        }
+    }
+    if (job->kind == JOB_REDUCE) job->out[b] = acc;
+}
+
+static int job_failed(Job *job) {
+    pthread_mutex_lock(&job->error_lock);
+    int failed = job->error != NULL || job->exited;
+    pthread_mutex_unlock(&job->error_lock);
+    return failed;
+}
+
+/* Errors in a callback land here as exceptions: the worker runs as if
+ * inside one try, which ends its loop when anything is thrown. */
+static void worker_loop(Interpreter *it, void *arg) {
+    struct Worker *w = arg;
+    Job *job = w->job;
+    int b;
+    it->try_depth = 1;
+    while (!job_failed(job) && !it->throwing && (b = next_block(w)) >= 0) run_block(w, b);
+    if (it->throwing) {
+        char *msg = interp_catch_message(it);
+        pthread_mutex_lock(&job->error_lock);
+        if (!job->error && !job->exited) job->error = msg;
+        else free(msg);
+        pthread_mutex_unlock(&job->error_lock);
+    }
+    it->try_depth = 0;
+}
+
+/* exit() skips the worker loop and ends up here */
+static void *worker_main(void *arg) {
+    struct Worker *w = arg;
+    Job *job = w->job;
+    if (interp_protect(&w->it, worker_loop, w) == JUNG_EXIT) {
+        pthread_mutex_lock(&job->error_lock);
+        if (!job->error && !job->exited) {
+            job->exited = 1;
+            job->exit_code = w->it.exit_code;
+        }
+        pthread_mutex_unlock(&job->error_lock);
+    }
+    return NULL;
+}
+
+static int thread_count(int blocks) {
+    int n = 0;
+    const char *env = getenv("JUNG_THREADS");
+    if (env) n = atoi(env);
+    if (n <= 0) n = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (n <= 0) n = 1;
+    if (n > MAX_THREADS) n = MAX_THREADS;
+    if (n > blocks) n = blocks;
+    return n;
+}
+
+static void job_init(Job *job, JobKind kind, FuncDef *fn, ArrObj *arr, int line) {
+    memset(job, 0, sizeof(Job));
+    job->kind = kind;
+    job->fn = fn;
+    job->arr = arr;
+    job->init = val_null();
+    job->line = line;
+    job->grain = arr->count / TARGET_BLOCKS > 0 ? arr->count / TARGET_BLOCKS : 1;
+    job->blocks = (arr->count + job->grain - 1) / job->grain;
+    pthread_mutex_init(&job->error_lock, NULL);
+}
+
+/* Run job on the pool. The calling thread works as worker 0 while it
+ * waits, so a failed pthread_create only costs parallelism. */
+static void run_job(Interpreter *it, Job *job) {
+    /* Workers cannot load modules, so give them everything up front */
+    interp_load_modules(it, job->line);
+    int n = thread_count(job->blocks);
+    if (n == 0) return;
+    struct Worker *ws = calloc((size_t)n, sizeof(struct Worker));
+    for (int i = 0; i < n; i++) {
+        worker_init(&ws[i], it, job);
+        ws[i].all = ws;
+        ws[i].count = n;
+        ws[i].id = i;
+        ws[i].lo = (int)((long)job->blocks * i / n);
+        ws[i].hi = (int)((long)job->blocks * (i + 1) / n);
+    }
+
+    /* Worker 0 shares the caller's C stack, and its limit */
+    ws[0].it.stack_limit = it->stack_limit;
+    ws[0].it.stack_fixed = 1;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, WORKER_STACK);
+    for (int i = 1; i < n; i++) {
+        ws[i].started = pthread_create(&ws[i].thread, &attr, worker_main, &ws[i]) == 0;
+    }
+    pthread_attr_destroy(&attr);
+    worker_main(&ws[0]);
+    for (int i = 1; i < n; i++) {
+        if (ws[i].started) pthread_join(ws[i].thread, NULL);
+    }
+
+    for (int i = 0; i < n; i++) worker_free(&ws[i]);
+    free(ws);
+}
+
+/* Re-raise a callback's error (or exit) in the calling interpreter */
+static void job_finish(Interpreter *it, Job *job) {
+    pthread_mutex_destroy(&job->error_lock);
+    if (job->exited) interp_exit(it, job->exit_code);
+    if (!job->error) return;
+    char msg[1200];
+    snprintf(msg, sizeof(msg), "%s", job->error);
+    free(job->error);
+    interp_error(it, 0, "%s", msg);
+}
+
+Value parallel_map(Interpreter *it, FuncDef *fn, ArrObj *arr, int line) {
+    Job job;
+    job_init(&job, JOB_MAP, fn, arr, line);
+    Value result = val_array(arr->count);
+    for (int i = 0; i < arr->count; i++) AS_ARRAY(result)->items[i] = val_null();
+    AS_ARRAY(result)->count = arr->count;
+    job.out = AS_ARRAY(result)->items;
+    run_job(it, &job);
+    if (job_failed(&job)) val_free(&result);
+    job_finish(it, &job);
+    return result;
+}
+
+Value parallel_filter(Interpreter *it, FuncDef *fn, ArrObj *arr, int line) {
+    Job job;
+    job_init(&job, JOB_FILTER, fn, arr, line);
+    job.keep = calloc((size_t)arr->count + 1, 1);
+    run_job(it, &job);
+    Value result = val_array(arr->count);
+    if (!job_failed(&job)) {
+        for (int i = 0; i < arr->count; i++) {
+            if (job.keep[i]) val_array_push(&result, val_copy(arr->items[i]));
+        }
+    }
+    free(job.keep);
+    if (job_failed(&job)) val_free(&result);
+    job_finish(it, &job);
+    return result;
+}
+
+Value parallel_reduce(Interpreter *it, FuncDef *fn, FuncDef *combine,
+                      ArrObj *arr, Value init, int line) {
+    if (arr->count == 0) return val_copy(init);
+    Job job;
+    job_init(&job, JOB_REDUCE, fn, arr, line);
+    job.init = init;
+    job.out = malloc(sizeof(Value) * (size_t)job.blocks);
+    for (int i = 0; i < job.blocks; i++) job.out[i] = val_null();
+    run_job(it, &job);
+    if (job_failed(&job)) {
+        for (int i = 0; i < job.blocks; i++) val_free(&job.out[i]);
+        free(job.out);
+        job_finish(it, &job);
+        return val_null();
+    }
+    pthread_mutex_destroy(&job.error_lock);
+
+    /* Fold the block results left to right on the calling interpreter */
+    if (!combine) combine = fn;
+    Value acc = job.out[0];
+    for (int i = 1; i < job.blocks; i++) {
+        Value args[2] = { acc, job.out[i] };
+        acc = interp_call_function(it, combine, args, 2, line);
+        val_free(&args[0]);
+        val_free(&args[1]);
+    }
+    free(job.out);
+    return acc;
+}
@@ -0,0 +1,34 @@
+#ifndef JUNG_PARALLEL_H
+#define JUNG_PARALLEL_H
+
+#include "value.h"
+
+/* pmap, pfilter and preduce: the parallel forms of map, filter and reduce.
+ *
+ * The array is cut into blocks which a pool of threads, one per CPU (or
+ * JUNG_THREADS), works through; an idle thread steals half of another's
+ * remaining blocks. Each thread runs the callback in its own worker
+ * interpreter. Workers share no values with the program or each other:
+ * every element, and every global or caller variable the callback reads,
+ * is deep-copied into the worker first. Callbacks are meant to be free of
+ * side effects; assignments they make to outside variables are discarded.
+ * An error (or exit()) in any callback stops the operation and is raised
+ * again in the calling interpreter. Inside a worker the p-forms run
+ * serially. */
+
+struct Interpreter;
+struct Worker;
+
+Value parallel_map(struct Interpreter *it, FuncDef *fn, ArrObj *arr, int line);
+Value parallel_filter(struct Interpreter *it, FuncDef *fn, ArrObj *arr, int line);
+
+/* Each block folds from a copy of init, so init must be an identity of fn;
+ * block results are then folded in order with combine (fn when NULL). */
+Value parallel_reduce(struct Interpreter *it, FuncDef *fn, FuncDef *combine,
+                      ArrObj *arr, Value init, int line);
+
+/* Slot for a variable a worker does not have yet: copied from the calling
+ * interpreter on first use. NULL if the caller has no such variable. */
+Value *parallel_import_var(struct Worker *w, const char *name);
+
+#endif
@@ -1,18 +1,30 @@
 #include "parser.h"
+#include "intern.h"
+#include "memstats.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 /* ---- helpers ---- */
 
-static ASTNode *alloc_node(NodeType type, int line, int col) {
-    ASTNode *n = calloc(1, sizeof(ASTNode));
+ASTNode *ast_node(Arena *a, NodeType type, int line, int col) {
+    ASTNode *n = arena_alloc(a, sizeof(ASTNode));
     n->type = type;
     n->line = line;
     n->col = col;
+    n->slot = -1;
     return n;
 }
 
+static ASTNode *alloc_node(Parser *p, NodeType type, int line, int col) {
+    return ast_node(p->arena, type, line, col);
+}
+
+/* The interned text of an identifier token */
+static const char *name_of(Parser *p, const Token *t) {
+    return intern(p->source + t->start, t->length);
+}
+
 static Token *peek(Parser *p, int offset) {
     int idx = p->current + offset;
     if (idx < p->token_count) return &p->tokens[idx];
@@ -34,12 +46,12 @@ static Token *advance_tok(Parser *p) {
 static void parser_error(Parser *p, const char *msg) {
     Token *t = cur(p);
     if (t) {
-        fprintf(stderr, "Parse error at line %d:%d - %s (got %s)\n",
-                t->line, t->col, msg, token_type_name(t->type));
+        snprintf(p->error, sizeof(p->error), "Parse error at line %d:%d - %s (got %s)",
+                 t->line, t->col, msg, token_type_name(t->type));
     } else {
-        fprintf(stderr, "Parse error: unexpected end of file - %s\n", msg);
+        snprintf(p->error, sizeof(p->error), "Parse error: unexpected end of file - %s", msg);
     }
-    exit(1);
+    longjmp(p->bail, 1);
 }
 
 static Token *consume(Parser *p, TokenType t, const char *msg) {
@@ -55,22 +67,55 @@ static void optional_semicolon(Parser *p) {
 static ASTNode *parse_expression(Parser *p);
 static ASTNode *parse_statement(Parser *p);
 
+/* ---- lists ---- */
+
+/* A list is collected on p->scratch, one stack shared by every list still
+ * being parsed (an inner block's statements sit above the outer one's),
+ * and moved into the arena once it is complete */
+static void push(Parser *p, void *item) {
+    if (p->scratch_count == p->scratch_cap) {
+        int cap = p->scratch_cap ? p->scratch_cap * 2 : 64;
+        MEM_RESIZE(MEM_AST, sizeof(void *) * (size_t)p->scratch_cap, sizeof(void *) * (size_t)cap);
+        p->scratch = realloc(p->scratch, sizeof(void *) * (size_t)cap);
+        p->scratch_cap = cap;
+    }
+    p->scratch[p->scratch_count++] = item;
+}
+
+/* The nodes pushed since base, as an array in the arena */
+static ASTNode **take_nodes(Parser *p, int base, int *count) {
+    int n = p->scratch_count - base;
+    ASTNode **nodes = arena_alloc(p->arena, sizeof(ASTNode *) * (size_t)n);
+    for (int i = 0; i < n; i++) nodes[i] = p->scratch[base + i];
+    p->scratch_count = base;
+    *count = n;
+    return nodes;
+}
+
 /* ---- parse block ---- */
 
 static void parse_block(Parser *p, ASTNode ***body, int *count) {
     consume(p, TOKEN_LBRACE, "Expected '{'");
-    int cap = 8;
-    *body = malloc(sizeof(ASTNode *) * (size_t)cap);
-    *count = 0;
+    int base = p->scratch_count;
 
     while (!match(p, TOKEN_RBRACE) && !match(p, TOKEN_EOF)) {
         ASTNode *s = parse_statement(p);
-        if (s) {
-            if (*count >= cap) { cap *= 2; *body = realloc(*body, sizeof(ASTNode *) * (size_t)cap); }
-            (*body)[(*count)++] = s;
-        }
+        if (s) push(p, s);
     }
     consume(p, TOKEN_RBRACE, "Expected '}'");
+    *body = take_nodes(p, base, count);
+}
+
+/* Comma-separated expressions up to and including the closing ')' */
+static void parse_args(Parser *p) {
+    if (!match(p, TOKEN_RPAREN)) {
+        push(p, parse_expression(p));
+        while (match(p, TOKEN_COMMA)) {
+            advance_tok(p);
+            push(p, parse_expression(p));
+        }
+    }
+    consume(p, TOKEN_RPAREN, "Expected ')' after arguments");
 }
 
 /* ---- expression parsing ---- */
@@ -82,7 +127,7 @@ static ASTNode *parse_primary(Parser *p) {
     /* unary not */
     if (match(p, TOKEN_NOT)) {
         advance_tok(p);
-        ASTNode *n = alloc_node(NODE_UNARY, line, col);
+        ASTNode *n = alloc_node(p, NODE_UNARY, line, col);
         n->as.unary.op = TOKEN_NOT;
         n->as.unary.operand = parse_primary(p);
         return n;
@@ -91,7 +136,7 @@ static ASTNode *parse_primary(Parser *p) {
     /* unary minus */
     if (match(p, TOKEN_MINUS)) {
         advance_tok(p);
-        ASTNode *n = alloc_node(NODE_UNARY, line, col);
+        ASTNode *n = alloc_node(p, NODE_UNARY, line, col);
         n->as.unary.op = TOKEN_MINUS;
         n->as.unary.operand = parse_primary(p);
         return n;
@@ -100,7 +145,7 @@ static ASTNode *parse_primary(Parser *p) {
     /* number */
     if (match(p, TOKEN_NUMBER)) {
         Token *t = advance_tok(p);
-        ASTNode *n = alloc_node(NODE_NUMBER, line, col);
+        ASTNode *n = alloc_node(p, NODE_NUMBER, line, col);
         n->as.number = t->num_value;
         return n;
     }
@@ -108,42 +153,35 @@ static ASTNode *parse_primary(Parser *p) {
     /* string */
     if (match(p, TOKEN_STRING)) {
         Token *t = advance_tok(p);
-        ASTNode *n = alloc_node(NODE_STRING, line, col);
-        n->as.string.str = strdup(t->value ? t->value : "");
-        n->as.string.len = (int)strlen(n->as.string.str);
+        ASTNode *n = alloc_node(p, NODE_STRING, line, col);
+        n->as.string.str = arena_alloc(p->arena, (size_t)t->length + 1);
+        n->as.string.len = token_string(p->source, t, n->as.string.str);
         return n;
     }
 
     /* string interpolation */
     if (match(p, TOKEN_INTERP_BEGIN)) {
         advance_tok(p); /* consume INTERP_BEGIN */
-        int cap = 8;
-        ASTNode **parts = malloc(sizeof(ASTNode *) * (size_t)cap);
-        int cnt = 0;
-
-        while (!match(p, TOKEN_INTERP_END) && !match(p, TOKEN_EOF)) {
-            ASTNode *part = parse_expression(p);
-            if (cnt >= cap) { cap *= 2; parts = realloc(parts, sizeof(ASTNode *) * (size_t)cap); }
-            parts[cnt++] = part;
-        }
+        int base = p->scratch_count;
+
+        while (!match(p, TOKEN_INTERP_END) && !match(p, TOKEN_EOF)) push(p, parse_expression(p));
         consume(p, TOKEN_INTERP_END, "Expected end of string interpolation");
 
-        ASTNode *n = alloc_node(NODE_STRING_INTERP, line, col);
-        n->as.interp.parts = parts;
-        n->as.interp.count = cnt;
+        ASTNode *n = alloc_node(p, NODE_STRING_INTERP, line, col);
+        n->as.interp.parts = take_nodes(p, base, &n->as.interp.count);
         return n;
     }
 
     /* null */
     if (match(p, TOKEN_NULL)) {
         advance_tok(p);
-        return alloc_node(NODE_NULL, line, col);
+        return alloc_node(p, NODE_NULL, line, col);
     }
 
     /* true */
     if (match(p, TOKEN_TRUE)) {
         advance_tok(p);
-        ASTNode *n = alloc_node(NODE_BOOL, line, col);
+        ASTNode *n = alloc_node(p, NODE_BOOL, line, col);
         n->as.boolean = 1;
         return n;
     }
@@ -151,7 +189,7 @@ static ASTNode *parse_primary(Parser *p) {
     /* false */
     if (match(p, TOKEN_FALSE)) {
         advance_tok(p);
-        ASTNode *n = alloc_node(NODE_BOOL, line, col);
+        ASTNode *n = alloc_node(p, NODE_BOOL, line, col);
         n->as.boolean = 0;
         return n;
     }
@@ -159,7 +197,7 @@ static ASTNode *parse_primary(Parser *p) {
     /* this */
     if (match(p, TOKEN_THIS)) {
         advance_tok(p);
-        return alloc_node(NODE_THIS, line, col);
+        return alloc_node(p, NODE_THIS, line, col);
     }
 
     /* new */
@@ -167,113 +205,84 @@ static ASTNode *parse_primary(Parser *p) {
         advance_tok(p);
         Token *name = consume(p, TOKEN_IDENTIFIER, "Expected class name after 'new'");
         consume(p, TOKEN_LPAREN, "Expected '(' after class name");
+        int base = p->scratch_count;
+        parse_args(p);
 
-        int cap = 4, cnt = 0;
-        ASTNode **args = malloc(sizeof(ASTNode *) * (size_t)cap);
-
-        if (!match(p, TOKEN_RPAREN)) {
-            if (cnt >= cap) { cap *= 2; args = realloc(args, sizeof(ASTNode *) * (size_t)cap); }
-            args[cnt++] = parse_expression(p);
-            while (match(p, TOKEN_COMMA)) {
-                advance_tok(p);
-                if (cnt >= cap) { cap *= 2; args = realloc(args, sizeof(ASTNode *) * (size_t)cap); }
-                args[cnt++] = parse_expression(p);
-            }
-        }
-        consume(p, TOKEN_RPAREN, "Expected ')' after arguments");
-
-        ASTNode *n = alloc_node(NODE_NEW, line, col);
-        n->as.new_inst.class_name = strdup(name->value);
-        n->as.new_inst.args = args;
-        n->as.new_inst.arg_count = cnt;
+        ASTNode *n = alloc_node(p, NODE_NEW, line, col);
+        n->as.new_inst.class_name = name_of(p, name);
+        n->as.new_inst.args = take_nodes(p, base, &n->as.new_inst.arg_count);
         return n;
     }
 
     /* identifier or function call */
     if (match(p, TOKEN_IDENTIFIER)) {
         Token *t = advance_tok(p);
-        char *name = t->value;
+        const char *name = name_of(p, t);
 
         if (match(p, TOKEN_LPAREN)) {
             advance_tok(p);
-            int cap = 4, cnt = 0;
-            ASTNode **args = malloc(sizeof(ASTNode *) * (size_t)cap);
-            if (!match(p, TOKEN_RPAREN)) {
-                if (cnt >= cap) { cap *= 2; args = realloc(args, sizeof(ASTNode *) * (size_t)cap); }
-                args[cnt++] = parse_expression(p);
-                while (match(p, TOKEN_COMMA)) {
-                    advance_tok(p);
-                    if (cnt >= cap) { cap *= 2; args = realloc(args, sizeof(ASTNode *) * (size_t)cap); }
-                    args[cnt++] = parse_expression(p);
-                }
-            }
-            consume(p, TOKEN_RPAREN, "Expected ')' after arguments");
-            ASTNode *n = alloc_node(NODE_FUNC_CALL, line, col);
-            n->as.func_call.name = strdup(name);
-            n->as.func_call.args = args;
-            n->as.func_call.arg_count = cnt;
+            int base = p->scratch_count;
+            parse_args(p);
+            ASTNode *n = alloc_node(p, NODE_FUNC_CALL, line, col);
+            n->as.func_call.name = name;
+            n->as.func_call.args = take_nodes(p, base, &n->as.func_call.arg_count);
             return n;
         }
 
-        ASTNode *n = alloc_node(NODE_VARIABLE, line, col);
-        n->as.var_name = strdup(name);
+        ASTNode *n = alloc_node(p, NODE_VARIABLE, line, col);
+        n->as.var_name = name;
         return n;
     }
 
     /* array literal */
     if (match(p, TOKEN_LBRACKET)) {
         advance_tok(p);
-        int cap = 8, cnt = 0;
-        ASTNode **elems = malloc(sizeof(ASTNode *) * (size_t)cap);
+        int base = p->scratch_count;
         if (!match(p, TOKEN_RBRACKET)) {
-            if (cnt >= cap) { cap *= 2; elems = realloc(elems, sizeof(ASTNode *) * (size_t)cap); }
-            elems[cnt++] = parse_expression(p);
+            push(p, parse_expression(p));
             while (match(p, TOKEN_COMMA)) {
                 advance_tok(p);
-                if (cnt >= cap) { cap *= 2; elems = realloc(elems, sizeof(ASTNode *) * (size_t)cap); }
-                elems[cnt++] = parse_expression(p);
+                push(p, parse_expression(p));
             }
         }
         consume(p, TOKEN_RBRACKET, "Expected ']'");
-        ASTNode *n = alloc_node(NODE_ARRAY, line, col);
-        n->as.array.elements = elems;
-        n->as.array.count = cnt;
+        ASTNode *n = alloc_node(p, NODE_ARRAY, line, col);
+        n->as.array.elements = take_nodes(p, base, &n->as.array.count);
         return n;
     }
 
     /* object literal */
     if (match(p, TOKEN_LBRACE)) {
         advance_tok(p);
-        int cap = 8, cnt = 0;
-        char **keys = malloc(sizeof(char *) * (size_t)cap);
-        ASTNode **vals = malloc(sizeof(ASTNode *) * (size_t)cap);
+        int base = p->scratch_count;
 
+        /* keys and values pushed in turn */
         if (!match(p, TOKEN_RBRACE)) {
             Token *k = consume(p, TOKEN_IDENTIFIER, "Expected property name");
             consume(p, TOKEN_COLON, "Expected ':' after property name");
-            ASTNode *v = parse_expression(p);
-            if (cnt >= cap) { cap *= 2; keys = realloc(keys, sizeof(char *) * (size_t)cap); vals = realloc(vals, sizeof(ASTNode *) * (size_t)cap); }
-            keys[cnt] = strdup(k->value);
-            vals[cnt] = v;
-            cnt++;
+            push(p, (void *)name_of(p, k));
+            push(p, parse_expression(p));
 
             while (match(p, TOKEN_COMMA)) {
                 advance_tok(p);
                 if (match(p, TOKEN_RBRACE)) break; /* trailing comma */
                 k = consume(p, TOKEN_IDENTIFIER, "Expected property name");
                 consume(p, TOKEN_COLON, "Expected ':' after property name");
-                v = parse_expression(p);
-                if (cnt >= cap) { cap *= 2; keys = realloc(keys, sizeof(char *) * (size_t)cap); vals = realloc(vals, sizeof(ASTNode *) * (size_t)cap); }
-                keys[cnt] = strdup(k->value);
-                vals[cnt] = v;
-                cnt++;
+                push(p, (void *)name_of(p, k));
+                push(p, parse_expression(p));
             }
         }
         consume(p, TOKEN_RBRACE, "Expected '}'");
-        ASTNode *n = alloc_node(NODE_OBJECT, line, col);
-        n->as.object.keys = keys;
-        n->as.object.values = vals;
+        int cnt = (p->scratch_count - base) / 2;
+        ASTNode *n = alloc_node(p, NODE_OBJECT, line, col);
+        n->as.object.keys = arena_alloc(p->arena, sizeof(const char *) * (size_t)cnt);
+        n->as.object.values = arena_alloc(p->arena, sizeof(ASTNode *) * (size_t)cnt);
         n->as.object.count = cnt;
+        for (int i = 0; i < cnt; i++) {
+            n->as.object.keys[i] = p->scratch[base + 2 * i];
+            n->as.object.values[i] = p->scratch[base + 2 * i + 1];
+        }
+        p->scratch_count = base;
         return n;
     }
 
@@ -301,7 +310,7 @@ static ASTNode *parse_postfix(Parser *p) {
             advance_tok(p);
             ASTNode *idx = parse_expression(p);
             consume(p, TOKEN_RBRACKET, "Expected ']'");
-            ASTNode *n = alloc_node(NODE_ARRAY_INDEX, line, col);
+            ASTNode *n = alloc_node(p, NODE_ARRAY_INDEX, line, col);
             n->as.array_index.array_expr = left;
             n->as.array_index.index = idx;
             left = n;
@@ -313,36 +322,21 @@ static ASTNode *parse_postfix(Parser *p) {
             Token *name = advance_tok(p);
 
             if (match(p, TOKEN_LPAREN)) {
-                /* method call -> __method_NAME */
+                /* method call: the receiver is the first arg */
                 advance_tok(p);
-                int cap = 4, cnt = 0;
-                ASTNode **args = malloc(sizeof(ASTNode *) * (size_t)cap);
-                /* first arg is the object */
-                args[cnt++] = left;
-                if (!match(p, TOKEN_RPAREN)) {
-                    if (cnt >= cap) { cap *= 2; args = realloc(args, sizeof(ASTNode *) * (size_t)cap); }
-                    args[cnt++] = parse_expression(p);
-                    while (match(p, TOKEN_COMMA)) {
-                        advance_tok(p);
-                        if (cnt >= cap) { cap *= 2; args = realloc(args, sizeof(ASTNode *) * (size_t)cap); }
-                        args[cnt++] = parse_expression(p);
-                    }
-                }
-                consume(p, TOKEN_RPAREN, "Expected ')' after arguments");
-
-                char method_name[300];
-                snprintf(method_name, sizeof(method_name), "__method_%s", name->value);
+                int base = p->scratch_count;
+                push(p, left);
+                parse_args(p);
 
-                ASTNode *n = alloc_node(NODE_FUNC_CALL, line, col);
-                n->as.func_call.name = strdup(method_name);
-                n->as.func_call.args = args;
-                n->as.func_call.arg_count = cnt;
+                ASTNode *n = alloc_node(p, NODE_METHOD_CALL, line, col);
+                n->as.func_call.name = name_of(p, name);
+                n->as.func_call.args = take_nodes(p, base, &n->as.func_call.arg_count);
                 left = n;
             } else {
                 /* property access */
-                ASTNode *n = alloc_node(NODE_OBJ_ACCESS, line, col);
+                ASTNode *n = alloc_node(p, NODE_OBJ_ACCESS, line, col);
                 n->as.obj_access.obj = left;
-                n->as.obj_access.key = strdup(name->value);
+                n->as.obj_access.key = name_of(p, name);
                 n->as.obj_access.key_expr = NULL;
                 n->as.obj_access.is_bracket = 0;
                 left = n;
@@ -360,7 +354,7 @@ static ASTNode *parse_multiplication(Parser *p) {
         int line = cur(p)->line, col = cur(p)->col;
         Token *op = advance_tok(p);
         ASTNode *right = parse_postfix(p);
-        ASTNode *n = alloc_node(NODE_BINARY, line, col);
+        ASTNode *n = alloc_node(p, NODE_BINARY, line, col);
         n->as.binary.left = left;
         n->as.binary.right = right;
         n->as.binary.op = op->type;
@@ -375,7 +369,7 @@ static ASTNode *parse_addition(Parser *p) {
         int line = cur(p)->line, col = cur(p)->col;
         Token *op = advance_tok(p);
         ASTNode *right = parse_multiplication(p);
-        ASTNode *n = alloc_node(NODE_BINARY, line, col);
+        ASTNode *n = alloc_node(p, NODE_BINARY, line, col);
         n->as.binary.left = left;
         n->as.binary.right = right;
         n->as.binary.op = op->type;
@@ -391,7 +385,7 @@ static ASTNode *parse_comparison(Parser *p) {
         int line = cur(p)->line, col = cur(p)->col;
         Token *op = advance_tok(p);
         ASTNode *right = parse_addition(p);
-        ASTNode *n = alloc_node(NODE_BINARY, line, col);
+        ASTNode *n = alloc_node(p, NODE_BINARY, line, col);
         n->as.binary.left = left;
         n->as.binary.right = right;
         n->as.binary.op = op->type;
@@ -406,7 +400,7 @@ static ASTNode *parse_and(Parser *p) {
         int line = cur(p)->line, col = cur(p)->col;
         advance_tok(p);
         ASTNode *right = parse_comparison(p);
-        ASTNode *n = alloc_node(NODE_BINARY, line, col);
+        ASTNode *n = alloc_node(p, NODE_BINARY, line, col);
         n->as.binary.left = left;
         n->as.binary.right = right;
         n->as.binary.op = TOKEN_AND;
@@ -421,7 +415,7 @@ static ASTNode *parse_or(Parser *p) {
         int line = cur(p)->line, col = cur(p)->col;
         advance_tok(p);
         ASTNode *right = parse_and(p);
-        ASTNode *n = alloc_node(NODE_BINARY, line, col);
+        ASTNode *n = alloc_node(p, NODE_BINARY, line, col);
         n->as.binary.left = left;
         n->as.binary.right = right;
         n->as.binary.op = TOKEN_OR;
@@ -438,7 +432,7 @@ static ASTNode *parse_ternary(Parser *p) {
         ASTNode *then_e = parse_ternary(p);
         consume(p, TOKEN_COLON, "Expected ':' in ternary expression");
         ASTNode *else_e = parse_ternary(p);
-        ASTNode *n = alloc_node(NODE_TERNARY, line, col);
+        ASTNode *n = alloc_node(p, NODE_TERNARY, line, col);
         n->as.ternary.condition = expr;
         n->as.ternary.then_expr = then_e;
         n->as.ternary.else_expr = else_e;
@@ -453,38 +447,38 @@ static ASTNode *parse_expression(Parser *p) {
 
 /* ---- parse params ---- */
 
+static void push_param(Parser *p) {
+    Token *pname = consume(p, TOKEN_IDENTIFIER, "Expected parameter name");
+    push(p, (void *)name_of(p, pname));
+    ASTNode *default_val = NULL;
+    if (match(p, TOKEN_ASSIGN)) {
+        advance_tok(p);
+        default_val = parse_expression(p);
+    }
+    push(p, default_val);
+}
+
 static void parse_params(Parser *p, Param **out, int *count) {
     consume(p, TOKEN_LPAREN, "Expected '(' after function name");
-    int cap = 4;
-    *out = malloc(sizeof(Param) * (size_t)cap);
-    *count = 0;
+    int base = p->scratch_count;
 
+    /* names and defaults pushed in turn */
     if (!match(p, TOKEN_RPAREN)) {
-        Token *pname = consume(p, TOKEN_IDENTIFIER, "Expected parameter name");
-        Param pm;
-        pm.name = strdup(pname->value);
-        pm.default_val = NULL;
-        if (match(p, TOKEN_ASSIGN)) {
-            advance_tok(p);
-            pm.default_val = parse_expression(p);
-        }
-        if (*count >= cap) { cap *= 2; *out = realloc(*out, sizeof(Param) * (size_t)cap); }
-        (*out)[(*count)++] = pm;
-
+        push_param(p);
         while (match(p, TOKEN_COMMA)) {
             advance_tok(p);
-            pname = consume(p, TOKEN_IDENTIFIER, "Expected parameter name");
-            pm.name = strdup(pname->value);
-            pm.default_val = NULL;
-            if (match(p, TOKEN_ASSIGN)) {
-                advance_tok(p);
-                pm.default_val = parse_expression(p);
-            }
-            if (*count >= cap) { cap *= 2; *out = realloc(*out, sizeof(Param) * (size_t)cap); }
-            (*out)[(*count)++] = pm;
+            push_param(p);
         }
     }
     consume(p, TOKEN_RPAREN, "Expected ')' after parameters");
+
+    *count = (p->scratch_count - base) / 2;
+    *out = arena_alloc(p->arena, sizeof(Param) * (size_t)*count);
+    for (int i = 0; i < *count; i++) {
+        (*out)[i].name = p->scratch[base + 2 * i];
+        (*out)[i].default_val = p->scratch[base + 2 * i + 1];
+    }
+    p->scratch_count = base;
 }
 
 /* ---- statement parsing ---- */
@@ -500,8 +494,7 @@ static ASTNode *parse_statement(Parser *p) {
         Token *name = consume(p, TOKEN_IDENTIFIER, "Expected class name");
         consume(p, TOKEN_LBRACE, "Expected '{' after class name");
 
-        int cap = 8, cnt = 0;
-        ASTNode **methods = malloc(sizeof(ASTNode *) * (size_t)cap);
+        int base = p->scratch_count;
 
         while (!match(p, TOKEN_RBRACE) && !match(p, TOKEN_EOF)) {
             int mline = cur(p)->line, mcol = cur(p)->col;
@@ -515,22 +508,20 @@ static ASTNode *parse_statement(Parser *p) {
             ASTNode **body; int bcount;
             parse_block(p, &body, &bcount);
 
-            ASTNode *m = alloc_node(NODE_FUNC_DEF, mline, mcol);
-            m->as.func_def.name = strdup(mname->value);
+            ASTNode *m = alloc_node(p, NODE_FUNC_DEF, mline, mcol);
+            m->as.func_def.name = name_of(p, mname);
             m->as.func_def.params = params;
             m->as.func_def.param_count = pcount;
             m->as.func_def.body = body;
             m->as.func_def.body_count = bcount;
 
-            if (cnt >= cap) { cap *= 2; methods = realloc(methods, sizeof(ASTNode *) * (size_t)cap); }
-            methods[cnt++] = m;
+            push(p, m);
         }
         consume(p, TOKEN_RBRACE, "Expected '}' after class body");
 
-        ASTNode *n = alloc_node(NODE_CLASS, line, col);
-        n->as.class_def.name = strdup(name->value);
-        n->as.class_def.methods = methods;
-        n->as.class_def.method_count = cnt;
+        ASTNode *n = alloc_node(p, NODE_CLASS, line, col);
+        n->as.class_def.name = name_of(p, name);
+        n->as.class_def.methods = take_nodes(p, base, &n->as.class_def.method_count);
         return n;
     }
 
@@ -545,8 +536,8 @@ static ASTNode *parse_statement(Parser *p) {
         ASTNode **body; int bcount;
         parse_block(p, &body, &bcount);
 
-        ASTNode *n = alloc_node(NODE_FUNC_DEF, line, col);
-        n->as.func_def.name = strdup(name->value);
+        ASTNode *n = alloc_node(p, NODE_FUNC_DEF, line, col);
+        n->as.func_def.name = name_of(p, name);
         n->as.func_def.params = params;
         n->as.func_def.param_count = pcount;
         n->as.func_def.body = body;
@@ -562,7 +553,7 @@ static ASTNode *parse_statement(Parser *p) {
             val = parse_expression(p);
         }
         optional_semicolon(p);
-        ASTNode *n = alloc_node(NODE_RETURN, line, col);
+        ASTNode *n = alloc_node(p, NODE_RETURN, line, col);
         n->as.return_val = val;
         return n;
     }
@@ -571,14 +562,14 @@ static ASTNode *parse_statement(Parser *p) {
     if (match(p, TOKEN_BREAK)) {
         advance_tok(p);
         optional_semicolon(p);
-        return alloc_node(NODE_BREAK, line, col);
+        return alloc_node(p, NODE_BREAK, line, col);
     }
 
     /* continue */
     if (match(p, TOKEN_CONTINUE)) {
         advance_tok(p);
         optional_semicolon(p);
-        return alloc_node(NODE_CONTINUE, line, col);
+        return alloc_node(p, NODE_CONTINUE, line, col);
     }
 
     /* import */
@@ -586,8 +577,9 @@ static ASTNode *parse_statement(Parser *p) {
         advance_tok(p);
         Token *path = consume(p, TOKEN_STRING, "Expected string path after import");
         optional_semicolon(p);
-        ASTNode *n = alloc_node(NODE_IMPORT, line, col);
-        n->as.import_path = strdup(path->value);
+        ASTNode *n = alloc_node(p, NODE_IMPORT, line, col);
+        n->as.import_path = arena_alloc(p->arena, (size_t)path->length + 1);
+        token_string(p->source, path, n->as.import_path);
         return n;
     }
 
@@ -599,18 +591,18 @@ static ASTNode *parse_statement(Parser *p) {
 
         consume(p, TOKEN_CATCH, "Expected 'catch' after try block");
 
-        char *catch_var = NULL;
+        const char *catch_var = NULL;
         if (match(p, TOKEN_LPAREN)) {
             advance_tok(p);
             Token *cv = consume(p, TOKEN_IDENTIFIER, "Expected variable name in catch");
-            catch_var = strdup(cv->value);
+            catch_var = name_of(p, cv);
             consume(p, TOKEN_RPAREN, "Expected ')' after catch variable");
         }
 
         ASTNode **catch_body; int catch_cnt;
         parse_block(p, &catch_body, &catch_cnt);
 
-        ASTNode *n = alloc_node(NODE_TRY_CATCH, line, col);
+        ASTNode *n = alloc_node(p, NODE_TRY_CATCH, line, col);
         n->as.try_catch.try_body = try_body;
         n->as.try_catch.try_count = try_cnt;
         n->as.try_catch.catch_var = catch_var;
@@ -624,7 +616,7 @@ static ASTNode *parse_statement(Parser *p) {
         advance_tok(p);
         ASTNode *val = parse_expression(p);
         optional_semicolon(p);
-        ASTNode *n = alloc_node(NODE_THROW, line, col);
+        ASTNode *n = alloc_node(p, NODE_THROW, line, col);
         n->as.throw_val = val;
         return n;
     }
@@ -642,7 +634,7 @@ static ASTNode *parse_statement(Parser *p) {
             advance_tok(p);
             /* else if */
             if (match(p, TOKEN_IF)) {
-                else_body = malloc(sizeof(ASTNode *));
+                else_body = arena_alloc(p->arena, sizeof(ASTNode *));
                 else_body[0] = parse_statement(p); /* recursion for else if */
                 else_cnt = 1;
             } else {
@@ -650,7 +642,7 @@ static ASTNode *parse_statement(Parser *p) {
             }
         }
 
-        ASTNode *n = alloc_node(NODE_IF, line, col);
+        ASTNode *n = alloc_node(p, NODE_IF, line, col);
         n->as.if_stmt.condition = cond;
         n->as.if_stmt.then_body = then_body;
         n->as.if_stmt.then_count = then_cnt;
@@ -666,7 +658,7 @@ static ASTNode *parse_statement(Parser *p) {
         ASTNode **body; int cnt;
         parse_block(p, &body, &cnt);
 
-        ASTNode *n = alloc_node(NODE_WHILE, line, col);
+        ASTNode *n = alloc_node(p, NODE_WHILE, line, col);
         n->as.while_loop.condition = cond;
         n->as.while_loop.body = body;
         n->as.while_loop.body_count = cnt;
@@ -682,8 +674,8 @@ static ASTNode *parse_statement(Parser *p) {
         ASTNode **body; int cnt;
         parse_block(p, &body, &cnt);
 
-        ASTNode *n = alloc_node(NODE_FOR, line, col);
-        n->as.for_loop.var = strdup(var->value);
+        ASTNode *n = alloc_node(p, NODE_FOR, line, col);
+        n->as.for_loop.var = name_of(p, var);
         n->as.for_loop.iterable = iter;
         n->as.for_loop.body = body;
         n->as.for_loop.body_count = cnt;
@@ -698,8 +690,8 @@ static ASTNode *parse_statement(Parser *p) {
         ASTNode *val = parse_expression(p);
         optional_semicolon(p);
 
-        ASTNode *n = alloc_node(NODE_ASSIGN, line, col);
-        n->as.assign.name = strdup(name->value);
+        ASTNode *n = alloc_node(p, NODE_ASSIGN, line, col);
+        n->as.assign.name = name_of(p, name);
         n->as.assign.value = val;
         return n;
     }
@@ -709,7 +701,7 @@ static ASTNode *parse_statement(Parser *p) {
         advance_tok(p);
         ASTNode *expr = parse_expression(p);
         optional_semicolon(p);
-        ASTNode *n = alloc_node(NODE_PRINT, line, col);
+        ASTNode *n = alloc_node(p, NODE_PRINT, line, col);
         n->as.print_expr = expr;
         return n;
     }
@@ -722,8 +714,8 @@ static ASTNode *parse_statement(Parser *p) {
             advance_tok(p); /* = */
             ASTNode *val = parse_expression(p);
             optional_semicolon(p);
-            ASTNode *n = alloc_node(NODE_ASSIGN, line, col);
-            n->as.assign.name = strdup(name->value);
+            ASTNode *n = alloc_node(p, NODE_ASSIGN, line, col);
+            n->as.assign.name = name_of(p, name);
             n->as.assign.value = val;
             return n;
         }
@@ -733,8 +725,8 @@ static ASTNode *parse_statement(Parser *p) {
             Token *op = advance_tok(p);
             ASTNode *val = parse_expression(p);
             optional_semicolon(p);
-            ASTNode *n = alloc_node(NODE_COMPOUND_ASSIGN, line, col);
-            n->as.comp_assign.name = strdup(name->value);
+            ASTNode *n = alloc_node(p, NODE_COMPOUND_ASSIGN, line, col);
+            n->as.comp_assign.name = name_of(p, name);
             n->as.comp_assign.op = op->type;
             n->as.comp_assign.value = val;
             return n;
@@ -751,22 +743,19 @@ static ASTNode *parse_statement(Parser *p) {
             ASTNode *val = parse_expression(p);
             optional_semicolon(p);
 
-            ASTNode *n = alloc_node(NODE_OBJ_ASSIGN, line, col);
+            ASTNode *n = alloc_node(p, NODE_OBJ_ASSIGN, line, col);
             if (expr->type == NODE_OBJ_ACCESS) {
                 n->as.obj_assign.obj = expr->as.obj_access.obj;
                 n->as.obj_assign.key = expr->as.obj_access.key;
                 n->as.obj_assign.key_expr = expr->as.obj_access.key_expr;
                 n->as.obj_assign.is_bracket = expr->as.obj_access.is_bracket;
                 n->as.obj_assign.value = val;
-                /* don't free expr, we stole its children */
-                free(expr);
             } else if (expr->type == NODE_ARRAY_INDEX) {
                 n->as.obj_assign.obj = expr->as.array_index.array_expr;
                 n->as.obj_assign.key = NULL;
                 n->as.obj_assign.key_expr = expr->as.array_index.index;
                 n->as.obj_assign.is_bracket = 1;
                 n->as.obj_assign.value = val;
-                free(expr);
             } else {
                 parser_error(p, "Invalid assignment target");
             }
@@ -781,7 +770,7 @@ static ASTNode *parse_statement(Parser *p) {
             optional_semicolon(p);
 
             if (expr->type == NODE_OBJ_ACCESS || expr->type == NODE_ARRAY_INDEX) {
-                ASTNode *n = alloc_node(NODE_OBJ_COMPOUND_ASSIGN, line, col);
+                ASTNode *n = alloc_node(p, NODE_OBJ_COMPOUND_ASSIGN, line, col);
                 if (expr->type == NODE_OBJ_ACCESS) {
                     n->as.obj_comp_assign.obj = expr->as.obj_access.obj;
                     n->as.obj_comp_assign.key = expr->as.obj_access.key;
@@ -795,7 +784,6 @@ static ASTNode *parse_statement(Parser *p) {
                 }
                 n->as.obj_comp_assign.value = rhs;
                 n->as.obj_comp_assign.op = op_tok->type;
-                free(expr);
                 return n;
             } else {
                 parser_error(p, "Invalid compound assignment target");
@@ -811,215 +799,288 @@ static ASTNode *parse_statement(Parser *p) {
 
 /* ---- public API ---- */
 
-void parser_init(Parser *p, Token *tokens, int count) {
+void parser_init(Parser *p, const char *source, Token *tokens, int count) {
+    p->source = source;
     p->tokens = tokens;
     p->token_count = count;
     p->current = 0;
+    p->arena = NULL;
+    p->scratch = NULL;
+    p->scratch_count = 0;
+    p->scratch_cap = 0;
+    p->error[0] = '\0';
 }
 
-ASTNode *parser_parse(Parser *p) {
-    int cap = 32;
-    ASTNode **stmts = malloc(sizeof(ASTNode *) * (size_t)cap);
-    int cnt = 0;
-
+static ASTNode *parse_program(Parser *p) {
     while (!match(p, TOKEN_EOF)) {
         ASTNode *s = parse_statement(p);
-        if (s) {
-            if (cnt >= cap) { cap *= 2; stmts = realloc(stmts, sizeof(ASTNode *) * (size_t)cap); }
-            stmts[cnt++] = s;
-        }
+        if (s) push(p, s);
     }
 
-    ASTNode *prog = alloc_node(NODE_PROGRAM, 0, 0);
-    prog->as.program.stmts = stmts;
-    prog->as.program.count = cnt;
+    ASTNode *prog = alloc_node(p, NODE_PROGRAM, 0, 0);
+    prog->as.program.stmts = take_nodes(p, 0, &prog->as.program.count);
+    prog->as.program.arena = p->arena;
     return prog;
 }
 
-ASTNode *parser_parse_expression(Parser *p) {
-    return parse_expression(p);
+ASTNode *parser_parse(Parser *p) {
+    p->arena = arena_new();
+    ASTNode *program = NULL;
+    if (setjmp(p->bail)) arena_free(p->arena);
+    else program = parse_program(p);
+    MEM_FREE(MEM_AST, sizeof(void *) * (size_t)p->scratch_cap);
+    free(p->scratch);
+    p->scratch = NULL;
+    p->scratch_cap = 0;
+    p->arena = NULL;
+    return program;
+}
+
+void ast_free(ASTNode *program) {
+    if (program) arena_free(program->as.program.arena);
+}
+
+/* ---- dump ---- */
+
+static const char *op_text(TokenType op) {
+    switch (op) {
+        case TOKEN_PLUS: return "+";
+        case TOKEN_MINUS: return "-";
+        case TOKEN_MULTIPLY: return "*";
+        case TOKEN_DIVIDE: return "/";
+        case TOKEN_MODULO: return "%";
+        case TOKEN_PLUS_ASSIGN: return "+=";
+        case TOKEN_MINUS_ASSIGN: return "-=";
+        case TOKEN_MULTIPLY_ASSIGN: return "*=";
+        case TOKEN_DIVIDE_ASSIGN: return "/=";
+        case TOKEN_EQ: return "==";
+        case TOKEN_NEQ: return "!=";
+        case TOKEN_GT: return ">";
+        case TOKEN_LT: return "<";
+        case TOKEN_GTE: return ">=";
+        case TOKEN_LTE: return "<=";
+        case TOKEN_AND: return "and";
+        case TOKEN_OR: return "or";
+        case TOKEN_NOT: return "not";
+        default: return token_type_name(op);
+    }
+}
+
+static void dump_quoted(const char *s, int len, FILE *out) {
+    fputc('"', out);
+    for (int i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)s[i];
+        if (c == '"' || c == '\\') fprintf(out, "\\%c", c);
+        else if (c == '\n') fputs("\\n", out);
+        else if (c == '\t') fputs("\\t", out);
+        else if (c < 0x20) fprintf(out, "\\x%02x", c);
+        else fputc(c, out);
+    }
+    fputc('"', out);
+}
+
+static void dump_node(ASTNode *node, FILE *out, int depth);
+
+static void dump_label(const char *label, FILE *out, int depth) {
+    fprintf(out, "%*s%s:\n", depth * 2, "", label);
+}
+
+static void dump_list(const char *label, ASTNode **nodes, int count, FILE *out, int depth) {
+    dump_label(label, out, depth);
+    for (int i = 0; i < count; i++) dump_node(nodes[i], out, depth + 1);
+}
+
+static void dump_key(const char *key, ASTNode *key_expr, int is_bracket, FILE *out, int depth) {
+    if (is_bracket || !key) {
+        dump_label("key", out, depth);
+        dump_node(key_expr, out, depth + 1);
+    } else {
+        fprintf(out, "%*s.%s\n", depth * 2, "", key);
+    }
 }
 
-void ast_free(ASTNode *node) {
-    if (!node) return;
+static void dump_node(ASTNode *node, FILE *out, int depth) {
+    fprintf(out, "%*s", depth * 2, "");
+    if (!node) {
+        fputs("(none)\n", out);
+        return;
+    }
+    int d = depth + 1;
 
     switch (node->type) {
-        case NODE_NUMBER:
-        case NODE_BOOL:
-        case NODE_NULL:
-        case NODE_THIS:
-        case NODE_BREAK:
-        case NODE_CONTINUE:
+        case NODE_NUMBER: {
+            char buf[64];
+            val_format_number(node->as.number, buf, sizeof(buf));
+            fprintf(out, "number %s", buf);
             break;
-
+        }
         case NODE_STRING:
-            free(node->as.string.str);
+            fputs("string ", out);
+            dump_quoted(node->as.string.str, node->as.string.len, out);
             break;
-
-        case NODE_VARIABLE:
-            free(node->as.var_name);
+        case NODE_CONST:
+            fputs("const ", out);
+            if (IS_STRING(node->as.constant)) {
+                dump_quoted(AS_STRING(node->as.constant)->chars,
+                            AS_STRING(node->as.constant)->len, out);
+            } else {
+                char *s = val_to_string(node->as.constant);
+                fputs(s, out);
+                free(s);
+            }
             break;
-
-        case NODE_BINARY:
-            ast_free(node->as.binary.left);
-            ast_free(node->as.binary.right);
+        case NODE_BOOL: fputs(node->as.boolean ? "true" : "false", out); break;
+        case NODE_NULL: fputs("null", out); break;
+        case NODE_THIS: fputs("this", out); break;
+        case NODE_BREAK: fputs("break", out); break;
+        case NODE_CONTINUE: fputs("continue", out); break;
+        case NODE_VARIABLE: fprintf(out, "variable %s", node->as.var_name); break;
+        case NODE_BINARY: fprintf(out, "binary %s", op_text(node->as.binary.op)); break;
+        case NODE_UNARY: fprintf(out, "unary %s", op_text(node->as.unary.op)); break;
+        case NODE_ASSIGN: fprintf(out, "assign %s", node->as.assign.name); break;
+        case NODE_COMPOUND_ASSIGN:
+            fprintf(out, "assign %s %s", node->as.comp_assign.name, op_text(node->as.comp_assign.op));
             break;
-
-        case NODE_UNARY:
-            ast_free(node->as.unary.operand);
+        case NODE_PRINT: fputs("print", out); break;
+        case NODE_IF: fputs("if", out); break;
+        case NODE_WHILE: fputs("while", out); break;
+        case NODE_FOR: fprintf(out, "for %s", node->as.for_loop.var); break;
+        case NODE_FUNC_DEF:
+            fprintf(out, "fn %s(", node->as.func_def.name ? node->as.func_def.name : "");
+            for (int i = 0; i < node->as.func_def.param_count; i++)
+                fprintf(out, "%s%s", i ? ", " : "", node->as.func_def.params[i].name);
+            fputc(')', out);
             break;
-
-        case NODE_ASSIGN:
-            free(node->as.assign.name);
-            ast_free(node->as.assign.value);
+        case NODE_FUNC_CALL: fprintf(out, "call %s", node->as.func_call.name); break;
+        case NODE_METHOD_CALL: fprintf(out, "method %s", node->as.func_call.name); break;
+        case NODE_RETURN: fputs("return", out); break;
+        case NODE_IMPORT:
+            fputs("import ", out);
+            dump_quoted(node->as.import_path, (int)strlen(node->as.import_path), out);
             break;
-
-        case NODE_COMPOUND_ASSIGN:
-            free(node->as.comp_assign.name);
-            ast_free(node->as.comp_assign.value);
+        case NODE_TRY_CATCH:
+            fprintf(out, "try catch %s", node->as.try_catch.catch_var ? node->as.try_catch.catch_var : "");
             break;
-
-        case NODE_PRINT:
-            ast_free(node->as.print_expr);
+        case NODE_THROW: fputs("throw", out); break;
+        case NODE_CLASS: fprintf(out, "class %s", node->as.class_def.name); break;
+        case NODE_NEW: fprintf(out, "new %s", node->as.new_inst.class_name); break;
+        case NODE_ARRAY: fputs("array", out); break;
+        case NODE_ARRAY_INDEX: fputs("index", out); break;
+        case NODE_OBJECT: fputs("object", out); break;
+        case NODE_OBJ_ACCESS: fputs("field", out); break;
+        case NODE_OBJ_ASSIGN: fputs("field assign", out); break;
+        case NODE_OBJ_COMPOUND_ASSIGN:
+            fprintf(out, "field assign %s", op_text(node->as.obj_comp_assign.op));
             break;
+        case NODE_TERNARY: fputs("ternary", out); break;
+        case NODE_STRING_INTERP: fputs("interpolation", out); break;
+        case NODE_PROGRAM: fputs("program", out); break;
+    }
+    if (node->type == NODE_PROGRAM) fputc('\n', out);
+    else fprintf(out, "  [line %d]\n", node->line);
 
+    switch (node->type) {
+        case NODE_BINARY:
+            dump_node(node->as.binary.left, out, d);
+            dump_node(node->as.binary.right, out, d);
+            break;
+        case NODE_UNARY: dump_node(node->as.unary.operand, out, d); break;
+        case NODE_ASSIGN: dump_node(node->as.assign.value, out, d); break;
+        case NODE_COMPOUND_ASSIGN: dump_node(node->as.comp_assign.value, out, d); break;
+        case NODE_PRINT: dump_node(node->as.print_expr, out, d); break;
         case NODE_IF:
-            ast_free(node->as.if_stmt.condition);
-            for (int i = 0; i < node->as.if_stmt.then_count; i++)
-                ast_free(node->as.if_stmt.then_body[i]);
-            free(node->as.if_stmt.then_body);
-            for (int i = 0; i < node->as.if_stmt.else_count; i++)
-                ast_free(node->as.if_stmt.else_body[i]);
-            free(node->as.if_stmt.else_body);
+            dump_node(node->as.if_stmt.condition, out, d);
+            dump_list("then", node->as.if_stmt.then_body, node->as.if_stmt.then_count, out, d);
+            if (node->as.if_stmt.else_body)
+                dump_list("else", node->as.if_stmt.else_body, node->as.if_stmt.else_count, out, d);
             break;
-
         case NODE_WHILE:
-            ast_free(node->as.while_loop.condition);
-            for (int i = 0; i < node->as.while_loop.body_count; i++)
-                ast_free(node->as.while_loop.body[i]);
-            free(node->as.while_loop.body);
+            dump_node(node->as.while_loop.condition, out, d);
+            dump_list("body", node->as.while_loop.body, node->as.while_loop.body_count, out, d);
             break;
-
         case NODE_FOR:
-            free(node->as.for_loop.var);
-            ast_free(node->as.for_loop.iterable);
-            for (int i = 0; i < node->as.for_loop.body_count; i++)
-                ast_free(node->as.for_loop.body[i]);
-            free(node->as.for_loop.body);
+            dump_node(node->as.for_loop.iterable, out, d);
+            dump_list("body", node->as.for_loop.body, node->as.for_loop.body_count, out, d);
             break;
-
         case NODE_FUNC_DEF:
-            free(node->as.func_def.name);
             for (int i = 0; i < node->as.func_def.param_count; i++) {
-                free(node->as.func_def.params[i].name);
-                ast_free(node->as.func_def.params[i].default_val);
+                Param *p = &node->as.func_def.params[i];
+                if (!p->default_val) continue;
+                fprintf(out, "%*sdefault %s:\n", d * 2, "", p->name);
+                dump_node(p->default_val, out, d + 1);
             }
-            free(node->as.func_def.params);
-            for (int i = 0; i < node->as.func_def.body_count; i++)
-                ast_free(node->as.func_def.body[i]);
-            free(node->as.func_def.body);
+            dump_list("body", node->as.func_def.body, node->as.func_def.body_count, out, d);
             break;
-
         case NODE_FUNC_CALL:
-            free(node->as.func_call.name);
+        case NODE_METHOD_CALL:
             for (int i = 0; i < node->as.func_call.arg_count; i++)
-                ast_free(node->as.func_call.args[i]);
-            free(node->as.func_call.args);
+                dump_node(node->as.func_call.args[i], out, d);
             break;
-
         case NODE_RETURN:
-            ast_free(node->as.return_val);
+            if (node->as.return_val) dump_node(node->as.return_val, out, d);
             break;
-
-        case NODE_IMPORT:
-            free(node->as.import_path);
-            break;
-
         case NODE_TRY_CATCH:
-            for (int i = 0; i < node->as.try_catch.try_count; i++)
-                ast_free(node->as.try_catch.try_body[i]);
-            free(node->as.try_catch.try_body);
-            free(node->as.try_catch.catch_var);
-            for (int i = 0; i < node->as.try_catch.catch_count; i++)
-                ast_free(node->as.try_catch.catch_body[i]);
-            free(node->as.try_catch.catch_body);
+            dump_list("try", node->as.try_catch.try_body, node->as.try_catch.try_count, out, d);
+            dump_list("catch", node->as.try_catch.catch_body, node->as.try_catch.catch_count, out, d);
             break;
-
-        case NODE_THROW:
-            ast_free(node->as.throw_val);
-            break;
-
+        case NODE_THROW: dump_node(node->as.throw_val, out, d); break;
         case NODE_CLASS:
-            free(node->as.class_def.name);
             for (int i = 0; i < node->as.class_def.method_count; i++)
-                ast_free(node->as.class_def.methods[i]);
-            free(node->as.class_def.methods);
+                dump_node(node->as.class_def.methods[i], out, d);
             break;
-
         case NODE_NEW:
-            free(node->as.new_inst.class_name);
             for (int i = 0; i < node->as.new_inst.arg_count; i++)
-                ast_free(node->as.new_inst.args[i]);
-            free(node->as.new_inst.args);
+                dump_node(node->as.new_inst.args[i], out, d);
             break;
-
         case NODE_ARRAY:
             for (int i = 0; i < node->as.array.count; i++)
-                ast_free(node->as.array.elements[i]);
-            free(node->as.array.elements);
+                dump_node(node->as.array.elements[i], out, d);
             break;
-
         case NODE_ARRAY_INDEX:
-            ast_free(node->as.array_index.array_expr);
-            ast_free(node->as.array_index.index);
+            dump_node(node->as.array_index.array_expr, out, d);
+            dump_node(node->as.array_index.index, out, d);
             break;
-
         case NODE_OBJECT:
             for (int i = 0; i < node->as.object.count; i++) {
-                free(node->as.object.keys[i]);
-                ast_free(node->as.object.values[i]);
+                fprintf(out, "%*s%s:\n", d * 2, "", node->as.object.keys[i]);
+                dump_node(node->as.object.values[i], out, d + 1);
             }
-            free(node->as.object.keys);
-            free(node->as.object.values);
             break;
-
         case NODE_OBJ_ACCESS:
-            ast_free(node->as.obj_access.obj);
-            free(node->as.obj_access.key);
-            ast_free(node->as.obj_access.key_expr);
+            dump_node(node->as.obj_access.obj, out, d);
+            dump_key(node->as.obj_access.key, node->as.obj_access.key_expr,
+                 node->as.obj_access.is_bracket, out, d);
             break;
-
         case NODE_OBJ_ASSIGN:
-            ast_free(node->as.obj_assign.obj);
-            free(node->as.obj_assign.key);
-            ast_free(node->as.obj_assign.key_expr);
-            ast_free(node->as.obj_assign.value);
+            dump_node(node->as.obj_assign.obj, out, d);
+            dump_key(node->as.obj_assign.key, node->as.obj_assign.key_expr,
+                 node->as.obj_assign.is_bracket, out, d);
+            dump_node(node->as.obj_assign.value, out, d);
             break;
-
         case NODE_OBJ_COMPOUND_ASSIGN:
-            ast_free(node->as.obj_comp_assign.obj);
-            free(node->as.obj_comp_assign.key);
-            ast_free(node->as.obj_comp_assign.key_expr);
-            ast_free(node->as.obj_comp_assign.value);
+            dump_node(node->as.obj_comp_assign.obj, out, d);
+            dump_key(node->as.obj_comp_assign.key, node->as.obj_comp_assign.key_expr,
+                 node->as.obj_comp_assign.is_bracket, out, d);
+            dump_node(node->as.obj_comp_assign.value, out, d);
             break;
-
         case NODE_TERNARY:
-            ast_free(node->as.ternary.condition);
-            ast_free(node->as.ternary.then_expr);
-            ast_free(node->as.ternary.else_expr);
+            dump_node(node->as.ternary.condition, out, d);
+            dump_node(node->as.ternary.then_expr, out, d);
+            dump_node(node->as.ternary.else_expr, out, d);
             break;
-
         case NODE_STRING_INTERP:
             for (int i = 0; i < node->as.interp.count; i++)
-                ast_free(node->as.interp.parts[i]);
-            free(node->as.interp.parts);
+                dump_node(node->as.interp.parts[i], out, d);
             break;
-
         case NODE_PROGRAM:
             for (int i = 0; i < node->as.program.count; i++)
-                ast_free(node->as.program.stmts[i]);
-            free(node->as.program.stmts);
+                dump_node(node->as.program.stmts[i], out, d);
+            break;
+        default:
             break;
     }
-    free(node);
+}
+
+void ast_dump(ASTNode *node, FILE *out) {
+    dump_node(node, out, 0);
 }
@@ -1,8 +1,11 @@
 #ifndef JUNG_PARSER_H
 #define JUNG_PARSER_H
 
+#include "arena.h"
 #include "lexer.h"
 #include "value.h"
+#include <setjmp.h>
+#include <stdio.h>
 
 typedef enum {
     NODE_NUMBER, NODE_STRING, NODE_BOOL, NODE_NULL,
@@ -17,14 +20,24 @@ typedef enum {
     NODE_OBJECT, NODE_OBJ_ACCESS, NODE_OBJ_ASSIGN,
     NODE_OBJ_COMPOUND_ASSIGN,
     NODE_TERNARY, NODE_STRING_INTERP,
+    NODE_CONST, NODE_METHOD_CALL,
     NODE_PROGRAM
 } NodeType;
 
+/* Identifier-like strings in the AST (names, keys, params) are interned
+ * (intern.h). Everything else, nodes, child lists, literal texts and
+ * paths, lives in the program's arena (arena.h) and goes with it. */
 struct ASTNode {
     NodeType type;
     int line;
     int col;
 
+    /* Lexical address set by the resolver on NODE_VARIABLE, NODE_ASSIGN and
+     * NODE_COMPOUND_ASSIGN: the value lives in slot 'slot' of the scope
+     * 'depth' levels out. slot is -1 for names looked up by name. */
+    int depth;
+    int slot;
+
     union {
         /* NODE_NUMBER */
         double number;
@@ -36,7 +49,7 @@ struct ASTNode {
         int boolean;
 
         /* NODE_VARIABLE */
-        char *var_name;
+        const char *var_name;
 
         /* NODE_BINARY */
         struct {
@@ -53,13 +66,13 @@ struct ASTNode {
 
         /* NODE_ASSIGN */
         struct {
-            char *name;
+            const char *name;
             ASTNode *value;
         } assign;
 
         /* NODE_COMPOUND_ASSIGN */
         struct {
-            char *name;
+            const char *name;
             TokenType op;
             ASTNode *value;
         } comp_assign;
@@ -85,7 +98,7 @@ struct ASTNode {
 
         /* NODE_FOR */
         struct {
-            char *var;
+            const char *var;
             ASTNode *iterable;
             ASTNode **body;
             int body_count;
@@ -93,18 +106,20 @@ struct ASTNode {
 
         /* NODE_FUNC_DEF */
         struct {
-            char *name;
+            const char *name;
             Param *params;
             int param_count;
             ASTNode **body;
             int body_count;
         } func_def;
 
-        /* NODE_FUNC_CALL */
+        /* NODE_FUNC_CALL, and NODE_METHOD_CALL (recv.name(...)): there name
+         * is the method's own and args[0] is the receiver */
         struct {
-            char *name;
+            const char *name;
             ASTNode **args;
             int arg_count;
+            CallCache cache;
         } func_call;
 
         /* NODE_RETURN */
@@ -117,7 +132,7 @@ struct ASTNode {
         struct {
             ASTNode **try_body;
             int try_count;
-            char *catch_var;   /* may be NULL */
+            const char *catch_var;   /* may be NULL */
             ASTNode **catch_body;
             int catch_count;
         } try_catch;
@@ -127,14 +142,14 @@ struct ASTNode {
 
         /* NODE_CLASS */
         struct {
-            char *name;
+            const char *name;
             ASTNode **methods;   /* each is NODE_FUNC_DEF */
             int method_count;
         } class_def;
 
         /* NODE_NEW */
         struct {
-            char *class_name;
+            const char *class_name;
             ASTNode **args;
             int arg_count;
         } new_inst;
@@ -153,7 +168,7 @@ struct ASTNode {
 
         /* NODE_OBJECT */
         struct {
-            char **keys;
+            const char **keys;
             ASTNode **values;
             int count;
         } object;
@@ -161,28 +176,31 @@ struct ASTNode {
         /* NODE_OBJ_ACCESS */
         struct {
             ASTNode *obj;
-            char *key;       /* for dot notation */
+            const char *key;       /* for dot notation */
             ASTNode *key_expr; /* for bracket notation */
             int is_bracket;
+            ShapeCache cache;  /* dot notation only */
         } obj_access;
 
         /* NODE_OBJ_ASSIGN */
         struct {
             ASTNode *obj;
-            char *key;
+            const char *key;
             ASTNode *key_expr;
             ASTNode *value;
             int is_bracket;
+            ShapeCache cache;
         } obj_assign;
 
         /* NODE_OBJ_COMPOUND_ASSIGN */
         struct {
             ASTNode *obj;
-            char *key;
+            const char *key;
             ASTNode *key_expr;
             ASTNode *value;
             int is_bracket;
             TokenType op;
+            ShapeCache cache;
         } obj_comp_assign;
 
         /* NODE_TERNARY */
@@ -198,23 +216,45 @@ struct ASTNode {
             int count;
         } interp;
 
+        /* NODE_CONST: a string literal pre-built by the optimizer
+         * (optimizer.h), held by the arena and copied out on each use */
+        Value constant;
+
         /* NODE_PROGRAM */
         struct {
             ASTNode **stmts;
             int count;
+            Arena *arena;  /* every node of the program */
         } program;
     } as;
 };
 
 typedef struct {
+    const char *source;   /* what the tokens are spans of */
     Token *tokens;
     int token_count;
     int current;
+    Arena *arena;         /* of the program being parsed */
+    void **scratch;       /* lists being parsed, innermost on top */
+    int scratch_count;
+    int scratch_cap;
+    jmp_buf bail;         /* parse errors unwind to parser_parse */
+    char error[256];      /* message of the error, if parsing failed */
 } Parser;
 
-void     parser_init(Parser *p, Token *tokens, int count);
-ASTNode *parser_parse(Parser *p);          /* returns NODE_PROGRAM */
-ASTNode *parser_parse_expression(Parser *p); /* for REPL / string interpolation */
-void     ast_free(ASTNode *node);
+void     parser_init(Parser *p, const char *source, Token *tokens, int count);
+
+/* A NODE_PROGRAM; on a syntax error NULL with p->error set, and nothing
+ * it built left behind */
+ASTNode *parser_parse(Parser *p);
+
+/* A zeroed node from the arena, not yet resolved (slot -1) */
+ASTNode *ast_node(Arena *a, NodeType type, int line, int col);
+
+/* Free a program and every node in it */
+void     ast_free(ASTNode *program);
+
+/* Print node and its subtree, one node per line indented by depth */
+void     ast_dump(ASTNode *node, FILE *out);
 
 #endif
@@ -0,0 +1,307 @@
+#include "profile.h"
+#include "parser.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct {
+    FuncDef *fn;
+    long calls;
+    uint64_t incl, excl;
+    int active;           /* frames of fn open now; incl counts the outermost */
+} FuncStat;
+
+typedef struct {
+    long count;
+    uint64_t incl, excl;
+    int active;
+} LineStat;
+
+/* Call tree node: one per distinct stack of functions */
+typedef struct {
+    int func;             /* index into funcs, -1 for the root */
+    int child;            /* first child node, -1 if none */
+    int next;             /* next sibling, -1 if none */
+    uint64_t self;
+} TreeNode;
+
+typedef struct {
+    int func;
+    int node;
+    uint64_t start;
+    uint64_t child;       /* time spent in callees */
+} CallFrame;
+
+typedef struct {
+    int line;
+    uint64_t start;
+    uint64_t child;       /* time spent in nested statements */
+} StmtFrame;
+
+struct Profile {
+    FuncStat *funcs;
+    int func_count, func_cap;
+    int *func_index;      /* FuncDef* hash -> funcs index, -1 empty */
+    int func_mask;
+    LineStat *lines;      /* by source line */
+    int line_cap;
+    TreeNode *nodes;
+    int node_count, node_cap;
+    CallFrame *calls;     /* calls[0] is the root frame: the whole run */
+    int call_top, call_cap;
+    StmtFrame *stmts;
+    int stmt_top, stmt_cap;
+};
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+#define GROW(arr, count, cap, init) do {                                 \
+        if ((count) >= (cap)) {                                          \
+            (cap) = (cap) ? (cap) * 2 : (init);                          \
+            (arr) = realloc((arr), sizeof(*(arr)) * (size_t)(cap));      \
+        }                                                                \
+    } while (0)
+
+static int new_node(Profile *p, int func) {
+    GROW(p->nodes, p->node_count, p->node_cap, 64);
+    TreeNode *n = &p->nodes[p->node_count];
+    n->func = func;
+    n->child = -1;
+    n->next = -1;
+    n->self = 0;
+    return p->node_count++;
+}
+
+Profile *profile_new(void) {
+    Profile *p = calloc(1, sizeof(Profile));
+    p->func_mask = 63;
+    p->func_index = malloc(sizeof(int) * 64);
+    memset(p->func_index, 0xFF, sizeof(int) * 64);
+    new_node(p, -1);
+    GROW(p->calls, p->call_top, p->call_cap, 64);
+    p->calls[0].func = -1;
+    p->calls[0].node = 0;
+    p->calls[0].start = now_ns();
+    p->calls[0].child = 0;
+    p->call_top = 1;
+    return p;
+}
+
+void profile_free(Profile *p) {
+    if (!p) return;
+    free(p->funcs);
+    free(p->func_index);
+    free(p->lines);
+    free(p->nodes);
+    free(p->calls);
+    free(p->stmts);
+    free(p);
+}
+
+static unsigned hash_ptr(const void *ptr) {
+    uintptr_t x = (uintptr_t)ptr;
+    x ^= x >> 17;
+    x *= 0x9E3779B1u;
+    return (unsigned)(x ^ (x >> 15));
+}
+
+/* Index of fn's stats, added on first sight */
+static int func_slot(Profile *p, FuncDef *fn) {
+    unsigned i = hash_ptr(fn) & (unsigned)p->func_mask;
+    for (;;) {
+        int f = p->func_index[i];
+        if (f < 0) break;
+        if (p->funcs[f].fn == fn) return f;
+        i = (i + 1) & (unsigned)p->func_mask;
+    }
+    GROW(p->funcs, p->func_count, p->func_cap, 32);
+    int f = p->func_count++;
+    memset(&p->funcs[f], 0, sizeof(FuncStat));
+    p->funcs[f].fn = fn;
+    p->func_index[i] = f;
+
+    /* Keep the index at most half full */
+    if (p->func_count * 2 > p->func_mask + 1) {
+        int size = (p->func_mask + 1) * 2;
+        free(p->func_index);
+        p->func_index = malloc(sizeof(int) * (size_t)size);
+        memset(p->func_index, 0xFF, sizeof(int) * (size_t)size);
+        p->func_mask = size - 1;
+        for (int k = 0; k < p->func_count; k++) {
+            unsigned j = hash_ptr(p->funcs[k].fn) & (unsigned)p->func_mask;
+            while (p->func_index[j] >= 0) j = (j + 1) & (unsigned)p->func_mask;
+            p->func_index[j] = k;
+        }
+    }
+    return f;
+}
+
+static int tree_child(Profile *p, int parent, int func) {
+    for (int c = p->nodes[parent].child; c >= 0; c = p->nodes[c].next)
+        if (p->nodes[c].func == func) return c;
+    int c = new_node(p, func);
+    p->nodes[c].next = p->nodes[parent].child;
+    p->nodes[parent].child = c;
+    return c;
+}
+
+void profile_enter(Profile *p, FuncDef *fn) {
+    int f = func_slot(p, fn);
+    p->funcs[f].calls++;
+    p->funcs[f].active++;
+    int node = tree_child(p, p->calls[p->call_top - 1].node, f);
+    GROW(p->calls, p->call_top, p->call_cap, 64);
+    CallFrame *fr = &p->calls[p->call_top++];
+    fr->func = f;
+    fr->node = node;
+    fr->child = 0;
+    fr->start = now_ns();
+}
+
+void profile_leave(Profile *p) {
+    uint64_t t = now_ns();
+    if (p->call_top <= 1) return;
+    CallFrame *fr = &p->calls[--p->call_top];
+    uint64_t elapsed = t - fr->start;
+    uint64_t self = elapsed > fr->child ? elapsed - fr->child : 0;
+    FuncStat *s = &p->funcs[fr->func];
+    if (--s->active == 0) s->incl += elapsed;
+    s->excl += self;
+    p->nodes[fr->node].self += self;
+    p->calls[p->call_top - 1].child += elapsed;
+}
+
+void profile_stmt_begin(Profile *p, int line) {
+    if (line < 0) line = 0;
+    if (line >= p->line_cap) {
+        int cap = p->line_cap ? p->line_cap : 256;
+        while (cap <= line) cap *= 2;
+        p->lines = realloc(p->lines, sizeof(LineStat) * (size_t)cap);
+        memset(p->lines + p->line_cap, 0, sizeof(LineStat) * (size_t)(cap - p->line_cap));
+        p->line_cap = cap;
+    }
+    p->lines[line].count++;
+    p->lines[line].active++;
+    GROW(p->stmts, p->stmt_top, p->stmt_cap, 64);
+    StmtFrame *fr = &p->stmts[p->stmt_top++];
+    fr->line = line;
+    fr->child = 0;
+    fr->start = now_ns();
+}
+
+void profile_stmt_end(Profile *p) {
+    uint64_t t = now_ns();
+    if (p->stmt_top <= 0) return;
+    StmtFrame *fr = &p->stmts[--p->stmt_top];
+    uint64_t elapsed = t - fr->start;
+    LineStat *s = &p->lines[fr->line];
+    if (--s->active == 0) s->incl += elapsed;
+    s->excl += elapsed > fr->child ? elapsed - fr->child : 0;
+    if (p->stmt_top > 0) p->stmts[p->stmt_top - 1].child += elapsed;
+}
+
+ProfileMark profile_mark(Profile *p) {
+    ProfileMark m = { 1, 0 };
+    if (p) {
+        m.calls = p->call_top;
+        m.stmts = p->stmt_top;
+    }
+    return m;
+}
+
+void profile_unwind(Profile *p, ProfileMark m) {
+    if (!p) return;
+    while (p->call_top > m.calls) profile_leave(p);
+    while (p->stmt_top > m.stmts) profile_stmt_end(p);
+}
+
+/* ---- report ---- */
+
+static const char *func_name(FuncDef *fn) {
+    return fn->name ? fn->name : "<anonymous>";
+}
+
+static int by_func_excl(const void *a, const void *b) {
+    uint64_t x = (*(const FuncStat *const *)a)->excl, y = (*(const FuncStat *const *)b)->excl;
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+static int by_line_excl(const void *a, const void *b) {
+    uint64_t x = (*(const LineStat *const *)a)->excl, y = (*(const LineStat *const *)b)->excl;
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+static double ms(uint64_t ns) {
+    return (double)ns / 1e6;
+}
+
+static void write_folded(Profile *p, FILE *out, int node, int *path, int depth) {
+    TreeNode *n = &p->nodes[node];
+    path[depth] = n->func;
+    uint64_t us = (n->self + 500) / 1000;
+    if (us > 0) {
+        fputs("main", out);
+        for (int i = 1; i <= depth; i++) fprintf(out, ";%s", func_name(p->funcs[path[i]].fn));
+        fprintf(out, " %llu\n", (unsigned long long)us);
+    }
+    for (int c = n->child; c >= 0; c = p->nodes[c].next)
+        write_folded(p, out, c, path, depth + 1);
+}
+
+static int tree_depth(Profile *p, int node) {
+    int d = 0;
+    for (int c = p->nodes[node].child; c >= 0; c = p->nodes[c].next) {
+        int k = tree_depth(p, c);
+        if (k > d) d = k;
+    }
+    return d + 1;
+}
+
+int profile_write(Profile *p, const char *folded_path, FILE *report, int n) {
+    profile_unwind(p, (ProfileMark){ 1, 0 });
+    uint64_t total = now_ns() - p->calls[0].start;
+    uint64_t root_self = total > p->calls[0].child ? total - p->calls[0].child : 0;
+    p->nodes[0].self = root_self;
+
+    if (report) {
+        FuncStat **funcs = malloc(sizeof(FuncStat *) * (size_t)(p->func_count + 1));
+        for (int i = 0; i < p->func_count; i++) funcs[i] = &p->funcs[i];
+        qsort(funcs, (size_t)p->func_count, sizeof(FuncStat *), by_func_excl);
+        fprintf(report, "profile: %.3f ms total, %.3f ms outside functions\n\n",
+                ms(total), ms(root_self));
+        fprintf(report, "%10s %12s %12s  %s\n", "calls", "incl ms", "excl ms", "function");
+        for (int i = 0; i < p->func_count && i < n; i++) {
+            const FuncStat *s = funcs[i];
+            fprintf(report, "%10ld %12.3f %12.3f  %s (line %d)\n", s->calls,
+                    ms(s->incl), ms(s->excl), func_name(s->fn), s->fn->line);
+        }
+        free(funcs);
+
+        int line_count = 0;
+        LineStat **lines = malloc(sizeof(LineStat *) * (size_t)(p->line_cap + 1));
+        for (int i = 0; i < p->line_cap; i++)
+            if (p->lines[i].count > 0) lines[line_count++] = &p->lines[i];
+        if (line_count > 0) {
+            qsort(lines, (size_t)line_count, sizeof(LineStat *), by_line_excl);
+            fprintf(report, "\n%10s %12s %12s  %s\n", "runs", "incl ms", "excl ms", "line");
+            for (int i = 0; i < line_count && i < n; i++) {
+                const LineStat *s = lines[i];
+                fprintf(report, "%10ld %12.3f %12.3f  %d\n", s->count,
+                        ms(s->incl), ms(s->excl), (int)(s - p->lines));
+            }
+        }
+        free(lines);
+    }
+
+    if (!folded_path) return 0;
+    FILE *out = fopen(folded_path, "w");
+    if (!out) return -1;
+    int *path = malloc(sizeof(int) * (size_t)tree_depth(p, 0));
+    write_folded(p, out, 0, path, 0);
+    free(path);
+    return fclose(out) == 0 ? 0 : -1;
+}
@@ -0,0 +1,45 @@
+#ifndef JUNG_PROFILE_H
+#define JUNG_PROFILE_H
+
+#include "value.h"
+#include <stdint.h>
+#include <stdio.h>
+
+/* Function and line profiler (jung --profile=FILE, jung_profile).
+ *
+ * While an interpreter has a profile, every call frame (both engines) and
+ * every statement the tree walker runs is timed on the monotonic clock.
+ * Functions get call counts plus inclusive and exclusive (minus callees)
+ * time; recursion counts a function's inclusive time once. Lines get run
+ * counts plus inclusive and exclusive (minus nested statements) time;
+ * under --vm only the statements the VM hands to the tree walker are
+ * seen. Calls also build a call tree, written out as folded stacks
+ * ("main;outer;inner <microseconds>") for flamegraph.pl. With no profile
+ * the hooks cost one pointer test each. */
+
+typedef struct Profile Profile;
+
+/* Open frames at some point, to unwind back to after a longjmp */
+typedef struct {
+    int calls;
+    int stmts;
+} ProfileMark;
+
+Profile *profile_new(void);
+void     profile_free(Profile *p);
+
+void     profile_enter(Profile *p, FuncDef *fn);
+void     profile_leave(Profile *p);
+void     profile_stmt_begin(Profile *p, int line);
+void     profile_stmt_end(Profile *p);
+
+/* NULL-safe: a zero mark, and a no-op unwind, without a profile */
+ProfileMark profile_mark(Profile *p);
+void     profile_unwind(Profile *p, ProfileMark m);  /* close frames above m */
+
+/* Close every open frame, then print the top n functions and lines to
+ * report and write folded stacks to folded_path. 0, or -1 with errno set
+ * when folded_path cannot be written. */
+int      profile_write(Profile *p, const char *folded_path, FILE *report, int n);
+
+#endif
@@ -0,0 +1,245 @@
+#include "resolver.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* One entry per runtime scope the interpreter will push, holding the names
+ * declared into its slots in binding order. */
+typedef struct {
+    const char **names;
+    int count;
+    int cap;
+} RScope;
+
+/* Scopes of the function body being resolved; index 0 is the call scope */
+typedef struct {
+    RScope *scopes;
+    int depth;
+    int cap;
+} Resolver;
+
+static void resolve_stmts(Resolver *r, ASTNode **stmts, int count);
+static void resolve_expr(Resolver *r, ASTNode *node);
+
+static void begin_scope(Resolver *r) {
+    if (r->depth + 1 >= r->cap) {
+        int old = r->cap;
+        r->cap = r->cap ? r->cap * 2 : 16;
+        r->scopes = realloc(r->scopes, sizeof(RScope) * (size_t)r->cap);
+        memset(r->scopes + old, 0, sizeof(RScope) * (size_t)(r->cap - old));
+    }
+    r->depth++;
+    r->scopes[r->depth].count = 0;
+}
+
+static void end_scope(Resolver *r) {
+    r->depth--;
+}
+
+static void declare(Resolver *r, const char *name) {
+    RScope *s = &r->scopes[r->depth];
+    if (s->count >= s->cap) {
+        s->cap = s->cap ? s->cap * 2 : 4;
+        s->names = realloc(s->names, sizeof(char *) * (size_t)s->cap);
+    }
+    s->names[s->count++] = name;
+}
+
+/* Address the innermost declaration of name, if any. Later slots win,
+ * matching how a repeated parameter name used to overwrite the first.
+ * Names are interned, so pointer equality is string equality. */
+static void resolve_name(Resolver *r, ASTNode *node, const char *name) {
+    for (int d = r->depth; d >= 0; d--) {
+        RScope *s = &r->scopes[d];
+        for (int i = s->count - 1; i >= 0; i--) {
+            if (s->names[i] == name) {
+                node->depth = r->depth - d;
+                node->slot = i;
+                return;
+            }
+        }
+    }
+    node->slot = -1;
+}
+
+static void resolver_init(Resolver *r) {
+    r->scopes = NULL;
+    r->cap = 0;
+    r->depth = -1;
+    begin_scope(r);
+}
+
+static void resolver_free(Resolver *r) {
+    for (int i = 0; i < r->cap; i++) free(r->scopes[i].names);
+    free(r->scopes);
+}
+
+/* Function bodies start a fresh chain: the call scope holds the parameters.
+ * Each default is resolved with only the parameters bound before it. */
+static void resolve_function(ASTNode *def) {
+    Resolver fr;
+    resolver_init(&fr);
+    for (int i = 0; i < def->as.func_def.param_count; i++) {
+        resolve_expr(&fr, def->as.func_def.params[i].default_val);
+        declare(&fr, def->as.func_def.params[i].name);
+    }
+    resolve_stmts(&fr, def->as.func_def.body, def->as.func_def.body_count);
+    resolver_free(&fr);
+}
+
+static void resolve_block(Resolver *r, ASTNode **stmts, int count) {
+    begin_scope(r);
+    resolve_stmts(r, stmts, count);
+    end_scope(r);
+}
+
+static void resolve_stmt(Resolver *r, ASTNode *node) {
+    if (!node) return;
+
+    switch (node->type) {
+    case NODE_PRINT:
+        resolve_expr(r, node->as.print_expr);
+        break;
+
+    case NODE_ASSIGN:
+        resolve_expr(r, node->as.assign.value);
+        resolve_name(r, node, node->as.assign.name);
+        break;
+
+    case NODE_COMPOUND_ASSIGN:
+        resolve_expr(r, node->as.comp_assign.value);
+        resolve_name(r, node, node->as.comp_assign.name);
+        break;
+
+    case NODE_OBJ_ASSIGN:
+        resolve_expr(r, node->as.obj_assign.obj);
+        resolve_expr(r, node->as.obj_assign.key_expr);
+        resolve_expr(r, node->as.obj_assign.value);
+        break;
+
+    case NODE_OBJ_COMPOUND_ASSIGN:
+        resolve_expr(r, node->as.obj_comp_assign.obj);
+        resolve_expr(r, node->as.obj_comp_assign.key_expr);
+        resolve_expr(r, node->as.obj_comp_assign.value);
+        break;
+
+    case NODE_IF:
+        resolve_expr(r, node->as.if_stmt.condition);
+        resolve_block(r, node->as.if_stmt.then_body, node->as.if_stmt.then_count);
+        if (node->as.if_stmt.else_body) {
+            resolve_block(r, node->as.if_stmt.else_body, node->as.if_stmt.else_count);
+        }
+        break;
+
+    case NODE_WHILE:
+        resolve_expr(r, node->as.while_loop.condition);
+        resolve_block(r, node->as.while_loop.body, node->as.while_loop.body_count);
+        break;
+
+    case NODE_FOR:
+        resolve_expr(r, node->as.for_loop.iterable);
+        begin_scope(r);
+        declare(r, node->as.for_loop.var);
+        resolve_stmts(r, node->as.for_loop.body, node->as.for_loop.body_count);
+        end_scope(r);
+        break;
+
+    case NODE_FUNC_DEF:
+        resolve_function(node);
+        break;
+
+    case NODE_CLASS:
+        for (int i = 0; i < node->as.class_def.method_count; i++) {
+            resolve_function(node->as.class_def.methods[i]);
+        }
+        break;
+
+    case NODE_RETURN:
+        resolve_expr(r, node->as.return_val);
+        break;
+
+    case NODE_TRY_CATCH:
+        resolve_block(r, node->as.try_catch.try_body, node->as.try_catch.try_count);
+        begin_scope(r);
+        if (node->as.try_catch.catch_var) declare(r, node->as.try_catch.catch_var);
+        resolve_stmts(r, node->as.try_catch.catch_body, node->as.try_catch.catch_count);
+        end_scope(r);
+        break;
+
+    case NODE_THROW:
+        resolve_expr(r, node->as.throw_val);
+        break;
+
+    case NODE_IMPORT:
+    case NODE_BREAK:
+    case NODE_CONTINUE:
+        break;
+
+    default:
+        resolve_expr(r, node);
+        break;
+    }
+}
+
+static void resolve_stmts(Resolver *r, ASTNode **stmts, int count) {
+    for (int i = 0; i < count; i++) resolve_stmt(r, stmts[i]);
+}
+
+static void resolve_exprs(Resolver *r, ASTNode **nodes, int count) {
+    for (int i = 0; i < count; i++) resolve_expr(r, nodes[i]);
+}
+
+static void resolve_expr(Resolver *r, ASTNode *node) {
+    if (!node) return;
+
+    switch (node->type) {
+    case NODE_VARIABLE:
+        resolve_name(r, node, node->as.var_name);
+        break;
+    case NODE_BINARY:
+        resolve_expr(r, node->as.binary.left);
+        resolve_expr(r, node->as.binary.right);
+        break;
+    case NODE_UNARY:
+        resolve_expr(r, node->as.unary.operand);
+        break;
+    case NODE_TERNARY:
+        resolve_expr(r, node->as.ternary.condition);
+        resolve_expr(r, node->as.ternary.then_expr);
+        resolve_expr(r, node->as.ternary.else_expr);
+        break;
+    case NODE_STRING_INTERP:
+        resolve_exprs(r, node->as.interp.parts, node->as.interp.count);
+        break;
+    case NODE_ARRAY:
+        resolve_exprs(r, node->as.array.elements, node->as.array.count);
+        break;
+    case NODE_OBJECT:
+        resolve_exprs(r, node->as.object.values, node->as.object.count);
+        break;
+    case NODE_ARRAY_INDEX:
+        resolve_expr(r, node->as.array_index.array_expr);
+        resolve_expr(r, node->as.array_index.index);
+        break;
+    case NODE_OBJ_ACCESS:
+        resolve_expr(r, node->as.obj_access.obj);
+        resolve_expr(r, node->as.obj_access.key_expr);
+        break;
+    case NODE_FUNC_CALL:
+    case NODE_METHOD_CALL:
+        resolve_exprs(r, node->as.func_call.args, node->as.func_call.arg_count);
+        break;
+    case NODE_NEW:
+        resolve_exprs(r, node->as.new_inst.args, node->as.new_inst.arg_count);
+        break;
+    default:
+        break;
+    }
+}
+
+void resolve_program(ASTNode *program) {
+    if (!program || program->type != NODE_PROGRAM) return;
+    Resolver r;
+    resolver_init(&r);
+    resolve_stmts(&r, program->as.program.stmts, program->as.program.count);
+    resolver_free(&r);
+}
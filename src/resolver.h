@@ -0,0 +1,16 @@
+#ifndef JUNG_RESOLVER_H
+#define JUNG_RESOLVER_H
+
+#include "parser.h"
+
+/* Assign lexical addresses to variable references and assignments.
+ *
+ * Jung scoping is dynamic: a function body sees its callers' variables, and
+ * assigning an unknown name defines it in whatever scope is current. Only
+ * names bound by a declaration -- function parameters, for-loop variables
+ * and catch variables -- have a location that is known before the program
+ * runs, so only references to those get a (depth, slot) address. Everything
+ * else keeps slot = -1 and is looked up by name at run time. */
+void resolve_program(ASTNode *program);
+
+#endif
@@ -0,0 +1,204 @@
+#include "sort.h"
+#include "kernels.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Position of each type in the natural order; RANK_OTHER keeps input order */
+enum { RANK_NULL, RANK_BOOL, RANK_NUMBER, RANK_STRING, RANK_OTHER, RANK_COUNT };
+
+static int rank(Value v) {
+    if (IS_NUMBER(v)) return RANK_NUMBER;
+    if (IS_STRING(v)) return RANK_STRING;
+    if (IS_NULL(v)) return RANK_NULL;
+    if (IS_BOOL(v)) return RANK_BOOL;
+    return RANK_OTHER;
+}
+
+static int compare_strings(const StrObj *a, const StrObj *b) {
+    int n = a->len < b->len ? a->len : b->len;
+    int c = memcmp(a->chars, b->chars, (size_t)n);
+    if (c) return c;
+    return (a->len > b->len) - (a->len < b->len);
+}
+
+int sort_compare(Value a, Value b) {
+    int ra = rank(a), rb = rank(b);
+    if (ra != rb) return ra - rb;
+    switch (ra) {
+        case RANK_NUMBER: {
+            double x = AS_NUMBER(a), y = AS_NUMBER(b);
+            if (x != x || y != y) return (x != x) - (y != y);
+            return (x > y) - (x < y);
+        }
+        case RANK_STRING: return compare_strings(AS_STRING(a), AS_STRING(b));
+        case RANK_BOOL:   return AS_BOOL(a) - AS_BOOL(b);
+        default:          return 0;
+    }
+}
+
+/* ---- strings ---- */
+
+/* A string with its first 8 bytes as a big-endian number (zero padded),
+ * so most comparisons never leave the array */
+typedef struct {
+    uint64_t prefix;
+    const StrObj *s;
+    int idx;
+} StrKey;
+
+static uint64_t str_prefix(const StrObj *s) {
+    uint64_t p = 0;
+    int n = s->len < 8 ? s->len : 8;
+    for (int i = 0; i < 8; i++) {
+        p = (p << 8) | (i < n ? (unsigned char)s->chars[i] : 0);
+    }
+    return p;
+}
+
+static int strkey_le(const StrKey *a, const StrKey *b) {
+    if (a->prefix != b->prefix) return a->prefix < b->prefix;
+    if (a->s->len <= 8 || b->s->len <= 8) return a->s->len <= b->s->len;
+    return compare_strings(a->s, b->s) <= 0;
+}
+
+#define SMALL_RUN 16
+
+static void merge_sort_strs(StrKey *a, StrKey *tmp, int n) {
+    if (n <= SMALL_RUN) {
+        for (int i = 1; i < n; i++) {
+            StrKey x = a[i];
+            int j = i - 1;
+            while (j >= 0 && !strkey_le(&a[j], &x)) {
+                a[j + 1] = a[j];
+                j--;
+            }
+            a[j + 1] = x;
+        }
+        return;
+    }
+    int half = n / 2;
+    merge_sort_strs(a, tmp, half);
+    merge_sort_strs(a + half, tmp, n - half);
+    if (strkey_le(&a[half - 1], &a[half])) return;   /* already in order */
+    memcpy(tmp, a, sizeof(StrKey) * (size_t)half);
+    int i = 0, j = half, k = 0;
+    while (i < half && j < n) a[k++] = strkey_le(&tmp[i], &a[j]) ? tmp[i++] : a[j++];
+    while (i < half) a[k++] = tmp[i++];
+}
+
+/* ---- order ---- */
+
+/* order[0, n): indices of keys in their natural order, ties in input order */
+static void sort_order(const Value *keys, int n, int *order) {
+    int start[RANK_COUNT + 1] = { 0 };
+    for (int i = 0; i < n; i++) start[rank(keys[i]) + 1]++;
+    for (int r = 0; r < RANK_COUNT; r++) start[r + 1] += start[r];
+    int at[RANK_COUNT];
+    memcpy(at, start, sizeof(at));
+    for (int i = 0; i < n; i++) order[at[rank(keys[i])]++] = i;
+
+    /* Booleans: false before true */
+    int lo = start[RANK_BOOL], hi = start[RANK_BOOL + 1];
+    if (hi - lo > 1) {
+        int *tmp = malloc(sizeof(int) * (size_t)(hi - lo));
+        int k = 0;
+        for (int i = lo; i < hi; i++) if (!AS_BOOL(keys[order[i]])) tmp[k++] = order[i];
+        for (int i = lo; i < hi; i++) if (AS_BOOL(keys[order[i]])) tmp[k++] = order[i];
+        memcpy(order + lo, tmp, sizeof(int) * (size_t)k);
+        free(tmp);
+    }
+
+    lo = start[RANK_NUMBER];
+    hi = start[RANK_NUMBER + 1];
+    if (hi - lo > 1) {
+        double *d = malloc(sizeof(double) * (size_t)(hi - lo));
+        for (int i = lo; i < hi; i++) d[i - lo] = AS_NUMBER(keys[order[i]]);
+        kernel_sort_pairs(d, order + lo, hi - lo);
+        free(d);
+    }
+
+    lo = start[RANK_STRING];
+    hi = start[RANK_STRING + 1];
+    if (hi - lo > 1) {
+        int m = hi - lo;
+        StrKey *sk = malloc(sizeof(StrKey) * (size_t)m);
+        StrKey *tmp = malloc(sizeof(StrKey) * (size_t)(m / 2 + 1));
+        for (int i = 0; i < m; i++) {
+            sk[i].s = AS_STRING(keys[order[lo + i]]);
+            sk[i].prefix = str_prefix(sk[i].s);
+            sk[i].idx = order[lo + i];
+        }
+        merge_sort_strs(sk, tmp, m);
+        for (int i = 0; i < m; i++) order[lo + i] = sk[i].idx;
+        free(sk);
+        free(tmp);
+    }
+}
+
+/* items[i] = items[order[i]], moving the values (no reference counting) */
+static void permute(Value *items, const int *order, int n) {
+    Value *tmp = malloc(sizeof(Value) * (size_t)n);
+    for (int i = 0; i < n; i++) tmp[i] = items[order[i]];
+    memcpy(items, tmp, sizeof(Value) * (size_t)n);
+    free(tmp);
+}
+
+void sort_values(Value *items, int n) {
+    if (n < 2) return;
+    int numbers = 1;
+    for (int i = 0; i < n && numbers; i++) numbers = IS_NUMBER(items[i]);
+    if (numbers) {
+        double *d = malloc(sizeof(double) * (size_t)n);
+        for (int i = 0; i < n; i++) d[i] = AS_NUMBER(items[i]);
+        kernel_sort(d, n);
+        for (int i = 0; i < n; i++) items[i] = val_number(d[i]);
+        free(d);
+        return;
+    }
+    int *order = malloc(sizeof(int) * (size_t)n);
+    sort_order(items, n, order);
+    permute(items, order, n);
+    free(order);
+}
+
+void sort_by_keys(Value *items, Value *keys, int n) {
+    if (n < 2) return;
+    int *order = malloc(sizeof(int) * (size_t)n);
+    sort_order(keys, n, order);
+    permute(items, order, n);
+    permute(keys, order, n);
+    free(order);
+}
+
+/* ---- user comparator ---- */
+
+static void merge_sort_with(Value *a, Value *tmp, int n, SortCompare cmp, void *ud) {
+    if (n <= SMALL_RUN) {
+        for (int i = 1; i < n; i++) {
+            Value x = a[i];
+            int j = i - 1;
+            while (j >= 0 && cmp(ud, a[j], x) > 0) {
+                a[j + 1] = a[j];
+                j--;
+            }
+            a[j + 1] = x;
+        }
+        return;
+    }
+    int half = n / 2;
+    merge_sort_with(a, tmp, half, cmp, ud);
+    merge_sort_with(a + half, tmp, n - half, cmp, ud);
+    if (cmp(ud, a[half - 1], a[half]) <= 0) return;
+    memcpy(tmp, a, sizeof(Value) * (size_t)half);
+    int i = 0, j = half, k = 0;
+    while (i < half && j < n) a[k++] = cmp(ud, tmp[i], a[j]) <= 0 ? tmp[i++] : a[j++];
+    while (i < half) a[k++] = tmp[i++];
+}
+
+void sort_with(Value *items, int n, SortCompare cmp, void *ud) {
+    if (n < 2) return;
+    Value *tmp = malloc(sizeof(Value) * (size_t)(n / 2 + 1));
+    merge_sort_with(items, tmp, n, cmp, ud);
+    free(tmp);
+}
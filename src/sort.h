@@ -0,0 +1,31 @@
+#ifndef JUNG_SORT_H
+#define JUNG_SORT_H
+
+#include "value.h"
+
+/* Stable sorting of Values for sort() and arr.sortInPlace().
+ *
+ * The natural order puts null first, then booleans (false first), numbers
+ * (NaN last), strings (bytewise, a prefix before the longer string), and
+ * everything else in its input order. Each type is sorted on its own
+ * path: values are first split by type, numbers go through the radix
+ * kernel and strings through a merge sort that compares a cached 8-byte
+ * prefix before touching the characters. */
+
+/* <0, 0 or >0 as a sorts before, with or after b in the natural order */
+int  sort_compare(Value a, Value b);
+
+/* Reorder items[0, n) into the natural order */
+void sort_values(Value *items, int n);
+
+/* Reorder items[0, n) by the natural order of keys[0, n) (keys[i] belongs
+ * to items[i]): each key is computed once by the caller and compared
+ * here. keys are reordered along with the items. */
+void sort_by_keys(Value *items, Value *keys, int n);
+
+/* Merge sort items[0, n) with cmp. It may be inconsistent (a user
+ * comparator) without harm: every item is still there afterwards. */
+typedef int (*SortCompare)(void *ud, Value a, Value b);
+void sort_with(Value *items, int n, SortCompare cmp, void *ud);
+
+#endif
@@ -0,0 +1,186 @@
+#include "stream.h"
+#include "json.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+Value stream_open(const char *path, const char *mode) {
+    FileMode fm;
+    int flags;
+    if (strcmp(mode, "r") == 0)      { fm = FILE_READ;  flags = O_RDONLY; }
+    else if (strcmp(mode, "m") == 0) { fm = FILE_MMAP;  flags = O_RDONLY; }
+    else if (strcmp(mode, "w") == 0) { fm = FILE_WRITE; flags = O_WRONLY | O_CREAT | O_TRUNC; }
+    else if (strcmp(mode, "a") == 0) { fm = FILE_WRITE; flags = O_WRONLY | O_CREAT | O_APPEND; }
+    else return val_null();
+
+    int fd = open(path, flags, 0666);
+    if (fd < 0) return val_null();
+
+    FileObj *f = calloc(1, sizeof(FileObj));
+    f->refcount = 1;
+    f->mode = fm;
+    f->fd = fd;
+    if (fm == FILE_MMAP) {
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            close(fd);
+            free(f);
+            return val_null();
+        }
+        f->map_len = (size_t)st.st_size;
+        if (f->map_len > 0) {
+            void *m = mmap(NULL, f->map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (m == MAP_FAILED) {
+                close(fd);
+                free(f);
+                return val_null();
+            }
+            f->map = m;
+        }
+    } else {
+        f->cap = STREAM_CHUNK;
+        f->buf = malloc(f->cap);
+    }
+
+    return val_from_ptr(VAL_FILE, f);
+}
+
+/* Read one more chunk after the unconsumed bytes; 0 at end of file */
+static int fill(FileObj *f) {
+    if (f->eof || f->fd < 0) return 0;
+    if (f->pos > 0) {
+        memmove(f->buf, f->buf + f->pos, f->len - f->pos);
+        f->len -= f->pos;
+        f->pos = 0;
+    }
+    if (f->cap - f->len < STREAM_CHUNK / 2) {
+        f->cap *= 2;
+        f->buf = realloc(f->buf, f->cap);
+    }
+    ssize_t n;
+    do n = read(f->fd, f->buf + f->len, f->cap - f->len);
+    while (n < 0 && errno == EINTR);
+    if (n <= 0) {
+        f->eof = 1;
+        return 0;
+    }
+    f->len += (size_t)n;
+    return 1;
+}
+
+/* Slice the next line (without "\n" / "\r\n") out of the buffer or
+ * mapping; valid until the next read. 0 at end of input. */
+static int next_line(FileObj *f, const char **s, size_t *n) {
+    if (f->fd < 0) return 0;
+    if (f->mode == FILE_MMAP) {
+        if (f->pos >= f->map_len) return 0;
+        const char *start = f->map + f->pos;
+        const char *nl = memchr(start, '\n', f->map_len - f->pos);
+        *n = nl ? (size_t)(nl - start) : f->map_len - f->pos;
+        f->pos += *n + (nl ? 1 : 0);
+        *s = start;
+    } else {
+        if (f->mode != FILE_READ) return 0;
+        size_t scanned = 0;
+        for (;;) {
+            char *start = f->buf + f->pos;
+            size_t avail = f->len - f->pos;
+            char *nl = memchr(start + scanned, '\n', avail - scanned);
+            if (nl) {
+                *n = (size_t)(nl - start);
+                f->pos += *n + 1;
+                *s = start;
+                goto found;
+            }
+            scanned = avail;
+            if (!fill(f)) break;
+        }
+        /* Last line without a newline */
+        if (f->pos >= f->len) return 0;
+        *s = f->buf + f->pos;
+        *n = f->len - f->pos;
+        f->pos = f->len;
+    }
+found:
+    if (*n > 0 && (*s)[*n - 1] == '\r') (*n)--;
+    return 1;
+}
+
+int stream_read_line(FileObj *f, Value *line) {
+    const char *s;
+    size_t n;
+    if (!next_line(f, &s, &n)) return 0;
+    *line = val_string(s, (int)n);
+    return 1;
+}
+
+void stream_json_lines(FileObj *f) {
+    if (!f->json) f->json = calloc(1, sizeof(JsonKeys));
+}
+
+int stream_next(FileObj *f, Value *item) {
+    if (!f->json) return stream_read_line(f, item);
+    const char *s;
+    size_t n;
+    for (;;) {
+        if (!next_line(f, &s, &n)) return 0;
+        size_t i = 0;
+        while (i < n && (s[i] == ' ' || s[i] == '\t')) i++;
+        if (i < n) break;
+    }
+    if (!json_parse(s, n, f->json, item)) *item = val_null();
+    return 1;
+}
+
+static int write_all(int fd, const char *p, size_t n) {
+    while (n > 0) {
+        ssize_t w = write(fd, p, n);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return 0;
+        }
+        p += w;
+        n -= (size_t)w;
+    }
+    return 1;
+}
+
+int stream_flush(FileObj *f) {
+    if (f->mode != FILE_WRITE || f->fd < 0) return 0;
+    int ok = write_all(f->fd, f->buf, f->len);
+    f->len = 0;
+    return ok;
+}
+
+int stream_write(FileObj *f, const char *data, size_t len) {
+    if (f->mode != FILE_WRITE || f->fd < 0) return 0;
+    if (f->len + len > f->cap && !stream_flush(f)) return 0;
+    /* Big writes skip the buffer */
+    if (len >= f->cap) return write_all(f->fd, data, len);
+    memcpy(f->buf + f->len, data, len);
+    f->len += len;
+    return 1;
+}
+
+int stream_close(FileObj *f) {
+    if (f->fd < 0) return 1;
+    int ok = 1;
+    if (f->mode == FILE_WRITE) ok = stream_flush(f);
+    if (f->map) munmap((void *)f->map, f->map_len);
+    f->map = NULL;
+    if (close(f->fd) != 0) ok = 0;
+    f->fd = -1;
+    return ok;
+}
+
+void stream_release(FileObj *f) {
+    stream_close(f);
+    if (f->json) json_keys_clear(f->json);
+    free(f->json);
+    free(f->buf);
+    free(f);
+}
@@ -0,0 +1,39 @@
+#ifndef JUNG_STREAM_H
+#define JUNG_STREAM_H
+
+#include "value.h"
+
+/* File handles (VAL_FILE) for streaming I/O.
+ *
+ * A read handle ("r") pulls the file in STREAM_CHUNK-sized reads and hands
+ * out one line at a time, so memory use is bounded by the longest line. A
+ * mapped handle ("m") maps the whole file and slices lines out of the
+ * mapping, which suits large inputs that are read once. Write handles
+ * ("w", "a") collect output in a buffer and write it when it fills, on
+ * flush/close, and when the last reference goes away. A handle from
+ * jsonLines() reads newline-delimited JSON, parsing each line straight
+ * out of the read buffer or mapping. */
+
+#define STREAM_CHUNK 65536
+
+/* mode is "r", "m", "w" or "a"; NULL value if the file cannot be opened */
+Value stream_open(const char *path, const char *mode);
+
+/* Next line without its "\n" (or "\r\n"); 0 at end of input */
+int   stream_read_line(FileObj *f, Value *line);
+
+/* Turn a fresh read handle into an NDJSON reader for stream_next */
+void  stream_json_lines(FileObj *f);
+
+/* What for-in and readLine() yield: the next line, or for an NDJSON
+ * reader the next non-blank line parsed as JSON (null if malformed) */
+int   stream_next(FileObj *f, Value *item);
+
+int   stream_write(FileObj *f, const char *data, size_t len);  /* 0 on error */
+int   stream_flush(FileObj *f);                                 /* 0 on error */
+int   stream_close(FileObj *f);  /* flushes; 0 on error; closing twice is fine */
+
+/* Called by val_free when the last reference is dropped */
+void  stream_release(FileObj *f);
+
+#endif
@@ -1,142 +1,357 @@
 #include "table.h"
+#include "intern.h"
+#include "memstats.h"
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 
-#define INITIAL_CAP 16
+#define INITIAL_CAP 4
+#define SHAPE_MAX_KIDS 64   /* past this, a shape's new children are untracked */
+#define SHAPE_SWEEP_MIN 4096 /* shapes the tree may hold before a sweep */
 
-static unsigned int hash_string(const char *s) {
-    unsigned int h = 2166136261u;
-    for (; *s; s++) {
-        h ^= (unsigned char)*s;
-        h *= 16777619u;
+struct Shape {
+    const char *key;      /* key added by the transition into this shape */
+    int count;            /* keys in the shape */
+    int refs;             /* tables in this shape, plus kid_count */
+    unsigned long long id; /* never reused, unlike the address (ShapeCache) */
+    Shape **kids;         /* transitions, one per distinct next key */
+    int kid_count;
+    int kid_cap;
+};
+
+/* The shape tree is shared by every interpreter in the process. A table
+ * holds a reference to its shape and drops it without the lock; a shape
+ * only gains references under the lock (shape_add), so one whose count is
+ * 0 there stays unused. Such shapes are kept, as objects of that shape are
+ * often made again, until the tree passes sweep_at: then every unused
+ * subtree is freed. */
+static pthread_mutex_t shape_lock = PTHREAD_MUTEX_INITIALIZER;
+static Shape root_shape = { .id = 1 };  /* 0 is an empty ShapeCache */
+static int shape_count;
+static int sweep_at = SHAPE_SWEEP_MIN;
+static unsigned long long shape_ids = 1;
+
+static void shape_release(Shape *s) {
+    if (s && s != &root_shape) __atomic_sub_fetch(&s->refs, 1, __ATOMIC_RELEASE);
+}
+
+static void shape_destroy(Shape *s) {
+    MEM_FREE(MEM_SHAPE, sizeof(Shape) + sizeof(Shape *) * (size_t)s->kid_cap);
+    intern_release(s->key);
+    free(s->kids);
+    free(s);
+    shape_count--;
+}
+
+/* Free the unused shapes below s */
+static void shape_sweep(Shape *s) {
+    int j = 0;
+    for (int i = 0; i < s->kid_count; i++) {
+        Shape *k = s->kids[i];
+        shape_sweep(k);
+        if (__atomic_load_n(&k->refs, __ATOMIC_ACQUIRE) == 0) {
+            shape_destroy(k);
+            if (s != &root_shape) __atomic_sub_fetch(&s->refs, 1, __ATOMIC_RELAXED);
+        } else {
+            s->kids[j++] = k;
+        }
+    }
+    s->kid_count = j;
+}
+
+/* The shape reached by adding key, or NULL to leave shape tracking */
+static Shape *shape_step(Shape *s, const char *key) {
+    for (int i = 0; i < s->kid_count; i++) {
+        if (s->kids[i]->key == key) return s->kids[i];
+    }
+    if (s->count >= SHAPE_MAX_KEYS || s->kid_count >= SHAPE_MAX_KIDS) return NULL;
+    if (shape_count >= sweep_at) {
+        shape_sweep(&root_shape);   /* s is in use, so it stays */
+        sweep_at = shape_count * 2 > SHAPE_SWEEP_MIN ? shape_count * 2 : SHAPE_SWEEP_MIN;
+    }
+    if (s->kid_count >= s->kid_cap) {
+        int cap = s->kid_cap ? s->kid_cap * 2 : 2;
+        MEM_RESIZE(MEM_SHAPE, sizeof(Shape *) * (size_t)s->kid_cap, sizeof(Shape *) * (size_t)cap);
+        s->kid_cap = cap;
+        s->kids = realloc(s->kids, sizeof(Shape *) * (size_t)s->kid_cap);
     }
-    return h;
+    Shape *k = calloc(1, sizeof(Shape));
+    MEM_ALLOC(MEM_SHAPE, sizeof(Shape));
+    intern_retain(key);
+    k->key = key;
+    k->count = s->count + 1;
+    k->id = ++shape_ids;
+    s->kids[s->kid_count++] = k;
+    if (s != &root_shape) __atomic_add_fetch(&s->refs, 1, __ATOMIC_RELAXED);
+    shape_count++;
+    return k;
+}
+
+/* A table in shape s adds key: its shape afterwards */
+static Shape *shape_add(Shape *s, const char *key) {
+    pthread_mutex_lock(&shape_lock);
+    Shape *k = shape_step(s, key);
+    if (k) __atomic_add_fetch(&k->refs, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&shape_lock);
+    shape_release(s);
+    return k;
 }
 
+static void shape_free_kids(Shape *s) {
+    for (int i = 0; i < s->kid_count; i++) {
+        shape_free_kids(s->kids[i]);
+        shape_destroy(s->kids[i]);
+    }
+}
+
+void table_shapes_free(void) {
+    pthread_mutex_lock(&shape_lock);
+    shape_free_kids(&root_shape);
+    MEM_FREE(MEM_SHAPE, sizeof(Shape *) * (size_t)root_shape.kid_cap);
+    free(root_shape.kids);
+    root_shape.kids = NULL;
+    root_shape.kid_count = root_shape.kid_cap = 0;
+    pthread_mutex_unlock(&shape_lock);
+}
+
+/* Storage is allocated on the first insert, so empty tables are free */
 void table_init(Table *t) {
-    t->cap = INITIAL_CAP;
+    t->entries = NULL;
+    t->index = NULL;
+    t->cap = 0;
+    t->used = 0;
+    t->index_mask = 0;
     t->count = 0;
     t->refcount = 1;
-    t->entries = calloc((size_t)t->cap, sizeof(TableEntry *));
+    t->gc = 0;
+    t->shape = NULL;
+    t->klass = NULL;
+}
+
+void table_track_shape(Table *t) {
+    if (t->count == 0) t->shape = &root_shape;
 }
 
 void table_free(Table *t) {
-    for (int i = 0; i < t->cap; i++) {
-        TableEntry *e = t->entries[i];
-        while (e) {
-            TableEntry *next = e->next;
-            free(e->key);
-            val_free(&e->value);
-            free(e);
-            e = next;
-        }
+    TABLE_FOR_EACH(t, e) {
+        val_free(&e->value);
+        intern_release(e->key);
     }
+    shape_release(t->shape);
+    t->shape = NULL;
+    MEM_FREE(MEM_TABLE, sizeof(TableEntry) * (size_t)t->cap +
+                        (t->index ? sizeof(int) * (size_t)(t->index_mask + 1) : 0));
     free(t->entries);
+    free(t->index);
     t->entries = NULL;
+    t->index = NULL;
+    t->cap = 0;
+    t->used = 0;
     t->count = 0;
 }
 
-static void table_resize(Table *t) {
-    int new_cap = t->cap * 2;
-    TableEntry **new_entries = calloc((size_t)new_cap, sizeof(TableEntry *));
+void table_clear(Table *t) {
+    TABLE_FOR_EACH(t, e) {
+        val_free(&e->value);
+        intern_release(e->key);
+    }
+    t->used = 0;
+    t->count = 0;
+    if (t->shape) {
+        shape_release(t->shape);
+        t->shape = &root_shape;
+    }
+    if (t->index) memset(t->index, 0xFF, sizeof(int) * (size_t)(t->index_mask + 1));
+}
 
-    for (int i = 0; i < t->cap; i++) {
-        TableEntry *e = t->entries[i];
-        while (e) {
-            TableEntry *next = e->next;
-            unsigned int idx = hash_string(e->key) % (unsigned int)new_cap;
-            e->next = new_entries[idx];
-            new_entries[idx] = e;
-            e = next;
+static void index_insert(Table *t, int pos) {
+    unsigned int i = t->entries[pos].hash & (unsigned int)t->index_mask;
+    while (t->index[i] >= 0) i = (i + 1) & (unsigned int)t->index_mask;
+    t->index[i] = pos;
+}
+
+/* Size the index for the entry capacity, once past small mode */
+static void index_rebuild(Table *t) {
+    if (t->cap <= TABLE_SMALL_MAX) return;
+    int size = 1;
+    while (size < t->cap * 2) size <<= 1;
+    if (size != t->index_mask + 1 || !t->index) {
+        MEM_RESIZE(MEM_TABLE, t->index ? sizeof(int) * (size_t)(t->index_mask + 1) : 0,
+                   sizeof(int) * (size_t)size);
+        free(t->index);
+        t->index = malloc(sizeof(int) * (size_t)size);
+        t->index_mask = size - 1;
+    }
+    memset(t->index, 0xFF, sizeof(int) * (size_t)size);
+    for (int i = 0; i < t->used; i++) index_insert(t, i);
+}
+
+/* Squeeze out holes, then grow the entry array if it is still full and
+ * rebuild the index when the table is past small mode. Stored hashes mean
+ * no key is rehashed. */
+static void table_rebuild(Table *t) {
+    if (t->count < t->used) {
+        int j = 0;
+        for (int i = 0; i < t->used; i++) {
+            if (t->entries[i].key) t->entries[j++] = t->entries[i];
         }
+        t->used = j;
     }
-    free(t->entries);
-    t->entries = new_entries;
-    t->cap = new_cap;
+    if (t->used >= t->cap) {
+        int cap = t->cap ? t->cap * 2 : INITIAL_CAP;
+        if (t->cap) MEM_EVENT(MEM_TABLE_RESIZE);
+        MEM_RESIZE(MEM_TABLE, sizeof(TableEntry) * (size_t)t->cap, sizeof(TableEntry) * (size_t)cap);
+        t->cap = cap;
+        t->entries = realloc(t->entries, sizeof(TableEntry) * (size_t)t->cap);
+    }
+    index_rebuild(t);
 }
 
-void table_set(Table *t, const char *key, Value val) {
-    if (t->count >= t->cap * 3 / 4) table_resize(t);
-
-    unsigned int idx = hash_string(key) % (unsigned int)t->cap;
-    TableEntry *e = t->entries[idx];
-    while (e) {
-        if (strcmp(e->key, key) == 0) {
-            val_free(&e->value);
-            e->value = val;
-            return;
+void table_reserve(Table *t, int n) {
+    if (n <= t->cap) return;
+    if (t->cap) MEM_EVENT(MEM_TABLE_RESIZE);
+    MEM_RESIZE(MEM_TABLE, sizeof(TableEntry) * (size_t)t->cap, sizeof(TableEntry) * (size_t)n);
+    t->cap = n;
+    t->entries = realloc(t->entries, sizeof(TableEntry) * (size_t)t->cap);
+    index_rebuild(t);
+}
+
+/* key with its hash, which is intern_hash(key) */
+static TableEntry *table_find_hashed(Table *t, const char *key, unsigned int hash) {
+    if (!t->index) {
+        for (int i = 0; i < t->used; i++) {
+            if (t->entries[i].key == key) return &t->entries[i];
         }
-        e = e->next;
+        return NULL;
+    }
+    unsigned int i = hash & (unsigned int)t->index_mask;
+    int pos;
+    while ((pos = t->index[i]) >= 0) {
+        if (t->entries[pos].key == key) return &t->entries[pos];
+        i = (i + 1) & (unsigned int)t->index_mask;
     }
+    return NULL;
+}
 
-    TableEntry *ne = malloc(sizeof(TableEntry));
-    ne->key = strdup(key);
-    ne->value = val;
-    ne->next = t->entries[idx];
-    t->entries[idx] = ne;
+static TableEntry *table_find(Table *t, const char *key) {
+    if (t->count == 0) return NULL;
+    return table_find_hashed(t, key, t->index ? intern_hash(key) : 0);
+}
+
+/* A string that is not in the intern pool cannot be a key of any table.
+ * The pointer found is only compared (another thread may drop the last
+ * reference to it meanwhile), so the hash comes from the bytes. */
+static TableEntry *table_find_str(Table *t, const char *key) {
+    if (t->count == 0) return NULL;
+    int len = (int)strlen(key);
+    unsigned int hash = intern_hash_bytes(key, len);
+    const char *k = intern_lookup(key, len, hash);
+    return k ? table_find_hashed(t, k, hash) : NULL;
+}
+
+void table_iset(Table *t, const char *key, Value val) {
+    TableEntry *e = table_find(t, key);
+    if (e) {
+        val_free(&e->value);
+        e->value = val;
+        return;
+    }
+
+    if (t->used >= t->cap) table_rebuild(t);
+    int pos = t->used++;
+    e = &t->entries[pos];
+    intern_retain(key);
+    e->key = key;
+    e->hash = intern_hash(key);
+    e->value = val;
     t->count++;
+    if (t->index) index_insert(t, pos);
+    if (t->shape) t->shape = shape_add(t->shape, key);
 }
 
-int table_get(Table *t, const char *key, Value *out) {
-    unsigned int idx = hash_string(key) % (unsigned int)t->cap;
-    TableEntry *e = t->entries[idx];
-    while (e) {
-        if (strcmp(e->key, key) == 0) {
-            *out = e->value;
-            return 1;
-        }
-        e = e->next;
+int table_iget(Table *t, const char *key, Value *out) {
+    TableEntry *e = table_find(t, key);
+    if (!e) return 0;
+    *out = e->value;
+    return 1;
+}
+
+Value *table_iref(Table *t, const char *key) {
+    TableEntry *e = table_find(t, key);
+    return e ? &e->value : NULL;
+}
+
+int table_ihas(Table *t, const char *key) {
+    return table_find(t, key) != NULL;
+}
+
+Value *table_iref_cached(Table *t, const char *key, ShapeCache *c) {
+    if (t->shape && t->shape->id == c->shape) return &t->entries[c->pos].value;
+    TableEntry *e = table_find(t, key);
+    if (!e) return NULL;
+    if (t->shape) {
+        c->shape = t->shape->id;
+        c->pos = (int)(e - t->entries);
     }
-    return 0;
+    return &e->value;
 }
 
-int table_has(Table *t, const char *key) {
-    unsigned int idx = hash_string(key) % (unsigned int)t->cap;
-    TableEntry *e = t->entries[idx];
-    while (e) {
-        if (strcmp(e->key, key) == 0) return 1;
-        e = e->next;
+void table_iset_cached(Table *t, const char *key, Value val, ShapeCache *c) {
+    Value *slot = table_iref_cached(t, key, c);
+    if (slot) {
+        val_free(slot);
+        *slot = val;
+        return;
     }
-    return 0;
+    table_iset(t, key, val);
+}
+
+void table_set(Table *t, const char *key, Value val) {
+    const char *k = intern_key(key, (int)strlen(key));
+    table_iset(t, k, val);
+    intern_release(k);
 }
 
+int table_get(Table *t, const char *key, Value *out) {
+    TableEntry *e = table_find_str(t, key);
+    if (!e) return 0;
+    *out = e->value;
+    return 1;
+}
+
+Value *table_get_ref(Table *t, const char *key) {
+    TableEntry *e = table_find_str(t, key);
+    return e ? &e->value : NULL;
+}
+
+int table_has(Table *t, const char *key) {
+    return table_find_str(t, key) != NULL;
+}
+
+/* The slot stays in the index as a tombstone until the next rebuild */
 void table_delete(Table *t, const char *key) {
-    unsigned int idx = hash_string(key) % (unsigned int)t->cap;
-    TableEntry **pp = &t->entries[idx];
-    while (*pp) {
-        if (strcmp((*pp)->key, key) == 0) {
-            TableEntry *del = *pp;
-            *pp = del->next;
-            free(del->key);
-            val_free(&del->value);
-            free(del);
-            t->count--;
-            return;
-        }
-        pp = &(*pp)->next;
-    }
+    TableEntry *e = table_find_str(t, key);
+    if (!e) return;
+    intern_release(e->key);
+    e->key = NULL;
+    val_free(&e->value);
+    t->count--;
+    shape_release(t->shape);
+    t->shape = NULL;
 }
 
 Value table_keys(Table *t) {
     Value arr = val_array(t->count > 0 ? t->count : 8);
-    for (int i = 0; i < t->cap; i++) {
-        TableEntry *e = t->entries[i];
-        while (e) {
-            val_array_push(&arr, val_string(e->key, (int)strlen(e->key)));
-            e = e->next;
-        }
+    TABLE_FOR_EACH(t, e) {
+        val_array_push(&arr, val_string(e->key, intern_len(e->key)));
     }
     return arr;
 }
 
 Value table_values(Table *t) {
     Value arr = val_array(t->count > 0 ? t->count : 8);
-    for (int i = 0; i < t->cap; i++) {
-        TableEntry *e = t->entries[i];
-        while (e) {
-            val_array_push(&arr, val_copy(e->value));
-            e = e->next;
-        }
+    TABLE_FOR_EACH(t, e) {
+        val_array_push(&arr, val_copy(e->value));
     }
     return arr;
 }
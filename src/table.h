@@ -3,28 +3,75 @@
 
 #include "value.h"
 
+/* Entries are stored densely in insertion order. Deleting leaves a hole
+ * (key == NULL) that is squeezed out on the next rebuild. */
 typedef struct TableEntry {
-    char *key;
+    const char *key;      /* interned */
+    unsigned int hash;
     Value value;
-    struct TableEntry *next;
 } TableEntry;
 
+/* Tables of up to TABLE_SMALL_MAX keys are a flat array scanned by hash;
+ * larger ones add an open-addressing index (linear probing, power-of-two
+ * size, at most half full) mapping hash slots to entry positions. */
+#define TABLE_SMALL_MAX 8
+
+/* Object tables also track a shape: a node in a global tree of key
+ * sequences, shared by every table that added the same keys in the same
+ * order. While a table has a shape it has no holes, so the shape alone
+ * fixes each key's entry position and a ShapeCache hit is one compare.
+ * Deleting a key, or growing past SHAPE_MAX_KEYS, drops the table to
+ * dictionary mode (shape NULL) for good. Shapes no table is in are freed
+ * when the tree grows large (table.c). */
+#define SHAPE_MAX_KEYS 32
+
 struct Table {
-    TableEntry **entries;
-    int cap;
-    int count;
+    TableEntry *entries;
+    int *index;           /* NULL in small mode; -1 marks an empty slot */
+    int cap;              /* entry capacity */
+    int used;             /* entries in use, including holes */
+    int index_mask;       /* index size - 1 */
+    int count;            /* live keys */
     int refcount;
+    unsigned gc;          /* cycle collector state of an object (gc.h) */
+    Shape *shape;         /* NULL when untracked or in dictionary mode */
+    ClassObj *klass;      /* class of an instance (counted reference) */
 };
 
+/* Iterate live entries in insertion order */
+#define TABLE_FOR_EACH(t, e) \
+    for (TableEntry *e = (t)->entries; e < (t)->entries + (t)->used; e++) \
+        if (e->key)
+
 void  table_init(Table *t);
+void  table_track_shape(Table *t); /* start shape tracking on an empty table */
 void  table_free(Table *t);
+void  table_clear(Table *t);   /* drop all keys, keep the storage */
+void  table_reserve(Table *t, int n);  /* room for n entries without growing */
+
+/* Keys are interned (intern.h) and matched by pointer; an entry retains
+ * its key while it holds it. These accept any string and intern it as a
+ * runtime key (intern_key) or look it up first... */
 void  table_set(Table *t, const char *key, Value val);
 int   table_get(Table *t, const char *key, Value *out);
+Value *table_get_ref(Table *t, const char *key); /* slot pointer, NULL if absent */
 int   table_has(Table *t, const char *key);
 void  table_delete(Table *t, const char *key);
 
-/* Iteration: collect all keys into a Value array */
+/* ...and these take a key that is already interned, skipping that step */
+void  table_iset(Table *t, const char *key, Value val);
+int   table_iget(Table *t, const char *key, Value *out);
+Value *table_iref(Table *t, const char *key);
+int   table_ihas(Table *t, const char *key);
+
+/* Interned-key access through a per-site cache */
+Value *table_iref_cached(Table *t, const char *key, ShapeCache *c);
+void  table_iset_cached(Table *t, const char *key, Value val, ShapeCache *c);
+
+/* Collect keys / values, in insertion order, into a Value array */
 Value table_keys(Table *t);
 Value table_values(Table *t);
 
+void  table_shapes_free(void);   /* release the shape tree at exit */
+
 #endif
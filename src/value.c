@@ -1,221 +1,409 @@
 #include "value.h"
 #include "table.h"
+#include "gc.h"
+#include "memstats.h"
+#include "stream.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
 
-Value val_null(void) {
-    Value v;
-    v.type = VAL_NULL;
-    v.refcount = 0;
-    return v;
+Value val_string(const char *s, int len) {
+    char *chars = malloc((size_t)len + 1);
+    memcpy(chars, s, (size_t)len);
+    chars[len] = '\0';
+    return val_string_take(chars, len);
 }
 
-Value val_bool(int b) {
-    Value v;
-    v.type = VAL_BOOL;
-    v.refcount = 0;
-    v.as.boolean = b ? 1 : 0;
-    return v;
+Value val_string_take(char *s, int len) {
+    return val_string_take_cap(s, len, len + 1);
 }
 
-Value val_number(double n) {
-    Value v;
-    v.type = VAL_NUMBER;
-    v.refcount = 0;
-    v.as.number = n;
-    return v;
+Value val_string_take_cap(char *s, int len, int cap) {
+    StrObj *str = gc_alloc(sizeof(StrObj));
+    str->refcount = 1;
+    str->len = len;
+    str->cap = cap;
+    str->chars = s;
+    MEM_ALLOC(MEM_STRING, sizeof(StrObj) + (size_t)cap);
+    return val_from_ptr(VAL_STRING, str);
 }
 
-Value val_string(const char *s, int len) {
-    Value v;
-    v.type = VAL_STRING;
-    v.refcount = 0;
-    v.as.string.str = malloc((size_t)len + 1);
-    memcpy(v.as.string.str, s, (size_t)len);
-    v.as.string.str[len] = '\0';
-    v.as.string.len = len;
-    return v;
+Value val_array(int initial_cap) {
+    if (initial_cap < 8) initial_cap = 8;
+    gc_step();
+    ArrObj *a = gc_alloc(sizeof(ArrObj));
+    a->refcount = 1;
+    a->gc = 0;
+    a->items = malloc(sizeof(Value) * (size_t)initial_cap);
+    a->count = 0;
+    a->cap = initial_cap;
+    MEM_ALLOC(MEM_ARRAY, sizeof(ArrObj) + sizeof(Value) * (size_t)initial_cap);
+    return val_from_ptr(VAL_ARRAY, a);
 }
 
-Value val_string_take(char *s, int len) {
-    Value v;
-    v.type = VAL_STRING;
-    v.refcount = 0;
-    v.as.string.str = s;
-    v.as.string.len = len;
-    return v;
+Value val_object(void) {
+    gc_step();
+    Table *t = gc_alloc(sizeof(Table));
+    MEM_ALLOC(MEM_TABLE, sizeof(Table));
+    table_init(t);
+    table_track_shape(t);
+    return val_from_ptr(VAL_OBJECT, t);
 }
 
-Value val_array(int initial_cap) {
-    Value v;
-    v.type = VAL_ARRAY;
-    v.refcount = 0;
-    if (initial_cap < 8) initial_cap = 8;
-    v.as.array.items = malloc(sizeof(Value) * (size_t)initial_cap);
-    v.as.array.count = 0;
-    v.as.array.cap = initial_cap;
-    return v;
+Value val_class(const char *name) {
+    ClassObj *c = gc_alloc(sizeof(ClassObj));
+    c->refcount = 1;
+    c->name = name;
+    c->ctor = NULL;
+    c->methods = malloc(sizeof(Table));
+    table_init(c->methods);
+    MEM_ALLOC(MEM_OTHER, sizeof(ClassObj) + sizeof(Table));
+    return val_from_ptr(VAL_CLASS, c);
 }
 
-Value val_object(void) {
-    Value v;
-    v.type = VAL_OBJECT;
-    v.refcount = 0;
-    v.as.object = malloc(sizeof(Table));
-    table_init(v.as.object);
-    return v;
+Value val_range(int start, int end, int step) {
+    RangeObj *r = gc_alloc(sizeof(RangeObj));
+    MEM_ALLOC(MEM_OTHER, sizeof(RangeObj));
+    r->refcount = 1;
+    r->start = start;
+    r->step = step;
+    long span = (long)end - start;
+    long count = 0;
+    if (step > 0 && span > 0) count = (span + step - 1) / step;
+    else if (step < 0 && span < 0) count = (-span + -(long)step - 1) / -(long)step;
+    r->count = (int)count;
+    return val_from_ptr(VAL_RANGE, r);
+}
+
+void val_materialize(Value *v) {
+    if (!IS_RANGE(*v)) return;
+    RangeObj *r = AS_RANGE(*v);
+    Value arr = val_array(r->count > 0 ? r->count : 8);
+    for (int i = 0; i < r->count; i++) AS_ARRAY(arr)->items[i] = val_range_at(r, i);
+    AS_ARRAY(arr)->count = r->count;
+    val_free(v);
+    *v = arr;
+}
+
+Value val_f64array(int count) {
+    F64Array *a = gc_alloc(sizeof(F64Array));
+    a->refcount = 1;
+    a->count = count;
+    a->cap = count > 8 ? count : 8;
+    a->data = calloc((size_t)a->cap, sizeof(double));
+    MEM_ALLOC(MEM_OTHER, sizeof(F64Array) + sizeof(double) * (size_t)a->cap);
+    return val_from_ptr(VAL_F64ARRAY, a);
+}
+
+void val_f64_detach(Value *v) {
+    F64Array *a = AS_F64(*v);
+    if (a->refcount == 1) return;
+    Value copy = val_f64array(a->count);
+    memcpy(AS_F64(copy)->data, a->data, sizeof(double) * (size_t)a->count);
+    a->refcount--;
+    *v = copy;
+}
+
+void val_f64_push(Value *v, double x) {
+    val_f64_detach(v);
+    F64Array *a = AS_F64(*v);
+    if (a->count >= a->cap) {
+        MEM_RESIZE(MEM_OTHER, sizeof(double) * (size_t)a->cap, sizeof(double) * (size_t)a->cap * 2);
+        a->cap *= 2;
+        a->data = realloc(a->data, sizeof(double) * (size_t)a->cap);
+    }
+    a->data[a->count++] = x;
+}
+
+Value val_f64_to_array(F64Array *a) {
+    Value arr = val_array(a->count);
+    for (int i = 0; i < a->count; i++) AS_ARRAY(arr)->items[i] = val_number(a->data[i]);
+    AS_ARRAY(arr)->count = a->count;
+    return arr;
 }
 
 Value val_func(FuncDef *f) {
-    Value v;
-    v.type = VAL_FUNCTION;
-    v.refcount = 0;
-    v.as.func = f;
-    return v;
+    return val_from_ptr(VAL_FUNCTION, f);
 }
 
 Value val_builtin(BuiltinFn fn) {
     Value v;
-    v.type = VAL_BUILTIN;
-    v.refcount = 0;
-    v.as.builtin = fn;
+    v.bits = VAL_TAG(VAL_BUILTIN) | ((uint64_t)(uintptr_t)fn & VAL_PAYLOAD);
     return v;
 }
 
 Value val_copy(Value v) {
-    /* For simple types, just copy. For heap types, dup the data. */
-    Value out = v;
-    if (v.type == VAL_STRING) {
-        out.as.string.str = malloc((size_t)v.as.string.len + 1);
-        memcpy(out.as.string.str, v.as.string.str, (size_t)v.as.string.len + 1);
-    } else if (v.type == VAL_ARRAY) {
-        int cap = v.as.array.cap;
-        int cnt = v.as.array.count;
-        out.as.array.items = malloc(sizeof(Value) * (size_t)cap);
-        out.as.array.cap = cap;
-        out.as.array.count = cnt;
-        for (int i = 0; i < cnt; i++) {
-            out.as.array.items[i] = val_copy(v.as.array.items[i]);
-        }
-    } else if (v.type == VAL_OBJECT) {
-        /* Shallow copy: share the Table pointer for reference semantics */
-        out.as.object = v.as.object;
-        if (v.as.object) v.as.object->refcount++;
+    /* Heap types share their storage; mutators copy on write. */
+    switch (val_type(v)) {
+        case VAL_STRING: AS_STRING(v)->refcount++; break;
+        case VAL_ARRAY: AS_ARRAY(v)->refcount++; break;
+        case VAL_OBJECT:
+            /* Objects have reference semantics: share the Table pointer */
+            if (AS_OBJECT(v)) AS_OBJECT(v)->refcount++;
+            break;
+        case VAL_CLASS: AS_CLASS(v)->refcount++; break;
+        case VAL_RANGE: AS_RANGE(v)->refcount++; break;
+        case VAL_F64ARRAY: AS_F64(v)->refcount++; break;
+        case VAL_FILE: AS_FILE(v)->refcount++; break;
+        default: return v;
+    }
+    MEM_EVENT(MEM_COPY);
+    return v;
+}
+
+static void class_release(ClassObj *c) {
+    if (--c->refcount <= 0) {
+        table_free(c->methods);
+        free(c->methods);
+        gc_release(c, sizeof(ClassObj));
+        MEM_FREE(MEM_OTHER, sizeof(ClassObj) + sizeof(Table));
     }
-    return out;
 }
 
 void val_free(Value *v) {
-    if (v->type == VAL_STRING) {
-        free(v->as.string.str);
-        v->as.string.str = NULL;
-    } else if (v->type == VAL_ARRAY) {
-        for (int i = 0; i < v->as.array.count; i++) {
-            val_free(&v->as.array.items[i]);
+    switch (val_type(*v)) {
+        case VAL_STRING: {
+            StrObj *s = AS_STRING(*v);
+            if (--s->refcount <= 0) {
+                MEM_FREE(MEM_STRING, sizeof(StrObj) + (size_t)s->cap);
+                free(s->chars);
+                gc_release(s, sizeof(StrObj));
+            }
+            break;
+        }
+        case VAL_ARRAY: {
+            ArrObj *a = AS_ARRAY(*v);
+            if (--a->refcount <= 0) {
+                if (GC_SLOT(a->gc)) gc_forget(*v);
+                for (int i = 0; i < a->count; i++) {
+                    val_free(&a->items[i]);
+                }
+                MEM_FREE(MEM_ARRAY, sizeof(ArrObj) + sizeof(Value) * (size_t)a->cap);
+                free(a->items);
+                gc_release(a, sizeof(ArrObj));
+            } else if (!GC_SLOT(a->gc)) {
+                gc_possible_root(*v);
+            }
+            break;
+        }
+        case VAL_OBJECT: {
+            Table *t = AS_OBJECT(*v);
+            if (!t) break;
+            if (--t->refcount <= 0) {
+                if (GC_SLOT(t->gc)) gc_forget(*v);
+                if (t->klass) class_release(t->klass);
+                table_free(t);
+                gc_release(t, sizeof(Table));
+                MEM_FREE(MEM_TABLE, sizeof(Table));
+            } else if (!GC_SLOT(t->gc)) {
+                gc_possible_root(*v);
+            }
+            break;
         }
-        free(v->as.array.items);
-        v->as.array.items = NULL;
-        v->as.array.count = 0;
-    } else if (v->type == VAL_OBJECT) {
-        if (v->as.object) {
-            v->as.object->refcount--;
-            if (v->as.object->refcount <= 0) {
-                table_free(v->as.object);
-                free(v->as.object);
+        case VAL_CLASS:
+            class_release(AS_CLASS(*v));
+            break;
+        case VAL_RANGE:
+            if (--AS_RANGE(*v)->refcount <= 0) {
+                gc_release(AS_RANGE(*v), sizeof(RangeObj));
+                MEM_FREE(MEM_OTHER, sizeof(RangeObj));
             }
-            v->as.object = NULL;
+            break;
+        case VAL_F64ARRAY: {
+            F64Array *a = AS_F64(*v);
+            if (--a->refcount <= 0) {
+                MEM_FREE(MEM_OTHER, sizeof(F64Array) + sizeof(double) * (size_t)a->cap);
+                free(a->data);
+                gc_release(a, sizeof(F64Array));
+            }
+            break;
         }
+        case VAL_FILE:
+            if (--AS_FILE(*v)->refcount <= 0) stream_release(AS_FILE(*v));
+            break;
+        default:
+            break;
+    }
+    *v = val_null();
+}
+
+Value val_string_empty(int cap) {
+    if (cap < 1) cap = 1;
+    char *chars = malloc((size_t)cap);
+    chars[0] = '\0';
+    return val_string_take_cap(chars, 0, cap);
+}
+
+/* Append raw bytes to a string value. Grows the buffer in place when this
+ * value is the only owner, otherwise copies into a fresh buffer. */
+void val_string_append(Value *s, const char *chars, int len) {
+    if (!IS_STRING(*s)) return;
+    StrObj *str = AS_STRING(*s);
+    int need = str->len + len + 1;
+    if (str->refcount > 1) {
+        MEM_EVENT(MEM_STRING_COW);
+        Value copy = val_string_empty(need > 16 ? need : 16);
+        memcpy(AS_STRING(copy)->chars, str->chars, (size_t)str->len);
+        AS_STRING(copy)->len = str->len;
+        str->refcount--;
+        *s = copy;
+        str = AS_STRING(copy);
+    } else if (need > str->cap) {
+        int cap = str->cap * 2;
+        if (cap < need) cap = need;
+        if (cap < 16) cap = 16;
+        MEM_RESIZE(MEM_STRING, (size_t)str->cap, (size_t)cap);
+        str->chars = realloc(str->chars, (size_t)cap);
+        str->cap = cap;
     }
-    v->type = VAL_NULL;
+    memcpy(str->chars + str->len, chars, (size_t)len);
+    str->len += len;
+    str->chars[str->len] = '\0';
+}
+
+/* Format n the way Jung prints numbers; returns the length */
+int val_format_number(double n, char *buf, size_t size) {
+    if (n == floor(n) && n >= -1e15 && n <= 1e15) {
+        return snprintf(buf, size, "%ld", (long)n);
+    }
+    return snprintf(buf, size, "%g", n);
+}
+
+void val_string_append_value(Value *s, Value v) {
+    char buf[32];
+    switch (val_type(v)) {
+        case VAL_STRING:
+            val_string_append(s, AS_STRING(v)->chars, AS_STRING(v)->len);
+            return;
+        case VAL_NUMBER:
+            val_string_append(s, buf, val_format_number(AS_NUMBER(v), buf, sizeof(buf)));
+            return;
+        case VAL_NULL:
+            val_string_append(s, "null", 4);
+            return;
+        case VAL_BOOL:
+            if (AS_BOOL(v)) val_string_append(s, "true", 4);
+            else val_string_append(s, "false", 5);
+            return;
+        default: {
+            char *str = val_to_string(v);
+            val_string_append(s, str, (int)strlen(str));
+            free(str);
+            return;
+        }
+    }
+}
+
+/* Give arr a private copy of its buffer if it is shared. Elements are
+ * copied by reference, so this is O(n) refcount bumps, not a deep copy. */
+void val_array_detach(Value *arr) {
+    if (!IS_ARRAY(*arr) || AS_ARRAY(*arr)->refcount == 1) return;
+    ArrObj *old = AS_ARRAY(*arr);
+    ArrObj *a = gc_alloc(sizeof(ArrObj));
+    a->refcount = 1;
+    a->gc = 0;
+    a->count = old->count;
+    a->cap = old->cap;
+    a->items = malloc(sizeof(Value) * (size_t)a->cap);
+    MEM_ALLOC(MEM_ARRAY, sizeof(ArrObj) + sizeof(Value) * (size_t)a->cap);
+    MEM_EVENT(MEM_ARRAY_COW);
+    for (int i = 0; i < a->count; i++) {
+        a->items[i] = val_copy(old->items[i]);
+    }
+    old->refcount--;
+    if (!GC_SLOT(old->gc)) gc_possible_root(*arr);
+    *arr = val_from_ptr(VAL_ARRAY, a);
 }
 
 void val_array_push(Value *arr, Value item) {
-    if (arr->type != VAL_ARRAY) return;
-    if (arr->as.array.count >= arr->as.array.cap) {
-        arr->as.array.cap *= 2;
-        arr->as.array.items = realloc(arr->as.array.items, sizeof(Value) * (size_t)arr->as.array.cap);
+    if (!IS_ARRAY(*arr)) return;
+    val_array_detach(arr);
+    ArrObj *a = AS_ARRAY(*arr);
+    if (a->count >= a->cap) {
+        MEM_RESIZE(MEM_ARRAY, sizeof(Value) * (size_t)a->cap, sizeof(Value) * (size_t)a->cap * 2);
+        a->cap *= 2;
+        a->items = realloc(a->items, sizeof(Value) * (size_t)a->cap);
     }
-    arr->as.array.items[arr->as.array.count++] = item;
+    a->items[a->count++] = item;
 }
 
 Value val_array_pop(Value *arr) {
-    if (arr->type != VAL_ARRAY || arr->as.array.count == 0) return val_null();
-    return arr->as.array.items[--arr->as.array.count];
+    if (!IS_ARRAY(*arr) || AS_ARRAY(*arr)->count == 0) return val_null();
+    val_array_detach(arr);
+    return AS_ARRAY(*arr)->items[--AS_ARRAY(*arr)->count];
 }
 
 Value val_array_get(Value *arr, int idx) {
-    if (arr->type != VAL_ARRAY) return val_null();
-    if (idx < 0 || idx >= arr->as.array.count) return val_null();
-    return arr->as.array.items[idx];
+    if (!IS_ARRAY(*arr)) return val_null();
+    if (idx < 0 || idx >= AS_ARRAY(*arr)->count) return val_null();
+    return AS_ARRAY(*arr)->items[idx];
 }
 
 void val_array_set(Value *arr, int idx, Value item) {
-    if (arr->type != VAL_ARRAY) return;
-    if (idx < 0 || idx >= arr->as.array.count) return;
-    val_free(&arr->as.array.items[idx]);
-    arr->as.array.items[idx] = item;
+    if (!IS_ARRAY(*arr)) return;
+    if (idx < 0 || idx >= AS_ARRAY(*arr)->count) return;
+    val_array_detach(arr);
+    val_free(&AS_ARRAY(*arr)->items[idx]);
+    AS_ARRAY(*arr)->items[idx] = item;
 }
 
 int val_is_truthy(Value v) {
-    switch (v.type) {
+    switch (val_type(v)) {
         case VAL_NULL: return 0;
-        case VAL_BOOL: return v.as.boolean;
-        case VAL_NUMBER: return v.as.number != 0;
-        case VAL_STRING: return v.as.string.len > 0;
-        case VAL_ARRAY: return v.as.array.count > 0;
+        case VAL_BOOL: return AS_BOOL(v);
+        case VAL_NUMBER: return AS_NUMBER(v) != 0;
+        case VAL_STRING: return AS_STRING(v)->len > 0;
+        case VAL_ARRAY: return AS_ARRAY(v)->count > 0;
         case VAL_OBJECT: return 1;
         case VAL_FUNCTION: return 1;
         case VAL_BUILTIN: return 1;
+        case VAL_CLASS: return 1;
+        case VAL_RANGE: return AS_RANGE(v)->count > 0;
+        case VAL_F64ARRAY: return AS_F64(v)->count > 0;
+        case VAL_FILE: return AS_FILE(v)->fd >= 0;
     }
     return 0;
 }
 
 int val_equal(Value a, Value b) {
-    if (a.type != b.type) return 0;
-    switch (a.type) {
+    if (val_type(a) != val_type(b)) return 0;
+    switch (val_type(a)) {
         case VAL_NULL: return 1;
-        case VAL_BOOL: return a.as.boolean == b.as.boolean;
-        case VAL_NUMBER: return a.as.number == b.as.number;
+        case VAL_BOOL: return AS_BOOL(a) == AS_BOOL(b);
+        case VAL_NUMBER: return AS_NUMBER(a) == AS_NUMBER(b);
         case VAL_STRING:
-            if (a.as.string.len != b.as.string.len) return 0;
-            return strcmp(a.as.string.str, b.as.string.str) == 0;
+            if (AS_STRING(a)->len != AS_STRING(b)->len) return 0;
+            return memcmp(AS_STRING(a)->chars, AS_STRING(b)->chars, (size_t)AS_STRING(a)->len) == 0;
         default: return 0;
     }
 }
 
 char *val_to_string(Value v) {
     char buf[256];
-    switch (v.type) {
+    switch (val_type(v)) {
         case VAL_NULL:
             return strdup("null");
         case VAL_BOOL:
-            return strdup(v.as.boolean ? "true" : "false");
-        case VAL_NUMBER: {
-            double n = v.as.number;
-            if (n == floor(n) && n >= -1e15 && n <= 1e15) {
-                snprintf(buf, sizeof(buf), "%ld", (long)n);
-            } else {
-                snprintf(buf, sizeof(buf), "%g", n);
-            }
+            return strdup(AS_BOOL(v) ? "true" : "false");
+        case VAL_NUMBER:
+            val_format_number(AS_NUMBER(v), buf, sizeof(buf));
             return strdup(buf);
-        }
         case VAL_STRING:
-            return strdup(v.as.string.str);
+            return strdup(AS_STRING(v)->chars);
         case VAL_ARRAY: {
             /* Build string like [1, 2, 3] */
             int cap = 256;
             char *out = malloc((size_t)cap);
             int len = 0;
             out[len++] = '[';
-            for (int i = 0; i < v.as.array.count; i++) {
+            for (int i = 0; i < AS_ARRAY(v)->count; i++) {
                 if (i > 0) { out[len++] = ','; out[len++] = ' '; }
-                char *s = val_to_string(v.as.array.items[i]);
+                char *s = val_to_string(AS_ARRAY(v)->items[i]);
                 int slen = (int)strlen(s);
                 while (len + slen + 4 >= cap) { cap *= 2; out = realloc(out, (size_t)cap); }
                 /* Quote strings in array display */
-                if (v.as.array.items[i].type == VAL_STRING) {
+                if (IS_STRING(AS_ARRAY(v)->items[i])) {
                     out[len++] = '"';
                     memcpy(out + len, s, (size_t)slen);
                     len += slen;
@@ -237,32 +425,27 @@ char *val_to_string(Value v) {
             int len = 0;
             out[len++] = '{';
             int first = 1;
-            for (int i = 0; i < v.as.object->cap; i++) {
-                TableEntry *e = v.as.object->entries[i];
-                while (e) {
-                    if (!first) { out[len++] = ','; out[len++] = ' '; }
-                    first = 0;
-                    /* skip internal __class__ etc */
-                    int klen = (int)strlen(e->key);
-                    char *vs = val_to_string(e->value);
-                    int vlen = (int)strlen(vs);
-                    while (len + klen + vlen + 10 >= cap) { cap *= 2; out = realloc(out, (size_t)cap); }
-                    memcpy(out + len, e->key, (size_t)klen);
-                    len += klen;
-                    out[len++] = ':';
-                    out[len++] = ' ';
-                    if (e->value.type == VAL_STRING) {
-                        out[len++] = '"';
-                        memcpy(out + len, vs, (size_t)vlen);
-                        len += vlen;
-                        out[len++] = '"';
-                    } else {
-                        memcpy(out + len, vs, (size_t)vlen);
-                        len += vlen;
-                    }
-                    free(vs);
-                    e = e->next;
+            TABLE_FOR_EACH(AS_OBJECT(v), e) {
+                if (!first) { out[len++] = ','; out[len++] = ' '; }
+                first = 0;
+                int klen = (int)strlen(e->key);
+                char *vs = val_to_string(e->value);
+                int vlen = (int)strlen(vs);
+                while (len + klen + vlen + 10 >= cap) { cap *= 2; out = realloc(out, (size_t)cap); }
+                memcpy(out + len, e->key, (size_t)klen);
+                len += klen;
+                out[len++] = ':';
+                out[len++] = ' ';
+                if (IS_STRING(e->value)) {
+                    out[len++] = '"';
+                    memcpy(out + len, vs, (size_t)vlen);
+                    len += vlen;
+                    out[len++] = '"';
+                } else {
+                    memcpy(out + len, vs, (size_t)vlen);
+                    len += vlen;
                 }
+                free(vs);
             }
             if (len + 2 >= cap) { cap += 4; out = realloc(out, (size_t)cap); }
             out[len++] = '}';
@@ -270,16 +453,34 @@ char *val_to_string(Value v) {
             return out;
         }
         case VAL_FUNCTION:
-            snprintf(buf, sizeof(buf), "<fn %s>", v.as.func ? v.as.func->name : "?");
+            snprintf(buf, sizeof(buf), "<fn %s>", AS_FUNC(v) ? AS_FUNC(v)->name : "?");
             return strdup(buf);
         case VAL_BUILTIN:
             return strdup("<builtin>");
+        case VAL_CLASS:
+            snprintf(buf, sizeof(buf), "<class %s>", AS_CLASS(v)->name);
+            return strdup(buf);
+        case VAL_RANGE: {
+            Value arr = val_copy(v);
+            val_materialize(&arr);
+            char *out = val_to_string(arr);
+            val_free(&arr);
+            return out;
+        }
+        case VAL_F64ARRAY: {
+            Value arr = val_f64_to_array(AS_F64(v));
+            char *out = val_to_string(arr);
+            val_free(&arr);
+            return out;
+        }
+        case VAL_FILE:
+            return strdup(AS_FILE(v)->fd >= 0 ? "<file>" : "<closed file>");
     }
     return strdup("null");
 }
 
 const char *val_type_name(Value v) {
-    switch (v.type) {
+    switch (val_type(v)) {
         case VAL_NULL: return "null";
         case VAL_BOOL: return "bool";
         case VAL_NUMBER: return "number";
@@ -288,6 +489,10 @@ const char *val_type_name(Value v) {
         case VAL_OBJECT: return "object";
         case VAL_FUNCTION: return "function";
         case VAL_BUILTIN: return "function";
+        case VAL_CLASS: return "class";
+        case VAL_RANGE: return "array";
+        case VAL_F64ARRAY: return "float64array";
+        case VAL_FILE: return "file";
     }
     return "unknown";
 }
@@ -2,74 +2,272 @@
 #define JUNG_VALUE_H
 
 #include <stddef.h>
+#include <stdint.h>
+#include <string.h>
 
+/* The numbering is part of the Value encoding below: val_type() computes
+ * it from the tag bits, so the order of the non-number types is fixed. */
 typedef enum {
+    VAL_NUMBER,
     VAL_NULL,
     VAL_BOOL,
-    VAL_NUMBER,
     VAL_STRING,
     VAL_ARRAY,
     VAL_OBJECT,
     VAL_FUNCTION,
-    VAL_BUILTIN
+    VAL_BUILTIN,
+    VAL_CLASS,         /* class descriptor; only held by the class table */
+    VAL_RANGE,         /* lazy range(); reads as an array of numbers */
+    VAL_F64ARRAY,      /* Float64Array: unboxed doubles */
+    VAL_FILE           /* open file handle (stream.h) */
 } ValueType;
 
 typedef struct Value Value;
 typedef struct Table Table;
+typedef struct Shape Shape;
 typedef struct ASTNode ASTNode;
 
+/* Shared heap storage for strings and arrays. Reads share the buffer by
+ * bumping refcount; mutators copy first when refcount > 1 (copy-on-write). */
+typedef struct StrObj {
+    int refcount;
+    int len;
+    int cap;              /* bytes allocated for chars, including the NUL */
+    char *chars;
+} StrObj;
+
+typedef struct ArrObj {
+    int refcount;
+    int count;
+    int cap;
+    unsigned gc;          /* cycle collector state (gc.h) */
+    Value *items;
+} ArrObj;
+
+/* The numbers start, start + step, ... (count of them), produced on
+ * demand. Anything that needs real array storage materializes it first. */
+typedef struct RangeObj {
+    int refcount;
+    int start;
+    int step;
+    int count;
+} RangeObj;
+
+/* Contiguous doubles, copy-on-write like ArrObj */
+typedef struct F64Array {
+    int refcount;
+    int count;
+    int cap;
+    double *data;
+} F64Array;
+
+/* A file opened by open(), readLines() or jsonLines(). Handles have reference
+ * semantics: copies share one position and one write buffer. */
+typedef enum { FILE_READ, FILE_MMAP, FILE_WRITE } FileMode;
+
+typedef struct FileObj {
+    int refcount;
+    FileMode mode;
+    int fd;               /* -1 once closed */
+    char *buf;            /* read: bytes [pos, len) not consumed yet;
+                           * write: [0, len) not written yet */
+    size_t pos;
+    size_t len;
+    size_t cap;
+    const char *map;      /* FILE_MMAP: the whole file */
+    size_t map_len;
+    int eof;              /* read: no more input past buf */
+    struct JsonKeys *json; /* jsonLines(): yields parsed lines (json.h) */
+} FileObj;
+
+/* Class descriptor, shared by the class table and every instance */
+typedef struct ClassObj {
+    int refcount;
+    const char *name;     /* interned */
+    Table *methods;       /* method name -> VAL_FUNCTION */
+    struct FuncDef *ctor; /* "constructor" or "init" method, NULL if none */
+} ClassObj;
+
 /* Function parameter: name + optional default expression */
 typedef struct {
-    char *name;
+    const char *name;
     ASTNode *default_val; /* NULL if no default */
 } Param;
 
-typedef struct {
-    char *name;
+typedef struct FuncDef {
+    const char *name;
     Param *params;
     int param_count;
     ASTNode **body;
     int body_count;
+    struct Chunk *code;   /* bytecode, compiled lazily by the VM */
+    struct JitFn *jit;    /* native code state (jit.h), NULL until --jit calls it */
+    int line;             /* of the definition */
+    struct FuncDef *next; /* every FuncDef of an interpreter, which frees
+                           * them in interp_free */
 } FuncDef;
 
 /* Builtin function pointer: receives array of Value, count, returns Value */
 typedef Value (*BuiltinFn)(Value *args, int argc);
 
-struct Value {
-    ValueType type;
-    int refcount;
+/* Resolved target of one call site, filled by interp_call or interp_invoke.
+ * A target is valid while version matches the interpreter's def_version,
+ * which moves whenever a function or class is (re)defined. Zeroed means
+ * empty. */
+typedef enum { CALL_UNRESOLVED, CALL_BUILTIN, CALL_FUNCTION, CALL_METHOD } CallKind;
+
+typedef struct {
+    CallKind kind;
+    unsigned int version;
+    ClassObj *klass;          /* method sites: class of the receiver */
+    int recv_kind;            /* method sites: its MethodKind */
     union {
-        int boolean;
-        double number;
-        struct { char *str; int len; } string;
-        struct { Value *items; int count; int cap; } array;
-        Table *object;
-        FuncDef *func;
         BuiltinFn builtin;
+        FuncDef *func;
     } as;
+    int mut_known;            /* mutator below has been looked up */
+    BuiltinFn mutator;        /* receiver-mutating builtin, or NULL */
+} CallCache;
+
+/* Where one dot-access site last found its key: valid for any table with
+ * the same shape (see table.h), which is known by id since the tree frees
+ * unused shapes. Zeroed means empty. */
+typedef struct {
+    unsigned long long shape; /* id of the shape */
+    int pos;
+} ShapeCache;
+
+/* A Value is one 64-bit word (NaN boxing). A number is its IEEE-754 bits,
+ * except that every NaN is stored as VAL_NAN: strtod and arithmetic can
+ * yield NaNs with any sign and payload. Every other type sits in the
+ * quiet-NaN space that leaves free: the top 16 bits hold the type, the
+ * low 48 a pointer, a bool or nothing.
+ * Heap objects carry their own refcount. The word is stored XORed with
+ * VAL_BIAS, the bits of null, so zeroed memory reads as null, and all
+ * access goes through the macros below so the layout lives here only. */
+struct Value {
+    uint64_t bits;
 };
 
+#define VAL_BIAS     0x7FF9000000000000ull
+#define VAL_PAYLOAD  0x0000FFFFFFFFFFFFull
+#define VAL_NAN      0x7FF8000000000000ull   /* the one NaN a number holds */
+
+/* Stored top 16 bits of a non-number of type t: 0x7FF8 + t for the first
+ * seven types, 0xFFF8 + (t - 7) for the rest */
+#define VAL_TAG(t) \
+    ((uint64_t)(((t) <= 7 ? 0x7FF8u + (t) : 0xFFF8u + (t) - 7) ^ 0x7FF9u) << 48)
+
+#define IS_NUMBER(v)   ((((v).bits ^ VAL_BIAS) & 0x7FFF000000000000ull) < 0x7FF9000000000000ull)
+#define VAL_IS(v, t)   (((v).bits & ~VAL_PAYLOAD) == VAL_TAG(t))
+#define IS_NULL(v)     ((v).bits == 0)
+#define IS_BOOL(v)     VAL_IS(v, VAL_BOOL)
+#define IS_STRING(v)   VAL_IS(v, VAL_STRING)
+#define IS_ARRAY(v)    VAL_IS(v, VAL_ARRAY)
+#define IS_OBJECT(v)   VAL_IS(v, VAL_OBJECT)
+#define IS_FUNCTION(v) VAL_IS(v, VAL_FUNCTION)
+#define IS_BUILTIN(v)  VAL_IS(v, VAL_BUILTIN)
+#define IS_CLASS(v)    VAL_IS(v, VAL_CLASS)
+#define IS_RANGE(v)    VAL_IS(v, VAL_RANGE)
+#define IS_F64ARRAY(v) VAL_IS(v, VAL_F64ARRAY)
+#define IS_FILE(v)     VAL_IS(v, VAL_FILE)
+
+#define VAL_PTR(v)     ((void *)(uintptr_t)((v).bits & VAL_PAYLOAD))
+#define AS_NUMBER(v)   val_as_number(v)
+#define AS_BOOL(v)     ((int)((v).bits & 1))
+#define AS_STRING(v)   ((StrObj *)VAL_PTR(v))
+#define AS_ARRAY(v)    ((ArrObj *)VAL_PTR(v))
+#define AS_OBJECT(v)   ((Table *)VAL_PTR(v))
+#define AS_FUNC(v)     ((FuncDef *)VAL_PTR(v))
+#define AS_BUILTIN(v)  ((BuiltinFn)(uintptr_t)((v).bits & VAL_PAYLOAD))
+#define AS_CLASS(v)    ((ClassObj *)VAL_PTR(v))
+#define AS_RANGE(v)    ((RangeObj *)VAL_PTR(v))
+#define AS_F64(v)      ((F64Array *)VAL_PTR(v))
+#define AS_FILE(v)     ((FileObj *)VAL_PTR(v))
+
+static inline ValueType val_type(Value v) {
+    unsigned h = (unsigned)((v.bits ^ VAL_BIAS) >> 48);
+    if ((h & 0x7FFF) < 0x7FF9) return VAL_NUMBER;
+    return (ValueType)((h & 7) + (h >> 15) * 7);
+}
+
+static inline double val_as_number(Value v) {
+    uint64_t raw = v.bits ^ VAL_BIAS;
+    double n;
+    memcpy(&n, &raw, sizeof(n));
+    return n;
+}
+
+/* A Value of heap type t pointing at p, which the caller has counted */
+static inline Value val_from_ptr(ValueType t, const void *p) {
+    Value v;
+    v.bits = VAL_TAG(t) | ((uint64_t)(uintptr_t)p & VAL_PAYLOAD);
+    return v;
+}
+
 /* Constructors -- all return stack values. Strings/arrays/objects are heap-backed. */
-Value val_null(void);
-Value val_bool(int b);
-Value val_number(double n);
+static inline Value val_null(void) {
+    Value v;
+    v.bits = 0;
+    return v;
+}
+
+static inline Value val_bool(int b) {
+    Value v;
+    v.bits = VAL_TAG(VAL_BOOL) | (b ? 1u : 0u);
+    return v;
+}
+
+static inline Value val_number(double n) {
+    Value v;
+    if (n == n) memcpy(&v.bits, &n, sizeof(n));
+    else v.bits = VAL_NAN;
+    v.bits ^= VAL_BIAS;
+    return v;
+}
+
 Value val_string(const char *s, int len);
 Value val_string_take(char *s, int len);
+Value val_string_take_cap(char *s, int len, int cap);   /* s holds cap bytes */
 Value val_array(int initial_cap);
 Value val_object(void);
 Value val_func(FuncDef *f);
 Value val_builtin(BuiltinFn fn);
+Value val_class(const char *name);   /* name must be interned */
+Value val_range(int start, int end, int step);
+Value val_f64array(int count);       /* zero-filled */
 
 /* Reference counting */
 Value val_copy(Value v);
 void  val_free(Value *v);
 
+/* String helpers. Appending to a uniquely owned string grows its buffer
+ * geometrically in place, so building a string by repeated appends is
+ * linear overall; a shared string is copied first. */
+Value val_string_empty(int cap);
+void  val_string_append(Value *s, const char *chars, int len);
+void  val_string_append_value(Value *s, Value v);   /* as val_to_string would print v */
+int   val_format_number(double n, char *buf, size_t size);
+
 /* Array helpers */
+void  val_array_detach(Value *arr);
 void  val_array_push(Value *arr, Value item);
 Value val_array_pop(Value *arr);
 Value val_array_get(Value *arr, int idx);
 void  val_array_set(Value *arr, int idx, Value item);
 
+/* Range helpers */
+static inline Value val_range_at(RangeObj *r, int i) {
+    return val_number((double)r->start + (double)i * r->step);
+}
+void  val_materialize(Value *v);   /* turn a range into a real array in place */
+
+/* Float64Array helpers. val_f64_detach gives v a private buffer;
+ * val_f64_to_array boxes the elements into a plain array. */
+void  val_f64_detach(Value *v);
+void  val_f64_push(Value *v, double x);
+Value val_f64_to_array(F64Array *a);
+
 /* Truthiness */
 int   val_is_truthy(Value v);
 
@@ -0,0 +1,694 @@
+#include "vm.h"
+#include "intern.h"
+#include "jit.h"
+#include "compiler.h"
+#include "builtins.h"
+#include "stream.h"
+#include "memstats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Computed-goto dispatch where the compiler supports labels as values,
+ * a plain switch everywhere else (or with -DJUNG_NO_COMPUTED_GOTO). */
+#if defined(__GNUC__) && !defined(JUNG_NO_COMPUTED_GOTO)
+#define VM_COMPUTED_GOTO 1
+#endif
+
+/* Operand stack discipline: each vm_execute frame owns the slots from its
+ * base up to sp, and publishes sp as it->stack_top (SYNC) before anything
+ * that can re-enter the VM or raise. Operands stay in their slots until the
+ * helper consuming them returns, so an uncaught error unwinding to
+ * interp_protect only ever frees live values. Inside a try a raise returns
+ * instead: every op that SYNCs checks it->throwing afterwards (RAISED) and
+ * leaves through the normal exit, freeing its own slots and scopes. */
+/* fn's chunk, compiled on first use; NULL (raised) when it cannot be */
+static Chunk *function_code(Interpreter *it, FuncDef *fn) {
+    if (!fn->code) {
+        fn->code = compile_function(it, fn);
+        if (it->throwing) {
+            /* Too large to compile: don't keep the broken chunk */
+            chunk_free(fn->code);
+            fn->code = NULL;
+        }
+    }
+    return fn->code;
+}
+
+/* Room for chunk's operands above slot top, else raise */
+static int stack_room(Interpreter *it, int top, Chunk *chunk, int line) {
+    if (top + chunk->max_stack <= VM_STACK_MAX) return 1;
+    interp_error(it, line, "stack overflow (VM stack exhausted)");
+    return 0;
+}
+
+/* Frames of calls made from bytecode (see vm.h). A frame records the
+ * caller: the callee runs in vm_execute's own variables. Each vm_execute
+ * only returns into frames it pushed, the ones above frame_floor. */
+static VMFrame *push_frame(Interpreter *it) {
+    if (it->frame_count == it->frame_cap) {
+        int cap = it->frame_cap ? it->frame_cap * 2 : 64;
+        MEM_RESIZE(MEM_SCOPE, sizeof(VMFrame) * (size_t)it->frame_cap, sizeof(VMFrame) * (size_t)cap);
+        it->frames = realloc(it->frames, sizeof(VMFrame) * (size_t)cap);
+        it->frame_cap = cap;
+    }
+    return &it->frames[it->frame_count++];
+}
+
+static Value vm_execute(Interpreter *it, Chunk *chunk) {
+    if (!it->stack) it->stack = malloc(sizeof(Value) * VM_STACK_MAX);
+    if (!stack_room(it, it->stack_top, chunk, chunk->count > 0 ? chunk->lines[0] : 0)) {
+        return val_null();
+    }
+
+    Value *base = it->stack + it->stack_top;
+    Value *sp = base;
+    const uint8_t *ip = chunk->code;
+    int scope_base = it->scope_depth;
+    int frame_floor = it->frame_count;
+    Value result = val_null();
+
+    /* A dream or class method OP_CALL or OP_INVOKE enters at 'enter' */
+    FuncDef *callee = NULL;
+    Value *call_args = NULL;
+    int call_argc = 0, call_line = 0, call_method = 0;
+
+#define READ_U16() (ip += 2, (int)(ip[-2] | (ip[-1] << 8)))
+#define NAME() chunk->names[READ_U16()]
+#define LINE() chunk->lines[ip - chunk->code - 1]
+#define SYNC() (it->stack_top = (int)(sp - it->stack))
+#define RAISED() do { if (it->throwing) goto done; } while (0)
+#define NUMBERS() (IS_NUMBER(sp[-2]) && IS_NUMBER(sp[-1]))
+#define BINARY_SLOW(tok) do {                                          \
+        SYNC();                                                        \
+        Value r_ = interp_binary(it, tok, sp[-2], sp[-1], LINE());     \
+        sp -= 2;                                                       \
+        *sp++ = r_;                                                    \
+        RAISED();                                                      \
+    } while (0)
+#define ARITH(op, tok) do {                                            \
+        if (NUMBERS()) {                                               \
+            sp[-2] = val_number(AS_NUMBER(sp[-2]) op AS_NUMBER(sp[-1])); \
+            sp--;                                                      \
+        } else BINARY_SLOW(tok);                                       \
+    } while (0)
+#define COMPARE(op, tok) do {                                          \
+        if (NUMBERS()) {                                               \
+            sp[-2] = val_bool(AS_NUMBER(sp[-2]) op AS_NUMBER(sp[-1]));   \
+            sp--;                                                      \
+        } else BINARY_SLOW(tok);                                       \
+    } while (0)
+
+#ifdef VM_COMPUTED_GOTO
+#if defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+#define JUNG_OPCODE_LABEL(op) &&L_##op,
+    static void *dispatch[OP_COUNT] = { JUNG_OPCODES(JUNG_OPCODE_LABEL) };
+#undef JUNG_OPCODE_LABEL
+#define CASE(op) L_##op
+#define DISPATCH() goto *dispatch[*ip++]
+    DISPATCH();
+#else
+#define CASE(op) case op
+#define DISPATCH() continue
+    for (;;) switch ((OpCode)*ip++) {
+#endif
+
+    CASE(OP_CONST): *sp++ = val_copy(chunk->consts[READ_U16()]); DISPATCH();
+    CASE(OP_NULL):  *sp++ = val_null();    DISPATCH();
+    CASE(OP_TRUE):  *sp++ = val_bool(1);   DISPATCH();
+    CASE(OP_FALSE): *sp++ = val_bool(0);   DISPATCH();
+    CASE(OP_POP):   val_free(--sp);        DISPATCH();
+
+    CASE(OP_THIS):
+        *sp++ = it->this_obj ? val_copy(*it->this_obj) : val_null();
+        DISPATCH();
+
+    CASE(OP_GET_VAR): {
+        const char *name = NAME();
+        Value v;
+        if (interp_get_var(it, name, &v)) {
+            *sp++ = val_copy(v);
+        } else {
+            SYNC();
+            *sp++ = interp_variable(it, name, LINE());
+            RAISED();
+        }
+        DISPATCH();
+    }
+
+    CASE(OP_SET_VAR): {
+        const char *name = NAME();
+        sp--;
+        interp_set_var(it, name, *sp);
+        DISPATCH();
+    }
+
+    CASE(OP_COMPOUND_VAR): {
+        const char *name = NAME();
+        TokenType op = (TokenType)READ_U16();
+        SYNC();
+        interp_compound_assign(it, name, op, sp[-1], LINE());
+        sp--;
+        RAISED();
+        DISPATCH();
+    }
+
+    CASE(OP_GET_LOCAL): {
+        int depth = READ_U16();
+        int slot = READ_U16();
+        *sp++ = val_copy(*interp_local(it, depth, slot));
+        DISPATCH();
+    }
+
+    CASE(OP_SET_LOCAL): {
+        int depth = READ_U16();
+        Value *slot = interp_local(it, depth, READ_U16());
+        val_free(slot);
+        *slot = *--sp;
+        DISPATCH();
+    }
+
+    CASE(OP_COMPOUND_LOCAL): {
+        int depth = READ_U16();
+        Value *slot = interp_local(it, depth, READ_U16());
+        TokenType op = (TokenType)READ_U16();
+        if (IS_NUMBER(*slot) && IS_NUMBER(sp[-1]) && op != TOKEN_DIVIDE_ASSIGN) {
+            double l = AS_NUMBER(*slot), r = AS_NUMBER(*--sp);
+            if (op == TOKEN_PLUS_ASSIGN) *slot = val_number(l + r);
+            else if (op == TOKEN_MINUS_ASSIGN) *slot = val_number(l - r);
+            else *slot = val_number(l * r);
+            DISPATCH();
+        }
+        SYNC();
+        interp_compound_slot(it, slot, op, sp[-1], LINE());
+        sp--;
+        RAISED();
+        DISPATCH();
+    }
+
+    CASE(OP_ADD): ARITH(+, TOKEN_PLUS);     DISPATCH();
+    CASE(OP_SUB): ARITH(-, TOKEN_MINUS);    DISPATCH();
+    CASE(OP_MUL): ARITH(*, TOKEN_MULTIPLY); DISPATCH();
+    CASE(OP_DIV): BINARY_SLOW(TOKEN_DIVIDE); DISPATCH();
+    CASE(OP_MOD): BINARY_SLOW(TOKEN_MODULO); DISPATCH();
+    CASE(OP_EQ):  COMPARE(==, TOKEN_EQ);    DISPATCH();
+    CASE(OP_NEQ): COMPARE(!=, TOKEN_NEQ);   DISPATCH();
+    CASE(OP_LT):  COMPARE(<, TOKEN_LT);     DISPATCH();
+    CASE(OP_GT):  COMPARE(>, TOKEN_GT);     DISPATCH();
+    CASE(OP_LTE): COMPARE(<=, TOKEN_LTE);   DISPATCH();
+    CASE(OP_GTE): COMPARE(>=, TOKEN_GTE);   DISPATCH();
+
+    CASE(OP_NEG):
+        if (IS_NUMBER(sp[-1])) {
+            sp[-1] = val_number(-AS_NUMBER(sp[-1]));
+        } else {
+            SYNC();
+            sp[-1] = interp_unary(it, TOKEN_MINUS, sp[-1], LINE());
+            RAISED();
+        }
+        DISPATCH();
+
+    CASE(OP_NOT): {
+        int t = val_is_truthy(sp[-1]);
+        val_free(&sp[-1]);
+        sp[-1] = val_bool(!t);
+        DISPATCH();
+    }
+
+    CASE(OP_TRUTHY): {
+        int t = val_is_truthy(sp[-1]);
+        val_free(&sp[-1]);
+        sp[-1] = val_bool(t);
+        DISPATCH();
+    }
+
+    CASE(OP_JUMP): {
+        int off = READ_U16();
+        ip += off;
+        DISPATCH();
+    }
+
+    CASE(OP_LOOP): {
+        int off = READ_U16();
+        ip -= off;
+        DISPATCH();
+    }
+
+    CASE(OP_JUMP_IF_FALSE): {
+        int off = READ_U16();
+        sp--;
+        int t = val_is_truthy(*sp);
+        val_free(sp);
+        if (!t) ip += off;
+        DISPATCH();
+    }
+
+    CASE(OP_JUMP_IF_TRUE_KEEP): {
+        int off = READ_U16();
+        if (val_is_truthy(sp[-1])) ip += off;
+        else val_free(--sp);
+        DISPATCH();
+    }
+
+    CASE(OP_JUMP_IF_FALSE_KEEP): {
+        int off = READ_U16();
+        if (!val_is_truthy(sp[-1])) ip += off;
+        else val_free(--sp);
+        DISPATCH();
+    }
+
+    CASE(OP_ARRAY): {
+        int n = READ_U16();
+        Value arr = val_array(n > 0 ? n : 8);
+        for (int i = 0; i < n; i++) val_array_push(&arr, sp[i - n]);
+        sp -= n;
+        *sp++ = arr;
+        DISPATCH();
+    }
+
+    CASE(OP_OBJECT): *sp++ = val_object(); DISPATCH();
+
+    CASE(OP_OBJECT_SET): {
+        const char *key = NAME();
+        sp--;
+        table_iset(AS_OBJECT(sp[-1]), key, *sp);
+        DISPATCH();
+    }
+
+    CASE(OP_INTERP): {
+        int n = READ_U16();
+        int cap = 1;
+        for (int i = 0; i < n; i++) {
+            cap += IS_STRING(sp[i - n]) ? AS_STRING(sp[i - n])->len : 24;
+        }
+        Value out = val_string_empty(cap);
+        for (int i = 0; i < n; i++) {
+            val_string_append_value(&out, sp[i - n]);
+            val_free(&sp[i - n]);
+        }
+        sp -= n;
+        *sp++ = out;
+        DISPATCH();
+    }
+
+    CASE(OP_INDEX): {
+        if (IS_ARRAY(sp[-2]) && IS_NUMBER(sp[-1])) {
+            ArrObj *a = AS_ARRAY(sp[-2]);
+            int i = (int)AS_NUMBER(sp[-1]);
+            if (i < 0) i += a->count;
+            Value v = (i >= 0 && i < a->count) ? val_copy(a->items[i]) : val_null();
+            val_free(&sp[-2]);
+            sp[-2] = v;
+            sp--;
+        } else {
+            Value v = interp_index(it, sp[-2], sp[-1]);
+            sp -= 2;
+            *sp++ = v;
+        }
+        DISPATCH();
+    }
+
+    CASE(OP_GET_FIELD): {
+        ASTNode *access = chunk->nodes[READ_U16()];
+        sp[-1] = interp_get_field(it, sp[-1], access->as.obj_access.key,
+                                  &access->as.obj_access.cache);
+        DISPATCH();
+    }
+
+    CASE(OP_CALL): {
+        ASTNode *call = chunk->nodes[READ_U16()];
+        int argc = READ_U16();
+        int line = LINE();
+        SYNC();
+        Value *args = sp - argc;
+        FuncDef *fn = interp_call_target(it, call->as.func_call.name, &call->as.func_call.cache,
+                                         argc);
+        if (!fn) {
+            Value r = interp_call(it, call->as.func_call.name, &call->as.func_call.cache,
+                                  args, argc, line);
+            sp = args;
+            *sp++ = r;
+            RAISED();
+            DISPATCH();
+        }
+
+        /* Natively, if it is hot: the arguments were numbers, nothing to free */
+        Value r;
+        if (it->jit && jit_call(it, fn, args, argc, &r)) {
+            sp = args;
+            *sp++ = r;
+            DISPATCH();
+        }
+
+        callee = fn;
+        call_args = args;
+        call_argc = argc;
+        call_line = line;
+        call_method = 0;
+        goto enter;
+    }
+
+    CASE(OP_INVOKE): {
+        ASTNode *call = chunk->nodes[READ_U16()];
+        int argc = READ_U16();
+        int line = LINE();
+        SYNC();
+        Value *args = sp - argc;
+        FuncDef *fn = interp_invoke_target(it, call->as.func_call.name, &call->as.func_call.cache,
+                                           args);
+        if (!fn) {
+            Value r = interp_invoke(it, call->as.func_call.name, &call->as.func_call.cache,
+                                    args, argc, line);
+            sp = args;
+            *sp++ = r;
+            RAISED();
+            DISPATCH();
+        }
+        callee = fn;
+        call_args = args;
+        call_argc = argc;
+        call_line = line;
+        call_method = 1;
+        goto enter;
+    }
+
+    enter: {
+        /* A dream: run it here, the arguments staying in their slots (a
+         * method's receiver is its Self) until it returns */
+        Chunk *code = function_code(it, callee);
+        RAISED();
+        if (!stack_room(it, (int)(sp - it->stack), code, call_line)) goto done;
+        VMFrame *f = push_frame(it);
+        f->chunk = chunk;
+        f->ip = ip;
+        f->base = base;
+        f->args = call_args;
+        f->scope_base = scope_base;
+        f->this_obj = it->this_obj;
+        if (call_method) {
+            it->this_obj = &call_args[0];
+            interp_enter_function(it, callee, call_args + 1, call_argc - 1, call_line);
+        } else {
+            interp_enter_function(it, callee, call_args, call_argc, call_line);
+        }
+        chunk = code;
+        ip = code->code;
+        base = sp;
+        scope_base = it->scope_depth;
+        RAISED();
+        DISPATCH();
+    }
+
+    CASE(OP_TAIL_CALL): {
+        ASTNode *call = chunk->nodes[READ_U16()];
+        int argc = READ_U16();
+        int line = LINE();
+        SYNC();
+        Value *args = sp - argc;
+        FuncDef *fn = interp_call_target(it, call->as.func_call.name, &call->as.func_call.cache,
+                                         argc);
+        Chunk *code = fn && interp_frame_reusable(it, scope_base, fn, argc)
+                    ? function_code(it, fn) : NULL;
+        RAISED();
+        if (!code) {
+            /* Not a dream, or one that could see this frame's bindings: an
+             * ordinary call, then return its value */
+            result = interp_call(it, call->as.func_call.name, &call->as.func_call.cache,
+                                 args, argc, line);
+            sp = args;
+            RAISED();
+            goto ret;
+        }
+
+        /* Leave this dream and enter fn in its place, with the arguments
+         * moved down to the frame's base */
+        while (it->scope_depth > scope_base) interp_pop_scope(it);
+        interp_leave_function(it);
+        for (Value *v = base; v < args; v++) val_free(v);
+        memmove(base, args, sizeof(Value) * (size_t)argc);
+        sp = base + argc;
+        SYNC();
+        interp_enter_function(it, fn, base, argc, line);
+        while (sp > base) val_free(--sp);
+        chunk = code;
+        ip = code->code;
+        scope_base = it->scope_depth;
+        RAISED();
+        if (!stack_room(it, (int)(base - it->stack), code, line)) goto done;
+        DISPATCH();
+    }
+
+    CASE(OP_CALL_MUT): {
+        ASTNode *call = chunk->nodes[READ_U16()];
+        int argc = READ_U16();
+        const char *var = NAME();
+        SYNC();
+        const char *name = call->as.func_call.name;
+        CallCache *cc = &call->as.func_call.cache;
+        Value *args = sp - argc;
+        Value *recv = interp_get_var_ref(it, var);
+        BuiltinFn fn;
+        Value r;
+        if (recv && !(IS_OBJECT(*recv) && AS_OBJECT(*recv)->klass) &&
+            (fn = interp_site_mutator(it, name, cc)) != NULL) {
+            r = interp_call_mutator(it, fn, recv, args, argc, LINE());
+            args[0] = val_null();   /* borrowed from the variable */
+        } else {
+            args[0] = recv ? val_copy(*recv) : interp_variable(it, var, LINE());
+            r = interp_call(it, name, cc, args, argc, LINE());
+        }
+        sp = args;
+        *sp++ = r;
+        RAISED();
+        DISPATCH();
+    }
+
+    CASE(OP_INVOKE_MUT): {
+        ASTNode *call = chunk->nodes[READ_U16()];
+        int argc = READ_U16();
+        const char *var = NAME();
+        SYNC();
+        const char *name = call->as.func_call.name;
+        CallCache *cc = &call->as.func_call.cache;
+        Value *args = sp - argc;
+        Value *recv = interp_get_var_ref(it, var);
+        BuiltinFn fn;
+        Value r;
+        if (recv && !(IS_OBJECT(*recv) && AS_OBJECT(*recv)->klass) &&
+            (fn = interp_method_mutator(it, name, cc)) != NULL) {
+            r = interp_call_mutator(it, fn, recv, args, argc, LINE());
+            args[0] = val_null();   /* borrowed from the variable */
+        } else {
+            args[0] = recv ? val_copy(*recv) : interp_variable(it, var, LINE());
+            r = interp_invoke(it, name, cc, args, argc, LINE());
+        }
+        sp = args;
+        *sp++ = r;
+        RAISED();
+        DISPATCH();
+    }
+
+    CASE(OP_NEW): {
+        const char *name = NAME();
+        int argc = READ_U16();
+        SYNC();
+        Value *args = sp - argc;
+        Value r = interp_new_instance(it, name, args, argc, LINE());
+        sp = args;
+        *sp++ = r;
+        RAISED();
+        DISPATCH();
+    }
+
+    CASE(OP_PRINT): {
+        sp--;
+        char *s = val_to_string(*sp);
+        printf("%s\n", s);
+        free(s);
+        val_free(sp);
+        DISPATCH();
+    }
+
+    CASE(OP_PUSH_SCOPE): interp_push_scope(it); DISPATCH();
+
+    CASE(OP_POP_SCOPES): {
+        int n = READ_U16();
+        while (n-- > 0) interp_pop_scope(it);
+        DISPATCH();
+    }
+
+    CASE(OP_ITER_INIT):
+        /* Objects iterate over a snapshot of their keys */
+        if (IS_OBJECT(sp[-1])) {
+            Value keys = table_keys(AS_OBJECT(sp[-1]));
+            val_free(&sp[-1]);
+            sp[-1] = keys;
+        }
+        *sp++ = val_number(0);
+        DISPATCH();
+
+    CASE(OP_ITER_NEXT): {
+        const char *name = NAME();
+        int off = READ_U16();
+        Value src = sp[-2];
+        if (IS_FILE(src)) {
+            Value line;
+            if (!stream_next(AS_FILE(src), &line)) {
+                ip += off;
+                DISPATCH();
+            }
+            interp_push_scope(it);
+            interp_bind_local(it, name, line);
+            DISPATCH();
+        }
+        int i = (int)AS_NUMBER(sp[-1]);
+        int len = IS_ARRAY(src) ? AS_ARRAY(src)->count
+                : IS_RANGE(src) ? AS_RANGE(src)->count
+                : IS_F64ARRAY(src) ? AS_F64(src)->count
+                : IS_STRING(src) ? AS_STRING(src)->len : 0;
+        if (i >= len) {
+            ip += off;
+            DISPATCH();
+        }
+        sp[-1] = val_number(i + 1);
+        interp_push_scope(it);
+        interp_bind_local(it, name, IS_ARRAY(src) ? val_copy(AS_ARRAY(src)->items[i])
+                                  : IS_RANGE(src) ? val_range_at(AS_RANGE(src), i)
+                                  : IS_F64ARRAY(src) ? val_number(AS_F64(src)->data[i])
+                                  : val_string(AS_STRING(src)->chars + i, 1));
+        DISPATCH();
+    }
+
+    CASE(OP_DEF_FUNC):  interp_define_function(it, chunk->nodes[READ_U16()]); DISPATCH();
+    CASE(OP_DEF_CLASS): interp_define_class(it, chunk->nodes[READ_U16()]);    DISPATCH();
+
+    CASE(OP_EVAL): {
+        ASTNode *node = chunk->nodes[READ_U16()];
+        SYNC();
+        Value v = interp_eval(it, node);
+        *sp++ = v;
+        RAISED();
+        DISPATCH();
+    }
+
+    CASE(OP_EXEC): {
+        ASTNode *node = chunk->nodes[READ_U16()];
+        SYNC();
+        interp_exec(it, &node, 1);
+        RAISED();
+        if (it->return_flag) {
+            it->return_flag = 0;
+            result = it->return_value;
+            it->return_value = val_null();
+            goto ret;
+        }
+        DISPATCH();
+    }
+
+    CASE(OP_TEST_FLAG): {
+        int *flag = READ_U16() == 0 ? &it->break_flag : &it->continue_flag;
+        *sp++ = val_bool(*flag);
+        *flag = 0;
+        DISPATCH();
+    }
+
+    CASE(OP_RETURN):
+        result = *--sp;
+    ret:
+        if (it->frame_count == frame_floor) goto done;
+        {
+            /* Back to the caller of a dream this loop entered */
+            VMFrame *f = &it->frames[--it->frame_count];
+            while (sp > f->args) val_free(--sp);
+            while (it->scope_depth > scope_base) interp_pop_scope(it);
+            interp_leave_function(it);
+            it->this_obj = f->this_obj;
+            chunk = f->chunk;
+            ip = f->ip;
+            base = f->base;
+            scope_base = f->scope_base;
+            *sp++ = result;
+            result = val_null();
+        }
+        DISPATCH();
+
+#ifdef VM_COMPUTED_GOTO
+#if defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+#else
+    default:
+        goto done;
+    }
+#endif
+
+done:
+    /* Raised: leave every dream this loop entered, then this frame */
+    while (it->frame_count > frame_floor) {
+        VMFrame *f = &it->frames[--it->frame_count];
+        while (it->scope_depth > scope_base) interp_pop_scope(it);
+        interp_leave_function(it);
+        it->this_obj = f->this_obj;
+        base = f->base;
+        scope_base = f->scope_base;
+    }
+    while (it->scope_depth > scope_base) interp_pop_scope(it);
+    while (sp > base) val_free(--sp);
+    it->stack_top = (int)(base - it->stack);
+    return result;
+
+#undef READ_U16
+#undef NAME
+#undef LINE
+#undef SYNC
+#undef RAISED
+#undef NUMBERS
+#undef BINARY_SLOW
+#undef ARITH
+#undef COMPARE
+#undef CASE
+#undef DISPATCH
+}
+
+void vm_run(Interpreter *it, ASTNode *program) {
+    Chunk *chunk = compile_program(it, program);
+    if (it->run_count >= it->run_cap) {
+        it->run_cap = it->run_cap ? it->run_cap * 2 : 4;
+        it->runs = realloc(it->runs, sizeof(Chunk *) * (size_t)it->run_cap);
+    }
+    it->runs[it->run_count++] = chunk;
+    Value v = it->throwing ? val_null() : vm_execute(it, chunk);
+    val_free(&v);
+    vm_unwind(it, it->run_count - 1);
+}
+
+void vm_unwind(Interpreter *it, int run_count) {
+    while (it->run_count > run_count) chunk_free(it->runs[--it->run_count]);
+}
+
+Value vm_call(Interpreter *it, FuncDef *fn, Value *args, int argc, int line) {
+    Chunk *code = function_code(it, fn);
+    if (!code) return val_null();
+    interp_enter_function(it, fn, args, argc, line);
+    Value result = it->throwing ? val_null() : vm_execute(it, code);
+    interp_leave_function(it);
+    return result;
+}
+
+void vm_free(Interpreter *it) {
+    free(it->stack);
+    it->stack = NULL;
+    it->stack_top = 0;
+    MEM_FREE(MEM_SCOPE, sizeof(VMFrame) * (size_t)it->frame_cap);
+    free(it->frames);
+    it->frames = NULL;
+    it->frame_count = 0;
+    it->frame_cap = 0;
+    vm_unwind(it, 0);
+    free(it->runs);
+    it->runs = NULL;
+    it->run_cap = 0;
+}
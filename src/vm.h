@@ -0,0 +1,37 @@
+#ifndef JUNG_VM_H
+#define JUNG_VM_H
+
+#include "interpreter.h"
+#include "compiler.h"
+
+/* Operand slots, shared by every frame. Reserved in one allocation the
+ * system commits as it is touched, so only what deep recursion uses costs
+ * memory. */
+#define VM_STACK_MAX (1 << 20)
+
+/* Bytecode execution (jung --vm). Programs are compiled as a whole; function
+ * bodies are compiled on first call and cached on their FuncDef. Statements
+ * without a bytecode form run on the tree walker, so both engines share one
+ * set of scopes, flags and exception state.
+ *
+ * A call from bytecode to a dream or class method does not recurse in C:
+ * vm_execute saves its position as a VMFrame on it->frames and carries on
+ * in the callee's chunk, popping the frame at its return. manifest f(...)
+ * replaces the running dream's frame instead (OP_TAIL_CALL). */
+typedef struct VMFrame {
+    Chunk *chunk;
+    const uint8_t *ip;
+    Value *base;
+    Value *args;          /* the call's arguments; the callee's base above */
+    int scope_base;
+    Value *this_obj;
+} VMFrame;
+
+void  vm_run(Interpreter *it, ASTNode *program);
+Value vm_call(Interpreter *it, FuncDef *fn, Value *args, int argc, int line);
+void  vm_free(Interpreter *it);
+/* Free the program chunks of vm_runs above the first run_count, which an
+ * uncaught error has unwound */
+void  vm_unwind(Interpreter *it, int run_count);
+
+#endif
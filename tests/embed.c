@@ -0,0 +1,105 @@
+/* Embedding test for `make test-embed`, built with AddressSanitizer so
+ * LeakSanitizer checks that jung_free and jung_shutdown release
+ * everything a script allocated.
+ *
+ * Runs one script on each engine (tree walker, VM, each with and without
+ * --jit) in a fresh Jung, then a few more on one Jung, then moves a Jung
+ * to a second thread and back. A script signals a wrong result with
+ * exit(), which comes back as JUNG_EXIT. */
+
+#include "jung.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static const char *program =
+    "dream fib(n) { if n < 2 { manifest n } manifest fib(n - 1) + fib(n - 2) }\n"
+    "dream count(n) { if n == 0 { manifest 0 } manifest count(n - 1) }\n"
+    "dream twice(f, x) { manifest f(f(x)) }\n"
+    "dream inc(x) { manifest x + 1 }\n"
+    "archetype Counter {\n"
+    "    fn init(start) { Self.n = start }\n"
+    "    fn bump(k) { Self.n = Self.n + k\n manifest Self }\n"
+    "}\n"
+    "perceive total = 0\n"
+    "for i in range(200) { total = total + fib(12) }\n"
+    "if total != 200 * 144 { exit(10) }\n"
+    "if count(5000) != 0 { exit(11) }\n"
+    "if twice(inc, 40) != 42 { exit(12) }\n"
+    "perceive c = emerge Counter(1)\n"
+    "c.bump(2).bump(3)\n"
+    "if c.n != 6 { exit(13) }\n"
+    "perceive o = {}\n"
+    "for i in range(100) { o[\"k\" + str(i)] = [i, str(i)] }\n"
+    "perceive j = jsonParse(\"{\\\"a\\\": [1, 2, {\\\"b\\\": \\\"c\\\"}]}\")\n"
+    "if len(keys(o)) != 100 or j.a[2].b != \"c\" { exit(14) }\n";
+
+/* Redefinitions, errors and a caught exception on one Jung */
+static const char *later[] = {
+    "dream fib(n) { manifest n }\nif fib(30) != 30 { exit(20) }",
+    "perceive caught = 0\ntry { throw \"x\" } catch (e) { caught = 1 }\n"
+    "if caught != 1 { exit(21) }",
+    "dream broken() { manifest missing_name }\nbroken()",
+};
+static const int later_status[] = { JUNG_OK, JUNG_OK, JUNG_ERROR };
+
+static int failures = 0;
+
+/* Recursion nests C frames on the tree walker, so it needs a stack limit
+ * taken from the thread it runs on */
+static const char *nested =
+    "dream depth(n) { if n == 0 { manifest 0 } manifest 1 + depth(n - 1) }\n"
+    "if depth(2000) != 2000 { exit(30) }\n";
+
+static void check(int ok, const char *what, Jung *J) {
+    if (ok) return;
+    fprintf(stderr, "FAIL %s: %s\n", what,
+            jung_error(J) ? jung_error(J) : "wrong result");
+    failures++;
+}
+
+static void *run_moved(void *J) {
+    int *status = malloc(sizeof(int));
+    *status = jung_run(J, nested);
+    jung_gc();  /* before the Jung goes back to the first thread */
+    return status;
+}
+
+int main(void) {
+    static const char *names[] = { "walker", "vm", "walker --jit", "vm --jit" };
+    for (int mode = 0; mode < 4; mode++) {
+        Jung *J = jung_new();
+        jung_use_vm(J, mode & 1);
+        jung_jit(J, mode & 2);
+        int status = jung_run(J, program);
+        check(status == JUNG_OK, names[mode], J);
+        if (status == JUNG_EXIT) fprintf(stderr, "  exit(%d)\n", jung_exit_code(J));
+
+        for (int i = 0; i < (int)(sizeof(later) / sizeof(later[0])); i++) {
+            check(jung_run(J, later[i]) == later_status[i], names[mode], J);
+        }
+        jung_free(J);
+    }
+
+    /* Run on this thread, then on another one, then here again */
+    Jung *J = jung_new();
+    check(jung_run(J, nested) == JUNG_OK, "first thread", J);
+    jung_gc();
+    pthread_t thread;
+    void *moved = NULL;
+    if (pthread_create(&thread, NULL, run_moved, J) != 0 || pthread_join(thread, &moved) != 0) {
+        fprintf(stderr, "FAIL second thread: cannot start it\n");
+        failures++;
+    } else {
+        check(*(int *)moved == JUNG_OK, "second thread", J);
+        free(moved);
+    }
+    check(jung_run(J, nested) == JUNG_OK, "back on the first thread", J);
+    jung_free(J);
+
+    jung_shutdown();
+
+    if (failures) return 1;
+    printf("embed: all engines and threads passed\n");
+    return 0;
+}
@@ -0,0 +1,51 @@
+#!/bin/bash
+# .jungc caches: --compile, reuse while the source is unchanged,
+# invalidation on an edit, and a damaged cache falling back to the source.
+# Run by run.sh as `jungc.sh JUNG [jung args..]`; exits non-zero on failure.
+
+set -euo pipefail
+
+JUNG="$1"
+shift
+WORK="$(mktemp -d)"
+trap 'rm -rf "$WORK"' EXIT
+SRC="$WORK/prog.jung"
+fail=0
+
+ARGS=("$@")
+
+expect() {
+    local what="$1" want="$2" got
+    got=$("$JUNG" ${ARGS[@]+"${ARGS[@]}"} "$SRC" 2>&1) || true
+    if [ "$got" != "$want" ]; then
+        echo "  $what: expected '$want', got '$got'"
+        fail=1
+    fi
+}
+
+printf 'dream greet(who) { manifest "hello " + who }\nproject greet("one")\n' > "$SRC"
+touch -d '2020-01-01 00:00:00' "$SRC"
+"$JUNG" --compile "$SRC"
+[ -f "$SRC"c ] || { echo "  --compile wrote no $SRC"c; exit 1; }
+expect "compiled" "hello one"
+
+# Same size and mtime: the cache is trusted without reading the source
+printf 'dream greet(who) { manifest "hello " + who }\nproject greet("two")\n' > "$SRC"
+touch -d '2020-01-01 00:00:00' "$SRC"
+expect "cache reused" "hello one"
+
+# An edit that changes the size or mtime invalidates it
+printf 'dream greet(who) { manifest "hi " + who }\nproject greet("three")\n' > "$SRC"
+expect "edited source" "hi three"
+
+# A flipped byte in the body is caught by the payload hash
+"$JUNG" --compile "$SRC"
+at=$(grep -obUa 'three' "$SRC"c | head -1 | cut -d: -f1)
+printf 'X' | dd of="$SRC"c bs=1 seek="$at" conv=notrunc status=none
+expect "damaged cache" "hi three"
+
+# A truncated one too
+head -c 40 "$SRC"c > "$WORK/short" && mv "$WORK/short" "$SRC"c
+expect "truncated cache" "hi three"
+
+exit $fail
@@ -0,0 +1,53 @@
+#!/bin/bash
+# Module registry: --lazy-imports (tests/modules/lazy.jung) and a program
+# importing more modules than any fixed-size list would hold.
+# Run by run.sh as `module_registry.sh JUNG [jung args..]`; exits non-zero
+# on failure.
+
+set -euo pipefail
+
+JUNG="$1"
+shift
+cd "$(dirname "$0")/.."    # import paths are relative to the working directory
+fail=0
+
+expect() {
+    local what="$1" want="$2" got
+    shift 2
+    got=$("$JUNG" "$@" 2>&1) || true
+    if [ "$got" != "$want" ]; then
+        echo "  $what: expected:"
+        echo "$want"
+        echo "  got:"
+        echo "$got"
+        fail=1
+    fi
+}
+
+# Loaded on the first miss, oldest pending first; the second spelling of
+# counter.jung is the same module
+expect "lazy imports" "before any use
+loading lazy_a
+loading lazy_b
+42
+loading counter
+11
+a
+done" "$@" --lazy-imports tests/modules/lazy.jung
+
+# 300 distinct modules, each imported twice, eagerly and lazily
+WORK="$(mktemp -d)"
+trap 'rm -rf "$WORK"' EXIT
+MAIN="$WORK/main.jung"
+for i in $(seq 0 299); do
+    printf 'dream mod_%d() { manifest %d }\n' "$i" "$i" > "$WORK/mod_$i.jung"
+    printf 'import "%s/mod_%d.jung"\n' "$WORK" "$i" >> "$MAIN"
+done
+for i in $(seq 0 299); do
+    printf 'import "%s/./mod_%d.jung"\n' "$WORK" "$i" >> "$MAIN"
+done
+printf 'project mod_0() + mod_150() + mod_299()\n' >> "$MAIN"
+expect "300 modules" "449" "$@" "$MAIN"
+expect "300 lazy modules" "449" "$@" --lazy-imports "$MAIN"
+
+exit $fail
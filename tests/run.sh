@@ -1,5 +1,7 @@
 #!/bin/bash
-# Jung test runner -- compares stdout of .jung files against .expected files
+# Jung test runner -- compares stdout of .jung files against .expected files,
+# then runs the other .sh scripts here, which pass by exiting 0
+# Extra arguments are passed to jung, e.g. `bash tests/run.sh --vm`
 
 set -euo pipefail
 
@@ -11,6 +13,9 @@ if [ ! -x "$JUNG" ]; then
     exit 1
 fi
 
+# Tests import paths like "tests/modules/x.jung", relative to the repo root
+cd "$DIR/.."
+
 pass=0
 fail=0
 errors=""
@@ -24,7 +29,7 @@ for test_file in "$DIR"/*.jung; do
         continue
     fi
 
-    actual=$("$JUNG" "$test_file" 2>&1) || true
+    actual=$("$JUNG" "$@" "$test_file" 2>&1) || true
 
     if [ "$actual" = "$(cat "$expected")" ]; then
         echo -e "\033[32mPASS\033[0m $name"
@@ -37,6 +42,22 @@ for test_file in "$DIR"/*.jung; do
     fi
 done
 
+# Scripted tests: each gets the jung binary and the extra arguments
+for test_script in "$DIR"/*.sh; do
+    name="$(basename "$test_script" .sh)"
+    [ "$name" = "run" ] && continue
+
+    if output=$(bash "$test_script" "$JUNG" "$@" 2>&1); then
+        echo -e "\033[32mPASS\033[0m $name"
+        pass=$((pass + 1))
+    else
+        echo -e "\033[31mFAIL\033[0m $name"
+        echo "$output"
+        fail=$((fail + 1))
+        errors="$errors $name"
+    fi
+done
+
 echo ""
 echo "Results: $pass passed, $fail failed"
 